@@ -2,14 +2,17 @@
 #include <BLEDevice.h>
 #include <Wire.h>
 #include <LiquidCrystal_I2C.h>
+#include <HelmetProtocol.h>
+#include <BoardTraits.h>
 
-// Set the LCD address to 0x27 or 0x3F depending on your module
-LiquidCrystal_I2C lcd(0x3F, 16, 2);  
+// Pins and the LCD address (0x27 or 0x3F depending on the module) come from
+// the board traits (lib/BoardTraits/BoardTraits.h)
+#ifndef BOARD
+#define BOARD BikeEvalBoard
+#endif
+typedef BOARD Board;
 
-#define SERVICE_UUID "4fafc201-1fb5-459e-8fcc-c5c9c331914b"
-#define CHAR_UUID_TX "beb5483e-36e1-4688-b7f5-ea07361b26a8"
-#define CHAR_UUID_RX "6e400002-b5a3-f393-e0a9-e50e24dcca9e"
-#define STAND_PIN 26
+LiquidCrystal_I2C lcd(Board::LCD_I2C_ADDRESS, 16, 2);  
 
 static BLERemoteCharacteristic* txCharacteristic;
 static BLERemoteCharacteristic* rxCharacteristic;
@@ -44,12 +47,12 @@ class MyAdvertisedDeviceCallbacks: public BLEAdvertisedDeviceCallbacks {
 
 static void notifyCallback(BLERemoteCharacteristic* pBLERemoteCharacteristic,
                            uint8_t* pData, size_t length, bool isNotify) {
-  String msg = "";
-  for (size_t i = 0; i < length; i++) msg += (char)pData[i];
+  HelmetStatus status;
+  if (!decodeHelmetStatus(pData, length, status)) return;
 
-  if (msg == "true") {
+  if (status.state == HELMET_SECURE) {
     Serial.println("✅ Helmet secure: Worn & Buckled");
-  } else if (msg == "warn") {
+  } else if (status.state == HELMET_REMOVED) {
     Serial.println("⚠️ Warning: Helmet not worn or buckle open!");
   }
 }
@@ -76,10 +79,10 @@ bool connectToServer() {
 
 void setup() {
   Serial.begin(115200);
-  Wire.begin(21, 22); // SDA, SCL
+  Wire.begin(Board::I2C_SDA_PIN, Board::I2C_SCL_PIN);
   lcd.init();
   lcd.backlight();
-  pinMode(STAND_PIN, INPUT);
+  pinMode(Board::STAND_PIN, INPUT);
 
   BLEDevice::init("BikeUnit");
 
@@ -112,7 +115,7 @@ void loop() {
   }
 
   if (connected) {
-    if (digitalRead(STAND_PIN) == HIGH) {
+    if (digitalRead(Board::STAND_PIN) == Board::STAND_UP_LEVEL) {
       rxCharacteristic->writeValue("true");
       Serial.println("📤Stand sensor TRUE sent to Helmet");
     }
@@ -1,64 +1,537 @@
 #include <Arduino.h>
 #include <BLEDevice.h>
+#include <esp_gap_ble_api.h>
+#include <Preferences.h>
 #include <Wire.h>
 #include <LiquidCrystal_I2C.h>
 // #include "esp_sleep.h"
 #include "driver/rtc_io.h"
+#include <HelmetProtocol.h>
+#include <FsrStream.h>
+#include <FsrCalibration.h>
+#include <TaskScheduler.h>
+#include <SnapshotMailbox.h>
+#include <SafetyStateMachine.h>
+#include <LatencyTrace.h>
+#include <LcdFrame.h>
+#include <HelmetPolicy.h>
+#include <ConnectionPlan.h>
+#include <TelemetryLog.h>
+#include <BikeStatus.h>
+#include <ConsoleRing.h>
+#include <BoardTraits.h>
+#include <SectionProfiler.h>
+#include <EventJournal.h>
+#include <esp_partition.h>
+
+// --- BOARD ---
+// Pins, LCD address and fitted parts come from the board traits
+// (lib/BoardTraits/BoardTraits.h); the environment picks the board with -DBOARD.
+#ifndef BOARD
+#define BOARD BikeDevkitBoard
+#endif
+typedef BOARD Board;
 
 // I2C LCD Setup
-LiquidCrystal_I2C lcd(0x27, 16, 2); 
-
-// --- PIN DEFINITIONS ---
-// STAND_PIN: LOW = Stand UP (1), HIGH = Stand DOWN (0). Uses INPUT_PULLUP.
-#define STAND_PIN 26    
-// RIDING_PIN: LOW = Riding (1), HIGH = Stationary (0). Uses INPUT_PULLUP.
-#define RIDING_PIN 34   
-// IGNITION_PIN: Output pin to control the ignition relay (HIGH = ON, LOW = OFF)
-#define IGNITION_PIN 25 
-// BUZZER_PIN: Output pin for the warning buzzer (HIGH = ON, LOW = OFF)
-#define BUZZER_PIN 27   
-
-#define BLE_red 2
-#define BLE_green 4
-
-// Assuming Starter switch is HIGH when ON (to simulate a wake-up event)
-#define STARTER_WAKEUP_PIN 32 // Choose an RTC GPIO pin (e.g., GPIO 32)
-#define WAKEUP_TRIGGER_LEVEL 1 // Wake up on HIGH (Starter ON)
-
-// --- BLE SERVICE DEFINITIONS (Must match the Helmet Unit) ---
-#define SERVICE_UUID "4fafc201-1fb5-459e-8fcc-c5c9c331914b"
-#define CHAR_UUID_TX "beb5483e-36e1-4688-b7f5-ea07361b26a8" // Receive notifications from Helmet (Helmet Status)
-#define CHAR_UUID_RX "6e400002-b5a3-f393-e0a9-e50e24dcca9e" // Send commands to Helmet (Stand Status) - NOT USED
-
-// --- BLE Globals ---
-static BLERemoteCharacteristic* txCharacteristic;
-static BLERemoteCharacteristic* rxCharacteristic;
-static BLEAdvertisedDevice* myDevice;
-
-// --- System State Variables ---
-bool connected = false;
+#define LCD_COLS 16
+#define LCD_ROWS 2
+LiquidCrystal_I2C lcd(Board::LCD_I2C_ADDRESS, LCD_COLS, LCD_ROWS); // Only used for init; the display task owns the LCD after that
+
+// --- BLE SERVICE DEFINITIONS ---
+// SERVICE_UUID / CHAR_UUID_TX / CHAR_UUID_RX come from HelmetProtocol.h (shared with the Helmet Unit)
+
+// --- BLE Globals (owned by the BLE task) ---
+// One slot per helmet: the rider's (RIDER_SLOT) and a pillion's. Which of
+// them the ignition depends on is HelmetPolicy's call.
+// Everything on the connect path is allocated once at boot: the clients and the
+// callback objects live for the whole run and addresses are kept as raw bytes,
+// so going in and out of range all day does not touch the heap.
+#define MAX_HELMETS 2
+
+struct HelmetConn {
+  BLEClient* client;                     // Created in setup(), reused for every connection
+  BLERemoteCharacteristic* tx;
+  BLERemoteCharacteristic* rx;
+  BLERemoteCharacteristic* stream;       // FSR stream, nullptr when the helmet has none
+  esp_bd_addr_t savedAddress;            // Helmet last connected in this slot
+  esp_ble_addr_type_t savedType;
+  bool saved;                            // False until a helmet has been connected in this slot
+  unsigned long lastProbeMs;
+};
+
+HelmetConn helmets[MAX_HELMETS];
+static esp_bd_addr_t foundAddress;       // Helmet seen by the last scan
+static esp_ble_addr_type_t foundAddressType;
+
 bool doConnect = false;
-bool doScan = true; 
 unsigned long lastScanStartTime = 0;
 const long scanDuration = 5000; // Scan for 5 seconds
 
-// Safety System State
+// --- Fast reconnect ---
+// The helmets we connected to are kept in NVS, one per slot. While the rider's
+// helmet has no link the BLE task connects to it directly (the controller
+// connects on the helmet's first advertisement) and only scans in short
+// windows in between, in case a different helmet is being paired. 0 = always
+// scan for scanDuration first. A direct connect blocks the BLE task, so once
+// the rider's helmet is linked the others are only found by scanning.
+#define BLE_FAST_RECONNECT 1
+#define FALLBACK_SCAN_MS 1000
+#define NVS_NAMESPACE "bike"
+#define NVS_HELMET_ADDRESS "helmetAddr"  // Slot 0; the other slots add their number
+#define NVS_HELMET_TYPE "helmetType"
+// Preferred connection parameters: 7.5-15 ms interval (1.25 ms units), no
+// peripheral latency, 2 s supervision timeout (10 ms units) so a dead link is
+// noticed, and reconnected, sooner
+#define CONN_INTERVAL_MIN 6
+#define CONN_INTERVAL_MAX 12
+#define CONN_LATENCY 0
+#define CONN_SUPERVISION_TIMEOUT 200
+
+// --- Connection event plan (ConnectionPlan.h) ---
+// 1 = every helmet link gets the same interval, so their connection events
+// never collide, and a free slot is only scanned for while the bike is parked
+// or the ignition waits for that helmet, in windows that fit between the
+// connection events. The helmet's own parameter request (7.5-15 ms) holds
+// the planned interval, so the link keeps it. 0 = each link gets whatever the
+// controller picks in CONN_INTERVAL_MIN..MAX and a free slot is scanned for
+// all the time at the default duty (for comparison in the simulator).
+#define HELMET_CONN_PLAN 1
+#define CONN_INTERVAL_PLANNED plannedConnInterval(MAX_HELMETS, CONN_INTERVAL_MAX)
+// Scanning for another helmet while the rider's is linked: 12 ms every 120 ms
+#define EXTRA_SCAN_INTERVAL_MS plannedScanIntervalMs(CONN_INTERVAL_PLANNED, 8)
+#define EXTRA_SCAN_WINDOW_MS plannedScanWindowMs(MAX_HELMETS, CONN_INTERVAL_PLANNED)
+#define SCAN_INTERVAL_MS 50              // Arduino BLEScan defaults, while the rider's helmet is not linked
+#define SCAN_WINDOW_MS 30
+
+Preferences prefs;
+bool directConnectNext = true;           // Alternate direct connects and fallback scans
+bool extraScanRunning = false;           // Scanning for another helmet while one is linked
+volatile bool bikeParked = true;         // Stand down and not moving; written by the control task
+volatile bool helmetMissing = false;     // A helmet that counts has no link; written by the control task
+
+// --- Fast resume from deep sleep ---
+// RTC slow memory survives deep sleep. finishDeepSleep() leaves the saved
+// helmet there, so a starter wakeup skips the NVS read; setup() then makes the
+// outputs safe, brings up BLE and starts the BLE task (which connects to the
+// saved helmet right away) before anything else. The LCD init takes over a
+// second (LiquidCrystal_I2C waits 50 + 1000 ms for the HD44780 to power up)
+// and is left to the display task. The ignition still waits for a fresh frame
+// from the helmet: none of its state is trusted across the sleep.
+// 0 = the old order, LCD and boot text first.
+#define FAST_RESUME 1
+#define RESUME_MAGIC 0x52534d32  // "RSM2", one helmet per slot
+
+struct ResumeState {
+  uint32_t magic;                // RESUME_MAGIC once a deep sleep has saved the session
+  esp_bd_addr_t helmetAddress[MAX_HELMETS];
+  uint8_t helmetType[MAX_HELMETS];
+  bool haveHelmet[MAX_HELMETS];
+  uint32_t sleeps;               // Deep sleeps since power-on
+};
+
+RTC_DATA_ATTR ResumeState resume;
+bool resumed = false;                    // This boot restored the session from RTC memory
+
+// --- FreeRTOS Tasks ---
+// BLE runs next to the Bluedroid stack on core 0; safety control and I/O run on core 1.
+#define BLE_TASK_CORE 0
+#define CONTROL_TASK_CORE 1
+#define BLE_TASK_PRIORITY 2
+#define CONTROL_TASK_PRIORITY 3
+#define BLE_TASK_STACK 5120
+#define CONTROL_TASK_STACK 6144
+#define BLE_TASK_PERIOD_MS 50    // Scan/connect management when no BLE events arrive
+#define BLE_EVENT_QUEUE_LEN 16
+#define LINK_PROBE_PERIOD_MS 10000 // Write-with-response round trip to the helmet (latency trace link floor)
+#define DISPLAY_TASK_CORE 1
+#define DISPLAY_TASK_PRIORITY 1  // Below control: LCD traffic never delays the safety logic
+#define DISPLAY_TASK_STACK 3072
+#define DISPLAY_TASK_PERIOD_MS 50
+#define LCD_I2C_BATCH 120        // Wire buffers 128 bytes: 20 characters per transmission
+
+// --- BLE -> Control link state ---
+// BLE callbacks only queue events for the BLE task. The BLE task folds them into a
+// BleSnapshot (one HelmetLink per slot) and publishes it through a lock-free
+// mailbox, which the control task reads without ever waiting on the BLE stack.
+enum BleUiStatus : uint8_t {
+  BLE_UI_NONE,
+  BLE_UI_SCANNING,
+  BLE_UI_FOUND,
+  BLE_UI_CONNECTING,
+  BLE_UI_CONNECT_FAILED,
+  BLE_UI_CONNECTED,
+  BLE_UI_DISCONNECTED
+};
+
+struct HelmetLink {
+  bool connected;
+  uint32_t linkChanges;      // Incremented on every connect/disconnect
+  uint32_t disconnectedAtMs; // millis() of the last disconnect
+  HelmetStatus helmet;       // Last decoded frame (HELMET_UNKNOWN when none or undecodable)
+  uint32_t helmetRxUs;       // micros() when that frame was received
+  uint32_t helmetHandledUs;  // micros() when the BLE task picked that frame up
+  uint32_t linkRttMinUs;     // Fastest write-with-response round trip on this connection (0 = none yet)
+  uint32_t reconnectMs;      // Disconnect -> connected for this connection (0 = first connection)
+};
+
+struct BleSnapshot {
+  HelmetLink helmets[MAX_HELMETS];
+  BleUiStatus ui;            // Latest BLE activity, shown on the LCD
+  uint32_t uiSeq;            // Incremented whenever ui is set
+};
+
+enum BleEventType : uint8_t {
+  BLE_EV_CONNECTED,
+  BLE_EV_DISCONNECTED,
+  BLE_EV_FOUND,
+  BLE_EV_STATUS
+};
+
+struct BleEvent {
+  BleEventType type;
+  uint8_t slot;              // Helmet slot (0 for BLE_EV_FOUND)
+  uint32_t atMs;
+  uint32_t atUs;
+  HelmetStatus status;       // BLE_EV_STATUS only
+};
+
+QueueHandle_t bleEvents;
+SnapshotMailbox<BleSnapshot> linkMailbox;
+BleSnapshot bleLink;         // BLE task working copy (producer side)
+TaskHandle_t bleTaskHandle;
+TaskHandle_t controlTaskHandle;
+
+// --- System State Variables (owned by the control task) ---
+bool connected = false;      // Every helmet the ignition depends on is linked
+BleSnapshot controlLink;     // Last snapshot read by the control task (consumer side)
+HelmetPolicy<MAX_HELMETS> helmetPolicy;
+uint32_t lcdUiSeq = 0;       // Last BLE message shown on the LCD
+
+// --- Display (control task draws, display task sends) ---
+// The control task draws into `screen` and publishes it; the display task
+// diffs the newest one against the glass and sends only the changed cells.
+typedef LcdCanvas<LCD_COLS, LCD_ROWS> Screen;
+Screen screen;
+SnapshotMailbox<Screen> screenMailbox;
+LcdShadow<LCD_COLS, LCD_ROWS> lcdShadow;   // Display task only
+TaskHandle_t displayTaskHandle;
+uint32_t lcdI2cBytes = 0;                  // Written by the display task
+uint32_t lcdI2cBytesReported = 0;
+
+// Free heap each time the link comes up: a leak on the connect path shows as
+// a steady fall from one connection to the next
+uint32_t heapAtFirstConnect = 0;
+uint32_t heapAtLastConnect = 0;
+uint32_t heapConnects = 0;
+
+// Safety System State (HelmetPolicy's verdict over the helmets that count)
 bool helmetSecure = false;     // 1=Secure ("true"), 0=Warning ("warn")
 bool helmetworn = false;       // Helmet worn state
-bool ignitionEnabled = false;  // Tracks the current intended ignition state (HIGH/LOW on IGNITION_PIN)
 
-// Warning Timers (Non-blocking using millis())
-unsigned long warningStartTime = 0; 
-const long warningDuration15s = 15000; // 15 seconds
-const long warningDuration60s = 60000; // 1 minute
+// Truth table, warning timers (15s/60s) and BLE grace period live in SafetyStateMachine
+class ArduinoSafetyClock : public SafetyClock {
+  uint32_t nowMs() override { return millis(); }
+};
+
+uint32_t ignitionWriteUs = 0; // micros() of the last IGNITION_PIN write
 
-// BLE Disconnect Grace Period Timer
-unsigned long disconnectStartTime = 0;
-const long disconnectGracePeriod = 60000; // 60 seconds for BLE=0 shutdown
+class PinSafetyOutputs : public SafetyOutputs {
+  void setIgnition(bool on) override {
+    digitalWrite(Board::IGNITION_PIN, on ? HIGH : LOW);
+    ignitionWriteUs = micros();
+  }
+  void setBuzzer(bool on) override { digitalWrite(Board::BUZZER_PIN, on ? HIGH : LOW); }
+};
+
+ArduinoSafetyClock safetyClock;
+PinSafetyOutputs safetyOutputs;
+SafetyStateMachine safety(safetyClock, safetyOutputs);
 
 // --- HIBERNATION/Deep Sleep Timer ---
 unsigned long starterOffTime = 0;
 const long hibernationDelayMs = 80000; // 80 seconds before going to sleep
+bool deepSleepPending = false;
+
+// --- Sampled Inputs (written by the input task only) ---
+bool isStandUp = false;
+bool isRiding = false;
+bool isStarterOn = false;
+
+// --- Task Scheduler ---
+#define INPUT_PERIOD_US     10000    // Stand/riding/starter sampling
+#define SAFETY_PERIOD_US    10000    // Truth table + grace period evaluation
+#define LCD_PERIOD_US       250000   // Screen redraw (RAM; the display task sends the changes)
+#define HIBERNATE_PERIOD_US 100000   // Starter-off timer
+#define STATS_PERIOD_US     10000000 // Scheduler statistics printout
+#define DEEP_SLEEP_MSG_US   1000000  // Time the "Deep Sleep Mode" message stays up
+#define SCHEDULER_TASKS     12       // Table size: 8 in use with every option on
+
+// --- Status telemetry (BikeStatus.h) ---
+// 1 = the control task logs the safety state every TELEMETRY_STATUS_US and
+// every SafetyEvent as binary records; the display task sends them on Serial
+// in CRC-checked blocks after its LCD updates. A fleet gateway collects them
+// from many bikes (Host_tools env:gateway); the text lines stay as they are.
+#define TELEMETRY 1
+#define TELEMETRY_STATUS_US 100000   // 10 Hz
+
+TelemetryLog<256> telemetry;         // Control task logs, display task drains
+SafetyInputs safetyInputs = {};      // Inputs of the last safety step
+
+// --- Control task console (ConsoleRing.h) ---
+// The control task prints into `console`, never to Serial: at 115200 baud a
+// statistics dump would hold the safety step for ~200 ms. The display task
+// sends the text on after its LCD updates. setup() and the other tasks print
+// to Serial as before.
+#define CONSOLE_RING 4096               // A statistics dump is ~2.5 KB
+#define CONSOLE_LINE 160                // Longest printf(); longer lines are cut
+
+class ConsoleBuffer : public Print {
+public:
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buffer, size_t size) override { return ring.write(buffer, size) ? size : 0; }
+  using Print::write;
+
+  // Formats on the stack: Print::printf() takes long lines from the heap
+  size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+    char line[CONSOLE_LINE];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (n < 0) return 0;
+    return write((const uint8_t*)line, (size_t)n < sizeof(line) ? (size_t)n : sizeof(line) - 1);
+  }
+
+  ConsoleRing<CONSOLE_RING> ring;    // Control task writes, display task reads
+};
+
+ConsoleBuffer console;
+
+// --- Helmet FSR stream (FsrStream.h) ---
+// 1 = subscribe to the FSR waveform of helmets that offer it (older helmets
+// only send status frames, as before). The samples land in a ring per slot;
+// the control task checks them against the helmet's own verdict and logs them
+// as TELEMETRY_SAMPLE records, so the bike's telemetry (and with it the fleet
+// store) carries the helmet's sensors. A disagreement is reported, it does
+// not change the ignition. Opt-in per build (env:esp32doit-devkit-v1-stream),
+// like the helmet end: the stream adds ~10 notifications/s per helmet.
+#ifndef FSR_STREAM
+#define FSR_STREAM 0
+#endif
+#define FSR_STREAM_RING 512             // Samples per helmet: 2 s at the helmet's 250 Hz
+#define FSR_STREAM_CHECK_US 100000      // Control task drains the rings
+// Log every sample (needs TELEMETRY): ~2.5 KB/s of binary per helmet on the console
+#ifndef FSR_STREAM_CAPTURE
+#define FSR_STREAM_CAPTURE 0
+#endif
+#define FSR_STREAM_MISMATCH_MS 1000     // Verdict and waveform disagree this long: warn
+
+FsrStreamReceiver<FSR_STREAM_RING> fsrStreams[MAX_HELMETS];  // BLE stack fills, control task drains
+
+// Control task's view of each stream
+struct StreamCheck {
+  uint32_t samples;          // Drained so far
+  uint16_t lastFsr;
+  uint8_t lastFlags;
+  bool disagreeing;          // Since mismatchSinceMs
+  bool mismatch;             // Disagreeing for FSR_STREAM_MISMATCH_MS, reported
+  uint32_t mismatchSinceMs;
+  uint32_t mismatches;       // Reported disagreements
+};
+StreamCheck streamCheck[MAX_HELMETS];
+
+// --- Event journal (EventJournal.h) ---
+// 1 = ignition enables, warnings, BLE shutdowns, helmet links, boots and deep
+// sleeps go to an append-only journal in the "journal" flash partition
+// (partitions.csv), kept across power cycles: 64 sectors, the last ~16000
+// events. The control task queues them, the display task writes them out.
+// Serial console:
+//   J<newline>         the whole journal as binary blocks (Host_tools env:journal decodes them)
+//   J<s><newline>      the last s seconds of journal time, e.g. J604800 for a week
+//   J<a>-<b><newline>  journal seconds a..b
+//   j                  summary
+#define JOURNAL 1
+#define JOURNAL_PARTITION "journal"
+#define JOURNAL_SUBTYPE 0x40            // Custom data subtype, see partitions.csv
+#define JOURNAL_MAX_SECTORS 64
+#define JOURNAL_QUEUE 16                // Events waiting for the display task
+#define SERIAL_TX_BUFFER 1024           // UART transmit ring: a dump block (518 bytes) fits with room to spare
+
+// The journal partition through esp_partition_*, offsets from its start
+struct PartitionFlash {
+  const esp_partition_t* partition = nullptr;
+
+  bool read(uint32_t offset, void* data, size_t size) {
+    return partition != nullptr && esp_partition_read(partition, offset, data, size) == ESP_OK;
+  }
+  bool write(uint32_t offset, const void* data, size_t size) {
+    return partition != nullptr && esp_partition_write(partition, offset, data, size) == ESP_OK;
+  }
+  bool erase(uint32_t offset, size_t size) {
+    return partition != nullptr && esp_partition_erase_range(partition, offset, size) == ESP_OK;
+  }
+  uint32_t size() { return partition != nullptr ? partition->size : 0; }
+};
+
+PartitionFlash journalFlash;
+EventJournal<PartitionFlash, JOURNAL_MAX_SECTORS, JOURNAL_QUEUE> journal(journalFlash);  // Control task appends, display task writes
+JournalCursor journalDump = {0, 0, true};  // Serial dump in progress (display task)
+uint32_t journalDumpToS = 0;
+uint32_t journalDumped = 0;
+
+TaskScheduler<SCHEDULER_TASKS> scheduler;
+int deepSleepTask = -1;
+
+void taskInputs();
+void taskSafety();
+void taskHibernation();
+void taskLcd();
+void taskStats();
+void taskStatus();
+void taskStream();
+void finishDeepSleep();
+
+// Ignition response time: input/helmet edge -> IGNITION_PIN change
+bool inputEdgePending = false;
+uint32_t inputEdgeUs = 0;
+uint32_t ignitionLatencyLastUs = 0;
+uint32_t ignitionLatencyMaxUs = 0;
+
+// Helmet frame -> ignition trace. Helmet stamps are mapped onto this clock by
+// helmetClock (one per slot, each helmet has its own clock); the link floor
+// (half the fastest round trip) is added back to the aligned link delay, see
+// LatencyTrace.h.
+enum LatencySpan : uint8_t {
+  SPAN_LINK,        // Helmet sample -> notifyCallback
+  SPAN_BLE_TASK,    // notifyCallback -> BLE task
+  SPAN_MAILBOX,     // BLE task -> control task
+  SPAN_DECISION,    // Control task read a helmet change -> IGNITION_PIN written
+  SPAN_HELMET_PIN,  // Helmet sample -> IGNITION_PIN written (ignition changed by a helmet frame)
+  SPAN_UNSAFE_LIVE, // First non-secure helmet sample with ignition ON -> ignition cut
+  SPAN_STEP_GAP,    // One safety step -> the next: how long IGNITION_PIN can go unserviced
+                    // (a journal erase stalls both cores; SAFETY_PERIOD_US when nothing does)
+  SPAN_COUNT
+};
+const char* const SPAN_NAMES[SPAN_COUNT] = {
+  "link", "ble task", "mailbox", "decision", "helmet>pin", "unsafe>cut", "step gap"
+};
+
+LatencyHistogram latency[SPAN_COUNT];
+LatencyHistogram reconnectTime;  // Link lost -> connected again
+ClockAligner helmetClock[MAX_HELMETS];
+bool helmetEdgeTraced = false;   // A state change of a counted helmet was read this pass
+uint32_t helmetEdgeSampleUs = 0; // Its sample time on our clock
+uint32_t helmetEdgeReadUs = 0;
+bool unsafeLive = false;         // A counted helmet not secure while the ignition is on
+uint32_t unsafeSinceUs = 0;
+
+// Boot timing: setup() start -> each phase of this boot, printed once the
+// first helmet frame is in (from then on the ignition only waits for the
+// rider) and with the statistics. ROM and bootloader time is not included.
+enum BootPhase : uint8_t {
+  BOOT_OUTPUTS,     // Ignition and buzzer driven low
+  BOOT_BLE_INIT,    // BLEDevice::init() done
+  BOOT_TASKS,       // Every task started
+  BOOT_LCD,         // LCD initialized
+  BOOT_LINK,        // Link to the helmet up
+  BOOT_READY,       // First helmet frame read by the control task
+  BOOT_PHASES
+};
+const char* const BOOT_PHASE_NAMES[BOOT_PHASES] = {
+  "outputs", "ble init", "tasks", "lcd", "link", "ready"
+};
+
+uint32_t bootStartUs = 0;
+uint32_t bootPhaseUs[BOOT_PHASES];
+bool bootPhaseDone[BOOT_PHASES];  // One writer per phase
+
+static void markBootPhase(BootPhase phase) {
+  if (bootPhaseDone[phase]) return;
+  bootPhaseUs[phase] = micros() - bootStartUs;
+  bootPhaseDone[phase] = true;
+}
+
+static void printBootTiming() {
+  const char* kind = esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_EXT0 ? "starter wakeup" : "power-on";
+  console.printf("⏱️ Boot (%s):", resumed ? "fast resume" : kind);
+  for (int i = 0; i < BOOT_PHASES; i++) {
+    if (bootPhaseDone[i]) console.printf(" %s %lu ms", BOOT_PHASE_NAMES[i], (unsigned long)(bootPhaseUs[i] / 1000));
+    else console.printf(" %s -", BOOT_PHASE_NAMES[i]);
+  }
+  console.println();
+}
+
+// ---------------- Profiling ----------------
+// 1 = CPU cycles of the sections below, printed with the statistics and on
+// 'P' from the serial console ('R' starts them over). 0 = compiled out: no
+// counter reads, no table. Sections nest: "lcd update" includes "lcd i2c".
+#define PROFILE 1
+
+enum ProfileId : uint8_t {
+  PROF_INPUTS,      // Control task: stand/riding/starter pin reads
+  PROF_LINK_POLL,   // Control task: helmet link snapshot, LEDs, latency trace
+  PROF_SAFETY,      // Control task: SafetyStateMachine::step()
+  PROF_LCD_DRAW,    // Control task: taskLcd() into the canvas
+  PROF_LCD_UPDATE,  // Display task: LcdShadow::update(), I2C included
+  PROF_LCD_I2C,     // Display task: one Wire transmission
+  PROF_TELEMETRY,   // Display task: telemetry blocks to Serial
+  PROF_BLE_EVENTS,  // BLE task: queued BLE events
+  PROF_BLE_MANAGE,  // BLE task: scan management and connects (connects block here)
+  PROF_BLE_PROBE,   // BLE task: link round trip probes
+  PROF_NOTIFY,      // BLE stack: notifyCallback()
+  PROF_STREAM_RX,   // BLE stack: streamCallback()
+  PROF_STREAM,      // Control task: taskStream()
+  PROF_JOURNAL,     // Display task: event journal writes, erases and dumps
+  PROF_SECTIONS
+};
+const char* const PROF_NAMES[PROF_SECTIONS] = {
+  "inputs", "link poll", "safety", "lcd draw", "lcd update", "lcd i2c", "telemetry",
+  "ble events", "ble manage", "ble probe", "notify", "stream rx", "stream", "journal"
+};
+
+struct CpuCycles {
+  static uint32_t now() { return ESP.getCycleCount(); }
+};
+
+SectionProfiler<PROF_SECTIONS> profiler;
+uint32_t profileStartUs = 0;
+typedef ProfileScope<SectionProfiler<PROF_SECTIONS>, CpuCycles, PROFILE> Profiled;
+#define PROFILE_SCOPE(id) Profiled profileScope(profiler, id)
+
+template <class Out>
+static void printProfile(Out& out) {
+  out.printf("---- Profile (cycles @ %lu MHz, %lu s) ----\n", (unsigned long)ESP.getCpuFreqMHz(),
+             (unsigned long)((micros() - profileStartUs) / 1000000));
+  profiler.print(out, PROF_NAMES, ESP.getCpuFreqMHz(), micros() - profileStartUs);
+}
+
+static void handleConsoleCommand(int c) {
+  if (!PROFILE) return;
+  if (c == 'P') {
+    printProfile(Serial);
+  } else if (c == 'R') {
+    profiler.reset();
+    profileStartUs = micros();
+    Serial.println("Profile reset.");
+  }
+}
+
+static uint32_t nowUs() { return micros(); }
+
+static uint64_t uptimeMs() { return (uint64_t)esp_timer_get_time() / 1000; }
+
+// Control task only (and setup() before it starts): the journal has one producer
+static void journalEvent(uint8_t type, uint8_t a, uint16_t b) {
+  if (JOURNAL) journal.append(type, a, b, 0, uptimeMs());
+}
+
+// Mark that an input the safety logic depends on has changed
+static void markInputEdge(uint32_t atUs) {
+  if (!inputEdgePending) {
+    inputEdgeUs = atUs;
+    inputEdgePending = true;
+  }
+}
 
 // ---------------- Wakeup reason ----------------
 void print_wakeup_reason() {
@@ -77,26 +550,51 @@ void print_wakeup_reason() {
 }
 
 // ---------------- Deep Sleep Function ----------------
+// Shows the sleep message; finishDeepSleep() runs once it has been visible for a second.
 void enterDeepSleep() {
-  Serial.println("🛑 Entering deep sleep...");
-  lcd.clear();
-  lcd.setCursor(0, 0);
-  lcd.print("Deep Sleep Mode");
-  lcd.setCursor(0, 1);
-  lcd.print("Wake: Starter Btn");
+  console.println("🛑 Entering deep sleep...");
+  screen.clear();
+  screen.setCursor(0, 0);
+  screen.print("Deep Sleep Mode");
+  screen.setCursor(0, 1);
+  screen.print("Wake: Starter Btn");
+  screenMailbox.publish(screen);
 
-  delay(1000); // Let LCD show message before power off
-  lcd.noBacklight(); // Turn off LCD backlight before sleep
-  lcd.clear();
+  deepSleepPending = true;
+  journalEvent(BIKE_JOURNAL_DEEP_SLEEP, bikeStatusFlags(safetyInputs, safety), 0);
+  scheduler.schedule(deepSleepTask, DEEP_SLEEP_MSG_US, micros()); // Let LCD show message before power off
+}
+
+void finishDeepSleep() {
+  screen.backlight = false; // Turn off LCD backlight before sleep
+  screen.clear();
+  screenMailbox.publish(screen);
+  vTaskDelay(pdMS_TO_TICKS(2 * DISPLAY_TASK_PERIOD_MS)); // The display task owns the bus: let it send the dark screen
+  // ... and the flash and the console: the sleep record was queued a second ago, wait until both are out
+  for (int i = 0; ((JOURNAL && journal.pending()) || console.ring.pending() > 0) && i < 10; i++) {
+    vTaskDelay(pdMS_TO_TICKS(DISPLAY_TASK_PERIOD_MS));
+  }
 
   // Turn off outputs to save power
-  digitalWrite(IGNITION_PIN, LOW);
-  digitalWrite(BUZZER_PIN, LOW);
-  digitalWrite(BLE_red, LOW);
-  digitalWrite(BLE_green, LOW);
+  digitalWrite(Board::IGNITION_PIN, LOW);
+  digitalWrite(Board::BUZZER_PIN, LOW);
+  if (Board::HAS_STATUS_LEDS) {
+    digitalWrite(Board::BLE_RED_PIN, LOW);
+    digitalWrite(Board::BLE_GREEN_PIN, LOW);
+  }
 
   // Enable external wake-up (Starter pin HIGH)
-  esp_sleep_enable_ext0_wakeup((gpio_num_t)STARTER_WAKEUP_PIN, WAKEUP_TRIGGER_LEVEL);
+  esp_sleep_enable_ext0_wakeup((gpio_num_t)Board::STARTER_WAKEUP_PIN, Board::STARTER_ON_LEVEL);
+
+  // Session for the fast resume on the starter wakeup
+  if (resume.magic != RESUME_MAGIC) resume.sleeps = 0;
+  for (uint8_t i = 0; i < MAX_HELMETS; i++) {
+    memcpy(resume.helmetAddress[i], helmets[i].savedAddress, ESP_BD_ADDR_LEN);
+    resume.helmetType[i] = helmets[i].savedType;
+    resume.haveHelmet[i] = helmets[i].saved;
+  }
+  resume.sleeps++;
+  resume.magic = RESUME_MAGIC;
 
   // Isolate unused RTC GPIOs to reduce leakage (optional)
   rtc_gpio_isolate(GPIO_NUM_12);
@@ -108,40 +606,37 @@ void enterDeepSleep() {
   esp_deep_sleep_start();
 }
 
+// ---------------- BLE Events ----------------
+// Called from the Bluedroid task: never block it.
+static void queueBleEvent(BleEventType type, uint8_t slot, const HelmetStatus* status = nullptr) {
+  BleEvent ev;
+  ev.type = type;
+  ev.slot = slot;
+  ev.atMs = millis();
+  ev.atUs = micros();
+  if (status != nullptr) ev.status = *status;
+  xQueueSend(bleEvents, &ev, 0);
+}
+
 // ---------------- BLE Client Callback ----------------
+// One per slot, so the events say which helmet they are about
 class MyClientCallback : public BLEClientCallbacks {
+public:
+  uint8_t slot = 0;
+
   void onConnect(BLEClient* pClient) override {
-    connected = true;
-    disconnectStartTime = 0; // Clear grace timer immediately on successful re-connection
-    Serial.println("✅ Connected to Helmet.");
-    digitalWrite(BLE_green, HIGH);
-    digitalWrite(BLE_red, LOW);
+    Serial.printf("✅ Connected to Helmet %u.\n", slot + 1);
+    queueBleEvent(BLE_EV_CONNECTED, slot);
   }
 
   void onDisconnect(BLEClient* pClient) override {
-    connected = false;
-    Serial.println("⚠️ Disconnected from Helmet. Starting 60s grace period.");
-    digitalWrite(BLE_green, LOW); 
-    digitalWrite(BLE_red, HIGH);
-    // Only start the shutdown timer if the ignition was enabled when disconnected
-    if (ignitionEnabled) { 
-      disconnectStartTime = millis();
-    } else {
-      // If ignition was already off, enforce full shutdown immediately (no need for timer)
-      disconnectStartTime = 0; 
-      digitalWrite(IGNITION_PIN, LOW); 
-      digitalWrite(BUZZER_PIN, LOW);
-      helmetSecure = false; // Assume insecure when disconnected
-      helmetworn = false;
-    }
-
-    doScan = true;  // Trigger scan again
-    lcd.clear();
-    lcd.setCursor(0, 0); 
-    lcd.print("Disconnected!");
+    Serial.printf("⚠️ Disconnected from Helmet %u.\n", slot + 1);
+    queueBleEvent(BLE_EV_DISCONNECTED, slot);
   }
 };
 
+MyClientCallback clientCallbacks[MAX_HELMETS];
+
 // ---------------- BLE Advertisement Callback ----------------
 class MyAdvertisedDeviceCallbacks: public BLEAdvertisedDeviceCallbacks {
   void onResult(BLEAdvertisedDevice advertisedDevice) override {
@@ -149,316 +644,1033 @@ class MyAdvertisedDeviceCallbacks: public BLEAdvertisedDeviceCallbacks {
         advertisedDevice.isAdvertisingService(BLEUUID(SERVICE_UUID))) {
       Serial.println("✅ Helmet found! Stopping scan.");
       BLEDevice::getScan()->stop();
-      myDevice = new BLEAdvertisedDevice(advertisedDevice);
-      doConnect = true;
-      lcd.clear();
-      lcd.setCursor(0, 0); 
-      lcd.print("Helmet found!");
+      memcpy(foundAddress, *advertisedDevice.getAddress().getNative(), ESP_BD_ADDR_LEN);  // Read by the BLE task after the event
+      foundAddressType = advertisedDevice.getAddressType();
+      queueBleEvent(BLE_EV_FOUND, 0);
     }
   }
 };
 
+MyAdvertisedDeviceCallbacks advertisedDeviceCallbacks;
+
+// Scans run asynchronously; the BLE task restarts them every scanDuration.
+static void scanCompleteCallback(BLEScanResults results) {
+  BLEDevice::getScan()->clearResults(); // Free the result list, we only need onResult()
+}
+
 // ---------------- Notification Callback (Helmet Status) ----------------
 static void notifyCallback(
   BLERemoteCharacteristic* pBLERemoteCharacteristic,
   uint8_t* pData, size_t length, bool isNotify
 ) {
-  String msg = "";
-  for (size_t i = 0; i < length; i++) msg += (char)pData[i];
-
-  // Update the global helmet state
-  if (msg == "true") {
-    helmetSecure = true; // 1: Worn & Buckled
-    helmetworn = true;
-    Serial.println("✅ Helmet secure: Worn & Buckled");
-  } else if (msg == "warn") {
-    helmetSecure = false; // 0: Not Worn or Buckle Open
-    helmetworn = false;
-    Serial.println("⚠️ Warning: Helmet not worn and buckle open!");
-  }else if (msg == "warn_notbuckeld") {
-    helmetSecure = false; // 0: Not Worn or Buckle Open
-    helmetworn = true;
-    Serial.println("⚠️ Warning: Helmet worn but buckle open!");
-  } else {
-    helmetSecure = false; // Default to insecure
-    helmetworn = false;
+  PROFILE_SCOPE(PROF_NOTIFY);
+  uint8_t slot = 0;
+  while (slot < MAX_HELMETS && helmets[slot].tx != pBLERemoteCharacteristic) slot++;
+  if (slot == MAX_HELMETS) return;  // Left over from a connection that is gone
+
+  HelmetStatus status;
+  decodeHelmetStatus(pData, length, status); // Undecodable -> HELMET_UNKNOWN (insecure)
+  queueBleEvent(BLE_EV_STATUS, slot, &status);
+
+  switch (status.state) {
+    case HELMET_SECURE:
+      Serial.printf("✅ Helmet %u secure: Worn & Buckled\n", slot + 1);
+      break;
+    case HELMET_WORN_NOT_BUCKLED:
+      Serial.printf("⚠️ Warning: Helmet %u worn but buckle open!\n", slot + 1);
+      break;
+    case HELMET_REMOVED:
+      Serial.printf("⚠️ Warning: Helmet %u not worn and buckle open!\n", slot + 1);
+      break;
+    default:
+      break;
   }
 }
 
+// ---------------- Stream Callback (Helmet FSR waveform) ----------------
+static void streamCallback(
+  BLERemoteCharacteristic* pBLERemoteCharacteristic,
+  uint8_t* pData, size_t length, bool isNotify
+) {
+  PROFILE_SCOPE(PROF_STREAM_RX);
+  uint8_t slot = 0;
+  while (slot < MAX_HELMETS && helmets[slot].stream != pBLERemoteCharacteristic) slot++;
+  if (slot == MAX_HELMETS) return;
+  fsrStreams[slot].receive(pData, length);  // Malformed batches are counted, not queued
+}
+
 // ---------------- Connect to Helmet ----------------
-bool connectToServer() {
-  BLEClient* pClient = BLEDevice::createClient();
-  pClient->setClientCallbacks(new MyClientCallback());
+// NVS key of a slot: slot 0 keeps the key from before there were slots
+static void slotKey(char* key, size_t size, const char* base, uint8_t slot) {
+  if (slot == 0) snprintf(key, size, "%s", base);
+  else snprintf(key, size, "%s%u", base, slot);
+}
 
-  if (!pClient->connect(myDevice)) return false;
+// Remember the helmet for direct reconnects; NVS is only written when it changes
+static void saveHelmet(uint8_t slot, esp_bd_addr_t address, esp_ble_addr_type_t type) {
+  HelmetConn& h = helmets[slot];
+  if (h.saved && memcmp(address, h.savedAddress, ESP_BD_ADDR_LEN) == 0 && type == h.savedType) {
+    return;
+  }
+  memcpy(h.savedAddress, address, ESP_BD_ADDR_LEN);
+  h.savedType = type;
+  h.saved = true;
+  char key[16];
+  slotKey(key, sizeof(key), NVS_HELMET_ADDRESS, slot);
+  prefs.putString(key, BLEAddress(address).toString().c_str());
+  slotKey(key, sizeof(key), NVS_HELMET_TYPE, slot);
+  prefs.putUChar(key, type);
+  Serial.printf("💾 Helmet %u " ESP_BD_ADDR_STR " saved for fast reconnect.\n", slot + 1, ESP_BD_ADDR_HEX(address));
+}
 
-  BLERemoteService* pRemoteService = pClient->getService(BLEUUID(SERVICE_UUID));
-  if (pRemoteService == nullptr) return false;
+bool connectToServer(uint8_t slot, esp_bd_addr_t address, esp_ble_addr_type_t type) {
+  // The previous connection's characteristics are gone
+  HelmetConn& h = helmets[slot];
+  h.tx = nullptr;
+  h.rx = nullptr;
+  h.stream = nullptr;
 
-  txCharacteristic = pRemoteService->getCharacteristic(BLEUUID(CHAR_UUID_TX));
-  rxCharacteristic = pRemoteService->getCharacteristic(BLEUUID(CHAR_UUID_RX));
+  uint16_t intervalMin = HELMET_CONN_PLAN ? CONN_INTERVAL_PLANNED : CONN_INTERVAL_MIN;
+  uint16_t intervalMax = HELMET_CONN_PLAN ? CONN_INTERVAL_PLANNED : CONN_INTERVAL_MAX;
+  esp_ble_gap_set_prefer_conn_params(address, intervalMin, intervalMax,
+                                     CONN_LATENCY, CONN_SUPERVISION_TIMEOUT);
+  BLEClient* pClient = h.client;
+  if (!pClient->connect(BLEAddress(address), type)) return false;
 
-  if (txCharacteristic == nullptr || rxCharacteristic == nullptr) return false;
+  // BLEClient keeps the services of its previous connection; rediscovering
+  // frees them instead of reusing stale handles (a different helmet may have
+  // been paired since)
+  pClient->getServices();
+  BLERemoteService* pRemoteService = pClient->getService(BLEUUID(SERVICE_UUID));
+  if (pRemoteService != nullptr) {
+    h.tx = pRemoteService->getCharacteristic(BLEUUID(CHAR_UUID_TX));
+    h.rx = pRemoteService->getCharacteristic(BLEUUID(CHAR_UUID_RX));
+  }
 
-  if (txCharacteristic->canNotify()) {
-    txCharacteristic->registerForNotify(notifyCallback);
+  if (pRemoteService == nullptr || h.tx == nullptr || h.rx == nullptr) {
+    pClient->disconnect(); // Link is up but unusable: drop it so onDisconnect keeps state consistent
+    return false;
   }
 
-  // Connection successful, clear any lingering disconnect timer
-  connected = true;
-  disconnectStartTime = 0; 
+  if (h.tx->canNotify()) {
+    h.tx->registerForNotify(notifyCallback);
+  }
+  if (FSR_STREAM) {
+    h.stream = pRemoteService->getCharacteristic(BLEUUID(CHAR_UUID_FSR_STREAM));
+    if (h.stream != nullptr && h.stream->canNotify()) {
+      pClient->setMTU(FSR_STREAM_MTU);  // Longer batches, fewer notifications
+      fsrStreams[slot].restart();
+      h.stream->registerForNotify(streamCallback);
+    }
+  }
+  saveHelmet(slot, address, type);
   return true;
 }
 
+// ---------------- BLE Task (core 0) ----------------
+static void setBleUi(BleUiStatus ui) {
+  bleLink.ui = ui;
+  bleLink.uiSeq++;
+  linkMailbox.publish(bleLink);
+}
+
+static void handleBleEvent(const BleEvent& ev) {
+  HelmetLink& link = bleLink.helmets[ev.slot];
+  switch (ev.type) {
+    case BLE_EV_CONNECTED:
+      link.connected = true;
+      link.reconnectMs = link.linkChanges > 0 ? ev.atMs - link.disconnectedAtMs : 0;
+      link.linkChanges++;
+      link.linkRttMinUs = 0;
+      bleLink.ui = BLE_UI_CONNECTED;
+      bleLink.uiSeq++;
+      break;
+    case BLE_EV_DISCONNECTED:
+      link.connected = false;
+      link.linkChanges++;
+      link.disconnectedAtMs = ev.atMs;
+      link.helmet.state = HELMET_UNKNOWN; // Assume insecure when disconnected
+      bleLink.ui = BLE_UI_DISCONNECTED;
+      bleLink.uiSeq++;
+      if (ev.slot == RIDER_SLOT) {
+        directConnectNext = true;
+        lastScanStartTime = 0;  // Start right away
+      }
+      break;
+    case BLE_EV_FOUND:
+      doConnect = true;
+      if (!bleLink.helmets[RIDER_SLOT].connected) {
+        bleLink.ui = BLE_UI_FOUND;
+        bleLink.uiSeq++;
+      }
+      break;
+    case BLE_EV_STATUS:
+      link.helmet = ev.status;
+      link.helmetRxUs = ev.atUs;
+      link.helmetHandledUs = micros();
+      break;
+  }
+}
+
+// Slot for a helmet a scan found: the one it was saved in, else the rider's
+// if that has no link, else the last free one. -1 when it is linked already
+// or every slot is.
+static int slotForHelmet(const uint8_t* address) {
+  for (int i = 0; i < MAX_HELMETS; i++) {
+    if (helmets[i].saved && memcmp(address, helmets[i].savedAddress, ESP_BD_ADDR_LEN) == 0) {
+      return bleLink.helmets[i].connected ? -1 : i;
+    }
+  }
+  if (!bleLink.helmets[RIDER_SLOT].connected) return RIDER_SLOT;
+  for (int i = MAX_HELMETS - 1; i >= 0; i--) {
+    if (!bleLink.helmets[i].connected) return i;
+  }
+  return -1;
+}
+
+static void startScan(unsigned long windowMs, uint16_t intervalMs, uint16_t scanWindowMs) {
+  BLEScan* pScan = BLEDevice::getScan();
+  pScan->setInterval(intervalMs);
+  pScan->setWindow(scanWindowMs);
+  pScan->start(windowMs / 1000, scanCompleteCallback, false);
+  lastScanStartTime = millis();
+}
+
+// Connection management
+// connectToServer() blocks inside the BLE stack while the link is set up; only this task waits on it.
+// While the rider's helmet is linked the task must keep passing its frames on,
+// so it never connects directly then: another helmet is scanned for, and only
+// blocks the task for the moment it takes to connect once it has been found.
+static void manageConnection() {
+  bool riderLinked = bleLink.helmets[RIDER_SLOT].connected;
+
+  if (doConnect) {
+    doConnect = false;
+    int slot = slotForHelmet(foundAddress);
+    if (slot >= 0) {
+      if (!riderLinked) setBleUi(BLE_UI_CONNECTING);
+      if (connectToServer(slot, foundAddress, foundAddressType)) {
+        Serial.printf("✅ Successfully connected to Helmet %d.\n", slot + 1);
+      } else {
+        Serial.println("❌ Connection failed. Will rescan...");
+        if (!riderLinked) setBleUi(BLE_UI_CONNECT_FAILED);
+      }
+    }
+    return;  // The link state changes with the events of this connect
+  }
+
+  if (!riderLinked) {
+    extraScanRunning = false;
+    HelmetConn& rider = helmets[RIDER_SLOT];
+    bool fast = BLE_FAST_RECONNECT && rider.saved;
+    unsigned long window = fast ? FALLBACK_SCAN_MS : scanDuration;
+    if (millis() - lastScanStartTime >= window || lastScanStartTime == 0) {
+      if (fast && directConnectNext) {
+        // Blocks until the helmet advertises or the stack's connect timeout expires
+        directConnectNext = false;
+        BLEDevice::getScan()->stop();
+        Serial.printf("🔁 Connecting to saved helmet " ESP_BD_ADDR_STR "...\n", ESP_BD_ADDR_HEX(rider.savedAddress));
+        setBleUi(BLE_UI_CONNECTING);
+        if (connectToServer(RIDER_SLOT, rider.savedAddress, rider.savedType)) {
+          Serial.println("✅ Successfully reconnected to Helmet.");
+        } else {
+          Serial.println("❌ Direct connect failed. Scanning briefly...");
+          setBleUi(BLE_UI_CONNECT_FAILED);
+          lastScanStartTime = 0;
+        }
+        return;
+      }
+      directConnectNext = true;
+      Serial.println("🔍 Scanning for Helmet...");
+      setBleUi(BLE_UI_SCANNING);
+      startScan(window, SCAN_INTERVAL_MS, SCAN_WINDOW_MS);
+    }
+    return;
+  }
+
+  // Rider linked: look for another helmet in a free slot, quietly
+  bool slotFree = false;
+  for (uint8_t i = 0; i < MAX_HELMETS; i++) slotFree = slotFree || !bleLink.helmets[i].connected;
+  bool allowed = slotFree && (!HELMET_CONN_PLAN || bikeParked || helmetMissing);
+  if (!allowed) {
+    if (extraScanRunning) BLEDevice::getScan()->stop();
+    extraScanRunning = false;
+    return;
+  }
+  if (millis() - lastScanStartTime >= (unsigned long)scanDuration || !extraScanRunning) {
+    if (HELMET_CONN_PLAN) startScan(scanDuration, EXTRA_SCAN_INTERVAL_MS, EXTRA_SCAN_WINDOW_MS);
+    else startScan(scanDuration, SCAN_INTERVAL_MS, SCAN_WINDOW_MS);
+    extraScanRunning = true;
+  }
+}
+
+// Time a write-with-response to each helmet now and then. Half the fastest
+// round trip is the floor the clock alignment cannot see.
+static void probeLink() {
+  for (uint8_t i = 0; i < MAX_HELMETS; i++) {
+    HelmetConn& h = helmets[i];
+    HelmetLink& link = bleLink.helmets[i];
+    if (!link.connected || h.rx == nullptr) continue;
+    if (millis() - h.lastProbeMs < LINK_PROBE_PERIOD_MS) continue;
+    h.lastProbeMs = millis();
+
+    uint32_t startUs = micros();
+    h.rx->writeValue((uint8_t*)&startUs, sizeof(startUs), true);
+    uint32_t rttUs = micros() - startUs;
+    if (link.connected && (link.linkRttMinUs == 0 || rttUs < link.linkRttMinUs)) {
+      link.linkRttMinUs = rttUs;
+      linkMailbox.publish(bleLink);
+    }
+  }
+}
+
+void bleTask(void* param) {
+  for (;;) {
+    BleEvent ev;
+    // Wait for BLE events, but wake up regularly for scan management
+    if (xQueueReceive(bleEvents, &ev, pdMS_TO_TICKS(BLE_TASK_PERIOD_MS)) == pdTRUE) {
+      PROFILE_SCOPE(PROF_BLE_EVENTS);
+      do {
+        handleBleEvent(ev);
+      } while (xQueueReceive(bleEvents, &ev, 0) == pdTRUE);
+      linkMailbox.publish(bleLink);
+    }
+    {
+      PROFILE_SCOPE(PROF_BLE_MANAGE);
+      manageConnection();
+    }
+    PROFILE_SCOPE(PROF_BLE_PROBE);
+    probeLink();
+  }
+}
+
+// ---------------- Control Task (core 1) ----------------
+void controlTask(void* param) {
+  for (;;) {
+    uint32_t idleUs = scheduler.run(nowUs);
+    // Sleep until the next deadline; at least one tick so lower priority tasks get the CPU
+    TickType_t ticks = pdMS_TO_TICKS(idleUs / 1000);
+    vTaskDelay(ticks > 0 ? ticks : 1);
+  }
+}
+
+// ---------------- Display Task (core 1, lowest priority) ----------------
+// HD44780 writes for a whole run of cells go out in one Wire transmission,
+// where LiquidCrystal_I2C makes one per nibble strobe (6 per character).
+class BatchedLcdBus : public LcdSink {
+public:
+  void setCursor(uint8_t col, uint8_t row) override {
+    put(Pcf8574LcdEncoder::setCursorCommand(col, row), false);
+  }
+
+  void write(const char* text, uint8_t length) override {
+    for (uint8_t i = 0; i < length; i++) put((uint8_t)text[i], true);
+  }
+
+  void setBacklight(bool on) override {
+    backlightOn = on;
+    if (used + 1 > LCD_I2C_BATCH) flush();
+    batch[used++] = on ? PCF8574_LCD_BACKLIGHT : 0;  // EN stays low: no strobe
+  }
+
+  void flush() override {
+    if (used == 0) return;
+    PROFILE_SCOPE(PROF_LCD_I2C);
+    Wire.beginTransmission(Board::LCD_I2C_ADDRESS);
+    Wire.write(batch, used);
+    Wire.endTransmission();
+    lcdI2cBytes += used + 1;  // Plus the address byte
+    used = 0;
+  }
+
+private:
+  void put(uint8_t value, bool data) {
+    if (used + PCF8574_LCD_BYTES_PER_WRITE > LCD_I2C_BATCH) flush();
+    used += Pcf8574LcdEncoder::encode(value, data, backlightOn, batch + used);
+  }
+
+  uint8_t batch[LCD_I2C_BATCH];
+  uint8_t used = 0;
+  bool backlightOn = true;
+};
+
+BatchedLcdBus lcdBus;
+
+static void initLcd() {
+  lcd.init();
+  lcd.backlight();
+  markBootPhase(BOOT_LCD);
+}
+
+// Owns the LCD after setup(): puts out what changed in the newest screen.
+// The I2C time is spent here instead of in the control loop.
+// Status telemetry goes out from here too: a slow serial port only fills the
+// ring (drops are counted in the next block), never the control task.
+static void drainTelemetry() {
+  PROFILE_SCOPE(PROF_TELEMETRY);
+  static uint8_t block[TELEMETRY_BLOCK_BYTES(TELEMETRY_MAX_BLOCK_RECORDS)];
+  // No more than the UART has room for (see serviceJournal()); the rest waits
+  // in the ring for the next pass
+  for (;;) {
+    size_t room = (size_t)Serial.availableForWrite();
+    if (room < TELEMETRY_BLOCK_BYTES(1)) break;
+    size_t n = telemetry.drain(block, room < sizeof(block) ? room : sizeof(block));
+    if (n == 0) break;
+    Serial.write(block, n);
+  }
+}
+
+// The control task's text (see ConsoleBuffer)
+static void drainConsole() {
+  uint8_t chunk[128];
+  size_t room, n;
+  while ((room = (size_t)Serial.availableForWrite()) > 0 &&
+         (n = console.ring.read(chunk, room < sizeof(chunk) ? room : sizeof(chunk))) > 0) {
+    Serial.write(chunk, n);
+  }
+  uint32_t dropped = console.ring.takeDropped();
+  if (dropped > 0) Serial.printf("⚠️ %lu bytes of console text dropped\n", (unsigned long)dropped);
+}
+
+// ---------------- Event Journal (display task) ----------------
+static void printJournalSummary() {
+  JournalStats s = journal.stats();
+  Serial.printf("📒 Journal: %u/%u sectors, %lu..%lu s, boot %u; %lu appended %lu dropped %lu written %lu errors %lu erases %lu bad\n",
+                journal.usedSectors(), journal.sectorCount(), (unsigned long)journal.oldestS(),
+                (unsigned long)journal.nowS(uptimeMs()), journal.boot(), (unsigned long)s.appended,
+                (unsigned long)s.dropped, (unsigned long)s.written, (unsigned long)s.writeErrors,
+                (unsigned long)s.erases, (unsigned long)s.badRecords);
+}
+
+// "" = everything, "<s>" = the last s seconds, "<a>-<b>" = journal seconds a..b
+static void startJournalDump(const char* range) {
+  uint32_t now = journal.nowS(uptimeMs());
+  uint32_t from = 0, to = UINT32_MAX;
+  if (*range != 0) {
+    char* end;
+    unsigned long a = strtoul(range, &end, 10);
+    if (*end == '-') {
+      from = a;
+      to = strtoul(end + 1, nullptr, 10);
+    } else {
+      from = a < now ? now - a : 0;
+    }
+  }
+  journalDump = journal.find(from);
+  journalDumpToS = to;
+  journalDumped = 0;
+  Serial.printf("📒 Journal dump %lu..%lu s (now %lu s)\n", (unsigned long)from, (unsigned long)to, (unsigned long)now);
+}
+
+// Writes what the control task queued, and one dump block per pass while a
+// dump runs, once the UART has room for all of it: telemetry and console
+// text share the port, and a Serial.write() that waits for room would hold
+// up the LCD and their drains.
+static void serviceJournal() {
+  PROFILE_SCOPE(PROF_JOURNAL);
+  journal.flush();
+  static JournalRecord records[JOURNAL_MAX_BLOCK_RECORDS];
+  static uint8_t block[JOURNAL_BLOCK_BYTES(JOURNAL_MAX_BLOCK_RECORDS)];
+  if (journalDump.done || Serial.availableForWrite() < (int)sizeof(block)) return;
+  size_t n = journal.read(journalDump, records, JOURNAL_MAX_BLOCK_RECORDS, journalDumpToS);
+  if (n > 0) {
+    Serial.write(block, encodeJournalBlock(records, (uint8_t)n, block));
+    journalDumped += n;
+  }
+  if (n < JOURNAL_MAX_BLOCK_RECORDS) {
+    journalDump.done = true;
+    Serial.printf("📒 Journal dump done: %lu events\n", (unsigned long)journalDumped);
+  }
+}
+
+// One letter per command, see handleConsoleCommand(); 'J' takes the rest of
+// the line as its range
+static void readConsole() {
+  static char range[24];
+  static int collecting = -1;  // Characters of the range so far, -1 = not in a 'J' command
+  while (Serial.available()) {
+    int c = Serial.read();
+    if (collecting >= 0) {
+      if (c == '\r' || c == '\n') {
+        range[collecting] = 0;
+        collecting = -1;
+        startJournalDump(range);
+      } else if (collecting < (int)sizeof(range) - 1) {
+        range[collecting++] = (char)c;
+      }
+    } else if (JOURNAL && c == 'J') {
+      collecting = 0;
+    } else if (JOURNAL && c == 'j') {
+      printJournalSummary();
+    } else {
+      handleConsoleCommand(c);
+    }
+  }
+}
+
+void displayTask(void* param) {
+  if (FAST_RESUME) initLcd();  // The shadow starts invalid: the first update draws everything
+  Screen want;
+  for (;;) {
+    if (screenMailbox.read(want)) {
+      PROFILE_SCOPE(PROF_LCD_UPDATE);
+      lcdShadow.update(want, lcdBus);
+    }
+    if (TELEMETRY) drainTelemetry();
+    drainConsole();
+    if (JOURNAL) serviceJournal();
+    if (PROFILE || JOURNAL) readConsole();
+    vTaskDelay(pdMS_TO_TICKS(DISPLAY_TASK_PERIOD_MS));
+  }
+}
+
 // ---------------- Setup ----------------
+// A full table would leave a task out without a word (deep sleep among
+// them): stop here instead, with the ignition still off.
+int requireTask(int id) {
+  if (id >= 0) return id;
+  Serial.printf("❌ Scheduler table full (SCHEDULER_TASKS %d). Halted.\n", SCHEDULER_TASKS);
+  for (;;) delay(1000);
+}
+
 void setup() {
+  bootStartUs = micros();
+  Serial.setTxBufferSize(SERIAL_TX_BUFFER);  // Before begin()
   Serial.begin(115200);
-  Wire.begin(21, 22); // SDA, SCL for ESP32
 
-  lcd.init();
-  lcd.backlight();
-  lcd.clear();
-  lcd.setCursor(0, 0);
-  lcd.print("Bike Unit Booting");
+  // Outputs first: the relay and buzzer pins float from reset until here.
+  // Initial State: Ignition and Buzzer OFF (Disabled)
+  pinMode(Board::IGNITION_PIN, OUTPUT);
+  pinMode(Board::BUZZER_PIN, OUTPUT);
+  safety.reset();
+  markBootPhase(BOOT_OUTPUTS);
+
+  resumed = FAST_RESUME && esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_EXT0 &&
+            resume.magic == RESUME_MAGIC;
+
+  // Before the display task starts writing it
+  if (JOURNAL) {
+    journalFlash.partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                      (esp_partition_subtype_t)JOURNAL_SUBTYPE, JOURNAL_PARTITION);
+    if (journal.mount(uptimeMs())) printJournalSummary();
+    else Serial.println("⚠️ No event journal: partition \"" JOURNAL_PARTITION "\" missing");
+    journalEvent(BIKE_JOURNAL_BOOT, esp_sleep_get_wakeup_cause(), resumed);
+  }
+
+  Wire.begin(Board::I2C_SDA_PIN, Board::I2C_SCL_PIN);
+  if (!FAST_RESUME) {
+    initLcd();
+    lcd.clear();
+    lcd.setCursor(0, 0);
+    lcd.print("Bike Unit Booting");
+  }
+  screen.clear();
+  screen.backlight = true;
+  screen.print(resumed ? "Resuming..." : "Bike Unit Booting");
+  screenMailbox.reset(screen);
+  // Its LCD init mostly waits, so it overlaps the BLE bring-up below
+  xTaskCreatePinnedToCore(displayTask, "display", DISPLAY_TASK_STACK, nullptr, DISPLAY_TASK_PRIORITY, &displayTaskHandle, DISPLAY_TASK_CORE);
 
   // Check and print the wake-up reason
   print_wakeup_reason();
   
-  pinMode(BLE_red, OUTPUT);
-  pinMode(BLE_green, OUTPUT);
-  digitalWrite(BLE_red, HIGH);
-  digitalWrite(BLE_green, LOW);
+  if (Board::HAS_STATUS_LEDS) {
+    pinMode(Board::BLE_RED_PIN, OUTPUT);
+    pinMode(Board::BLE_GREEN_PIN, OUTPUT);
+    digitalWrite(Board::BLE_RED_PIN, HIGH);
+    digitalWrite(Board::BLE_GREEN_PIN, LOW);
+  }
 
   // Initialize Input Pins with internal pull-up resistors
-  pinMode(STAND_PIN, INPUT_PULLUP); 
-  pinMode(RIDING_PIN, INPUT_PULLUP);
-
-  // Initialize Output Pins
-  pinMode(IGNITION_PIN, OUTPUT);
-  pinMode(BUZZER_PIN, OUTPUT);
+  pinMode(Board::STAND_PIN, INPUT_PULLUP); 
+  pinMode(Board::RIDING_PIN, INPUT_PULLUP);
 
-  // Initial State: Ignition and Buzzer OFF (Disabled)
-  digitalWrite(IGNITION_PIN, LOW);
-  digitalWrite(BUZZER_PIN, LOW);
-  ignitionEnabled = false;
+  // --- RTC GPIO configuration for Starter wake pin ---
+  rtc_gpio_init((gpio_num_t)Board::STARTER_WAKEUP_PIN);
+  rtc_gpio_set_direction((gpio_num_t)Board::STARTER_WAKEUP_PIN, RTC_GPIO_MODE_INPUT_ONLY);
+  rtc_gpio_pulldown_en((gpio_num_t)Board::STARTER_WAKEUP_PIN);
+  rtc_gpio_pullup_dis((gpio_num_t)Board::STARTER_WAKEUP_PIN);
 
+  // --- BLE -> Control link ---
+  bleEvents = xQueueCreate(BLE_EVENT_QUEUE_LEN, sizeof(BleEvent));
+  BleSnapshot initialLink = {};
+  for (uint8_t i = 0; i < MAX_HELMETS; i++) initialLink.helmets[i].helmet.state = HELMET_UNKNOWN;
+  bleLink = initialLink;
+  controlLink = initialLink;
+  linkMailbox.reset(initialLink);
 
-  // --- RTC GPIO configuration for Starter wake pin ---
-  rtc_gpio_init((gpio_num_t)STARTER_WAKEUP_PIN);
-  rtc_gpio_set_direction((gpio_num_t)STARTER_WAKEUP_PIN, RTC_GPIO_MODE_INPUT_ONLY);
-  rtc_gpio_pulldown_en((gpio_num_t)STARTER_WAKEUP_PIN);
-  rtc_gpio_pullup_dis((gpio_num_t)STARTER_WAKEUP_PIN);
+  // Helmets from the last connections, for direct reconnects: from RTC memory
+  // after a deep sleep, from NVS otherwise
+  prefs.begin(NVS_NAMESPACE, false);
+  if (resumed) Serial.printf("Resuming after deep sleep #%lu\n", (unsigned long)resume.sleeps);
+  for (uint8_t i = 0; i < MAX_HELMETS; i++) {
+    HelmetConn& h = helmets[i];
+    h.savedType = BLE_ADDR_TYPE_PUBLIC;
+    if (resumed) {
+      memcpy(h.savedAddress, resume.helmetAddress[i], ESP_BD_ADDR_LEN);
+      h.savedType = (esp_ble_addr_type_t)resume.helmetType[i];
+      h.saved = resume.haveHelmet[i];
+      continue;
+    }
+    char key[16];
+    slotKey(key, sizeof(key), NVS_HELMET_ADDRESS, i);
+    String saved = prefs.getString(key, "");
+    if (saved.length() > 0) {
+      memcpy(h.savedAddress, *BLEAddress(saved.c_str()).getNative(), ESP_BD_ADDR_LEN);
+      slotKey(key, sizeof(key), NVS_HELMET_TYPE, i);
+      h.savedType = (esp_ble_addr_type_t)prefs.getUChar(key, BLE_ADDR_TYPE_PUBLIC);
+      h.saved = true;
+      Serial.printf("Saved helmet %u: %s\n", i + 1, saved.c_str());
+    }
+  }
 
   BLEDevice::init("BikeUnit");
+  for (uint8_t i = 0; i < MAX_HELMETS; i++) {
+    clientCallbacks[i].slot = i;
+    helmets[i].client = BLEDevice::createClient();
+    helmets[i].client->setClientCallbacks(&clientCallbacks[i]);
+  }
 
   BLEScan* pScan = BLEDevice::getScan();
-  pScan->setAdvertisedDeviceCallbacks(new MyAdvertisedDeviceCallbacks());
+  pScan->setAdvertisedDeviceCallbacks(&advertisedDeviceCallbacks);
   pScan->setActiveScan(true);
+  markBootPhase(BOOT_BLE_INIT);
+
+  // The BLE task starts connecting while the rest is set up
+  xTaskCreatePinnedToCore(bleTask, "ble", BLE_TASK_STACK, nullptr, BLE_TASK_PRIORITY, &bleTaskHandle, BLE_TASK_CORE);
 
   // **CRITICAL INITIAL CHECK**
   // If the starter is ON at boot, we clear the hibernation timer right away.
-  if (digitalRead(STARTER_WAKEUP_PIN) == HIGH) {
+  if (digitalRead(Board::STARTER_WAKEUP_PIN) == Board::STARTER_ON_LEVEL) {
       starterOffTime = 0;
       Serial.println("Starter ON at boot. Hibernation timer cleared.");
   }
+
+  // --- Tasks (input sampling and safety first so they run first in each pass) ---
+  uint32_t now = micros();
+  requireTask(scheduler.addPeriodic("inputs", taskInputs, INPUT_PERIOD_US, now));
+  requireTask(scheduler.addPeriodic("safety", taskSafety, SAFETY_PERIOD_US, now));
+  requireTask(scheduler.addPeriodic("hibernate", taskHibernation, HIBERNATE_PERIOD_US, now));
+  requireTask(scheduler.addPeriodic("lcd", taskLcd, LCD_PERIOD_US, now));
+  requireTask(scheduler.addPeriodic("stats", taskStats, STATS_PERIOD_US, now + STATS_PERIOD_US));
+  if (TELEMETRY) requireTask(scheduler.addPeriodic("status", taskStatus, TELEMETRY_STATUS_US, now));
+  if (FSR_STREAM) requireTask(scheduler.addPeriodic("stream", taskStream, FSR_STREAM_CHECK_US, now));
+  deepSleepTask = requireTask(scheduler.addOneShot("sleep", finishDeepSleep));
+
+  xTaskCreatePinnedToCore(controlTask, "control", CONTROL_TASK_STACK, nullptr, CONTROL_TASK_PRIORITY, &controlTaskHandle, CONTROL_TASK_CORE);
+  markBootPhase(BOOT_TASKS);
 }
 
-// ---------------- Main Loop ----------------
-void loop() {
-   bool isStarterOn = (digitalRead(STARTER_WAKEUP_PIN) == HIGH);
+// ---------------- Tasks ----------------
+// Every task is short and non-blocking; they all run from the control task's scheduler.
+
+// Stand / riding / starter sampling
+void taskInputs() {
+  PROFILE_SCOPE(PROF_INPUTS);
+  bool standUp = (digitalRead(Board::STAND_PIN) == Board::STAND_UP_LEVEL);   // 1=UP, 0=DOWN
+  bool riding = (digitalRead(Board::RIDING_PIN) == Board::RIDING_LEVEL);     // 1=RIDING, 0=STATIONARY
+  if (standUp != isStandUp || riding != isRiding) markInputEdge(micros());
+  isStandUp = standUp;
+  isRiding = riding;
+  isStarterOn = (digitalRead(Board::STARTER_WAKEUP_PIN) == Board::STARTER_ON_LEVEL);
+}
+
+// Deep sleep trigger
+void taskHibernation() {
+  if (deepSleepPending) return;
 
-  // --- Deep Sleep Trigger ---
   if (!isStarterOn) {
     if (starterOffTime == 0) {
       starterOffTime = millis();
-      Serial.println("Starter OFF → starting 80s timer");
+      console.println("Starter OFF → starting 80s timer");
     } else if (millis() - starterOffTime >= hibernationDelayMs) {
       enterDeepSleep();
     }
   } else {
     starterOffTime = 0; // Reset timer when starter ON
   }
-  // --- A. Connection Management ---
-  if (doConnect) {
-    lcd.clear();
-    lcd.setCursor(0, 0); 
-    lcd.print("Connecting...");
+}
 
-    if (connectToServer()) {
-      Serial.println("✅ Successfully connected to Helmet.");
-    } else {
-      Serial.println("❌ Connection failed. Will rescan...");
-      lcd.clear();
-      lcd.setCursor(0, 0); 
-      lcd.print("Connection FAILED");
-      doScan = true; // Re-enable scan
-    }
-    doConnect = false;
+// Stage timestamps of a newly received helmet frame
+static void traceHelmetFrame(uint8_t slot, const HelmetLink& link) {
+  uint32_t readUs = micros();
+  helmetClock[slot].update(link.helmetRxUs, link.helmet.timestampUs);
+  uint32_t sampleUs = helmetClock[slot].toLocal(link.helmet.timestampUs) - link.linkRttMinUs / 2;
+
+  latency[SPAN_LINK].record(link.helmetRxUs - sampleUs);
+  latency[SPAN_BLE_TASK].record(link.helmetHandledUs - link.helmetRxUs);
+  latency[SPAN_MAILBOX].record(readUs - link.helmetHandledUs);
+
+  if (!helmetPolicy.counts(slot)) return;
+  if (link.helmet.state != controlLink.helmets[slot].helmet.state) {
+    helmetEdgeTraced = true;
+    helmetEdgeSampleUs = sampleUs;
+    helmetEdgeReadUs = readUs;
+  }
+  if (link.helmet.state != HELMET_SECURE && !unsafeLive && safety.ignitionEnabled()) {
+    unsafeLive = true;
+    unsafeSinceUs = sampleUs;
   }
+}
+
+// Pick up the latest BLE snapshot, react to connect/disconnect edges and let
+// HelmetPolicy decide which helmets count. Runs every pass even without a new
+// snapshot: whether the bike is parked changes the verdict too.
+static void pollLink() {
+  BleSnapshot snap;
+  if (!linkMailbox.read(snap)) snap = controlLink;
+
+  bool parked = !isStandUp && !isRiding;
+  bikeParked = parked;
+  HelmetSlotState slots[MAX_HELMETS];
+  for (uint8_t i = 0; i < MAX_HELMETS; i++) {
+    slots[i].linked = snap.helmets[i].connected;
+    slots[i].state = snap.helmets[i].helmet.state;
+  }
+  HelmetVerdict verdict = helmetPolicy.evaluate(slots, parked);
+  helmetMissing = !verdict.connected;
+
+  for (uint8_t i = 0; i < MAX_HELMETS; i++) {
+    const HelmetLink& link = snap.helmets[i];
+    const HelmetLink& before = controlLink.helmets[i];
+    if (link.linkChanges != before.linkChanges) helmetClock[i].reset(); // The helmet may have rebooted
+
+    // Legacy string frames carry no timestamp
+    if (link.helmetRxUs != before.helmetRxUs && !link.helmet.legacy &&
+        link.helmet.state != HELMET_UNKNOWN) {
+      traceHelmetFrame(i, link);
+    }
 
-  if (doScan && !connected) {
-    if (millis() - lastScanStartTime >= scanDuration || lastScanStartTime == 0) {
-      if (disconnectStartTime == 0) { // Only show Scanning if not in grace period
-        Serial.println("🔍 Scanning for Helmet...");
-        lcd.setCursor(0, 0); 
-        lcd.print("Scanning...     "); 
+    if (link.connected != before.connected) journalEvent(BIKE_JOURNAL_HELMET_LINK, i, link.connected);
+    if (link.connected && !before.connected) {
+      heapAtLastConnect = ESP.getFreeHeap();
+      if (heapConnects++ == 0) heapAtFirstConnect = heapAtLastConnect;
+      if (link.reconnectMs != 0) {
+        reconnectTime.record(link.reconnectMs * 1000);
+        console.printf("🔁 Helmet %u link back after %lu ms\n", i + 1, (unsigned long)link.reconnectMs);
       }
-      BLEDevice::getScan()->start(scanDuration / 1000.0, false);
-      lastScanStartTime = millis();
     }
+    if (helmetPolicy.counts(i) && link.helmet.state != before.helmet.state) markInputEdge(link.helmetRxUs);
   }
 
-  // --- B. BLE Disconnection Grace Period Logic (BLE = 0) ---
-  if (!connected && disconnectStartTime > 0) {
-    // If we are disconnected AND the ignition was ON, we are in the 60s grace period.
-    unsigned long elapsed = millis() - disconnectStartTime;
-
-    if (elapsed >= disconnectGracePeriod) {
-      // Grace period expired: force OFF
-      digitalWrite(IGNITION_PIN, LOW);
-      digitalWrite(BUZZER_PIN, LOW);
-      ignitionEnabled = false;
-      disconnectStartTime = 0;
-      Serial.println("❌ 60s BLE GRACE PERIOD EXPIRED. IGNITION DISABLED.");
-      lcd.clear();
-      lcd.setCursor(0, 0);
-      lcd.print("BLE Shutdown!");
-      lcd.setCursor(0, 1);
-      lcd.print("Ignition OFF");
-    } else {
-      // Still within grace period: maintain current IGNITION_PIN state
-      // LCD Update for disconnected state
-      lcd.setCursor(0, 0);
-      lcd.print("BLE Disconnected");
-      lcd.setCursor(0, 1);
-      long remaining = (disconnectGracePeriod - elapsed) / 1000;
-      lcd.print("Shutdown in ");
-      lcd.print(remaining);
-      lcd.print("s ");
+  if (verdict.connected && !connected) {
+    markBootPhase(BOOT_LINK);
+    if (Board::HAS_STATUS_LEDS) {
+      digitalWrite(Board::BLE_GREEN_PIN, HIGH);
+      digitalWrite(Board::BLE_RED_PIN, LOW);
     }
-    
-    // Skip main safety logic when disconnected and in grace period
-    delay(500);
-    return; 
+  } else if (!verdict.connected && connected && Board::HAS_STATUS_LEDS) {
+    digitalWrite(Board::BLE_GREEN_PIN, LOW); 
+    digitalWrite(Board::BLE_RED_PIN, HIGH);
   }
+  connected = verdict.connected;
 
-  // --- C. Safety Logic (Only runs if connected is true, or if grace period just ended) ---
-  if (connected) {
-    
-    // 1. Read Inputs (Stand: 1=UP, 0=DOWN | Riding: 1=RIDING, 0=STATIONARY)
-    bool isStandUp = (digitalRead(STAND_PIN) == LOW);
-    bool isRiding = (digitalRead(RIDING_PIN) == LOW); 
-    
-    // 2. Core Logic Evaluation based on Truth Table
-    // Ignition ON: (S=1 AND H=1)
-    bool requiredIgnition = isStandUp && helmetSecure;
+  const HelmetLink& rider = snap.helmets[RIDER_SLOT];
+  if (rider.connected && rider.helmetRxUs != controlLink.helmets[RIDER_SLOT].helmetRxUs &&
+      rider.helmet.state != HELMET_UNKNOWN && !bootPhaseDone[BOOT_READY]) {
+    markBootPhase(BOOT_READY);
+    printBootTiming();
+  }
 
-    // 60s Warning: (S=0, R=0, H=1) - Stand Down, Stationary, Helmet Secure
-    bool require60sWarning = (!isStandUp && !isRiding && helmetworn);
-    
-    // 15s Warning: (S=0, R=1, H=0 or 1) OR (S=1, R=1, H=0)
-    bool require15sWarning = (!isStandUp && isRiding) || (isStandUp && isRiding && !helmetSecure);
+  helmetSecure = verdict.secure;
+  helmetworn = verdict.worn;
+  if (helmetSecure) unsafeLive = false;
 
-    // --- State Machine Implementation ---
+  controlLink = snap;
+}
 
-    if (requiredIgnition) {
-        // Case: Ignition ON (S=1 AND H=1)
-        if (!ignitionEnabled) {
-            ignitionEnabled = true;
-            digitalWrite(IGNITION_PIN, HIGH);
-            Serial.println("🔥 IGNITION ENABLED.");
-        }
-        // Clear all warnings and buzzer when ignition is ON
-        warningStartTime = 0;
-        digitalWrite(BUZZER_PIN, LOW);
-    } 
-    else { 
-        // Case: Ignition OFF (S=0 OR H=0)
-        
-        // 1. Check for 60-second warning condition (Immediate Ignition Cut, Buzzer for 60s)
-        if (require60sWarning) {
-            if (warningStartTime == 0) {
-                ignitionEnabled = false;
-                digitalWrite(IGNITION_PIN, LOW); // **IMMEDIATE IGNITION CUT**
-                warningStartTime = millis();
-                Serial.println("🔔 Starting 60s warning (Stand Down, Stationary, Helmet Secure). IGNITION CUT.");
-            }
-            digitalWrite(BUZZER_PIN, HIGH); // Buzzer ON for the duration
-
-            if (millis() - warningStartTime >= warningDuration60s) {
-                // Buzzer stops after 60 seconds (Ignition is already off)
-                digitalWrite(BUZZER_PIN, LOW);
-                warningStartTime = 0;
-                Serial.println("❌ 60s WARNING EXPIRED. BUZZER DISABLED.");
-            }
-        }
-        
-        // 2. Check for 15-second warning condition
-        else if (require15sWarning) {
-            if (warningStartTime == 0) {
-                // ignitionEnabled = false; // Ensure ignition is off on entering warning
-                // digitalWrite(IGNITION_PIN, LOW);
-                warningStartTime = millis();
-                Serial.println("🔔 Starting 15s warning (Hazard detected). ");
-            }
-            // digitalWrite(BUZZER_PIN, HIGH); // Buzzer ON
-
-            if (millis() - warningStartTime >= warningDuration15s) {
-                // // Buzzer stops after 15 seconds (Ignition is already off)
-                // digitalWrite(BUZZER_PIN, LOW);
-                ignitionEnabled = false; // Ensure ignition is off after warning
-                digitalWrite(IGNITION_PIN, LOW);
-                warningStartTime = 0;
-                // Serial.println("❌ 15s WARNING EXPIRED. BUZZER DISABLED.");
-                Serial.println("❌ 15s WARNING EXPIRED. IGNITION CUT.");
-
-            }
-        }
-        
-        // 3. Default Disabled State (All other cases where ignition is not required)
-        else { 
-            ignitionEnabled = false;
-            digitalWrite(IGNITION_PIN, LOW);
-            digitalWrite(BUZZER_PIN, LOW);
-            warningStartTime = 0;
+static void logSafetyEvent(SafetyEvent event) {
+  switch (event) {
+    case SAFETY_EV_IGNITION_ENABLED:
+      console.println("🔥 IGNITION ENABLED.");
+      break;
+    case SAFETY_EV_WARN60_START:
+      console.println("🔔 Starting 60s warning (Stand Down, Stationary, Helmet Secure). IGNITION CUT.");
+      break;
+    case SAFETY_EV_WARN60_EXPIRED:
+      console.println("❌ 60s WARNING EXPIRED. BUZZER DISABLED.");
+      break;
+    case SAFETY_EV_WARN15_START:
+      console.println("🔔 Starting 15s warning (Hazard detected). ");
+      break;
+    case SAFETY_EV_WARN15_EXPIRED:
+      console.println("❌ 15s WARNING EXPIRED. IGNITION CUT.");
+      break;
+    case SAFETY_EV_GRACE_START:
+      console.println("⚠️ Starting 60s grace period.");
+      break;
+    case SAFETY_EV_GRACE_EXPIRED:
+      console.println("❌ 60s BLE GRACE PERIOD EXPIRED. IGNITION DISABLED.");
+      screen.clear();
+      screen.setCursor(0, 0);
+      screen.print("BLE Shutdown!");
+      screen.setCursor(0, 1);
+      screen.print("Ignition OFF");
+      break;
+    default:
+      break;
+  }
+}
+
+// Safety logic: BLE grace period and truth table
+void taskSafety() {
+  static uint32_t lastStepUs = 0;
+  uint32_t stepUs = micros();
+  if (lastStepUs != 0) latency[SPAN_STEP_GAP].record(stepUs - lastStepUs);
+  lastStepUs = stepUs;
+  {
+    PROFILE_SCOPE(PROF_LINK_POLL);
+    pollLink();
+  }
+
+  bool edgePending = inputEdgePending;
+  uint32_t edgeUs = inputEdgeUs;
+  bool ignitionBefore = safety.ignitionEnabled();
+
+  SafetyInputs in;
+  in.standUp = isStandUp;
+  in.riding = isRiding;
+  in.helmetSecure = helmetSecure;
+  in.helmetWorn = helmetworn;
+  in.bleConnected = connected;
+  SafetyEvent event;
+  {
+    PROFILE_SCOPE(PROF_SAFETY);
+    event = safety.step(in);
+  }
+  logSafetyEvent(event);
+  safetyInputs = in;
+  if (TELEMETRY && event != SAFETY_EV_NONE) {
+    telemetry.log(TELEMETRY_BIKE_EVENT, event, bikeStatusFlags(in, safety), micros());
+  }
+  if (event != SAFETY_EV_NONE) journalEvent(event, bikeStatusFlags(in, safety), bikeWarningField(safety));
+
+  if (safety.ignitionEnabled() != ignitionBefore) {
+    if (helmetEdgeTraced) {
+      latency[SPAN_DECISION].record(ignitionWriteUs - helmetEdgeReadUs);
+      latency[SPAN_HELMET_PIN].record(ignitionWriteUs - helmetEdgeSampleUs);
+    }
+    if (!safety.ignitionEnabled() && unsafeLive) {
+      latency[SPAN_UNSAFE_LIVE].record(ignitionWriteUs - unsafeSinceUs);
+      unsafeLive = false;
+    }
+  }
+  helmetEdgeTraced = false;
+
+  // Response time of decisions taken directly on an input edge
+  if (edgePending) {
+    if (safety.ignitionEnabled() != ignitionBefore) {
+      ignitionLatencyLastUs = micros() - edgeUs;
+      if (ignitionLatencyLastUs > ignitionLatencyMaxUs) ignitionLatencyMaxUs = ignitionLatencyLastUs;
+    }
+    inputEdgePending = false;
+  }
+}
+
+// Safety state for the status telemetry
+void taskStatus() {
+  telemetry.log(TELEMETRY_BIKE_STATUS, bikeStatusFlags(safetyInputs, safety), bikeWarningField(safety), micros());
+}
+
+// A helmet's waveform against its own verdict, over one drain. The verdict
+// needs touch, buckle and the FSR; the stream shows all three, so a secure
+// verdict with the FSR below FSR_WORN_OFF or a switch open is implausible,
+// and so is a warning while everything reads worn. Status frames and batches
+// arrive at different times, so only a disagreement that lasts counts.
+static void checkStream(uint8_t slot, uint32_t n, uint32_t fsrMean) {
+  StreamCheck& c = streamCheck[slot];
+  const HelmetLink& link = controlLink.helmets[slot];
+  bool secure = link.helmet.state == HELMET_SECURE;
+  bool closed = c.lastFlags == (HELMET_FLAG_TOUCHED | HELMET_FLAG_BUCKLED);
+  bool disagree = n > 0 && link.connected && link.helmet.state != HELMET_UNKNOWN &&
+                  (secure ? !closed || fsrMean < FSR_WORN_OFF : closed && fsrMean >= FSR_WORN_ON);
+  if (!disagree) {
+    if (c.mismatch) console.printf("✅ Helmet %u: FSR stream agrees with its verdict again\n", slot + 1);
+    c.mismatch = false;
+    c.disagreeing = false;
+    return;
+  }
+  if (!c.disagreeing) {
+    c.disagreeing = true;
+    c.mismatchSinceMs = millis();
+  }
+  if (c.mismatch || millis() - c.mismatchSinceMs < FSR_STREAM_MISMATCH_MS) return;
+  c.mismatch = true;
+  c.mismatches++;
+  console.printf("⚠️ Helmet %u says %s but its FSR stream reads %lu, touched %d, buckled %d\n", slot + 1,
+                secure ? "secure" : "not secure", (unsigned long)fsrMean,
+                (c.lastFlags & HELMET_FLAG_TOUCHED) != 0, (c.lastFlags & HELMET_FLAG_BUCKLED) != 0);
+}
+
+// Drain the helmets' FSR streams: capture the samples on our clock, then
+// check them against each helmet's verdict
+void taskStream() {
+  PROFILE_SCOPE(PROF_STREAM);
+  for (uint8_t i = 0; i < MAX_HELMETS; i++) {
+    StreamCheck& c = streamCheck[i];
+    FsrStreamSample sample;
+    uint32_t n = 0, sum = 0;
+    while (fsrStreams[i].pop(sample)) {
+      n++;
+      sum += sample.fsr;
+      c.lastFsr = sample.fsr;
+      c.lastFlags = sample.flags;
+      // Needs a status frame first to place the helmet's clock on ours
+      if (FSR_STREAM_CAPTURE && TELEMETRY && helmetClock[i].valid()) {
+        telemetry.log(TELEMETRY_SAMPLE, sample.flags | (i << 4), sample.fsr, helmetClock[i].toLocal(sample.timeUs));
+      }
+    }
+    c.samples += n;
+    checkStream(i, n, n > 0 ? sum / n : 0);
+  }
+}
+
+// LCD Status Update
+void taskLcd() {
+  if (deepSleepPending) return;
+  PROFILE_SCOPE(PROF_LCD_DRAW);
+
+  // One-off BLE messages
+  if (controlLink.uiSeq != lcdUiSeq) {
+    lcdUiSeq = controlLink.uiSeq;
+    switch (controlLink.ui) {
+      case BLE_UI_SCANNING:
+        if (!safety.graceActive()) { // Only show Scanning if not in grace period
+          screen.setCursor(0, 0); 
+          screen.print("Scanning...     "); 
         }
+        break;
+      case BLE_UI_FOUND:
+        screen.clear();
+        screen.setCursor(0, 0); 
+        screen.print("Helmet found!");
+        break;
+      case BLE_UI_CONNECTING:
+        screen.clear();
+        screen.setCursor(0, 0); 
+        screen.print("Connecting...");
+        break;
+      case BLE_UI_CONNECT_FAILED:
+        screen.clear();
+        screen.setCursor(0, 0); 
+        screen.print("Connection FAILED");
+        break;
+      case BLE_UI_DISCONNECTED:
+        screen.clear();
+        screen.setCursor(0, 0); 
+        screen.print("Disconnected!");
+        break;
+      default:
+        break;
     }
+  }
 
-    // --- D. LCD Status Update (Connected State) ---
-    lcd.setCursor(0, 0);
-    lcd.print("S:");
-    lcd.print(isStandUp ? "UP " : "DN ");
-    lcd.print(" R:");
-    lcd.print(isRiding ? "ON " : "OFF");
-    lcd.print(" I:");
-    lcd.print(ignitionEnabled ? "ON " : "OFF");
-
-    lcd.setCursor(0, 1);
+  if (connected) {
+    screen.setCursor(0, 0);
+    screen.print("S:");
+    screen.print(isStandUp ? "UP " : "DN ");
+    screen.print(" R:");
+    screen.print(isRiding ? "ON " : "OFF");
+    screen.print(" I:");
+    screen.print(safety.ignitionEnabled() ? "ON " : "OFF");
+
+    screen.setCursor(0, 1);
     
-    if (warningStartTime > 0) {
+    if (safety.warningActive()) {
         // Show remaining time
-        unsigned long elapsed = millis() - warningStartTime;
-        long remainingDuration = require60sWarning ? warningDuration60s : warningDuration15s;
-        long remaining = (remainingDuration - elapsed) / 1000;
-        if (remaining < 0) remaining = 0;
+        long remaining = safety.warningRemainingMs() / 1000;
         
-        lcd.print("WARNING: ");
-        lcd.print(remaining);
-        lcd.print("s ");
+        screen.print("WARNING: ");
+        screen.print(remaining);
+        screen.print("s ");
 
     } else {
-        // Show Helmet status
-        lcd.print("H: ");
-        lcd.print(helmetSecure ? "SECURE " : "WARN   ");
-        lcd.print("       "); 
-    }
-    
-    // Slow down the loop execution
-    delay(500); 
-  } else {
-    // If not connected and not in grace period, run slowly for scanning
-    if (disconnectStartTime == 0) {
-        delay(100); 
+        // Show Helmet status (every helmet that counts), then each other
+        // helmet's own: S secure, W worn, R removed, - no link
+        screen.print("H: ");
+        screen.print(helmetSecure ? "SECURE " : "WARN   ");
+        for (uint8_t i = 0; i < MAX_HELMETS; i++) {
+          if (i == RIDER_SLOT) continue;
+          const HelmetLink& link = controlLink.helmets[i];
+          screen.print(" P:");
+          screen.print(!link.connected ? "-" :
+                       link.helmet.state == HELMET_SECURE ? "S" :
+                       link.helmet.state == HELMET_WORN_NOT_BUCKLED ? "W" :
+                       link.helmet.state == HELMET_REMOVED ? "R" : "?");
+        }
+        screen.print("   "); 
     }
+  } else if (safety.graceActive()) {
+    // LCD Update for disconnected state (grace period)
+    long remaining = safety.graceRemainingMs() / 1000;
+    screen.setCursor(0, 0);
+    screen.print("BLE Disconnected");
+    screen.setCursor(0, 1);
+    screen.print("Shutdown in ");
+    screen.print(remaining);
+    screen.print("s ");
   }
+  screenMailbox.publish(screen);
+}
+
+// Scheduler statistics
+void taskStats() {
+  console.println("---- Scheduler (us) ----");
+  for (size_t i = 0; i < scheduler.size(); i++) {
+    const SchedulerTask& t = scheduler.task(i);
+    if (t.runs == 0) continue;
+    console.printf("%-10s runs:%6lu late max:%6lu run max:%6lu avg:%5lu\n", t.name,
+                  (unsigned long)t.runs, (unsigned long)t.maxLatencyUs, (unsigned long)t.maxRunUs,
+                  (unsigned long)(t.totalRunUs / t.runs));
+  }
+  console.printf("Ignition response: last %lu us, max %lu us\n",
+                (unsigned long)ignitionLatencyLastUs, (unsigned long)ignitionLatencyMaxUs);
+
+  console.printf("---- Latency (us), link floor %lu ----\n",
+                (unsigned long)(controlLink.helmets[RIDER_SLOT].linkRttMinUs / 2));
+  for (int i = 0; i < SPAN_COUNT; i++) printLatency(console, SPAN_NAMES[i], latency[i]);
+  printLatency(console, "reconnect", reconnectTime);
+  printBootTiming();
+
+  // Heap and stack high-water marks (stack: bytes never used so far)
+  console.println("---- Memory (bytes) ----");
+  console.printf("heap free:%6lu min:%6lu largest block:%6lu\n", (unsigned long)ESP.getFreeHeap(),
+                (unsigned long)ESP.getMinFreeHeap(), (unsigned long)ESP.getMaxAllocHeap());
+  if (heapConnects > 0) {
+    console.printf("heap at connect: first %lu, last %lu (%ld over %lu connects)\n",
+                  (unsigned long)heapAtFirstConnect, (unsigned long)heapAtLastConnect,
+                  (long)heapAtLastConnect - (long)heapAtFirstConnect, (unsigned long)heapConnects);
+  }
+  console.printf("stack free ble:%5lu control:%5lu display:%5lu\n",
+                (unsigned long)uxTaskGetStackHighWaterMark(bleTaskHandle),
+                (unsigned long)uxTaskGetStackHighWaterMark(controlTaskHandle),
+                (unsigned long)uxTaskGetStackHighWaterMark(displayTaskHandle));
+
+  uint32_t lcdBytes = lcdI2cBytes;
+  console.printf("LCD: %lu I2C B/s, %lu cells sent\n",
+                (unsigned long)((uint64_t)(lcdBytes - lcdI2cBytesReported) * 1000000 / STATS_PERIOD_US),
+                (unsigned long)lcdShadow.totalCellsSent());
+  lcdI2cBytesReported = lcdBytes;
+
+  for (uint8_t i = 0; FSR_STREAM && i < MAX_HELMETS; i++) {
+    const FsrStreamStats& s = fsrStreams[i].stats();
+    if (s.batches == 0 && s.bad == 0) continue;
+    console.printf("FSR stream %u: %lu batches %lu samples, %lu lost %lu bad %lu overflows, fsr %u, %lu mismatches\n",
+                  i + 1, (unsigned long)s.batches, (unsigned long)streamCheck[i].samples, (unsigned long)s.lost,
+                  (unsigned long)s.bad, (unsigned long)s.overflows, streamCheck[i].lastFsr,
+                  (unsigned long)streamCheck[i].mismatches);
+  }
+  if (JOURNAL) {
+    JournalStats j = journal.stats();
+    console.printf("Journal: %lu events, %lu dropped, %lu written, %lu errors, %lu erases\n", (unsigned long)j.appended,
+                  (unsigned long)j.dropped, (unsigned long)j.written, (unsigned long)j.writeErrors,
+                  (unsigned long)j.erases);
+  }
+  if (PROFILE) printProfile(console);
+}
+
+// ---------------- Main Loop ----------------
+// All work happens in bleTask and controlTask.
+void loop() {
+  vTaskDelete(NULL);
 }
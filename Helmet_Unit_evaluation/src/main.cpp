@@ -2,15 +2,20 @@
 #include <BLEDevice.h>
 #include <BLEUtils.h>
 #include <BLEServer.h>
+#include <HelmetProtocol.h>
+#include <HelmetNotifyPolicy.h>
+#include <FsrCalibration.h>
+#include <BoardTraits.h>
 
-#define SERVICE_UUID "4fafc201-1fb5-459e-8fcc-c5c9c331914b"
-#define CHAR_UUID_TX "beb5483e-36e1-4688-b7f5-ea07361b26a8"
-#define CHAR_UUID_RX "6e400002-b5a3-f393-e0a9-e50e24dcca9e"
+// Pins and sensors come from the board traits (lib/BoardTraits/BoardTraits.h)
+#ifndef BOARD
+#define BOARD HelmetC3Board
+#endif
+typedef BOARD Board;
 
-#define FSR_PIN 0 
-#define TOUCH_PIN 5        // TTP223 touch sensor → HIGH = touched (helmet worn)
-#define BUCKLE_PIN 6       // Buckle switch input (active LOW when buckled)
-#define BUTTON_PIN 7      // push button to enable/disable pairing 
+// 1 = sample fast and notify on state change (+ heartbeat), 0 = legacy fixed 500 ms notify
+#define NOTIFY_ON_CHANGE 1
+#define LOG_INTERVAL_MS 500 // Sensor printout rate (kept at the capture rate used by analyze_helmet.py)
 
 BLECharacteristic *txCharacteristic;
 BLECharacteristic *rxCharacteristic;
@@ -21,6 +26,12 @@ bool deviceConnected = false;
 bool isAdvertising = false;
 bool lastButtonState = HIGH;
 
+HelmetNotifyPolicy notifyPolicy(NOTIFY_ON_CHANGE,
+                                NOTIFY_ON_CHANGE ? HELMET_HEARTBEAT_INTERVAL_MS : HELMET_LEGACY_NOTIFY_MS);
+bool wasConnected = false;
+unsigned long lastSampleTime = 0;
+unsigned long lastLogTime = 0;
+
 class ServerCallbacks: public BLEServerCallbacks {
   void onConnect(BLEServer* pServer) {
     deviceConnected = true;
@@ -50,9 +61,9 @@ void setup() {
   Serial.begin(115200);
   delay(1000);
   Serial.println("Booting Helmet Unit...");
-  pinMode(TOUCH_PIN, INPUT);
-  pinMode(BUCKLE_PIN, INPUT_PULLUP);   
-  pinMode(BUTTON_PIN, INPUT_PULLUP);
+  pinMode(Board::TOUCH_PIN, INPUT);
+  pinMode(Board::BUCKLE_PIN, INPUT_PULLUP);   
+  pinMode(Board::BUTTON_PIN, INPUT_PULLUP);
 
   BLEDevice::init("HelmetUnit");
   pServer = BLEDevice::createServer();
@@ -78,36 +89,41 @@ void setup() {
 }
 
 void loop() {
-  if (digitalRead(BUTTON_PIN) == LOW && !isAdvertising) {
+  if (digitalRead(Board::BUTTON_PIN) == LOW && !isAdvertising) {
     Serial.println("Button pressed → start advertising for pairing");
     pAdvertising->start();
     isAdvertising = true;
   }
 
-  if (deviceConnected) {
-    unsigned long startTime = millis();  // Start timing
+  if (deviceConnected && !wasConnected) {
+    notifyPolicy.reset(); // Send the current state to a newly connected bike right away
+  }
+  wasConnected = deviceConnected;
 
-    bool helmetTouched = (digitalRead(TOUCH_PIN) == HIGH);
-    int fsrValue = analogRead(FSR_PIN);
-    bool buckled = (digitalRead(BUCKLE_PIN) == LOW);
+  unsigned long sampleInterval = NOTIFY_ON_CHANGE ? HELMET_SAMPLE_INTERVAL_MS : HELMET_LEGACY_NOTIFY_MS;
+  if (deviceConnected && millis() - lastSampleTime >= sampleInterval) {
+    lastSampleTime = millis();
+    unsigned long startTime = micros();  // Start timing
 
-    Serial.printf("helmetTouched: %d, fsrValue: %d, buckled: %d\n", 
-                  helmetTouched, fsrValue, buckled);
+    bool helmetTouched = (digitalRead(Board::TOUCH_PIN) == Board::TOUCH_ACTIVE);
+    int fsrValue = Board::HAS_FSR ? analogRead(Board::FSR_PIN) : 0;
+    bool buckled = (digitalRead(Board::BUCKLE_PIN) == Board::BUCKLE_ACTIVE);
 
-    String status;
-    if (helmetTouched && fsrValue > 50 && buckled) {
-      status = "true";
-    } else {
-      status = "warn";
+    if (millis() - lastLogTime >= LOG_INTERVAL_MS) {
+      lastLogTime = millis();
+      Serial.printf("helmetTouched: %d, fsrValue: %d, buckled: %d\n", 
+                    helmetTouched, fsrValue, buckled);
     }
 
-    txCharacteristic->setValue(status.c_str());
+    bool secure = helmetTouched && (!Board::HAS_FSR || fsrValue > FSR_ANALOG_THRESHOLD) && buckled;
+    if (notifyPolicy.update(secure, millis()) == NOTIFY_NONE) return;
+
+    const char* status = secure ? "true" : "warn";
+    txCharacteristic->setValue(status);
     txCharacteristic->notify();
 
-    unsigned long endTime = millis();  // End timing
+    unsigned long endTime = micros();  // End timing
     unsigned long responseTime = endTime - startTime;
-    Serial.printf("Status sent: %s, Helmet Response Time: %lu ms\n", status.c_str(), responseTime);
-
-    delay(500);  // Adjust for experiment rate
+    Serial.printf("Status sent: %s, Helmet Response Time: %lu us\n", status, responseTime);
   }
-}
\ No newline at end of file
+}
@@ -0,0 +1,360 @@
+#pragma once
+
+// Fleet telemetry store: the bike status records (BikeStatus.h) of many
+// vehicles, partitioned by UTC day and kept column by column.
+//
+//   STORE/YYYY-MM-DD/seg-NNNNNN.fcol  chunks, one file per gateway run, appended
+//   STORE/YYYY-MM-DD/index.fidx       FleetIndexEntry per vehicle and chunk, appended
+//   STORE/YYYY-MM-DD/summary.fsum     FleetSummaryEntry per vehicle (the day's
+//                                     totals), replaced after every chunk
+//
+// A chunk holds the records of one flush, sorted by vehicle and time:
+//   FleetChunkHeader, FleetChunkVehicle[vehicles],
+//   u32 timeMs[rows] (since the day's midnight), u8 type[rows], u8 a[rows], u16 b[rows]
+// Everything is little endian and every array starts 8-byte aligned, as in
+// the .hcol files of env:ingest, so a column loads with numpy.frombuffer.
+//
+// "Violations per vehicle per day" reads summary.fsum only, 64 bytes per
+// vehicle and day. The rows of one vehicle are found through index.fidx
+// (64 bytes per vehicle and flush) and read as slices of the chunk columns.
+// summary.fsum is rebuilt from index.fidx when it is missing; a chunk whose
+// index entries never made it to disk (crash between the writes) is skipped.
+
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <BikeStatus.h>
+
+#define FLEET_STORE_VERSION 1
+#define FLEET_DAY_MS 86400000ULL
+
+// One decoded record on the gateway's clock
+struct FleetRecord {
+  uint64_t wallMs;   // Unix time
+  uint32_t vehicle;
+  uint8_t type;      // TelemetryType
+  uint8_t a;
+  uint16_t b;
+};
+
+struct FleetChunkHeader {
+  char magic[4];     // "FCHK"
+  uint32_t version;
+  uint32_t rows;
+  uint32_t vehicles;
+  uint32_t firstMs;  // Since midnight
+  uint32_t lastMs;
+  uint32_t reserved[2];
+};
+
+struct FleetChunkVehicle {
+  uint32_t vehicle;
+  uint32_t firstRow;
+  uint32_t rows;
+  uint32_t reserved;
+};
+
+struct FleetIndexEntry {
+  uint32_t vehicle;
+  uint32_t segment;                    // seg-NNNNNN.fcol
+  uint64_t chunkOffset;
+  uint32_t chunkRows;
+  uint32_t chunkVehicles;
+  uint32_t firstRow;                   // This vehicle's rows in the chunk
+  uint32_t rows;
+  uint32_t firstMs;
+  uint32_t lastMs;
+  uint16_t events[BIKE_EVENT_TYPES];   // TELEMETRY_BIKE_EVENT records by SafetyEvent
+  uint16_t reserved[3];
+};
+
+struct FleetSummaryHeader {
+  char magic[4];     // "FSUM"
+  uint32_t version;
+  uint32_t vehicles;
+  uint32_t reserved;
+};
+
+struct FleetSummaryEntry {
+  uint32_t vehicle;
+  uint32_t chunks;
+  uint64_t rows;
+  uint32_t firstMs;
+  uint32_t lastMs;
+  uint32_t events[BIKE_EVENT_TYPES];
+  uint32_t reserved;
+};
+
+static_assert(sizeof(FleetChunkHeader) == 32, "FleetChunkHeader must stay 32 bytes");
+static_assert(sizeof(FleetIndexEntry) == 64, "FleetIndexEntry must stay 64 bytes");
+static_assert(sizeof(FleetSummaryEntry) == 64, "FleetSummaryEntry must stay 64 bytes");
+
+// ---------------- Days ----------------
+inline int64_t fleetDayOf(uint64_t wallMs) { return (int64_t)(wallMs / FLEET_DAY_MS); }
+
+inline std::string fleetDayName(int64_t day) {
+  time_t t = (time_t)(day * 86400);
+  struct tm tm;
+  gmtime_r(&t, &tm);
+  char name[16];
+  strftime(name, sizeof(name), "%Y-%m-%d", &tm);
+  return name;
+}
+
+inline bool fleetParseDay(const char* text, int64_t& day) {
+  struct tm tm = {};
+  char rest;
+  if (sscanf(text, "%4d-%2d-%2d%c", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &rest) != 3) return false;
+  tm.tm_year -= 1900;
+  tm.tm_mon -= 1;
+  day = (int64_t)timegm(&tm) / 86400;
+  return fleetDayName(day) == text;
+}
+
+inline std::string fleetTimeOfDay(uint32_t ms) {
+  char text[16];
+  snprintf(text, sizeof(text), "%02u:%02u:%02u.%03u", ms / 3600000, ms / 60000 % 60, ms / 1000 % 60, ms % 1000);
+  return text;
+}
+
+// Day partitions in STORE from `from` to `to` (inclusive), oldest first
+inline std::vector<int64_t> fleetListDays(const std::string& root, int64_t from, int64_t to) {
+  std::vector<int64_t> days;
+  DIR* dir = opendir(root.c_str());
+  if (dir == nullptr) return days;
+  while (struct dirent* e = readdir(dir)) {
+    int64_t day;
+    if (fleetParseDay(e->d_name, day) && day >= from && day <= to) days.push_back(day);
+  }
+  closedir(dir);
+  std::sort(days.begin(), days.end());
+  return days;
+}
+
+// ---------------- Reading ----------------
+inline bool fleetReadIndex(const std::string& dayDir, std::vector<FleetIndexEntry>& entries) {
+  FILE* f = fopen((dayDir + "/index.fidx").c_str(), "rb");
+  if (f == nullptr) return false;
+  FleetIndexEntry e;
+  while (fread(&e, sizeof(e), 1, f) == 1) entries.push_back(e);  // A torn last entry is dropped
+  fclose(f);
+  return true;
+}
+
+inline void fleetAddToSummary(FleetSummaryEntry& s, const FleetIndexEntry& e) {
+  if (s.chunks == 0 || e.firstMs < s.firstMs) s.firstMs = e.firstMs;
+  if (s.chunks == 0 || e.lastMs > s.lastMs) s.lastMs = e.lastMs;
+  s.chunks++;
+  s.rows += e.rows;
+  for (int i = 0; i < BIKE_EVENT_TYPES; i++) s.events[i] += e.events[i];
+}
+
+// Day totals by vehicle: summary.fsum, or index.fidx when there is no
+// complete summary
+inline bool fleetReadSummary(const std::string& dayDir, std::map<uint32_t, FleetSummaryEntry>& out) {
+  FILE* f = fopen((dayDir + "/summary.fsum").c_str(), "rb");
+  if (f != nullptr) {
+    FleetSummaryHeader h;
+    std::vector<FleetSummaryEntry> entries;
+    bool ok = fread(&h, sizeof(h), 1, f) == 1 && !memcmp(h.magic, "FSUM", 4) && h.version == FLEET_STORE_VERSION;
+    if (ok) {
+      entries.resize(h.vehicles);
+      ok = h.vehicles == 0 || fread(entries.data(), sizeof(FleetSummaryEntry), h.vehicles, f) == h.vehicles;
+    }
+    fclose(f);
+    if (ok) {
+      for (const FleetSummaryEntry& e : entries) out[e.vehicle] = e;
+      return true;
+    }
+  }
+
+  std::vector<FleetIndexEntry> index;
+  if (!fleetReadIndex(dayDir, index)) return false;
+  for (const FleetIndexEntry& e : index) {
+    FleetSummaryEntry& s = out[e.vehicle];
+    s.vehicle = e.vehicle;
+    fleetAddToSummary(s, e);
+  }
+  return true;
+}
+
+inline std::string fleetSegmentPath(const std::string& dayDir, uint32_t segment) {
+  char name[32];
+  snprintf(name, sizeof(name), "/seg-%06u.fcol", segment);
+  return dayDir + name;
+}
+
+inline uint64_t fleetAlign8(uint64_t n) { return (n + 7) & ~(uint64_t)7; }
+
+// Reads the rows of one index entry; the four column slices are read
+// directly, the rest of the chunk is not touched
+inline bool fleetReadRows(FILE* segment, const FleetIndexEntry& e, std::vector<uint32_t>& timeMs,
+                          std::vector<uint8_t>& type, std::vector<uint8_t>& a, std::vector<uint16_t>& b) {
+  uint64_t n = e.chunkRows;
+  uint64_t columns = e.chunkOffset + sizeof(FleetChunkHeader) + (uint64_t)e.chunkVehicles * sizeof(FleetChunkVehicle);
+  uint64_t at[4] = {columns + e.firstRow * 4ULL, 0, 0, 0};
+  at[1] = columns + fleetAlign8(n * 4) + e.firstRow;
+  at[2] = columns + fleetAlign8(n * 4) + fleetAlign8(n) + e.firstRow;
+  at[3] = columns + fleetAlign8(n * 4) + 2 * fleetAlign8(n) + e.firstRow * 2ULL;
+
+  timeMs.resize(e.rows);
+  type.resize(e.rows);
+  a.resize(e.rows);
+  b.resize(e.rows);
+  void* into[4] = {timeMs.data(), type.data(), a.data(), b.data()};
+  size_t width[4] = {4, 1, 1, 2};
+  for (int i = 0; i < 4; i++) {
+    if (fseeko(segment, (off_t)at[i], SEEK_SET) != 0) return false;
+    if (e.rows > 0 && fread(into[i], width[i], e.rows, segment) != e.rows) return false;
+  }
+  return true;
+}
+
+// ---------------- Writing ----------------
+// One day partition, written by one gateway run: a segment of its own, and
+// the index and summary shared with earlier runs.
+class FleetDayWriter {
+public:
+  FleetDayWriter(const std::string& root, int64_t day) : dir(root + "/" + fleetDayName(day)) {}
+  FleetDayWriter(const FleetDayWriter&) = delete;
+  FleetDayWriter& operator=(const FleetDayWriter&) = delete;
+  ~FleetDayWriter() { close(); }
+
+  bool open() {
+    mkdir(dir.c_str(), 0755);
+    segment = 1;
+    if (DIR* d = opendir(dir.c_str())) {
+      while (struct dirent* e = readdir(d)) {
+        unsigned n;
+        if (sscanf(e->d_name, "seg-%u.fcol", &n) == 1 && n >= segment) segment = n + 1;
+      }
+      closedir(d);
+    }
+    fleetReadSummary(dir, summary);
+    seg = fopen(fleetSegmentPath(dir, segment).c_str(), "wb");
+    index = fopen((dir + "/index.fidx").c_str(), "ab");
+    return seg != nullptr && index != nullptr;
+  }
+
+  void close() {
+    if (seg != nullptr) fclose(seg);
+    if (index != nullptr) fclose(index);
+    seg = index = nullptr;
+  }
+
+  // rows: this day's records, sorted by vehicle and time
+  bool append(const FleetRecord* rows, size_t count, int64_t day) {
+    if (count == 0) return true;
+    uint64_t midnightMs = (uint64_t)day * FLEET_DAY_MS;
+    std::vector<FleetChunkVehicle> vehicles;
+    std::vector<FleetIndexEntry> entries;
+    for (size_t i = 0; i < count; i++) {
+      uint32_t ms = (uint32_t)(rows[i].wallMs - midnightMs);
+      if (vehicles.empty() || vehicles.back().vehicle != rows[i].vehicle) {
+        vehicles.push_back(FleetChunkVehicle{rows[i].vehicle, (uint32_t)i, 0, 0});
+        FleetIndexEntry e = {};
+        e.vehicle = rows[i].vehicle;
+        e.segment = segment;
+        e.chunkOffset = offset;
+        e.firstRow = (uint32_t)i;
+        e.firstMs = ms;
+        entries.push_back(e);
+      }
+      vehicles.back().rows++;
+      FleetIndexEntry& e = entries.back();
+      e.rows++;
+      e.lastMs = ms;
+      if (rows[i].type == TELEMETRY_BIKE_EVENT && rows[i].a < BIKE_EVENT_TYPES && e.events[rows[i].a] < 0xffff) {
+        e.events[rows[i].a]++;
+      }
+    }
+
+    FleetChunkHeader h = {};
+    memcpy(h.magic, "FCHK", 4);
+    h.version = FLEET_STORE_VERSION;
+    h.rows = (uint32_t)count;
+    h.vehicles = (uint32_t)vehicles.size();
+    h.firstMs = (uint32_t)(rows[0].wallMs - midnightMs);
+    h.lastMs = h.firstMs;
+    for (const FleetIndexEntry& e : entries) h.lastMs = std::max(h.lastMs, e.lastMs);
+
+    std::vector<uint32_t> timeMs(count);
+    std::vector<uint8_t> type(count), a(count);
+    std::vector<uint16_t> b(count);
+    for (size_t i = 0; i < count; i++) {
+      timeMs[i] = (uint32_t)(rows[i].wallMs - midnightMs);
+      type[i] = rows[i].type;
+      a[i] = rows[i].a;
+      b[i] = rows[i].b;
+    }
+
+    write(&h, sizeof(h));
+    write(vehicles.data(), vehicles.size() * sizeof(FleetChunkVehicle));
+    writeColumn(timeMs.data(), count * 4);
+    writeColumn(type.data(), count);
+    writeColumn(a.data(), count);
+    writeColumn(b.data(), count * 2);
+    for (FleetIndexEntry& e : entries) {
+      e.chunkRows = h.rows;
+      e.chunkVehicles = h.vehicles;
+    }
+
+    // Data before index, index before summary: whatever a reader finds
+    // through the index is on disk
+    if (fflush(seg) != 0 || failed) return false;
+    if (fwrite(entries.data(), sizeof(FleetIndexEntry), entries.size(), index) != entries.size()) return false;
+    if (fflush(index) != 0) return false;
+    for (const FleetIndexEntry& e : entries) {
+      FleetSummaryEntry& s = summary[e.vehicle];
+      s.vehicle = e.vehicle;
+      fleetAddToSummary(s, e);
+    }
+    return writeSummary();
+  }
+
+  uint64_t bytesWritten() const { return offset; }
+
+private:
+  void write(const void* data, size_t length) {
+    if (length > 0 && fwrite(data, 1, length, seg) != length) failed = true;
+    offset += length;
+  }
+
+  void writeColumn(const void* data, size_t length) {
+    static const char zeros[8] = {};
+    write(data, length);
+    write(zeros, fleetAlign8(length) - length);
+  }
+
+  bool writeSummary() {
+    std::string path = dir + "/summary.fsum";
+    std::string tmp = path + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if (f == nullptr) return false;
+    FleetSummaryHeader h = {};
+    memcpy(h.magic, "FSUM", 4);
+    h.version = FLEET_STORE_VERSION;
+    h.vehicles = (uint32_t)summary.size();
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+    for (const auto& s : summary) ok = ok && fwrite(&s.second, sizeof(s.second), 1, f) == 1;
+    ok = fclose(f) == 0 && ok;
+    return ok && rename(tmp.c_str(), path.c_str()) == 0;
+  }
+
+  std::string dir;
+  uint32_t segment = 0;
+  FILE* seg = nullptr;
+  FILE* index = nullptr;
+  uint64_t offset = 0;
+  bool failed = false;
+  std::map<uint32_t, FleetSummaryEntry> summary;
+};
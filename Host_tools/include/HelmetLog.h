@@ -0,0 +1,217 @@
+#pragma once
+
+// Reading helmet serial captures (helmet_data_*.csv) on the host.
+//
+// The captures are raw serial logs: `##<section>` header lines, sensor lines
+//   helmetTouched: 1, fsrValue: 1157, buckled: 0
+// and whatever else the firmware printed (warnings, emoji, latency tables).
+// scanHelmetLog() finds the same rows as the regex in analyze_helmet.py:
+// a sensor line counts wherever the pattern appears in it, rows before the
+// first header are dropped, and a header line is never a data line. It works
+// on raw bytes, so undecodable UTF-8 is skipped just like errors="ignore".
+//
+// MappedFile maps a capture read-only (falls back to reading for pipes);
+// listCaptures() expands command line arguments into capture files.
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+struct HelmetRow {
+  uint32_t touched;
+  uint32_t fsr;
+  uint32_t buckled;
+};
+
+namespace helmet_log {
+
+inline bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\f' || c == '\v'; }
+inline bool isDigit(char c) { return (unsigned char)(c - '0') < 10; }
+
+// \s*(\d+) at p; values saturate at UINT32_MAX
+inline const char* number(const char* p, const char* end, uint32_t& out) {
+  while (p < end && isSpace(*p)) p++;
+  if (p == end || !isDigit(*p)) return nullptr;
+  uint64_t v = 0;
+  while (p < end && isDigit(*p)) {
+    v = v * 10 + (uint64_t)(*p++ - '0');
+    if (v > UINT32_MAX) v = UINT32_MAX;
+  }
+  out = (uint32_t)v;
+  return p;
+}
+
+inline const char* literal(const char* p, const char* end, const char* text, size_t length) {
+  while (p < end && isSpace(*p)) p++;
+  if ((size_t)(end - p) < length || memcmp(p, text, length) != 0) return nullptr;
+  return p + length;
+}
+
+// The fields after "helmetTouched:"
+inline bool rowAt(const char* p, const char* end, HelmetRow& row) {
+  if (!(p = number(p, end, row.touched))) return false;
+  if (p == end || *p++ != ',') return false;
+  if (!(p = literal(p, end, "fsrValue:", 9))) return false;
+  if (!(p = number(p, end, row.fsr))) return false;
+  if (p == end || *p++ != ',') return false;
+  if (!(p = literal(p, end, "buckled:", 8))) return false;
+  return number(p, end, row.buckled) != nullptr;
+}
+
+}  // namespace helmet_log
+
+// Calls visitor.section(name, length) for every header and
+// visitor.row(const HelmetRow&) for every sensor row inside a section.
+template <typename Visitor>
+void scanHelmetLog(const char* data, size_t size, Visitor& visitor) {
+  using namespace helmet_log;
+  static const char KEY[] = "helmetTouched:";
+  const size_t KEY_LENGTH = sizeof(KEY) - 1;
+
+  const char* p = data;
+  const char* end = data + size;
+  bool inSection = false;
+
+  while (p < end) {
+    // One line; \r\n, \n and a lone \r all end it, as in Python text mode
+    const char* eol = (const char*)memchr(p, '\n', end - p);
+    if (eol == nullptr) eol = end;
+    const char* cr = (const char*)memchr(p, '\r', eol - p);
+    const char* lineEnd = cr != nullptr ? cr : eol;
+    const char* next = cr != nullptr ? cr + 1 : eol + 1;
+
+    const char* s = p;
+    while (s < lineEnd && (isSpace(*s))) s++;
+    if (lineEnd - s >= 2 && s[0] == '#' && s[1] == '#') {
+      const char* name = s + 2;
+      const char* nameEnd = lineEnd;
+      while (name < nameEnd && isSpace(*name)) name++;
+      while (nameEnd > name && isSpace(nameEnd[-1])) nameEnd--;
+      visitor.section(name, (size_t)(nameEnd - name));
+      inSection = true;
+    } else if (inSection) {
+      const char* k = s;
+      while ((size_t)(lineEnd - k) >= KEY_LENGTH &&
+             (k = (const char*)memchr(k, 'h', lineEnd - k - KEY_LENGTH + 1)) != nullptr) {
+        HelmetRow row;
+        if (memcmp(k, KEY, KEY_LENGTH) == 0 && rowAt(k + KEY_LENGTH, lineEnd, row)) {
+          visitor.row(row);
+          break;
+        }
+        k++;
+      }
+    }
+    p = next;
+  }
+}
+
+class MappedFile {
+public:
+  MappedFile() {}
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  ~MappedFile() { close(); }
+
+  bool open(const char* path) {
+    close();
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+      void* m = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (m != MAP_FAILED) {
+        madvise(m, (size_t)st.st_size, MADV_SEQUENTIAL);
+        mapped = (const char*)m;
+        length = (size_t)st.st_size;
+        ::close(fd);
+        return true;
+      }
+    }
+    // Pipe, empty file or mmap failure: read it instead
+    char buf[65536];
+    ssize_t n;
+    while ((n = ::read(fd, buf, sizeof(buf))) > 0) copy.insert(copy.end(), buf, buf + n);
+    ::close(fd);
+    length = copy.size();
+    return n == 0;
+  }
+
+  void close() {
+    if (mapped != nullptr) munmap((void*)mapped, length);
+    mapped = nullptr;
+    copy.clear();
+    length = 0;
+  }
+
+  const char* data() const { return mapped != nullptr ? mapped : copy.data(); }
+  size_t size() const { return length; }
+
+private:
+  const char* mapped = nullptr;
+  std::vector<char> copy;
+  size_t length = 0;
+};
+
+// A file is taken as is, a directory stands for its *.csv files (sorted)
+inline bool listCaptures(const char* path, std::vector<std::string>& files) {
+  struct stat st;
+  if (stat(path, &st) != 0) return false;
+  if (!S_ISDIR(st.st_mode)) {
+    files.push_back(path);
+    return true;
+  }
+  DIR* dir = opendir(path);
+  if (dir == nullptr) return false;
+  std::vector<std::string> found;
+  while (struct dirent* e = readdir(dir)) {
+    std::string name = e->d_name;
+    if (name.size() > 4 && name.compare(name.size() - 4, 4, ".csv") == 0) found.push_back(std::string(path) + "/" + name);
+  }
+  closedir(dir);
+  std::sort(found.begin(), found.end());
+  files.insert(files.end(), found.begin(), found.end());
+  return true;
+}
+
+// Shortest text that reads back as the same double, formatted like Python's
+// repr() (1069.225, 100.0, 93.44262295081968), so CSVs match the pandas ones.
+inline std::string pythonRepr(double v) {
+  char buf[40];
+  int digits = 1;
+  for (; digits <= 17; digits++) {
+    snprintf(buf, sizeof(buf), "%.*e", digits - 1, v);
+    if (strtod(buf, nullptr) == v) break;
+  }
+  // buf = [-]d.ddde[+-]xx
+  std::string s(buf);
+  bool negative = s[0] == '-';
+  if (negative) s.erase(0, 1);
+  size_t e = s.find('e');
+  int exponent = atoi(s.c_str() + e + 1);
+  std::string mantissa = s.substr(0, 1) + (e > 2 ? s.substr(2, e - 2) : "");
+
+  std::string out;
+  if (exponent < -4 || exponent >= 16) {
+    out = mantissa.substr(0, 1);
+    if (mantissa.size() > 1) out += "." + mantissa.substr(1);
+    snprintf(buf, sizeof(buf), "e%c%02d", exponent < 0 ? '-' : '+', exponent < 0 ? -exponent : exponent);
+    out += buf;
+  } else if (exponent < 0) {
+    out = "0." + std::string(-exponent - 1, '0') + mantissa;
+  } else if ((size_t)exponent + 1 >= mantissa.size()) {
+    out = mantissa + std::string(exponent + 1 - mantissa.size(), '0') + ".0";
+  } else {
+    out = mantissa.substr(0, exponent + 1) + "." + mantissa.substr(exponent + 1);
+  }
+  return negative ? "-" + out : out;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+// Streaming per-section statistics for helmet captures.
+//
+// SectionStats takes one HelmetRow at a time and keeps everything
+// experimental_summary.csv needs (count, FSR sum/min/max, touched and
+// buckled counts) plus Welford mean/variance and an FSR histogram. Two of
+// them merge into the statistics of the concatenated rows, so threads can
+// work on separate files and combine their results at the end.
+//
+// The histogram has one bucket per 12-bit ADC value, which makes it an
+// exact quantile sketch for the FSR in fixed memory (values above 4095 are
+// counted as 4095). quantile() interpolates linearly between the order
+// statistics, like pandas' default.
+
+#include <HelmetLog.h>
+
+#include <math.h>
+#include <stdint.h>
+
+#include <vector>
+
+#define SECTION_STATS_MAX_FSR 4095
+
+class SectionStats {
+public:
+  SectionStats() : histogram(SECTION_STATS_MAX_FSR + 1, 0) {}
+
+  void add(const HelmetRow& r) {
+    n++;
+    fsrSum += r.fsr;
+    touchedSum += r.touched;
+    buckledSum += r.buckled;
+    if (r.fsr < fsrMin) fsrMin = r.fsr;
+    if (r.fsr > fsrMax) fsrMax = r.fsr;
+    double delta = r.fsr - welfordMean;
+    welfordMean += delta / n;
+    m2 += delta * (r.fsr - welfordMean);
+    histogram[r.fsr < SECTION_STATS_MAX_FSR ? r.fsr : SECTION_STATS_MAX_FSR]++;
+  }
+
+  // Chan et al. pairwise combination of the Welford terms
+  void merge(const SectionStats& o) {
+    if (o.n == 0) return;
+    if (n == 0) {
+      *this = o;
+      return;
+    }
+    uint64_t total = n + o.n;
+    double delta = o.welfordMean - welfordMean;
+    welfordMean += delta * o.n / total;
+    m2 += o.m2 + delta * delta * ((double)n * o.n / total);
+    n = total;
+    fsrSum += o.fsrSum;
+    touchedSum += o.touchedSum;
+    buckledSum += o.buckledSum;
+    if (o.fsrMin < fsrMin) fsrMin = o.fsrMin;
+    if (o.fsrMax > fsrMax) fsrMax = o.fsrMax;
+    for (size_t i = 0; i < histogram.size(); i++) histogram[i] += o.histogram[i];
+  }
+
+  uint64_t count() const { return n; }
+  uint32_t min() const { return fsrMin; }
+  uint32_t max() const { return fsrMax; }
+  // From the exact sums, so the summary matches pandas to the last digit
+  double mean() const { return (double)fsrSum / n; }
+  double touchedPercent() const { return (double)touchedSum / n * 100; }
+  double buckledPercent() const { return (double)buckledSum / n * 100; }
+  // Sample standard deviation (ddof=1, as pandas' std())
+  double stddev() const { return n > 1 ? sqrt(m2 / (n - 1)) : NAN; }
+
+  double quantile(double q) const {
+    if (n == 0) return NAN;
+    double position = q * (n - 1);
+    uint64_t below = (uint64_t)position;
+    double fraction = position - below;
+    double low = valueAt(below);
+    return fraction > 0 ? low + fraction * (valueAt(below + 1) - low) : low;
+  }
+
+private:
+  uint64_t n = 0;
+  uint64_t fsrSum = 0;
+  uint64_t touchedSum = 0;
+  uint64_t buckledSum = 0;
+  uint32_t fsrMin = UINT32_MAX;
+  uint32_t fsrMax = 0;
+  double welfordMean = 0;
+  double m2 = 0;
+  std::vector<uint64_t> histogram;
+
+  // k-th smallest FSR value (0-based)
+  double valueAt(uint64_t k) const {
+    uint64_t seen = 0;
+    for (size_t v = 0; v < histogram.size(); v++) {
+      seen += histogram[v];
+      if (seen > k) return (double)v;
+    }
+    return SECTION_STATS_MAX_FSR;
+  }
+};
@@ -0,0 +1,557 @@
+// Host microbenchmarks of the firmware hot paths.
+//
+//   bench_runner [--filter TEXT] [--reps N] [--min-ms MS] [--cpu N]
+//                [--json FILE] [--baseline FILE] [--tolerance PCT]
+//
+// Every benchmark runs the firmware's own code (the headers in ../lib) over
+// inputs prepared up front, so the loop measures the code and not the input
+// generator:
+//   frame/*   helmet status payloads: the binary HelmetStatusFrame next to
+//             the "true"/"warn" strings it replaced, both ways. decode_string
+//             is the bike's original notifyCallback, a String built a char
+//             at a time and compared; decode_legacy is the memcmp fallback
+//             decodeHelmetStatus() keeps for old helmets.
+//   safety/*  SafetyStateMachine::step() at the control task's 10 ms period.
+//   fsr/*     FsrFilter::update() on a 2 kHz worn/removed trace with dropouts.
+//   lcd/*     taskLcd()'s drawing into the canvas, and LcdShadow::update()
+//             into a PCF8574 encoder like the display task's, for a frame
+//             where the countdown changes (diff) and a full redraw (full).
+//
+// The iteration count is calibrated so one repetition takes --min-ms; the
+// ns per operation of --reps repetitions give median, min, max and the median
+// absolute deviation (MAD). Host numbers are not ESP32 numbers, but the ratio
+// between two versions of the same code carries over far better than a
+// printf of micros() around one call.
+//
+// --json writes the results, one benchmark per line. --baseline reads such a
+// file from another commit and prints the change; a benchmark whose median is
+// more than --tolerance percent slower, by more than 3 MADs of either run,
+// fails the run (exit code 1).
+
+#include <HelmetProtocol.h>
+#include <SafetyStateMachine.h>
+#include <FsrFilter.h>
+#include <LcdFrame.h>
+
+#include <sched.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+#define INPUT_COUNT 4096  // Prepared inputs per benchmark (power of two, indexed with & INPUT_MASK)
+#define INPUT_MASK (INPUT_COUNT - 1)
+#define LCD_BENCH_BATCH 120  // Biketest's LCD_I2C_BATCH
+
+// Keeps a result alive without costing more than a store
+template <class T>
+inline void keep(T& value) {
+  asm volatile("" : "+m"(value) : : "memory");
+}
+
+uint64_t checksum = 0;  // Everything a benchmark computes ends up here
+
+struct Benchmark {
+  const char* name;
+  void (*prepare)();
+  void (*run)(uint64_t iterations);
+};
+
+struct Result {
+  std::string name;
+  uint64_t iterations;
+  double medianNs;
+  double minNs;
+  double maxNs;
+  double madNs;
+};
+
+std::mt19937 rng(1);
+
+// ---------------- Status frames ----------------
+
+struct SensorSample {
+  HelmetState state;
+  bool touched;
+  bool buckled;
+  uint16_t fsr;
+};
+
+std::vector<SensorSample> samples;
+std::vector<std::string> stringPayloads;
+std::vector<std::vector<uint8_t>> binaryPayloads;
+
+void prepareFrames() {
+  static const char* const STRINGS[3] = {"warn", "warn_notbuckeld", "true"};
+  std::uniform_int_distribution<int> state(HELMET_REMOVED, HELMET_SECURE);
+  std::uniform_int_distribution<int> fsr(0, 4095);
+  samples.clear();
+  stringPayloads.clear();
+  binaryPayloads.clear();
+  for (int i = 0; i < INPUT_COUNT; i++) {
+    SensorSample s;
+    s.state = (HelmetState)state(rng);
+    s.touched = s.state != HELMET_REMOVED;
+    s.buckled = s.state == HELMET_SECURE;
+    s.fsr = (uint16_t)fsr(rng);
+    samples.push_back(s);
+    stringPayloads.push_back(STRINGS[s.state]);
+    HelmetStatusFrame frame;
+    encodeHelmetStatus(frame, s.state, s.touched, s.buckled, s.fsr, (uint16_t)i, (uint32_t)i * 1000);
+    const uint8_t* bytes = (const uint8_t*)&frame;
+    binaryPayloads.push_back(std::vector<uint8_t>(bytes, bytes + sizeof(frame)));
+  }
+}
+
+// Helmet side: what goes into txCharacteristic->setValue()
+void runEncodeBinary(uint64_t n) {
+  uint8_t out[sizeof(HelmetStatusFrame)];
+  for (uint64_t i = 0; i < n; i++) {
+    const SensorSample& s = samples[i & INPUT_MASK];
+    HelmetStatusFrame frame;
+    encodeHelmetStatus(frame, s.state, s.touched, s.buckled, s.fsr, (uint16_t)i, (uint32_t)i);
+    memcpy(out, &frame, sizeof(frame));
+    keep(out);
+    checksum += out[1];
+  }
+}
+
+// setValue(const char*) goes through a std::string
+void runEncodeString(uint64_t n) {
+  for (uint64_t i = 0; i < n; i++) {
+    const SensorSample& s = samples[i & INPUT_MASK];
+    std::string value(s.state == HELMET_SECURE ? "true" : s.touched ? "warn_notbuckeld" : "warn");
+    keep(value);
+    checksum += value.size();
+  }
+}
+
+void runDecodeString(uint64_t n) {
+  for (uint64_t i = 0; i < n; i++) {
+    const std::string& payload = stringPayloads[i & INPUT_MASK];
+    const uint8_t* data = (const uint8_t*)payload.data();
+    std::string msg = "";
+    for (size_t j = 0; j < payload.size(); j++) msg += (char)data[j];
+    bool secure, worn;
+    if (msg == "true") {
+      secure = true;
+      worn = true;
+    } else if (msg == "warn") {
+      secure = false;
+      worn = false;
+    } else if (msg == "warn_notbuckeld") {
+      secure = false;
+      worn = true;
+    } else {
+      secure = false;
+      worn = false;
+    }
+    checksum += secure + 2 * worn;
+  }
+}
+
+void runDecodeLegacy(uint64_t n) {
+  for (uint64_t i = 0; i < n; i++) {
+    const std::string& payload = stringPayloads[i & INPUT_MASK];
+    HelmetStatus status;
+    decodeHelmetStatus((const uint8_t*)payload.data(), payload.size(), status);
+    keep(status);
+    checksum += status.state;
+  }
+}
+
+void runDecodeBinary(uint64_t n) {
+  for (uint64_t i = 0; i < n; i++) {
+    const std::vector<uint8_t>& payload = binaryPayloads[i & INPUT_MASK];
+    HelmetStatus status;
+    decodeHelmetStatus(payload.data(), payload.size(), status);
+    keep(status);
+    checksum += status.state + status.fsrValue;
+  }
+}
+
+// ---------------- Safety step ----------------
+
+class BenchClock : public SafetyClock {
+public:
+  uint32_t now = 0;
+  uint32_t nowMs() override { return now; }
+};
+
+class BenchOutputs : public SafetyOutputs {
+public:
+  uint32_t writes = 0;
+  void setIgnition(bool on) override { writes += on; }
+  void setBuzzer(bool on) override { writes += on; }
+};
+
+BenchClock benchClock;
+BenchOutputs benchOutputs;
+SafetyStateMachine benchSafety(benchClock, benchOutputs);
+std::vector<SafetyInputs> safetyInputs;
+
+// A ride: inputs hold for a while (1 % of the steps change one of them),
+// so the warnings and the grace period all run to the end now and then
+void prepareSafety() {
+  std::uniform_real_distribution<double> unit(0, 1);
+  std::uniform_int_distribution<int> which(0, 4);
+  SafetyInputs in = {true, false, true, true, true};
+  safetyInputs.clear();
+  for (int i = 0; i < INPUT_COUNT; i++) {
+    if (unit(rng) < 0.01) {
+      switch (which(rng)) {
+        case 0: in.standUp = !in.standUp; break;
+        case 1: in.riding = !in.riding; break;
+        case 2: in.helmetSecure = !in.helmetSecure; break;
+        case 3: in.helmetWorn = !in.helmetWorn; break;
+        default: in.bleConnected = !in.bleConnected; break;
+      }
+    }
+    safetyInputs.push_back(in);
+  }
+  benchSafety.reset();
+}
+
+void runSafetyStep(uint64_t n) {
+  for (uint64_t i = 0; i < n; i++) {
+    benchClock.now += 10;
+    checksum += benchSafety.step(safetyInputs[i & INPUT_MASK]);
+  }
+}
+
+// ---------------- FSR filter ----------------
+
+FsrFilter benchFsr;
+std::vector<uint16_t> fsrTrace;
+
+// 2 kHz: worn (~120 counts) and removed (~15) for a second each, noise and
+// the odd 0 dropout of helmet_data_2
+void prepareFsr() {
+  std::normal_distribution<double> worn(120, 25);
+  std::normal_distribution<double> removed(15, 10);
+  std::uniform_real_distribution<double> unit(0, 1);
+  fsrTrace.clear();
+  for (int i = 0; i < INPUT_COUNT; i++) {
+    bool on = (i / 2000) % 2 == 0;
+    double v = on ? worn(rng) : removed(rng);
+    if (unit(rng) < 0.002) v = 0;
+    fsrTrace.push_back((uint16_t)std::min(4095.0, std::max(0.0, v)));
+  }
+  benchFsr.reset();
+}
+
+void runFsrUpdate(uint64_t n) {
+  for (uint64_t i = 0; i < n; i++) checksum += benchFsr.update(fsrTrace[i & INPUT_MASK]);
+  checksum += benchFsr.value();
+}
+
+// ---------------- LCD ----------------
+
+typedef LcdCanvas<16, 2> BenchScreen;
+
+// The display task's sink without the Wire calls
+class BenchLcdBus : public LcdSink {
+public:
+  uint64_t bytes = 0;
+
+  void setCursor(uint8_t col, uint8_t row) override { put(Pcf8574LcdEncoder::setCursorCommand(col, row), false); }
+
+  void write(const char* text, uint8_t length) override {
+    for (uint8_t i = 0; i < length; i++) put((uint8_t)text[i], true);
+  }
+
+  void setBacklight(bool on) override {
+    backlightOn = on;
+    if (used + 1 > LCD_BENCH_BATCH) flush();
+    batch[used++] = on ? PCF8574_LCD_BACKLIGHT : 0;
+  }
+
+  void flush() override {
+    keep(batch);
+    bytes += used + 1;
+    used = 0;
+  }
+
+private:
+  void put(uint8_t value, bool data) {
+    if (used + PCF8574_LCD_BYTES_PER_WRITE > LCD_BENCH_BATCH) flush();
+    used += Pcf8574LcdEncoder::encode(value, data, backlightOn, batch + used);
+  }
+
+  uint8_t batch[LCD_BENCH_BATCH];
+  uint8_t used = 0;
+  bool backlightOn = true;
+};
+
+struct LcdState {
+  bool standUp;
+  bool riding;
+  bool ignition;
+  bool warning;
+  long remaining;
+  bool helmetSecure;
+  char pillion;
+};
+
+std::vector<LcdState> lcdStates;
+std::vector<BenchScreen> lcdFrames;
+BenchLcdBus lcdBus;
+LcdShadow<16, 2> lcdShadow;
+
+// taskLcd()'s connected screen
+void drawStatus(BenchScreen& screen, const LcdState& s) {
+  screen.setCursor(0, 0);
+  screen.print("S:");
+  screen.print(s.standUp ? "UP " : "DN ");
+  screen.print(" R:");
+  screen.print(s.riding ? "ON " : "OFF");
+  screen.print(" I:");
+  screen.print(s.ignition ? "ON " : "OFF");
+  screen.setCursor(0, 1);
+  if (s.warning) {
+    screen.print("WARNING: ");
+    screen.print(s.remaining);
+    screen.print("s ");
+  } else {
+    char pillion[2] = {s.pillion, 0};
+    screen.print("H: ");
+    screen.print(s.helmetSecure ? "SECURE " : "WARN   ");
+    screen.print(" P:");
+    screen.print(pillion);
+    screen.print("   ");
+  }
+}
+
+// A 15 s warning counting down while riding, then a while of normal riding
+void prepareLcd() {
+  lcdStates.clear();
+  lcdFrames.clear();
+  BenchScreen screen;
+  screen.clear();
+  screen.backlight = true;
+  for (int i = 0; i < INPUT_COUNT; i++) {
+    int phase = i % 64;
+    LcdState s = {true, true, phase >= 16, phase < 16, 15 - phase, phase >= 16, phase % 8 ? 'S' : 'W'};
+    lcdStates.push_back(s);
+    drawStatus(screen, s);
+    lcdFrames.push_back(screen);
+  }
+  lcdShadow.invalidate();
+}
+
+void runLcdDraw(uint64_t n) {
+  BenchScreen screen;
+  screen.clear();
+  for (uint64_t i = 0; i < n; i++) {
+    drawStatus(screen, lcdStates[i & INPUT_MASK]);
+    keep(screen);
+  }
+  checksum += (uint8_t)screen.cells[1][0];
+}
+
+void runLcdUpdateDiff(uint64_t n) {
+  for (uint64_t i = 0; i < n; i++) checksum += lcdShadow.update(lcdFrames[i & INPUT_MASK], lcdBus);
+}
+
+void runLcdUpdateFull(uint64_t n) {
+  for (uint64_t i = 0; i < n; i++) {
+    lcdShadow.invalidate();
+    checksum += lcdShadow.update(lcdFrames[i & INPUT_MASK], lcdBus);
+  }
+}
+
+const Benchmark BENCHMARKS[] = {
+  {"frame/encode_binary", prepareFrames, runEncodeBinary},
+  {"frame/encode_string", prepareFrames, runEncodeString},
+  {"frame/decode_string", prepareFrames, runDecodeString},
+  {"frame/decode_legacy", prepareFrames, runDecodeLegacy},
+  {"frame/decode_binary", prepareFrames, runDecodeBinary},
+  {"safety/step", prepareSafety, runSafetyStep},
+  {"fsr/update", prepareFsr, runFsrUpdate},
+  {"lcd/draw", prepareLcd, runLcdDraw},
+  {"lcd/update_diff", prepareLcd, runLcdUpdateDiff},
+  {"lcd/update_full", prepareLcd, runLcdUpdateFull},
+};
+const int NUM_BENCHMARKS = sizeof(BENCHMARKS) / sizeof(BENCHMARKS[0]);
+
+// ---------------- Measurement ----------------
+
+double secondsFor(const Benchmark& b, uint64_t iterations) {
+  auto start = std::chrono::steady_clock::now();
+  b.run(iterations);
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+double median(std::vector<double> v) {
+  std::sort(v.begin(), v.end());
+  size_t m = v.size() / 2;
+  return v.size() % 2 ? v[m] : (v[m - 1] + v[m]) / 2;
+}
+
+Result measure(const Benchmark& b, int reps, double minMs) {
+  rng.seed(1);  // Same inputs on every run and every commit
+  b.prepare();
+  // Grow the count until a run is long enough to time, then scale it to --min-ms
+  uint64_t iterations = 1;
+  double sec = secondsFor(b, iterations);
+  while (sec < minMs / 1000 / 10 && iterations < (1ULL << 40)) {
+    iterations *= 4;
+    sec = secondsFor(b, iterations);
+  }
+  iterations = std::max<uint64_t>(1, (uint64_t)(iterations * (minMs / 1000) / std::max(sec, 1e-9)));
+  secondsFor(b, iterations);  // Warm-up at full length
+
+  std::vector<double> ns;
+  for (int r = 0; r < reps; r++) ns.push_back(secondsFor(b, iterations) * 1e9 / iterations);
+
+  Result res;
+  res.name = b.name;
+  res.iterations = iterations;
+  res.medianNs = median(ns);
+  res.minNs = *std::min_element(ns.begin(), ns.end());
+  res.maxNs = *std::max_element(ns.begin(), ns.end());
+  std::vector<double> deviation;
+  for (double x : ns) deviation.push_back(std::fabs(x - res.medianNs));
+  res.madNs = median(deviation);
+  return res;
+}
+
+bool writeJson(const char* path, const std::vector<Result>& results, int reps, double minMs) {
+  FILE* f = std::fopen(path, "w");
+  if (!f) return false;
+  std::fprintf(f, "{\n  \"compiler\": \"%s\",\n  \"reps\": %d,\n  \"min_ms\": %.1f,\n  \"benchmarks\": [\n",
+               __VERSION__, reps, minMs);
+  for (size_t i = 0; i < results.size(); i++) {
+    const Result& r = results[i];
+    std::fprintf(f,
+                 "    {\"name\": \"%s\", \"median_ns\": %.3f, \"min_ns\": %.3f, \"max_ns\": %.3f, "
+                 "\"mad_ns\": %.3f, \"iterations\": %llu}%s\n",
+                 r.name.c_str(), r.medianNs, r.minNs, r.maxNs, r.madNs, (unsigned long long)r.iterations,
+                 i + 1 < results.size() ? "," : "");
+  }
+  std::fprintf(f, "  ]\n}\n");
+  return std::fclose(f) == 0;
+}
+
+// Reads what writeJson() wrote: one benchmark per line
+bool readJson(const char* path, std::vector<Result>& results) {
+  FILE* f = std::fopen(path, "r");
+  if (!f) return false;
+  char line[512];
+  while (std::fgets(line, sizeof(line), f)) {
+    const char* name = std::strstr(line, "\"name\": \"");
+    const char* medianAt = std::strstr(line, "\"median_ns\": ");
+    const char* madAt = std::strstr(line, "\"mad_ns\": ");
+    if (!name || !medianAt || !madAt) continue;
+    name += std::strlen("\"name\": \"");
+    const char* end = std::strchr(name, '"');
+    if (!end) continue;
+    Result r = Result();
+    r.name.assign(name, end - name);
+    r.medianNs = std::atof(medianAt + std::strlen("\"median_ns\": "));
+    r.madNs = std::atof(madAt + std::strlen("\"mad_ns\": "));
+    results.push_back(r);
+  }
+  std::fclose(f);
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const char* filter = nullptr;
+  const char* jsonPath = nullptr;
+  const char* baselinePath = nullptr;
+  int reps = 15;
+  double minMs = 50;
+  double tolerance = 5;
+  int cpu = -1;
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!std::strcmp(argv[i], "--filter") && hasValue) {
+      filter = argv[++i];
+    } else if (!std::strcmp(argv[i], "--reps") && hasValue) {
+      reps = std::atoi(argv[++i]);
+    } else if (!std::strcmp(argv[i], "--min-ms") && hasValue) {
+      minMs = std::atof(argv[++i]);
+    } else if (!std::strcmp(argv[i], "--cpu") && hasValue) {
+      cpu = std::atoi(argv[++i]);
+    } else if (!std::strcmp(argv[i], "--json") && hasValue) {
+      jsonPath = argv[++i];
+    } else if (!std::strcmp(argv[i], "--baseline") && hasValue) {
+      baselinePath = argv[++i];
+    } else if (!std::strcmp(argv[i], "--tolerance") && hasValue) {
+      tolerance = std::atof(argv[++i]);
+    } else {
+      std::fprintf(stderr,
+                   "usage: %s [--filter TEXT] [--reps N] [--min-ms MS] [--cpu N]\n"
+                   "          [--json FILE] [--baseline FILE] [--tolerance PCT]\n",
+                   argv[0]);
+      return 2;
+    }
+  }
+  if (reps < 1 || minMs <= 0) {
+    std::fprintf(stderr, "--reps and --min-ms must be positive\n");
+    return 2;
+  }
+
+  // One core for the whole run: no migrations between repetitions
+  if (cpu >= 0) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) std::fprintf(stderr, "could not pin to CPU %d\n", cpu);
+  }
+
+  std::vector<Result> baseline;
+  if (baselinePath && !readJson(baselinePath, baseline)) {
+    std::fprintf(stderr, "cannot read %s\n", baselinePath);
+    return 2;
+  }
+
+  std::vector<Result> results;
+  std::printf("%-22s %12s %10s %10s %8s %14s\n", "benchmark", "median ns", "min", "max", "MAD %", "iterations");
+  for (int i = 0; i < NUM_BENCHMARKS; i++) {
+    if (filter && !std::strstr(BENCHMARKS[i].name, filter)) continue;
+    Result r = measure(BENCHMARKS[i], reps, minMs);
+    std::printf("%-22s %12.2f %10.2f %10.2f %8.2f %14llu\n", r.name.c_str(), r.medianNs, r.minNs, r.maxNs,
+                r.medianNs > 0 ? 100 * r.madNs / r.medianNs : 0.0, (unsigned long long)r.iterations);
+    results.push_back(r);
+  }
+  std::printf("(checksum %llu)\n", (unsigned long long)checksum);
+
+  if (jsonPath && !writeJson(jsonPath, results, reps, minMs)) {
+    std::fprintf(stderr, "cannot write %s\n", jsonPath);
+    return 2;
+  }
+  if (!baselinePath) return 0;
+
+  int regressions = 0;
+  std::printf("\n%-22s %12s %12s %9s\n", "vs. baseline", "before ns", "now ns", "change");
+  for (const Result& now : results) {
+    const Result* before = nullptr;
+    for (const Result& b : baseline) {
+      if (b.name == now.name) before = &b;
+    }
+    if (!before) {
+      std::printf("%-22s %12s %12.2f %9s\n", now.name.c_str(), "-", now.medianNs, "new");
+      continue;
+    }
+    double change = before->medianNs > 0 ? 100 * (now.medianNs / before->medianNs - 1) : 0;
+    double noise = 3 * std::max(now.madNs, before->madNs);
+    bool slower = change > tolerance && now.medianNs - before->medianNs > noise;
+    if (slower) regressions++;
+    std::printf("%-22s %12.2f %12.2f %+8.1f%%%s\n", now.name.c_str(), before->medianNs, now.medianNs, change,
+                slower ? "  SLOWER" : "");
+  }
+  std::printf("%d regression(s) beyond %.1f %%\n", regressions, tolerance);
+  return regressions == 0 ? 0 : 1;
+}
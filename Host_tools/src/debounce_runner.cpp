@@ -0,0 +1,224 @@
+// Host runner for EdgeDebouncer on synthetic bouncy switch traces.
+//
+//   debounce_runner [--transitions N] [--seed S] [--settle-us US]
+//                   [--max-bounces N] [--glitch-rate P] [--tick-us US]
+//                   [--fast-level 0|1]
+//
+// Generates a random input: real level changes, each followed by up to
+// --max-bounces contact bounces (gaps shorter than the settle time), and
+// isolated glitch pulses with probability --glitch-rate per quiet period
+// (quiet periods are at least two settle times and one tick long).
+// The edges are fed to the debouncer the way the helmet firmware does it:
+// every edge is handled when it happens (ISR + queue, poll() then edge()),
+// and otherwise poll() runs at the debouncer's deadline rounded up to the
+// next RTOS tick.
+//
+// Checked for every run: each real change is reported once, with the right
+// level and the timestamp of its first edge, no later than its last bounce
+// + settle time + one tick (changes to --fast-level: at the first edge
+// itself); the debounced level is right whenever the input has been quiet;
+// and no glitch is reported (with --fast-level, glitches towards that level
+// are, as a change there and back). Exits with 1 on any violation.
+
+#include <EdgeDebouncer.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+
+struct RawEdge {
+  uint64_t timeUs;
+  bool level;
+  bool starts;  // First edge after a quiet period
+};
+
+struct Report {
+  uint64_t timeUs;
+  uint32_t stampUs;
+  bool level;
+};
+
+struct Change {
+  uint64_t firstEdgeUs;
+  uint64_t lastEdgeUs;  // Last bounce
+  bool level;
+};
+
+struct Options {
+  uint32_t transitions = 100000;
+  unsigned seed = 1;
+  uint32_t settleUs = 2000;
+  uint32_t maxBounces = 8;
+  double glitchRate = 0.2;
+  uint32_t tickUs = 1000;
+  int fastLevel = EDGE_NO_FAST_LEVEL;
+};
+
+uint64_t violationCount = 0;
+
+void violation(const char* what, uint64_t timeUs) {
+  if (violationCount < 5) std::printf("VIOLATION at %llu us: %s\n", (unsigned long long)timeUs, what);
+  violationCount++;
+}
+
+// Raw edges plus the changes a perfect debouncer would report
+void generate(const Options& o, std::mt19937& rng, std::vector<RawEdge>& edges, std::vector<Change>& changes) {
+  std::uniform_int_distribution<uint32_t> quiet(o.settleUs * 2 + o.tickUs, o.settleUs * 50 + o.tickUs);
+  std::uniform_int_distribution<uint32_t> bounces(0, o.maxBounces);
+  std::uniform_int_distribution<uint32_t> bounceGap(5, o.settleUs - 1);
+  std::uniform_int_distribution<uint32_t> glitchWidth(1, o.settleUs - 1);
+  std::uniform_real_distribution<double> unit(0, 1);
+
+  uint64_t t = o.settleUs;
+  bool level = false;
+  for (uint32_t i = 0; i < o.transitions; i++) {
+    t += quiet(rng);
+    if (unit(rng) < o.glitchRate) {
+      // Short pulse (with its own bounces) that ends at the current level
+      edges.push_back(RawEdge{t, !level, true});
+      uint32_t n = bounces(rng) / 2;
+      for (uint32_t b = 0; b < n; b++) {
+        t += bounceGap(rng) / 4 + 1;
+        edges.push_back(RawEdge{t, level, false});
+        t += bounceGap(rng) / 4 + 1;
+        edges.push_back(RawEdge{t, !level, false});
+      }
+      t += glitchWidth(rng);
+      edges.push_back(RawEdge{t, level, false});
+      t += quiet(rng);
+    }
+
+    level = !level;
+    Change c;
+    c.firstEdgeUs = t;
+    c.level = level;
+    edges.push_back(RawEdge{t, level, true});
+    uint32_t n = bounces(rng);
+    for (uint32_t b = 0; b < n; b++) {
+      t += bounceGap(rng);
+      edges.push_back(RawEdge{t, !level, false});
+      t += bounceGap(rng);
+      edges.push_back(RawEdge{t, level, false});
+    }
+    c.lastEdgeUs = t;
+    changes.push_back(c);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options o;
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!std::strcmp(argv[i], "--transitions") && hasValue) {
+      o.transitions = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+    } else if (!std::strcmp(argv[i], "--seed") && hasValue) {
+      o.seed = (unsigned)std::strtoul(argv[++i], nullptr, 10);
+    } else if (!std::strcmp(argv[i], "--settle-us") && hasValue) {
+      o.settleUs = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+    } else if (!std::strcmp(argv[i], "--max-bounces") && hasValue) {
+      o.maxBounces = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+    } else if (!std::strcmp(argv[i], "--glitch-rate") && hasValue) {
+      o.glitchRate = std::atof(argv[++i]);
+    } else if (!std::strcmp(argv[i], "--tick-us") && hasValue) {
+      o.tickUs = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+    } else if (!std::strcmp(argv[i], "--fast-level") && hasValue) {
+      o.fastLevel = std::atoi(argv[++i]) ? 1 : 0;
+    } else {
+      std::fprintf(stderr,
+                   "usage: %s [--transitions N] [--seed S] [--settle-us US]\n"
+                   "          [--max-bounces N] [--glitch-rate P] [--tick-us US]\n"
+                   "          [--fast-level 0|1]\n",
+                   argv[0]);
+      return 2;
+    }
+  }
+  if (o.settleUs < 8 || o.tickUs == 0) {
+    std::fprintf(stderr, "--settle-us must be at least 8 and --tick-us positive\n");
+    return 2;
+  }
+
+  std::mt19937 rng(o.seed);
+  std::vector<RawEdge> edges;
+  std::vector<Change> changes;
+  generate(o, rng, edges, changes);
+
+  // Replay: edges as they come, poll() at the next tick after the deadline.
+  // Timestamps go through uint32_t like micros() and wrap every ~71 minutes.
+  EdgeDebouncer d(o.settleUs, (int8_t)o.fastLevel);
+  d.reset(false, 0);
+  std::vector<Report> reports;
+
+  auto pollAt = [&](uint64_t nowUs) {
+    if (d.poll((uint32_t)nowUs)) reports.push_back(Report{nowUs, d.changedAtUs(), d.level()});
+  };
+
+  for (size_t i = 0; i < edges.size(); i++) {
+    // Polls due before this edge
+    while (d.pending()) {
+      int32_t ahead = (int32_t)(d.deadlineUs() - (uint32_t)edges[i].timeUs);
+      if (ahead >= 0) break;
+      uint64_t deadline = edges[i].timeUs + ahead;
+      uint64_t tick = (deadline + o.tickUs - 1) / o.tickUs * o.tickUs;
+      if (tick >= edges[i].timeUs) break;
+      pollAt(tick);
+    }
+    if (edges[i].starts && d.level() == edges[i].level) violation("wrong level after a quiet period", edges[i].timeUs);
+    // As the firmware: poll, edge, and poll again once the queue is drained
+    pollAt(edges[i].timeUs);
+    d.edge(edges[i].level, (uint32_t)edges[i].timeUs);
+    pollAt(edges[i].timeUs);
+  }
+  uint64_t endUs = edges.empty() ? 0 : edges.back().timeUs;
+  while (d.pending()) {
+    endUs += o.tickUs;
+    pollAt(endUs);
+  }
+
+  // Match the reports against the real changes
+  size_t r = 0;
+  uint64_t extra = 0;
+  uint64_t latencySum = 0;
+  uint64_t latencyMax = 0;
+  uint64_t afterBounceMax = 0;
+  for (const Change& c : changes) {
+    while (r < reports.size() && reports[r].stampUs != (uint32_t)c.firstEdgeUs) {
+      if (o.fastLevel == EDGE_NO_FAST_LEVEL) violation("change reported that never happened", reports[r].timeUs);
+      extra++;
+      r++;
+    }
+    if (r == reports.size()) {
+      violation("change missed", c.firstEdgeUs);
+      break;
+    }
+    const Report& rep = reports[r++];
+    if (rep.level != c.level) violation("wrong level", rep.timeUs);
+    if ((int)c.level == o.fastLevel) {
+      if (rep.timeUs != c.firstEdgeUs) violation("change to the fast level delayed", rep.timeUs);
+    } else if (rep.timeUs > c.lastEdgeUs + o.settleUs + o.tickUs) {
+      violation("reported too late", rep.timeUs);
+    }
+    uint64_t latency = rep.timeUs - c.firstEdgeUs;
+    latencySum += latency;
+    if (latency > latencyMax) latencyMax = latency;
+    if (rep.timeUs > c.lastEdgeUs && rep.timeUs - c.lastEdgeUs > afterBounceMax) {
+      afterBounceMax = rep.timeUs - c.lastEdgeUs;
+    }
+  }
+  extra += reports.size() - r;
+  if (extra % 2 != 0) violation("glitch reported without its way back", endUs);
+
+  std::printf("%llu edges, %u changes reported (%llu real, %llu from glitches), %u glitches rejected\n",
+              (unsigned long long)edges.size(), d.changes(), (unsigned long long)changes.size(),
+              (unsigned long long)extra, d.glitches());
+  std::printf("first edge -> reported: mean %.2f ms, max %.2f ms; last bounce -> reported max %.2f ms\n",
+              changes.empty() ? 0.0 : latencySum / 1000.0 / changes.size(), latencyMax / 1000.0,
+              afterBounceMax / 1000.0);
+  std::printf("%llu violations\n", (unsigned long long)violationCount);
+  return violationCount == 0 ? 0 : 1;
+}
@@ -0,0 +1,713 @@
+// Fleet gateway: collects the status telemetry of many bike units
+// (BikeStatus.h records in TelemetryLog blocks) into one FleetStore.
+//
+//   fleet_gateway serve STORE [--udp PORT] [--serial PATH=VEHICLE]... [--flush-s S] [--start UNIX_S]
+//   fleet_gateway load [--to HOST:PORT] [--vehicles N] [--hz HZ] [--seconds S] [--batch N] [--seed N]
+//   fleet_gateway query STORE [--from DAY] [--to DAY] [--vehicle ID] [--rows]
+//
+// serve takes UDP datagrams from any number of bikes, each one
+//   FleetDatagramHeader  'F' 'G' version=1 0 u32 vehicle
+//   TelemetryLog blocks  as the bike writes them to its serial port
+// (the bike has no network of its own: whatever forwards its serial port
+// puts the header in front), and raw serial streams: a capture, a FIFO or a
+// tty, each given with the vehicle it belongs to. Text between the blocks is
+// skipped, as in env:telemetry. Records are put on the gateway's clock (the
+// bike's micros() is anchored to the arrival time, and re-anchored after a
+// reboot or a deep sleep; --start replays captures as if they began at
+// UNIX_S) and written to STORE every --flush-s seconds. With serial sources
+// only, serve stops at their end; otherwise at SIGINT / SIGTERM.
+// Every flush prints a line of statistics to stderr.
+//
+// load stands in for a fleet: N bikes, each running SafetyStateMachine on
+// made-up rides (some with the helmet unbuckled on the way) at HZ, sending a
+// datagram every --batch records, spread evenly over time.
+//
+// query prints CSV. Without --rows, one line per vehicle and day from the
+// day summaries only:
+//   day,vehicle,violations,ignition_cuts,warn60,grace_cuts,ble_offs,records,first,last
+// (violations: bikeViolation(), ignition_cuts: the 15 s warning ran out).
+// --rows --vehicle ID prints that vehicle's records, found through the day
+// indexes. What was read goes to stderr.
+
+#include <BikeStatus.h>
+#include <FleetStore.h>
+#include <SafetyStateMachine.h>
+#include <TelemetryLog.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+#define DATAGRAM_VERSION 1
+#define DATAGRAM_MAX_BYTES 1472      // One Ethernet frame
+#define CLOCK_SLACK_US 2000000ULL    // Arrival vs. anchored device time before re-anchoring
+#define REORDER_US 1000000           // A record this far behind the newest is late, not a restart
+#define RECV_BATCH 64
+
+struct __attribute__((packed)) FleetDatagramHeader {
+  uint8_t magic[2];  // 'F' 'G'
+  uint8_t version;
+  uint8_t reserved;
+  uint32_t vehicle;
+};
+
+static_assert(sizeof(FleetDatagramHeader) == 8, "FleetDatagramHeader must stay 8 bytes");
+
+uint64_t wallClockUs() {
+  return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+// ---------------- Decoding ----------------
+struct IngestStats {
+  std::atomic<uint64_t> datagrams{0};
+  std::atomic<uint64_t> badDatagrams{0};
+  std::atomic<uint64_t> blocks{0};
+  std::atomic<uint64_t> crcErrors{0};
+  std::atomic<uint64_t> missingBlocks{0};  // Sequence gaps: lost on the way
+  std::atomic<uint64_t> dropped{0};        // Reported by the bikes (ring full)
+  std::atomic<uint64_t> records{0};
+  std::atomic<uint64_t> reanchors{0};
+};
+
+IngestStats stats;
+
+// Block sequence and clock of one bike
+class VehicleStream {
+public:
+  explicit VehicleStream(uint32_t vehicle) : vehicle(vehicle) {}
+
+  // arrivedUs = 0: replaying, the first record is put at startUs and the
+  // device clock is followed from there
+  void block(const TelemetryBlockHeader& header, const uint8_t* records, uint64_t arrivedUs, uint64_t startUs,
+             std::vector<FleetRecord>& out) {
+    if (haveSequence) stats.missingBlocks += (uint16_t)(header.sequence - lastSequence - 1);
+    haveSequence = true;
+    lastSequence = header.sequence;
+    stats.blocks++;
+    stats.dropped += header.dropped;
+    if (header.count == 0) return;
+
+    size_t first = out.size();
+    for (uint8_t i = 0; i < header.count; i++) {
+      TelemetryRecord r;
+      memcpy(&r, records + i * sizeof(TelemetryRecord), sizeof(r));
+      // Device time only moves forward: micros() wraps every ~71 minutes,
+      // and a reboot or a deep sleep starts it over (that time is lost).
+      // Streamed helmet samples are logged at their sample time, up to
+      // REORDER_US behind the bike's own records: they go back to that time.
+      int64_t behindUs = 0;
+      if (!started) {
+        started = true;
+        anchorUs = arrivedUs != 0 ? arrivedUs : startUs;
+        lastRawUs = r.timeUs;
+      } else {
+        int32_t delta = (int32_t)(r.timeUs - lastRawUs);
+        if (delta > 0) {
+          deviceUs += (uint32_t)delta;
+          lastRawUs = r.timeUs;
+        } else if (delta >= -REORDER_US && (uint64_t)-delta <= deviceUs) {
+          behindUs = -delta;
+        } else {
+          lastRawUs = r.timeUs;
+        }
+      }
+      out.push_back(FleetRecord{(anchorUs + deviceUs - behindUs) / 1000, vehicle, r.type, r.a, r.b});
+    }
+    stats.records += header.count;
+
+    // The newest record was logged just before the block left the bike
+    if (arrivedUs == 0) return;
+    uint64_t lastUs = anchorUs + deviceUs;
+    if (lastUs > arrivedUs + CLOCK_SLACK_US || lastUs + CLOCK_SLACK_US < arrivedUs) {
+      int64_t shiftMs = ((int64_t)arrivedUs - (int64_t)lastUs) / 1000;
+      anchorUs += arrivedUs - lastUs;
+      for (size_t i = first; i < out.size(); i++) out[i].wallMs += shiftMs;
+      stats.reanchors++;
+    }
+  }
+
+private:
+  uint32_t vehicle;
+  bool haveSequence = false;
+  uint16_t lastSequence = 0;
+  bool started = false;
+  uint32_t lastRawUs = 0;
+  uint64_t deviceUs = 0;   // Unwrapped device time since the first record
+  uint64_t anchorUs = 0;   // Wall clock of deviceUs 0
+};
+
+// Every valid block in data[0, size); returns the bytes used. Stops at a
+// block that is not complete yet unless `final`.
+size_t scanBlocks(const uint8_t* data, size_t size, bool final, VehicleStream& stream, uint64_t arrivedUs,
+                  uint64_t startUs, std::vector<FleetRecord>& out) {
+  size_t i = 0;
+  while (i < size) {
+    TelemetryBlockHeader header;
+    size_t length;
+    switch (telemetryBlockAt(data + i, size - i, header, length)) {
+      case TELEMETRY_BLOCK:
+        stream.block(header, data + i + sizeof(header), arrivedUs, startUs, out);
+        i += length;
+        break;
+      case TELEMETRY_PARTIAL:
+        if (!final) return i;
+        i++;
+        break;
+      case TELEMETRY_BAD_CRC:
+        stats.crcErrors++;
+        i++;
+        break;
+      default: {
+        // Text: skip to the next possible block start
+        const void* next = memchr(data + i + 1, TELEMETRY_MAGIC0, size - i - 1);
+        i = next != nullptr ? (const uint8_t*)next - data : size;
+        break;
+      }
+    }
+  }
+  return i;
+}
+
+// Records from all sources, swapped out by the flusher
+class Pending {
+public:
+  void add(std::vector<FleetRecord>& records) {
+    if (records.empty()) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (queue.empty()) {
+      queue.swap(records);
+    } else {
+      queue.insert(queue.end(), records.begin(), records.end());
+      records.clear();
+    }
+  }
+
+  void take(std::vector<FleetRecord>& into) {
+    into.clear();
+    std::lock_guard<std::mutex> lock(mutex);
+    into.swap(queue);
+  }
+
+private:
+  std::mutex mutex;
+  std::vector<FleetRecord> queue;
+};
+
+// ---------------- Sources ----------------
+std::atomic<bool> stopping(false);
+
+void onSignal(int) { stopping = true; }
+
+void udpSource(int fd, Pending& pending) {
+  std::unordered_map<uint32_t, std::unique_ptr<VehicleStream>> streams;
+  std::vector<FleetRecord> records;
+  static uint8_t buffers[RECV_BATCH][DATAGRAM_MAX_BYTES + 1];
+  mmsghdr messages[RECV_BATCH];
+  iovec vectors[RECV_BATCH];
+  uint64_t lastHandOffUs = 0;
+
+  while (!stopping) {
+    for (int i = 0; i < RECV_BATCH; i++) {
+      vectors[i].iov_base = buffers[i];
+      vectors[i].iov_len = sizeof(buffers[i]);
+      memset(&messages[i].msg_hdr, 0, sizeof(messages[i].msg_hdr));
+      messages[i].msg_hdr.msg_iov = &vectors[i];
+      messages[i].msg_hdr.msg_iovlen = 1;
+    }
+    int n = recvmmsg(fd, messages, RECV_BATCH, MSG_WAITFORONE, nullptr);
+    uint64_t nowUs = wallClockUs();
+    for (int m = 0; m < n; m++) {
+      const uint8_t* p = buffers[m];
+      size_t size = messages[m].msg_len;
+      stats.datagrams++;
+      FleetDatagramHeader header;
+      if (size < sizeof(header) || size > DATAGRAM_MAX_BYTES) {
+        stats.badDatagrams++;
+        continue;
+      }
+      memcpy(&header, p, sizeof(header));
+      if (header.magic[0] != 'F' || header.magic[1] != 'G' || header.version != DATAGRAM_VERSION) {
+        stats.badDatagrams++;
+        continue;
+      }
+      std::unique_ptr<VehicleStream>& stream = streams[header.vehicle];
+      if (!stream) stream.reset(new VehicleStream(header.vehicle));
+      scanBlocks(p + sizeof(header), size - sizeof(header), true, *stream, nowUs, 0, records);
+    }
+    // Hand over in batches, so the lock is not taken per datagram
+    if (records.size() >= 4096 || nowUs - lastHandOffUs > 100000) {
+      pending.add(records);
+      lastHandOffUs = nowUs;
+    }
+  }
+  pending.add(records);
+}
+
+struct SerialSource {
+  std::string path;
+  uint32_t vehicle;
+};
+
+void serialSource(const SerialSource& source, uint64_t startUs, Pending& pending) {
+  FILE* f = std::fopen(source.path.c_str(), "rb");
+  if (f == nullptr) {
+    std::fprintf(stderr, "cannot read %s\n", source.path.c_str());
+    return;
+  }
+  VehicleStream stream(source.vehicle);
+  std::vector<uint8_t> buffer;
+  std::vector<FleetRecord> records;
+  uint8_t chunk[65536];
+  size_t n;
+  while (!stopping && (n = std::fread(chunk, 1, sizeof(chunk), f)) > 0) {
+    buffer.insert(buffer.end(), chunk, chunk + n);
+    size_t used = scanBlocks(buffer.data(), buffer.size(), false, stream, startUs != 0 ? 0 : wallClockUs(),
+                             startUs, records);
+    buffer.erase(buffer.begin(), buffer.begin() + used);
+    pending.add(records);
+  }
+  scanBlocks(buffer.data(), buffer.size(), true, stream, startUs != 0 ? 0 : wallClockUs(), startUs, records);
+  pending.add(records);
+  std::fclose(f);
+}
+
+// ---------------- Store ----------------
+class FleetStoreWriter {
+public:
+  explicit FleetStoreWriter(const std::string& root) : root(root) {}
+
+  // Sorts `records` and appends one chunk per day they fall on
+  bool write(std::vector<FleetRecord>& records) {
+    std::sort(records.begin(), records.end(), [](const FleetRecord& x, const FleetRecord& y) {
+      int64_t dx = fleetDayOf(x.wallMs), dy = fleetDayOf(y.wallMs);
+      if (dx != dy) return dx < dy;
+      if (x.vehicle != y.vehicle) return x.vehicle < y.vehicle;
+      return x.wallMs < y.wallMs;
+    });
+    size_t i = 0;
+    while (i < records.size()) {
+      int64_t day = fleetDayOf(records[i].wallMs);
+      size_t end = i;
+      while (end < records.size() && fleetDayOf(records[end].wallMs) == day) end++;
+      FleetDayWriter* w = writer(day);
+      if (w == nullptr || !w->append(&records[i], end - i, day)) {
+        std::fprintf(stderr, "cannot write %s/%s\n", root.c_str(), fleetDayName(day).c_str());
+        return false;
+      }
+      i = end;
+    }
+    // Late records for a day are rare after two days: close those
+    while (!days.empty() && days.begin()->first + 2 < days.rbegin()->first) {
+      closedBytes += days.begin()->second->bytesWritten();
+      days.erase(days.begin());
+    }
+    return true;
+  }
+
+  uint64_t bytesWritten() const {
+    uint64_t total = closedBytes;
+    for (const auto& d : days) total += d.second->bytesWritten();
+    return total;
+  }
+
+private:
+  FleetDayWriter* writer(int64_t day) {
+    auto it = days.find(day);
+    if (it != days.end()) return it->second.get();
+    std::unique_ptr<FleetDayWriter> w(new FleetDayWriter(root, day));
+    if (!w->open()) return nullptr;
+    return (days[day] = std::move(w)).get();
+  }
+
+  std::string root;
+  std::map<int64_t, std::unique_ptr<FleetDayWriter>> days;
+  uint64_t closedBytes = 0;
+};
+
+int serve(int argc, char** argv) {
+  if (argc < 1 || argv[0][0] == '-') return 2;
+  std::string root = argv[0];
+  int udpPort = 0;
+  std::vector<SerialSource> serials;
+  double flushSec = 30;
+  uint64_t startUs = 0;
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!std::strcmp(argv[i], "--udp") && hasValue) {
+      udpPort = std::atoi(argv[++i]);
+    } else if (!std::strcmp(argv[i], "--serial") && hasValue) {
+      const char* spec = argv[++i];
+      const char* eq = std::strrchr(spec, '=');
+      if (eq == nullptr) return 2;
+      serials.push_back(SerialSource{std::string(spec, eq - spec), (uint32_t)std::strtoul(eq + 1, nullptr, 0)});
+    } else if (!std::strcmp(argv[i], "--flush-s") && hasValue) {
+      flushSec = std::atof(argv[++i]);
+    } else if (!std::strcmp(argv[i], "--start") && hasValue) {
+      startUs = std::strtoull(argv[++i], nullptr, 10) * 1000000ULL;
+    } else {
+      return 2;
+    }
+  }
+  if (udpPort == 0 && serials.empty()) return 2;
+  mkdir(root.c_str(), 0755);
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+  Pending pending;
+  std::vector<std::thread> threads;
+
+  int fd = -1;
+  if (udpPort != 0) {
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int bufferBytes = 16 << 20;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &bufferBytes, sizeof(bufferBytes));
+    timeval timeout = {0, 200000};  // So the thread sees `stopping`
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons((uint16_t)udpPort);
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (fd < 0 || bind(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+      std::fprintf(stderr, "cannot listen on UDP port %d\n", udpPort);
+      return 1;
+    }
+    threads.push_back(std::thread(udpSource, fd, std::ref(pending)));
+  }
+  std::atomic<size_t> serialsDone(0);
+  for (const SerialSource& s : serials) {
+    threads.push_back(std::thread([&, s]() {
+      serialSource(s, startUs, pending);
+      serialsDone++;
+    }));
+  }
+
+  FleetStoreWriter store(root);
+  std::vector<FleetRecord> batch;
+  auto last = std::chrono::steady_clock::now();
+  uint64_t lastRecords = 0, lastDatagrams = 0;
+  bool ok = true;
+  for (;;) {
+    bool finished = stopping || (fd < 0 && serialsDone == serials.size());
+    auto next = last + std::chrono::microseconds((uint64_t)(flushSec * 1e6));
+    while (!finished && std::chrono::steady_clock::now() < next) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      finished = stopping || (fd < 0 && serialsDone == serials.size());
+    }
+    if (finished) {
+      stopping = true;
+      for (std::thread& t : threads) t.join();
+      threads.clear();
+    }
+
+    auto flushStart = std::chrono::steady_clock::now();
+    pending.take(batch);
+    size_t rows = batch.size();
+    ok = store.write(batch) && ok;
+    auto now = std::chrono::steady_clock::now();
+    double sec = std::chrono::duration<double>(now - last).count();
+    uint64_t records = stats.records, datagrams = stats.datagrams;
+    std::fprintf(stderr,
+                 "%.0f records/s, %.0f datagrams/s, %zu rows flushed in %.1f ms, %llu bytes stored; "
+                 "blocks %llu (%llu missing, %llu CRC errors), dropped on bikes %llu, bad datagrams %llu, "
+                 "re-anchored %llu\n",
+                 sec > 0 ? (records - lastRecords) / sec : 0.0, sec > 0 ? (datagrams - lastDatagrams) / sec : 0.0,
+                 rows, std::chrono::duration<double, std::milli>(now - flushStart).count(),
+                 (unsigned long long)store.bytesWritten(), (unsigned long long)stats.blocks,
+                 (unsigned long long)stats.missingBlocks, (unsigned long long)stats.crcErrors,
+                 (unsigned long long)stats.dropped, (unsigned long long)stats.badDatagrams,
+                 (unsigned long long)stats.reanchors);
+    last = now;
+    lastRecords = records;
+    lastDatagrams = datagrams;
+    if (finished) break;
+  }
+  if (fd >= 0) close(fd);
+  return ok ? 0 : 1;
+}
+
+// ---------------- Load generator ----------------
+class TickClock : public SafetyClock {
+public:
+  uint32_t ms = 0;
+  uint32_t nowMs() override { return ms; }
+};
+
+class NoOutputs : public SafetyOutputs {
+  void setIgnition(bool) override {}
+  void setBuzzer(bool) override {}
+};
+
+NoOutputs noOutputs;
+
+// One made-up bike: parked, ready, riding (now and then with the helmet
+// unbuckled for a while), stopped, parked again (the helmet comes off a
+// little later)
+struct LoadVehicle {
+  enum Phase { PARKED, READY, RIDING, STOPPED };
+
+  TickClock clock;
+  SafetyStateMachine safety;
+  TelemetryLog<64> telemetry;
+  Phase phase = PARKED;
+  uint32_t phaseLeft = 0;    // Ticks
+  uint32_t unbuckledLeft = 0;
+  uint32_t helmetOnLeft = 0; // Parked with the helmet still on
+  uint32_t bootUs;
+
+  explicit LoadVehicle(uint32_t bootUs) : safety(clock, noOutputs), bootUs(bootUs) {}
+
+  SafetyInputs inputs() const {
+    SafetyInputs in = {};
+    in.standUp = phase != PARKED;
+    in.riding = phase == RIDING;
+    in.helmetWorn = phase != PARKED || helmetOnLeft > 0;
+    in.helmetSecure = in.helmetWorn && unbuckledLeft == 0;
+    in.bleConnected = true;
+    return in;
+  }
+
+  void tick(uint32_t tickMs, std::mt19937& rng) {
+    auto ticks = [&](uint32_t fromS, uint32_t toS) {
+      return std::uniform_int_distribution<uint32_t>(fromS * 1000 / tickMs, toS * 1000 / tickMs)(rng);
+    };
+    if (phaseLeft == 0) {
+      phase = phase == PARKED ? READY : phase == READY ? RIDING : phase == RIDING ? STOPPED : PARKED;
+      phaseLeft = phase == PARKED ? ticks(30, 300) : phase == READY ? ticks(5, 20)
+                  : phase == RIDING ? ticks(60, 600) : ticks(5, 30);
+      if (phase == PARKED) helmetOnLeft = ticks(0, 20);
+    }
+    phaseLeft--;
+    if (helmetOnLeft > 0) helmetOnLeft--;
+    if (unbuckledLeft > 0) unbuckledLeft--;
+    if (phase == RIDING && unbuckledLeft == 0 && std::uniform_int_distribution<uint32_t>(0, 3000)(rng) == 0) {
+      unbuckledLeft = ticks(3, 30);
+    }
+
+    clock.ms += tickMs;
+    uint32_t nowUs = bootUs + clock.ms * 1000;
+    SafetyInputs in = inputs();
+    SafetyEvent event = safety.step(in);
+    if (event != SAFETY_EV_NONE) telemetry.log(TELEMETRY_BIKE_EVENT, event, bikeStatusFlags(in, safety), nowUs);
+    telemetry.log(TELEMETRY_BIKE_STATUS, bikeStatusFlags(in, safety), bikeWarningField(safety), nowUs);
+  }
+};
+
+int load(int argc, char** argv) {
+  std::string host = "127.0.0.1";
+  int port = 7350;
+  uint32_t vehicles = 1000;
+  double hz = 10;
+  double seconds = 60;
+  uint32_t batch = 5;
+  uint32_t seed = 1;
+  for (int i = 0; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!std::strcmp(argv[i], "--to") && hasValue) {
+      std::string to = argv[++i];
+      size_t colon = to.rfind(':');
+      if (colon == std::string::npos) return 2;
+      host = to.substr(0, colon);
+      port = std::atoi(to.c_str() + colon + 1);
+    } else if (!std::strcmp(argv[i], "--vehicles") && hasValue) {
+      vehicles = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+    } else if (!std::strcmp(argv[i], "--hz") && hasValue) {
+      hz = std::atof(argv[++i]);
+    } else if (!std::strcmp(argv[i], "--seconds") && hasValue) {
+      seconds = std::atof(argv[++i]);
+    } else if (!std::strcmp(argv[i], "--batch") && hasValue) {
+      batch = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+    } else if (!std::strcmp(argv[i], "--seed") && hasValue) {
+      seed = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+    } else {
+      return 2;
+    }
+  }
+  if (vehicles == 0 || hz <= 0 || batch == 0) return 2;
+
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_port = htons((uint16_t)port);
+  if (fd < 0 || inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1) {
+    std::fprintf(stderr, "cannot send to %s:%d\n", host.c_str(), port);
+    return 1;
+  }
+
+  std::mt19937 rng(seed);
+  std::vector<std::unique_ptr<LoadVehicle>> fleet;
+  for (uint32_t v = 0; v < vehicles; v++) {
+    fleet.push_back(std::unique_ptr<LoadVehicle>(new LoadVehicle(rng())));
+    fleet.back()->phaseLeft = std::uniform_int_distribution<uint32_t>(0, (uint32_t)(300 * hz))(rng);
+  }
+
+  uint32_t tickMs = (uint32_t)(1000 / hz);
+  uint64_t ticks = (uint64_t)(seconds * hz);
+  uint8_t datagram[DATAGRAM_MAX_BYTES];
+  uint64_t sent = 0, sendErrors = 0, lateTicks = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (uint64_t t = 0; t < ticks && !stopping; t++) {
+    auto due = start + std::chrono::microseconds(t * tickMs * 1000);
+    if (std::chrono::steady_clock::now() > due + std::chrono::milliseconds(tickMs)) lateTicks++;
+    std::this_thread::sleep_until(due);
+    for (uint32_t v = 0; v < vehicles; v++) {
+      LoadVehicle& vehicle = *fleet[v];
+      vehicle.tick(tickMs, rng);
+      if ((t + v) % batch != 0) continue;
+
+      FleetDatagramHeader header = {{'F', 'G'}, DATAGRAM_VERSION, 0, v + 1};
+      memcpy(datagram, &header, sizeof(header));
+      size_t used = sizeof(header), n;
+      while ((n = vehicle.telemetry.drain(datagram + used, sizeof(datagram) - used)) > 0) used += n;
+      if (sendto(fd, datagram, used, 0, (sockaddr*)&address, sizeof(address)) == (ssize_t)used) {
+        sent++;
+      } else {
+        sendErrors++;
+      }
+    }
+  }
+  double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::fprintf(stderr, "%u vehicles at %.0f Hz for %.1f s: %llu datagrams (%.0f/s), %llu send errors, %llu late ticks\n",
+               vehicles, hz, sec, (unsigned long long)sent, sent / sec, (unsigned long long)sendErrors,
+               (unsigned long long)lateTicks);
+  close(fd);
+  return 0;
+}
+
+// ---------------- Queries ----------------
+int query(int argc, char** argv) {
+  if (argc < 1 || argv[0][0] == '-') return 2;
+  std::string root = argv[0];
+  int64_t from = 0, to = INT64_MAX;
+  bool oneVehicle = false, rows = false;
+  uint32_t vehicle = 0;
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!std::strcmp(argv[i], "--from") && hasValue) {
+      if (!fleetParseDay(argv[++i], from)) return 2;
+    } else if (!std::strcmp(argv[i], "--to") && hasValue) {
+      if (!fleetParseDay(argv[++i], to)) return 2;
+    } else if (!std::strcmp(argv[i], "--vehicle") && hasValue) {
+      oneVehicle = true;
+      vehicle = (uint32_t)std::strtoul(argv[++i], nullptr, 0);
+    } else if (!std::strcmp(argv[i], "--rows")) {
+      rows = true;
+    } else {
+      return 2;
+    }
+  }
+  if (rows && !oneVehicle) return 2;
+
+  auto start = std::chrono::steady_clock::now();
+  uint64_t bytesRead = 0, lines = 0;
+  std::vector<int64_t> days = fleetListDays(root, from, to);
+
+  if (!rows) {
+    std::printf("day,vehicle,violations,ignition_cuts,warn60,grace_cuts,ble_offs,records,first,last\n");
+    for (int64_t day : days) {
+      std::string dayDir = root + "/" + fleetDayName(day);
+      std::map<uint32_t, FleetSummaryEntry> summary;
+      if (!fleetReadSummary(dayDir, summary)) continue;
+      bytesRead += sizeof(FleetSummaryHeader) + summary.size() * sizeof(FleetSummaryEntry);
+      for (const auto& item : summary) {
+        const FleetSummaryEntry& s = item.second;
+        if (oneVehicle && s.vehicle != vehicle) continue;
+        uint32_t violations = 0;
+        for (int e = 0; e < BIKE_EVENT_TYPES; e++) {
+          if (bikeViolation(e)) violations += s.events[e];
+        }
+        std::printf("%s,%u,%u,%u,%u,%u,%u,%llu,%s,%s\n", fleetDayName(day).c_str(), s.vehicle, violations,
+                    s.events[SAFETY_EV_WARN15_EXPIRED], s.events[SAFETY_EV_WARN60_START],
+                    s.events[SAFETY_EV_GRACE_EXPIRED], s.events[SAFETY_EV_DISCONNECT_SHUTDOWN],
+                    (unsigned long long)s.rows, fleetTimeOfDay(s.firstMs).c_str(), fleetTimeOfDay(s.lastMs).c_str());
+        lines++;
+      }
+    }
+  } else {
+    std::printf("time,record,stand_up,riding,helmet_secure,helmet_worn,ble,ignition,buzzer,grace,warning,left_s,event\n");
+    std::vector<uint32_t> timeMs;
+    std::vector<uint8_t> type, a;
+    std::vector<uint16_t> b;
+    for (int64_t day : days) {
+      std::string dayDir = root + "/" + fleetDayName(day);
+      std::vector<FleetIndexEntry> index;
+      if (!fleetReadIndex(dayDir, index)) continue;
+      bytesRead += index.size() * sizeof(FleetIndexEntry);
+      std::map<uint32_t, FILE*> segments;
+      for (const FleetIndexEntry& e : index) {
+        if (e.vehicle != vehicle) continue;
+        FILE*& seg = segments[e.segment];
+        if (seg == nullptr) seg = std::fopen(fleetSegmentPath(dayDir, e.segment).c_str(), "rb");
+        if (seg == nullptr || !fleetReadRows(seg, e, timeMs, type, a, b)) {
+          std::fprintf(stderr, "cannot read segment %u of %s\n", e.segment, dayDir.c_str());
+          continue;
+        }
+        bytesRead += e.rows * 8ULL;
+        for (uint32_t r = 0; r < e.rows; r++) {
+          bool status = type[r] == TELEMETRY_BIKE_STATUS;
+          bool event = type[r] == TELEMETRY_BIKE_EVENT;
+          if (!status && !event) continue;
+          uint8_t f = status ? a[r] : (uint8_t)b[r];
+          std::printf("%sT%s,%s,%d,%d,%d,%d,%d,%d,%d,%d,", fleetDayName(day).c_str(),
+                      fleetTimeOfDay(timeMs[r]).c_str(), status ? "status" : "event",
+                      !!(f & BIKE_FLAG_STAND_UP), !!(f & BIKE_FLAG_RIDING), !!(f & BIKE_FLAG_HELMET_SECURE),
+                      !!(f & BIKE_FLAG_HELMET_WORN), !!(f & BIKE_FLAG_BLE_CONNECTED), !!(f & BIKE_FLAG_IGNITION),
+                      !!(f & BIKE_FLAG_BUZZER), !!(f & BIKE_FLAG_GRACE));
+          if (status) {
+            std::printf("%u,%u,\n", b[r] & 0xff, b[r] >> 8);
+          } else {
+            std::printf(",,%u\n", a[r]);
+          }
+          lines++;
+        }
+      }
+      for (const auto& s : segments) {
+        if (s.second != nullptr) std::fclose(s.second);
+      }
+    }
+  }
+
+  std::fprintf(stderr, "%zu days, %llu lines, %llu bytes read, %.1f ms\n", days.size(), (unsigned long long)lines,
+               (unsigned long long)bytesRead,
+               std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int result = 2;
+  if (argc >= 2 && !std::strcmp(argv[1], "serve")) {
+    result = serve(argc - 2, argv + 2);
+  } else if (argc >= 2 && !std::strcmp(argv[1], "load")) {
+    result = load(argc - 2, argv + 2);
+  } else if (argc >= 2 && !std::strcmp(argv[1], "query")) {
+    result = query(argc - 2, argv + 2);
+  }
+  if (result == 2) {
+    std::fprintf(stderr,
+                 "usage: %s serve STORE [--udp PORT] [--serial PATH=VEHICLE]... [--flush-s S] [--start UNIX_S]\n"
+                 "       %s load [--to HOST:PORT] [--vehicles N] [--hz HZ] [--seconds S] [--batch N] [--seed N]\n"
+                 "       %s query STORE [--from DAY] [--to DAY] [--vehicle ID] [--rows]\n",
+                 argv[0], argv[0], argv[0]);
+  }
+  return result;
+}
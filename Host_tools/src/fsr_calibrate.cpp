@@ -0,0 +1,420 @@
+// FSR threshold calibration from labeled helmet captures.
+//
+//   fsr_calibrate [--on MIN:MAX:STEP] [--hysteresis MIN:MAX:STEP]
+//                 [--shifts LIST] [--debounce LIST] [--sample-ms MS]
+//                 [--max-latency-ms MS] [--threads N] [--top N]
+//                 [--header FILE] CAPTURE|DIR...
+//
+// Every section of a capture is a label: "...remov..." means the helmet is
+// off, "...worn..." that it is on (other sections are replayed but not
+// scored). The sections of each file are replayed in order through
+// BasicFsrFilter for every combination of on threshold, hysteresis width
+// (off = on - width), average window (2^shift taps, comma separated list)
+// and debounce samples (list), spread over --threads workers.
+//
+// In each labeled section the decision first has to reach the label (the
+// rows until then are the detection latency); every other row on the wrong
+// side is a false accept (helmet off, decided worn) or a false reject. The
+// latency is free up to --max-latency-ms only for a worn helmet: a removed
+// one decided worn is a false accept however soon after the label changed.
+// Configurations are ranked by false accepts, false rejects, then margin:
+// the distance from the thresholds to the nearest correctly classified
+// filtered value, so the winner sits in the middle of the gap in the data.
+// The single analogRead() decision (fsrValue > threshold, the non-filtered
+// firmware path and Helmet_Unit_evaluation) is calibrated the same way, with
+// thresholds from the largest removed value up only: it has no filter delay
+// to excuse a removed reading above it.
+//
+// --header writes the winners as lib/FsrFilter/FsrCalibration.h. Window and
+// debounce are reported at the capture rate (--sample-ms, 500 ms in the
+// checked-in captures) but not written: the firmware filters at 2 kHz, so
+// they do not carry over.
+
+#include <FsrFilter.h>
+#include <HelmetLog.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+enum Label : int8_t { UNLABELED = -1, REMOVED = 0, WORN = 1 };
+
+struct Segment {
+  Label label;
+  std::vector<uint16_t> fsr;
+};
+
+struct Capture {
+  std::string path;
+  std::vector<Segment> segments;
+};
+
+// Sections in the order they were recorded (a repeated name is a new one)
+class SegmentCollector {
+public:
+  std::vector<Segment>& segments;
+  explicit SegmentCollector(std::vector<Segment>& segments) : segments(segments) {}
+
+  void section(const char* name, size_t length) {
+    std::string lower(name, length);
+    for (char& c : lower) c = (char)tolower((unsigned char)c);
+    Segment s;
+    s.label = lower.find("remov") != std::string::npos ? REMOVED
+              : lower.find("worn") != std::string::npos ? WORN
+                                                         : UNLABELED;
+    segments.push_back(s);
+  }
+
+  void row(const HelmetRow& r) { segments.back().fsr.push_back(r.fsr > 0xFFFF ? 0xFFFF : (uint16_t)r.fsr); }
+};
+
+struct Config {
+  uint16_t on;
+  uint16_t off;
+  uint8_t shift;
+  uint16_t debounce;
+};
+
+struct Score {
+  Config config;
+  uint64_t wornRows = 0;
+  uint64_t removedRows = 0;
+  uint64_t falseAccepts = 0;
+  uint64_t falseRejects = 0;
+  uint32_t unsettled = 0;    // Sections that never reached their label
+  uint32_t transitions = 0;  // Sections that started on the wrong decision
+  uint64_t latencyRowsSum = 0;
+  uint64_t latencyRowsMax = 0;
+  int32_t maxRemoved = -1;    // Largest correctly classified value, helmet off
+  int32_t minWorn = 0x10000;  // Smallest correctly classified value, helmet on
+
+  double falseAcceptRate() const { return removedRows ? 100.0 * falseAccepts / removedRows : 0; }
+  double falseRejectRate() const { return wornRows ? 100.0 * falseRejects / wornRows : 0; }
+  // Distance from the thresholds to the nearest correctly classified value
+  int32_t margin() const {
+    int32_t low = maxRemoved < 0 ? config.on : (int32_t)config.on - 1 - maxRemoved;
+    int32_t high = minWorn > 0xFFFF ? config.off : minWorn - (int32_t)config.off;
+    return low < high ? low : high;
+  }
+
+  bool operator<(const Score& o) const {
+    if (falseAccepts * o.removedRows != o.falseAccepts * removedRows) {
+      return falseAccepts * o.removedRows < o.falseAccepts * removedRows;
+    }
+    if (falseRejects * o.wornRows != o.falseRejects * wornRows) return falseRejects * o.wornRows < o.falseRejects * wornRows;
+    if (unsettled != o.unsettled) return unsettled < o.unsettled;
+    if (margin() != o.margin()) return margin() > o.margin();
+    if (latencyRowsSum != o.latencyRowsSum) return latencyRowsSum < o.latencyRowsSum;
+    if (config.shift != o.config.shift) return config.shift < o.config.shift;
+    return config.debounce < o.config.debounce;
+  }
+};
+
+// Scoring shared by the filter and the single-threshold decision
+class Scorer {
+public:
+  Scorer(Score& score, uint64_t latencyBudgetRows) : score(score), budget(latencyBudgetRows) {}
+
+  void begin(Label segmentLabel, bool decision) {
+    label = segmentLabel;
+    settled = false;
+    rows = 0;
+    if (label != UNLABELED && decision != (label == WORN)) score.transitions++;
+  }
+
+  void sample(bool decision, uint16_t value) {
+    if (label == UNLABELED) return;
+    rows++;
+    bool worn = label == WORN;
+    (worn ? score.wornRows : score.removedRows)++;
+    if (!settled) {
+      if (decision != worn) {
+        if (!worn) {
+          score.falseAccepts++;
+        } else if (rows > budget) {
+          score.falseRejects++;
+        }
+        return;
+      }
+      settled = true;
+      score.latencyRowsSum += rows - 1;
+      if (rows - 1 > score.latencyRowsMax) score.latencyRowsMax = rows - 1;
+    }
+    if (decision != worn) {
+      (worn ? score.falseRejects : score.falseAccepts)++;
+    } else if (worn) {
+      if (value < score.minWorn) score.minWorn = value;
+    } else if (value > score.maxRemoved) {
+      score.maxRemoved = value;
+    }
+  }
+
+  void end() {
+    if (label == UNLABELED || settled) return;
+    score.unsettled++;
+    score.latencyRowsSum += rows;
+    if (rows > score.latencyRowsMax) score.latencyRowsMax = rows;
+  }
+
+private:
+  Score& score;
+  uint64_t budget;
+  Label label = UNLABELED;
+  bool settled = false;
+  uint64_t rows = 0;
+};
+
+template <uint8_t Shift>
+void replayFilter(const std::vector<Capture>& captures, uint64_t budget, Score& score) {
+  const Config& c = score.config;
+  Scorer scorer(score, budget);
+  for (const Capture& capture : captures) {
+    BasicFsrFilter<Shift> filter(c.on, c.off, c.debounce);
+    bool primed = false;
+    for (const Segment& segment : capture.segments) {
+      // Before the first sample the filter decides as prime() will
+      bool decision = primed ? filter.worn() : !segment.fsr.empty() && segment.fsr[0] >= c.on;
+      scorer.begin(segment.label, decision);
+      for (uint16_t v : segment.fsr) {
+        filter.update(v);
+        primed = true;
+        scorer.sample(filter.worn(), filter.value());
+      }
+      scorer.end();
+    }
+  }
+}
+
+void replay(const std::vector<Capture>& captures, uint64_t budget, Score& score) {
+  switch (score.config.shift) {
+    case 0: replayFilter<0>(captures, budget, score); break;
+    case 1: replayFilter<1>(captures, budget, score); break;
+    case 2: replayFilter<2>(captures, budget, score); break;
+    case 3: replayFilter<3>(captures, budget, score); break;
+    case 4: replayFilter<4>(captures, budget, score); break;
+    case 5: replayFilter<5>(captures, budget, score); break;
+    default: break;
+  }
+}
+
+// fsrValue > threshold on every row; config.on holds the threshold + 1
+void replayAnalog(const std::vector<Capture>& captures, uint64_t budget, Score& score) {
+  Scorer scorer(score, budget);
+  for (const Capture& capture : captures) {
+    for (const Segment& segment : capture.segments) {
+      scorer.begin(segment.label, !segment.fsr.empty() && segment.fsr[0] >= score.config.on);
+      for (uint16_t v : segment.fsr) scorer.sample(v >= score.config.on, v);
+      scorer.end();
+    }
+  }
+}
+
+bool parseRange(const char* text, std::vector<uint32_t>& out) {
+  unsigned long from, to, step = 1;
+  int n = sscanf(text, "%lu:%lu:%lu", &from, &to, &step);
+  if (n < 2 || step == 0 || to < from) return false;
+  out.clear();
+  for (unsigned long v = from; v <= to; v += step) out.push_back((uint32_t)v);
+  return true;
+}
+
+bool parseList(const char* text, std::vector<uint32_t>& out) {
+  out.clear();
+  for (const char* p = text; *p;) {
+    char* end;
+    unsigned long v = strtoul(p, &end, 10);
+    if (end == p) return false;
+    out.push_back((uint32_t)v);
+    p = *end == ',' ? end + 1 : end;
+    if (*end != ',' && *end != '\0') return false;
+  }
+  return !out.empty();
+}
+
+void printScore(const char* label, const Score& s, double sampleMs, bool filtered) {
+  std::printf("%-10s on %4u off %4u", label, s.config.on, s.config.off);
+  if (filtered) std::printf(" avg %2u deb %2u", 1u << s.config.shift, s.config.debounce);
+  std::printf("  FA %6.3f%% FR %6.3f%% unsettled %u  latency mean %6.0f max %6.0f ms  margin %d\n",
+              s.falseAcceptRate(), s.falseRejectRate(), s.unsettled,
+              s.transitions ? s.latencyRowsSum * sampleMs / s.transitions : 0.0, s.latencyRowsMax * sampleMs,
+              s.margin());
+}
+
+bool writeHeader(const char* path, const std::vector<std::string>& inputs, uint64_t rows, const Score& filter,
+                 const Score& analog, double sampleMs, double maxLatencyMs) {
+  FILE* f = std::fopen(path, "w");
+  if (f == nullptr) return false;
+  std::fprintf(f, "#pragma once\n\n");
+  std::fprintf(f, "// Generated by Host_tools/src/fsr_calibrate.cpp from %zu capture(s), %llu rows:\n",
+               inputs.size(), (unsigned long long)rows);
+  for (const std::string& input : inputs) std::fprintf(f, "//   %s\n", input.c_str());
+  std::fprintf(f, "// Rerun it (env:calibrate) when captures are added instead of editing this file.\n//\n");
+  std::fprintf(f, "// A worn helmet may take %.0f ms to be detected before it counts as false rejects;\n", maxLatencyMs);
+  std::fprintf(f, "// a removed one decided worn is a false accept from its first row (filter delay included).\n");
+  std::fprintf(f, "// FsrFilter: false accept %.3f %%, false reject %.3f %%, margin %d counts\n",
+               filter.falseAcceptRate(), filter.falseRejectRate(), filter.margin());
+  std::fprintf(f, "// (best at the %.0f ms capture rate with a %u-tap average and %u-sample debounce;\n",
+               sampleMs, 1u << filter.config.shift, filter.config.debounce);
+  std::fprintf(f, "// the firmware keeps its own window for 2 kHz).\n");
+  std::fprintf(f, "// analogRead() > FSR_ANALOG_THRESHOLD: false accept %.3f %%, false reject %.3f %%, margin %d counts\n\n",
+               analog.falseAcceptRate(), analog.falseRejectRate(), analog.margin());
+  std::fprintf(f, "#define FSR_WORN_ON %u\n", filter.config.on);
+  std::fprintf(f, "#define FSR_WORN_OFF %u\n", filter.config.off);
+  std::fprintf(f, "#define FSR_ANALOG_THRESHOLD %u\n", analog.config.on - 1);
+  return std::fclose(f) == 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::vector<uint32_t> ons, widths, shifts, debounces;
+  parseRange("10:600:2", ons);
+  parseRange("0:100:5", widths);
+  parseList("0,1,2,3,4", shifts);
+  parseList("1,2,3,4,6,8", debounces);
+  double sampleMs = 500;
+  double maxLatencyMs = 1000;
+  unsigned threadCount = 0;
+  size_t top = 10;
+  const char* headerPath = nullptr;
+  std::vector<std::string> files;
+  bool usage = false;
+
+  for (int i = 1; i < argc && !usage; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!std::strcmp(argv[i], "--on") && hasValue) {
+      usage = !parseRange(argv[++i], ons);
+    } else if (!std::strcmp(argv[i], "--hysteresis") && hasValue) {
+      usage = !parseRange(argv[++i], widths);
+    } else if (!std::strcmp(argv[i], "--shifts") && hasValue) {
+      usage = !parseList(argv[++i], shifts);
+      for (uint32_t s : shifts) usage |= s > 5;
+    } else if (!std::strcmp(argv[i], "--debounce") && hasValue) {
+      usage = !parseList(argv[++i], debounces);
+    } else if (!std::strcmp(argv[i], "--sample-ms") && hasValue) {
+      sampleMs = std::atof(argv[++i]);
+    } else if (!std::strcmp(argv[i], "--max-latency-ms") && hasValue) {
+      maxLatencyMs = std::atof(argv[++i]);
+    } else if (!std::strcmp(argv[i], "--threads") && hasValue) {
+      threadCount = (unsigned)std::strtoul(argv[++i], nullptr, 10);
+    } else if (!std::strcmp(argv[i], "--top") && hasValue) {
+      top = std::strtoul(argv[++i], nullptr, 10);
+    } else if (!std::strcmp(argv[i], "--header") && hasValue) {
+      headerPath = argv[++i];
+    } else if (argv[i][0] != '-') {
+      if (!listCaptures(argv[i], files)) {
+        std::fprintf(stderr, "cannot read %s\n", argv[i]);
+        return 1;
+      }
+    } else {
+      usage = true;
+    }
+  }
+  if (usage || files.empty() || sampleMs <= 0) {
+    std::fprintf(stderr,
+                 "usage: %s [--on MIN:MAX:STEP] [--hysteresis MIN:MAX:STEP]\n"
+                 "          [--shifts LIST] [--debounce LIST] [--sample-ms MS]\n"
+                 "          [--max-latency-ms MS] [--threads N] [--top N]\n"
+                 "          [--header FILE] CAPTURE|DIR...\n"
+                 "shifts are 0..5 (average of 2^shift samples)\n",
+                 argv[0]);
+    return 2;
+  }
+
+  std::vector<Capture> captures(files.size());
+  uint64_t rows = 0;
+  for (size_t i = 0; i < files.size(); i++) {
+    MappedFile file;
+    if (!file.open(files[i].c_str())) {
+      std::fprintf(stderr, "cannot read %s\n", files[i].c_str());
+      return 1;
+    }
+    captures[i].path = files[i];
+    SegmentCollector collector(captures[i].segments);
+    scanHelmetLog(file.data(), file.size(), collector);
+    for (const Segment& s : captures[i].segments) rows += s.fsr.size();
+  }
+
+  std::vector<Score> scores;
+  for (uint32_t on : ons) {
+    for (uint32_t width : widths) {
+      if (width > on || on > 0xFFFF) continue;
+      for (uint32_t shift : shifts) {
+        for (uint32_t debounce : debounces) {
+          Score s;
+          s.config = Config{(uint16_t)on, (uint16_t)(on - width), (uint8_t)shift, (uint16_t)debounce};
+          scores.push_back(s);
+        }
+      }
+    }
+  }
+  if (scores.empty()) {
+    std::fprintf(stderr, "no configurations to try\n");
+    return 2;
+  }
+
+  uint64_t budget = (uint64_t)(maxLatencyMs / sampleMs);
+  if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+  auto start = std::chrono::steady_clock::now();
+  std::atomic<size_t> next(0);
+  auto worker = [&]() {
+    for (size_t i; (i = next++) < scores.size();) replay(captures, budget, scores[i]);
+  };
+  std::vector<std::thread> threads;
+  for (unsigned t = 1; t < threadCount; t++) threads.push_back(std::thread(worker));
+  worker();
+  for (std::thread& t : threads) t.join();
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  uint32_t removedMax = 0;
+  for (const Capture& capture : captures) {
+    for (const Segment& segment : capture.segments) {
+      if (segment.label != REMOVED) continue;
+      for (uint16_t v : segment.fsr) removedMax = std::max<uint32_t>(removedMax, v);
+    }
+  }
+  std::vector<Score> analog;
+  for (uint32_t threshold = removedMax; threshold < 4096 || analog.empty(); threshold++) {
+    Score s;
+    s.config = Config{(uint16_t)(threshold + 1), (uint16_t)(threshold + 1), 0, 1};
+    replayAnalog(captures, budget, s);
+    analog.push_back(s);
+  }
+
+  std::sort(scores.begin(), scores.end());
+  std::sort(analog.begin(), analog.end());
+
+  std::printf("%zu captures, %llu rows, %zu configurations in %.2f s (%u threads, %.1f M samples/s)\n\n",
+              captures.size(), (unsigned long long)rows, scores.size(), seconds, threadCount,
+              seconds > 0 ? rows * scores.size() / seconds / 1e6 : 0.0);
+  for (size_t i = 0; i < top && i < scores.size(); i++) printScore(i == 0 ? "best" : "", scores[i], sampleMs, true);
+
+  // The thresholds in the tree today, with the best window
+  Score current;
+  current.config = Config{FSR_WORN_ON, FSR_WORN_OFF, scores[0].config.shift, scores[0].config.debounce};
+  replay(captures, budget, current);
+  std::printf("\n");
+  printScore("current", current, sampleMs, true);
+  printScore("analog", analog[0], sampleMs, false);
+  Score currentAnalog;
+  currentAnalog.config = Config{FSR_ANALOG_THRESHOLD + 1, FSR_ANALOG_THRESHOLD + 1, 0, 1};
+  replayAnalog(captures, budget, currentAnalog);
+  printScore("analog now", currentAnalog, sampleMs, false);
+
+  if (headerPath != nullptr) {
+    if (!writeHeader(headerPath, files, rows, scores[0], analog[0], sampleMs, maxLatencyMs)) {
+      std::fprintf(stderr, "cannot write %s\n", headerPath);
+      return 1;
+    }
+    std::printf("\nwrote %s\n", headerPath);
+  }
+  return 0;
+}
@@ -0,0 +1,347 @@
+// Fast ingestion of helmet serial captures (replaces parse_file() in
+// analyze_helmet.py for large logs).
+//
+//   helmet_ingest [--threads N] [--stats] [--columns DIR] [--quiet] CAPTURE|DIR...
+//
+// A directory stands for all *.csv files in it (sorted by name). Files are
+// handed out to --threads workers (default: one per core); each capture is
+// memory-mapped and scanned once (HelmetLog.h) into streaming per-section
+// accumulators (SectionStats.h), so memory does not grow with the data.
+// The summary goes to stdout in the format of
+// helmet_results/experimental_summary.csv, one row per file and section in
+// input order, with numbers printed as pandas would:
+//   File,Section,Avg_FSR,Max_FSR,Min_FSR,Helmet_Detected_%,Buckle_Detected_%
+// --stats adds Std_FSR,P50_FSR,P95_FSR,P99_FSR columns and, merged over all
+// files, one row per section with File "ALL".
+// --quiet skips the summary; scan statistics (bytes, rows, GB/s) go to stderr.
+//
+// --columns DIR also writes the rows column by column to DIR/<file>.hcol:
+//   "HCOL" u32 version=1, u32 sections, u32 0
+//   per section: u32 name length, name, u64 rows, then u32 touched[rows],
+//                u32 fsr[rows], u32 buckled[rows]
+// Everything is little endian and each array starts 8-byte aligned, so the
+// columns load with numpy.frombuffer(data, "<u4", rows, offset) unchanged.
+
+#include <HelmetLog.h>
+#include <SectionStats.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Options {
+  const char* columnsDir = nullptr;
+  bool quiet = false;
+  bool stats = false;
+  unsigned threads = 0;
+};
+
+struct Section {
+  std::string name;
+  std::vector<uint32_t> touched;
+  std::vector<uint32_t> fsr;
+  std::vector<uint32_t> buckled;
+};
+
+// Columns of one capture, sections in order of first appearance
+class ColumnBuilder {
+public:
+  std::vector<Section> sections;
+
+  void section(const char* name, size_t length) {
+    std::string key(name, length);
+    for (size_t i = 0; i < sections.size(); i++) {
+      if (sections[i].name == key) {
+        current = &sections[i];
+        return;
+      }
+    }
+    sections.push_back(Section());
+    sections.back().name = key;
+    current = &sections.back();
+  }
+
+  void row(const HelmetRow& r) {
+    current->touched.push_back(r.touched);
+    current->fsr.push_back(r.fsr);
+    current->buckled.push_back(r.buckled);
+  }
+
+private:
+  Section* current = nullptr;
+};
+
+struct NamedStats {
+  std::string name;
+  SectionStats stats;
+};
+
+// Statistics of one capture (and its columns with --columns)
+class CaptureScanner {
+public:
+  std::vector<NamedStats> sections;
+  ColumnBuilder* columns = nullptr;
+  uint64_t rows = 0;
+
+  void section(const char* name, size_t length) {
+    if (columns != nullptr) columns->section(name, length);
+    std::string key(name, length);
+    for (size_t i = 0; i < sections.size(); i++) {
+      if (sections[i].name == key) {
+        current = &sections[i].stats;
+        return;
+      }
+    }
+    sections.push_back(NamedStats());
+    sections.back().name = key;
+    current = &sections.back().stats;
+  }
+
+  void row(const HelmetRow& r) {
+    if (columns != nullptr) columns->row(r);
+    current->add(r);
+    rows++;
+  }
+
+private:
+  SectionStats* current = nullptr;
+};
+
+// Merged statistics of one section over several files; first = position of
+// its first appearance (file index, section index) for the output order
+struct MergedSection {
+  std::string name;
+  std::pair<size_t, size_t> first;
+  SectionStats stats;
+};
+
+void mergeInto(std::vector<MergedSection>& merged, size_t file, const std::vector<NamedStats>& sections) {
+  for (size_t i = 0; i < sections.size(); i++) {
+    MergedSection* m = nullptr;
+    for (MergedSection& candidate : merged) {
+      if (candidate.name == sections[i].name) m = &candidate;
+    }
+    if (m == nullptr) {
+      merged.push_back(MergedSection());
+      m = &merged.back();
+      m->name = sections[i].name;
+      m->first = std::make_pair(file, i);
+    } else if (std::make_pair(file, i) < m->first) {
+      m->first = std::make_pair(file, i);
+    }
+    m->stats.merge(sections[i].stats);
+  }
+}
+
+std::string stemOf(const std::string& path) {
+  size_t slash = path.find_last_of("/\\");
+  std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+  size_t dot = name.find_last_of('.');
+  return dot == std::string::npos || dot == 0 ? name : name.substr(0, dot);
+}
+
+// CSV field, quoted only when needed (as pandas.to_csv does)
+std::string csvField(const std::string& s) {
+  if (s.find_first_of(",\"\n") == std::string::npos) return s;
+  std::string out = "\"";
+  for (char c : s) {
+    if (c == '"') out += '"';
+    out += c;
+  }
+  return out + "\"";
+}
+
+// NaN is an empty field in pandas' CSVs
+std::string number(double v) { return v == v ? pythonRepr(v) : std::string(); }
+
+std::string summaryRow(const std::string& file, const std::string& section, const SectionStats& s, bool stats) {
+  char buf[64];
+  snprintf(buf, sizeof(buf), ",%lu,%lu,", (unsigned long)s.max(), (unsigned long)s.min());
+  std::string row = csvField(file) + "," + csvField(section) + "," + pythonRepr(s.mean()) + buf +
+                    pythonRepr(s.touchedPercent()) + "," + pythonRepr(s.buckledPercent());
+  if (stats) {
+    row += "," + number(s.stddev()) + "," + number(s.quantile(0.5)) + "," + number(s.quantile(0.95)) + "," +
+           number(s.quantile(0.99));
+  }
+  return row + "\n";
+}
+
+void writeArray(FILE* f, const std::vector<uint32_t>& v, uint64_t& offset) {
+  static const char zeros[8] = {};
+  fwrite(v.data(), sizeof(uint32_t), v.size(), f);
+  offset += v.size() * sizeof(uint32_t);
+  if (offset % 8) {
+    fwrite(zeros, 1, 8 - offset % 8, f);
+    offset += 8 - offset % 8;
+  }
+}
+
+bool writeColumns(const std::string& path, const std::vector<Section>& sections) {
+  FILE* f = std::fopen(path.c_str(), "wb");
+  if (f == nullptr) return false;
+  static const char zeros[8] = {};
+  uint32_t header[4] = {0, 1, (uint32_t)sections.size(), 0};
+  std::memcpy(&header[0], "HCOL", 4);
+  fwrite(header, sizeof(header), 1, f);
+  uint64_t offset = sizeof(header);
+
+  for (const Section& s : sections) {
+    uint32_t nameLength = (uint32_t)s.name.size();
+    fwrite(&nameLength, sizeof(nameLength), 1, f);
+    fwrite(s.name.data(), 1, nameLength, f);
+    offset += sizeof(nameLength) + nameLength;
+    if (offset % 8) {
+      fwrite(zeros, 1, 8 - offset % 8, f);
+      offset += 8 - offset % 8;
+    }
+    uint64_t rows = s.fsr.size();
+    fwrite(&rows, sizeof(rows), 1, f);
+    offset += sizeof(rows);
+    writeArray(f, s.touched, offset);
+    writeArray(f, s.fsr, offset);
+    writeArray(f, s.buckled, offset);
+  }
+  return std::fclose(f) == 0;
+}
+
+struct FileResult {
+  bool done = false;
+  bool failed = false;
+  std::string summary;  // Rows for stdout
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options o;
+  std::vector<std::string> files;
+  bool usage = false;
+
+  for (int i = 1; i < argc && !usage; i++) {
+    if (!std::strcmp(argv[i], "--columns") && i + 1 < argc) {
+      o.columnsDir = argv[++i];
+    } else if (!std::strcmp(argv[i], "--threads") && i + 1 < argc) {
+      o.threads = (unsigned)std::strtoul(argv[++i], nullptr, 10);
+    } else if (!std::strcmp(argv[i], "--stats")) {
+      o.stats = true;
+    } else if (!std::strcmp(argv[i], "--quiet")) {
+      o.quiet = true;
+    } else if (argv[i][0] != '-') {
+      if (!listCaptures(argv[i], files)) {
+        std::fprintf(stderr, "cannot read %s\n", argv[i]);
+        return 1;
+      }
+    } else {
+      usage = true;
+    }
+  }
+  if (usage || files.empty()) {
+    std::fprintf(stderr, "usage: %s [--threads N] [--stats] [--columns DIR] [--quiet] CAPTURE|DIR...\n", argv[0]);
+    return 2;
+  }
+  if (o.threads == 0) o.threads = std::max(1u, std::thread::hardware_concurrency());
+  if (o.threads > files.size()) o.threads = (unsigned)files.size();
+
+  // Workers take the next unscanned file. Finished summaries are printed in
+  // input order as soon as every file before them is done, so only the
+  // rows of files that finished early are held back.
+  std::vector<FileResult> results(files.size());
+  std::atomic<size_t> nextFile(0);
+  std::atomic<uint64_t> totalBytes(0), totalRows(0);
+  std::atomic<bool> failed(false);
+  std::mutex outputLock;
+  size_t printed = 0;
+  std::vector<std::vector<MergedSection>> merged(o.threads);
+
+  if (!o.quiet) {
+    std::printf("File,Section,Avg_FSR,Max_FSR,Min_FSR,Helmet_Detected_%%,Buckle_Detected_%%%s\n",
+                o.stats ? ",Std_FSR,P50_FSR,P95_FSR,P99_FSR" : "");
+  }
+
+  auto worker = [&](unsigned id) {
+    for (size_t i; !failed && (i = nextFile++) < files.size();) {
+      FileResult result;
+      MappedFile file;
+      ColumnBuilder columns;
+      CaptureScanner scanner;
+      if (o.columnsDir != nullptr) scanner.columns = &columns;
+      std::string stem = stemOf(files[i]);
+
+      if (!file.open(files[i].c_str())) {
+        std::fprintf(stderr, "cannot read %s\n", files[i].c_str());
+        result.failed = true;
+      } else {
+        scanHelmetLog(file.data(), file.size(), scanner);
+        totalBytes += file.size();
+        totalRows += scanner.rows;
+        for (const NamedStats& s : scanner.sections) {
+          if (s.stats.count() > 0) result.summary += summaryRow(stem, s.name, s.stats, o.stats);
+        }
+        if (o.stats) mergeInto(merged[id], i, scanner.sections);
+        if (o.columnsDir != nullptr) {
+          std::string out = std::string(o.columnsDir) + "/" + stem + ".hcol";
+          if (!writeColumns(out, columns.sections)) {
+            std::fprintf(stderr, "cannot write %s\n", out.c_str());
+            result.failed = true;
+          }
+        }
+      }
+      if (result.failed) failed = true;
+
+      std::lock_guard<std::mutex> lock(outputLock);
+      result.done = true;
+      results[i] = std::move(result);
+      while (printed < results.size() && results[printed].done) {
+        if (!o.quiet) std::fputs(results[printed].summary.c_str(), stdout);
+        results[printed] = FileResult();
+        results[printed].done = true;
+        printed++;
+      }
+    }
+  };
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (unsigned t = 1; t < o.threads; t++) threads.push_back(std::thread(worker, t));
+  worker(0);
+  for (std::thread& t : threads) t.join();
+  double wallSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  if (failed) return 1;
+
+  if (o.stats) {
+    std::vector<MergedSection> all;
+    for (const std::vector<MergedSection>& part : merged) {
+      for (const MergedSection& m : part) {
+        MergedSection* target = nullptr;
+        for (MergedSection& candidate : all) {
+          if (candidate.name == m.name) target = &candidate;
+        }
+        if (target == nullptr) {
+          all.push_back(m);
+          continue;
+        }
+        if (m.first < target->first) target->first = m.first;
+        target->stats.merge(m.stats);
+      }
+    }
+    std::sort(all.begin(), all.end(),
+              [](const MergedSection& a, const MergedSection& b) { return a.first < b.first; });
+    for (const MergedSection& m : all) {
+      if (!o.quiet && m.stats.count() > 0) std::fputs(summaryRow("ALL", m.name, m.stats, true).c_str(), stdout);
+    }
+  }
+
+  std::fprintf(stderr, "%zu files, %llu bytes, %llu rows, %u threads, %.3f s (%.2f GB/s)\n", files.size(),
+               (unsigned long long)totalBytes, (unsigned long long)totalRows, o.threads, wallSec,
+               wallSec > 0 ? totalBytes / wallSec / 1e9 : 0.0);
+  return 0;
+}
@@ -0,0 +1,141 @@
+// Decoder for the bike's event journal dumps (lib/EventJournal/EventJournal.h).
+//
+//   journal_decode [FILE]
+//
+// Reads a raw serial capture of the bike (console 'J' commands, see
+// Biketest/src/main.cpp) from FILE or stdin and writes one CSV row per event:
+//   time_s,boot,event,a,b,c
+// time_s is the journal clock, which stops while the bike is off or in deep
+// sleep; boot tells the power cycles apart. a, b and c per event type are in
+// BikeStatus.h. Rows come out in journal order, and an event read by
+// several dumps is written once. Telemetry blocks and text in between are
+// skipped.
+//
+// Block, CRC and record statistics go to stderr.
+
+#include <BikeStatus.h>
+#include <EventJournal.h>
+#include <TelemetryLog.h>
+
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <tuple>
+#include <vector>
+
+namespace {
+
+struct Stats {
+  uint64_t blocks = 0;
+  uint64_t crcErrors = 0;
+  uint64_t records = 0;
+  uint64_t badRecords = 0;  // Record CRC wrong in a block whose CRC was right
+  uint64_t duplicates = 0;
+};
+
+typedef std::tuple<uint16_t, uint32_t, uint16_t, uint8_t> EventKey;  // boot, s, ms, type
+
+class Decoder {
+public:
+  void decode(const std::vector<uint8_t>& data) {
+    size_t i = 0;
+    while (i < data.size()) {
+      size_t length = blockAt(data, i);
+      i += length > 0 ? length : 1;
+    }
+
+    std::printf("time_s,boot,event,a,b,c\n");
+    for (const auto& e : events) {
+      const JournalRecord& r = e.second;
+      std::printf("%lu.%03u,%u,%s,%u,%u,%u\n", (unsigned long)r.timeS, r.timeMs, r.boot,
+                  bikeJournalTypeName(r.type), r.a, r.b, r.c);
+    }
+  }
+
+  const Stats& stats() const { return stats_; }
+
+private:
+  // Size of the block (journal or telemetry) at data[i], or 0 when there is none
+  size_t blockAt(const std::vector<uint8_t>& data, size_t i) {
+    const uint8_t* p = &data[i];
+    size_t available = data.size() - i;
+    size_t length;
+    TelemetryBlockHeader telemetryHeader;
+    if (telemetryBlockAt(p, available, telemetryHeader, length) == TELEMETRY_BLOCK) return length;
+
+    JournalBlockHeader header;
+    switch (journalBlockAt(p, available, header, length)) {
+      case TELEMETRY_BLOCK:
+        break;
+      case TELEMETRY_BAD_CRC:
+        stats_.crcErrors++;
+        return 0;
+      default:
+        return 0;
+    }
+
+    stats_.blocks++;
+    for (uint8_t r = 0; r < header.count; r++) {
+      JournalRecord record;
+      std::memcpy(&record, p + sizeof(header) + r * sizeof(JournalRecord), sizeof(record));
+      emit(record);
+    }
+    return length;
+  }
+
+  void emit(const JournalRecord& r) {
+    if (!journalRecordValid(r)) {
+      stats_.badRecords++;
+      return;
+    }
+    if (!events.insert(std::make_pair(EventKey(r.boot, r.timeS, r.timeMs, r.type), r)).second) {
+      stats_.duplicates++;
+      return;
+    }
+    stats_.records++;
+  }
+
+  Stats stats_;
+  std::map<EventKey, JournalRecord> events;
+};
+
+bool readAll(FILE* f, std::vector<uint8_t>& data) {
+  uint8_t buf[65536];
+  size_t n;
+  while ((n = std::fread(buf, 1, sizeof(buf), f)) > 0) data.insert(data.end(), buf, buf + n);
+  return !std::ferror(f);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const char* path = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (argv[i][0] != '-' && path == nullptr) {
+      path = argv[i];
+    } else {
+      std::fprintf(stderr, "usage: %s [FILE]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  FILE* f = path != nullptr ? std::fopen(path, "rb") : stdin;
+  if (f == nullptr) {
+    std::fprintf(stderr, "cannot open %s\n", path);
+    return 1;
+  }
+  std::vector<uint8_t> data;
+  if (!readAll(f, data)) {
+    std::fprintf(stderr, "read error\n");
+    return 1;
+  }
+
+  Decoder decoder;
+  decoder.decode(data);
+
+  const Stats& s = decoder.stats();
+  std::fprintf(stderr, "blocks: %llu (%llu CRC errors), events: %llu (%llu bad, %llu duplicates)\n",
+               (unsigned long long)s.blocks, (unsigned long long)s.crcErrors, (unsigned long long)s.records,
+               (unsigned long long)s.badRecords, (unsigned long long)s.duplicates);
+  return 0;
+}
@@ -0,0 +1,170 @@
+// Host stress test for SnapshotMailbox with real threads.
+//
+//   mailbox_runner [--seconds S] [--words N] [--seed S] [--yield-rate P]
+//
+// The simulator runs every firmware task on one host thread, so it never
+// publishes and reads a mailbox at the same time. Here a producer thread
+// publishes snapshots as fast as it can while a consumer thread reads them,
+// each on its own core where the host has them. Every snapshot carries a
+// sequence number, N words derived from it and a checksum over both.
+//
+// Checked on every read(): the snapshot is whole (checksum and words match
+// its sequence), a fresh read has a higher sequence than the one before and
+// a read that is not fresh returns the same snapshot again. --yield-rate is
+// the chance that the consumer yields before a read, so both the "producer
+// far ahead" and the "nothing new" paths are taken. Exits with 1 on any
+// violation, or when no snapshot at all got through.
+//
+// Worth running under ThreadSanitizer too (-fsanitize=thread): the slot
+// copies are plain memcpy, ordered only by the mailbox's atomic exchange.
+
+#include <SnapshotMailbox.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+
+namespace {
+
+#define MAX_WORDS 256
+
+struct Options {
+  double seconds = 5;
+  uint32_t words = 32;  // About the size of the bike's BLE snapshot
+  unsigned seed = 1;
+  double yieldRate = 0.01;
+};
+
+struct Snapshot {
+  uint64_t sequence;
+  uint32_t words[MAX_WORDS];
+  uint32_t checksum;
+};
+
+uint32_t wordAt(uint64_t sequence, uint32_t i) {
+  uint64_t x = sequence * 0x9E3779B97F4A7C15ull + i;
+  x ^= x >> 29;
+  x *= 0xBF58476D1CE4E5B9ull;
+  return (uint32_t)(x ^ (x >> 32));
+}
+
+// FNV-1a over the sequence and the words
+uint32_t checksumOf(const Snapshot& s, uint32_t words) {
+  uint32_t h = 2166136261u;
+  const uint8_t* p = (const uint8_t*)&s.sequence;
+  for (size_t i = 0; i < sizeof(s.sequence); i++) h = (h ^ p[i]) * 16777619u;
+  p = (const uint8_t*)s.words;
+  for (size_t i = 0; i < words * sizeof(uint32_t); i++) h = (h ^ p[i]) * 16777619u;
+  return h;
+}
+
+struct Result {
+  uint64_t reads = 0;
+  uint64_t fresh = 0;
+  uint64_t torn = 0;
+  uint64_t backwards = 0;   // Fresh read with a sequence not above the previous one
+  uint64_t changed = 0;     // Stale read that did not return the previous snapshot
+  uint64_t lastSequence = 0;
+};
+
+bool whole(const Snapshot& s, uint32_t words) {
+  if (checksumOf(s, words) != s.checksum) return false;
+  for (uint32_t i = 0; i < words; i++) {
+    if (s.words[i] != wordAt(s.sequence, i)) return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options o;
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!std::strcmp(argv[i], "--seconds") && hasValue) {
+      o.seconds = std::atof(argv[++i]);
+    } else if (!std::strcmp(argv[i], "--words") && hasValue) {
+      o.words = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+    } else if (!std::strcmp(argv[i], "--seed") && hasValue) {
+      o.seed = (unsigned)std::strtoul(argv[++i], nullptr, 10);
+    } else if (!std::strcmp(argv[i], "--yield-rate") && hasValue) {
+      o.yieldRate = std::atof(argv[++i]);
+    } else {
+      std::fprintf(stderr, "usage: %s [--seconds S] [--words N] [--seed S] [--yield-rate P]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (o.words == 0 || o.words > MAX_WORDS) {
+    std::fprintf(stderr, "--words must be 1..%d\n", MAX_WORDS);
+    return 2;
+  }
+
+  static SnapshotMailbox<Snapshot> mailbox;
+  static Snapshot first;  // Sequence 0, seeded before the threads start
+  first.sequence = 0;
+  for (uint32_t i = 0; i < o.words; i++) first.words[i] = wordAt(0, i);
+  first.checksum = checksumOf(first, o.words);
+  mailbox.reset(first);
+
+  std::atomic<bool> stop(false);
+  uint64_t published = 0;
+
+  std::thread producer([&] {
+    static Snapshot s;
+    uint64_t sequence = 0;
+    while (!stop.load(std::memory_order_relaxed)) {
+      s.sequence = ++sequence;
+      for (uint32_t i = 0; i < o.words; i++) s.words[i] = wordAt(sequence, i);
+      s.checksum = checksumOf(s, o.words);
+      mailbox.publish(s);
+    }
+    published = sequence;
+  });
+
+  Result r;
+  std::thread consumer([&] {
+    static Snapshot s;
+    std::mt19937 rng(o.seed);
+    std::bernoulli_distribution yieldNow(o.yieldRate);
+    while (!stop.load(std::memory_order_relaxed)) {
+      if (yieldNow(rng)) std::this_thread::yield();
+      bool fresh = mailbox.read(s);
+      r.reads++;
+      if (!whole(s, o.words)) {
+        if (r.torn++ == 0) {
+          std::printf("torn snapshot: sequence %llu, read %llu\n", (unsigned long long)s.sequence,
+                      (unsigned long long)r.reads);
+        }
+        continue;
+      }
+      if (fresh) {
+        r.fresh++;
+        if (s.sequence <= r.lastSequence && r.backwards++ == 0) {
+          std::printf("sequence went from %llu to %llu on a fresh read\n", (unsigned long long)r.lastSequence,
+                      (unsigned long long)s.sequence);
+        }
+      } else if (s.sequence != r.lastSequence && r.changed++ == 0) {
+        std::printf("stale read returned %llu after %llu\n", (unsigned long long)s.sequence,
+                    (unsigned long long)r.lastSequence);
+      }
+      r.lastSequence = s.sequence;
+    }
+  });
+
+  std::this_thread::sleep_for(std::chrono::duration<double>(o.seconds));
+  stop.store(true);
+  producer.join();
+  consumer.join();
+
+  bool ok = r.torn == 0 && r.backwards == 0 && r.changed == 0 && r.fresh > 0;
+  std::printf("published %llu, read %llu (%llu fresh, last sequence %llu), %u words per snapshot\n",
+              (unsigned long long)published, (unsigned long long)r.reads, (unsigned long long)r.fresh,
+              (unsigned long long)r.lastSequence, o.words);
+  std::printf("torn: %llu, backwards: %llu, stale changed: %llu  %s\n", (unsigned long long)r.torn,
+              (unsigned long long)r.backwards, (unsigned long long)r.changed, ok ? "PASS" : "FAIL");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,210 @@
+// Host runner for the bike unit SafetyStateMachine.
+//
+//   safety_runner [--depth N] [--random STEPS] [--seed S]
+//
+// Exhaustive mode walks every sequence of N steps, where each step picks one
+// of the 32 (stand, riding, helmet secure, helmet worn, BLE) input
+// combinations and one of a few time advances, and checks the safety
+// invariants after every step. Random mode runs one long random sequence and
+// is mostly useful for measuring the per-step cost.
+
+#include <SafetyStateMachine.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+class HostClock : public SafetyClock {
+public:
+  uint32_t now = 0;
+  uint32_t nowMs() override { return now; }
+};
+
+class HostOutputs : public SafetyOutputs {
+public:
+  bool ignition = false;
+  bool buzzer = false;
+  uint64_t writes = 0;
+  void setIgnition(bool on) override { ignition = on; writes++; }
+  void setBuzzer(bool on) override { buzzer = on; writes++; }
+};
+
+// Time advances tried before each step (ms)
+const uint32_t TIME_STEPS[] = {10, 5000, SAFETY_WARNING_15S_MS, SAFETY_WARNING_60S_MS};
+const int NUM_TIME_STEPS = sizeof(TIME_STEPS) / sizeof(TIME_STEPS[0]);
+const int NUM_INPUTS = 32;
+
+struct Step {
+  int input;
+  uint32_t dt;
+};
+
+// Observer state kept next to the machine to check timing bounds
+struct Watch {
+  bool connected = false;
+  uint32_t unsafeSinceMs = 0;   // First step of the current run of non-ignition rules
+  bool unsafe = false;
+  uint32_t disconnectedAtMs = 0;
+};
+
+SafetyInputs decodeInput(int bits) {
+  SafetyInputs in;
+  in.standUp = bits & 1;
+  in.riding = (bits >> 1) & 1;
+  in.helmetSecure = (bits >> 2) & 1;
+  in.helmetWorn = (bits >> 3) & 1;
+  in.bleConnected = (bits >> 4) & 1;
+  return in;
+}
+
+HostClock hostClock;
+HostOutputs hostOutputs;
+
+uint64_t stepCount = 0;
+uint64_t violationCount = 0;
+std::vector<Step> path;
+
+void printPath(const char* what) {
+  std::printf("VIOLATION: %s\n", what);
+  uint32_t t = 0;
+  for (const Step& s : path) {
+    SafetyInputs in = decodeInput(s.input);
+    t += s.dt;
+    std::printf("  t=%8u ms  S=%d R=%d H=%d W=%d BLE=%d\n", t, in.standUp, in.riding,
+                in.helmetSecure, in.helmetWorn, in.bleConnected);
+  }
+}
+
+// Returns a description of the first broken invariant, or nullptr.
+const char* checkInvariants(const SafetyStateMachine& sm, const SafetyInputs& in, Watch& w) {
+  uint32_t now = hostClock.now;
+
+  if (hostOutputs.ignition != sm.ignitionEnabled()) return "ignition pin differs from state";
+  if (hostOutputs.buzzer != sm.buzzerOn()) return "buzzer pin differs from state";
+  if (sm.buzzerOn() && sm.ignitionEnabled()) return "buzzer on with ignition on";
+
+  if (in.bleConnected) {
+    if (!w.connected) w.unsafe = false;
+    w.connected = true;
+
+    SafetyRule rule = SafetyStateMachine::ruleFor(in.standUp, in.riding, in.helmetSecure, in.helmetWorn);
+    if (rule == SAFETY_RULE_IGNITION_ON) {
+      w.unsafe = false;
+      if (!sm.ignitionEnabled()) return "ignition off although S=1 and H=1";
+    } else {
+      if (!w.unsafe) {
+        w.unsafe = true;
+        w.unsafeSinceMs = now;
+      }
+      if (sm.ignitionEnabled()) {
+        if (rule != SAFETY_RULE_WARN_15S) return "ignition on outside the 15s warning";
+        if (now - w.unsafeSinceMs >= SAFETY_WARNING_15S_MS) return "ignition on for 15s or more without S=1,H=1";
+      }
+    }
+  } else {
+    if (w.connected) w.disconnectedAtMs = now;
+    w.connected = false;
+    w.unsafe = false;
+    if (sm.ignitionEnabled()) {
+      if (!sm.graceActive()) return "ignition on while disconnected without grace period";
+      if (now - w.disconnectedAtMs >= SAFETY_GRACE_PERIOD_MS) return "ignition on after grace period";
+    }
+  }
+  return nullptr;
+}
+
+void explore(const SafetyStateMachine& parent, const Watch& parentWatch, int depth) {
+  if (depth == 0) return;
+
+  uint32_t savedNow = hostClock.now;
+  HostOutputs savedOutputs = hostOutputs;
+
+  for (int t = 0; t < NUM_TIME_STEPS; t++) {
+    for (int input = 0; input < NUM_INPUTS; input++) {
+      hostClock.now = savedNow + TIME_STEPS[t];
+      hostOutputs = savedOutputs;
+
+      SafetyStateMachine sm(parent);
+      Watch w = parentWatch;
+      SafetyInputs in = decodeInput(input);
+      sm.step(in);
+      stepCount++;
+
+      path.push_back(Step{input, TIME_STEPS[t]});
+      const char* broken = checkInvariants(sm, in, w);
+      if (broken != nullptr) {
+        if (violationCount < 5) printPath(broken);
+        violationCount++;
+      } else {
+        explore(sm, w, depth - 1);
+      }
+      path.pop_back();
+    }
+  }
+
+  hostClock.now = savedNow;
+  hostOutputs = savedOutputs;
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void report(const char* mode, double seconds) {
+  std::printf("%s: %llu steps in %.3f s  (%.1f Msteps/s, %.2f ns/step), %llu violations\n", mode,
+              (unsigned long long)stepCount, seconds, stepCount / seconds / 1e6,
+              seconds * 1e9 / (double)stepCount, (unsigned long long)violationCount);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int depth = 4;
+  uint64_t randomSteps = 0;
+  unsigned seed = 1;
+
+  for (int i = 1; i < argc; i++) {
+    if (!std::strcmp(argv[i], "--depth") && i + 1 < argc) {
+      depth = std::atoi(argv[++i]);
+    } else if (!std::strcmp(argv[i], "--random") && i + 1 < argc) {
+      randomSteps = std::strtoull(argv[++i], nullptr, 10);
+    } else if (!std::strcmp(argv[i], "--seed") && i + 1 < argc) {
+      seed = (unsigned)std::strtoul(argv[++i], nullptr, 10);
+    } else {
+      std::fprintf(stderr, "usage: %s [--depth N] [--random STEPS] [--seed S]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  SafetyStateMachine root(hostClock, hostOutputs);
+  root.reset();
+
+  if (randomSteps > 0) {
+    // xorshift32: cheap enough not to dominate the measurement
+    uint32_t x = seed ? seed : 1;
+    Watch w;
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < randomSteps; i++) {
+      x ^= x << 13;
+      x ^= x >> 17;
+      x ^= x << 5;
+      hostClock.now += TIME_STEPS[(x >> 5) % NUM_TIME_STEPS];
+      SafetyInputs in = decodeInput(x & 31);
+      root.step(in);
+      stepCount++;
+      if (checkInvariants(root, in, w) != nullptr) violationCount++;
+    }
+    report("random", secondsSince(start));
+  } else {
+    auto start = std::chrono::steady_clock::now();
+    explore(root, Watch(), depth);
+    char mode[32];
+    std::snprintf(mode, sizeof(mode), "exhaustive depth %d", depth);
+    report(mode, secondsSince(start));
+  }
+  return violationCount == 0 ? 0 : 1;
+}
@@ -0,0 +1,610 @@
+// Arduino core, FreeRTOS, ESP-IDF and LCD stand-ins (see stubs/), implemented
+// on top of the simulator runtime. Everything acts on the device whose code
+// is currently running.
+
+#include <Arduino.h>
+#include <LiquidCrystal_I2C.h>
+#include <Preferences.h>
+#include <Wire.h>
+
+#include <deque>
+#include <map>
+#include <vector>
+
+#include "SimBle.h"
+#include "SimRuntime.h"
+
+using sim::Device;
+
+HardwareSerial Serial;
+EspClass ESP;
+TwoWire Wire;
+
+static Device* dev() { return sim::current(); }
+
+// ---------------- GPIO ----------------
+void pinMode(uint8_t pin, uint8_t mode) {
+  Device* d = dev();
+  if (pin >= sim::NUM_PINS) return;
+  d->mode[pin] = mode;
+  if (d->driven[pin]) return;
+  if ((mode & PULLUP) != 0) d->level[pin] = HIGH;
+  if ((mode & PULLDOWN) != 0) d->level[pin] = LOW;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+  Device* d = dev();
+  if (pin >= sim::NUM_PINS) return;
+  uint8_t level = val ? HIGH : LOW;
+  if (d->level[pin] == level) return;
+  d->level[pin] = level;
+  if (d->onPinWrite) d->onPinWrite(*d, pin, level);
+}
+
+int digitalRead(uint8_t pin) { return pin < sim::NUM_PINS ? dev()->level[pin] : LOW; }
+
+uint16_t analogRead(uint8_t pin) { return sim::readAnalog(dev(), pin); }
+
+void attachInterruptArg(uint8_t pin, void (*isr)(void*), void* arg, int mode) {
+  if (pin >= sim::NUM_PINS) return;
+  dev()->isr[pin] = isr;
+  dev()->isrArg[pin] = arg;
+  dev()->isrMode[pin] = mode;
+}
+
+static void callPlainIsr(void* arg) { ((void (*)())arg)(); }
+
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode) {
+  attachInterruptArg(pin, callPlainIsr, (void*)isr, mode);
+}
+
+void detachInterrupt(uint8_t pin) {
+  if (pin < sim::NUM_PINS) dev()->isr[pin] = nullptr;
+}
+
+esp_err_t gpio_set_intr_type(gpio_num_t gpio, gpio_int_type_t type) {
+  if (gpio < 0 || gpio >= sim::NUM_PINS) return ESP_FAIL;
+  dev()->isrMode[gpio] = type <= GPIO_INTR_ANYEDGE ? type : 0;  // Same values as RISING/FALLING/CHANGE
+  return ESP_OK;
+}
+
+esp_err_t gpio_intr_enable(gpio_num_t gpio) {
+  if (gpio < 0 || gpio >= sim::NUM_PINS) return ESP_FAIL;
+  dev()->isrMasked[gpio] = false;
+  return ESP_OK;
+}
+
+esp_err_t gpio_intr_disable(gpio_num_t gpio) {
+  if (gpio < 0 || gpio >= sim::NUM_PINS) return ESP_FAIL;
+  dev()->isrMasked[gpio] = true;
+  return ESP_OK;
+}
+
+esp_err_t gpio_wakeup_enable(gpio_num_t gpio, gpio_int_type_t type) {
+  if (gpio < 0 || gpio >= sim::NUM_PINS) return ESP_FAIL;
+  if (type != GPIO_INTR_LOW_LEVEL && type != GPIO_INTR_HIGH_LEVEL) return ESP_FAIL;
+  dev()->wakeLevel[gpio] = type == GPIO_INTR_HIGH_LEVEL ? 1 : 0;
+  dev()->isrMode[gpio] = 0;  // Level interrupts are not modelled: the pin's edge interrupt is gone
+  return ESP_OK;
+}
+
+esp_err_t gpio_wakeup_disable(gpio_num_t gpio) {
+  if (gpio < 0 || gpio >= sim::NUM_PINS) return ESP_FAIL;
+  dev()->wakeLevel[gpio] = -1;
+  return ESP_OK;
+}
+
+// ---------------- Time ----------------
+unsigned long millis() { return (unsigned long)(uint32_t)(sim::nowUs() / 1000); }
+unsigned long micros() { return (unsigned long)(uint32_t)sim::nowUs(); }
+void delay(uint32_t ms) { sim::sleepFor((uint64_t)ms * 1000); }
+void delayMicroseconds(uint32_t us) { sim::sleepFor(us); }
+void yield() { sim::sleepFor(0); }
+int64_t esp_timer_get_time() { return (int64_t)sim::nowUs(); }
+
+long random(long max) { return max > 0 ? (long)(sim::rng()() % (uint64_t)max) : 0; }
+long random(long min, long max) { return max > min ? min + random(max - min) : min; }
+void randomSeed(unsigned long seed) {}
+
+// ---------------- String ----------------
+void String::trim() {
+  size_t begin = str.find_first_not_of(" \t\r\n");
+  size_t end = str.find_last_not_of(" \t\r\n");
+  str = begin == std::string::npos ? std::string() : str.substr(begin, end - begin + 1);
+}
+
+// ---------------- Print / Serial ----------------
+size_t Print::write(const uint8_t* buffer, size_t size) {
+  size_t n = 0;
+  while (size--) n += write(*buffer++);
+  return n;
+}
+
+size_t Print::print(long v, int base) {
+  char buf[24];
+  snprintf(buf, sizeof(buf), base == HEX ? "%lx" : "%ld", v);
+  return write(buf);
+}
+
+size_t Print::print(unsigned long v, int base) {
+  char buf[24];
+  snprintf(buf, sizeof(buf), base == HEX ? "%lx" : "%lu", v);
+  return write(buf);
+}
+
+size_t Print::print(double v, int digits) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.*f", digits, v);
+  return write(buf);
+}
+
+size_t Print::printf(const char* format, ...) {
+  char buf[256];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(buf, sizeof(buf), format, args);
+  va_end(args);
+  if (len < 0) return 0;
+  if ((size_t)len >= sizeof(buf)) {
+    std::vector<char> big(len + 1);
+    va_start(args, format);
+    vsnprintf(big.data(), big.size(), format, args);
+    va_end(args);
+    return write((const uint8_t*)big.data(), len);
+  }
+  return write((const uint8_t*)buf, len);
+}
+
+void HardwareSerial::begin(unsigned long baud, uint32_t config, int8_t rxPin, int8_t txPin) {
+  dev()->serialBaud = (uint32_t)baud;
+}
+
+// Transmit side: the UART FIFO plus setTxBufferSize() hold what has not gone
+// out yet. Writes never wait here; the time they would have waited for room
+// is added up in serialTxBlockedUs instead.
+#define SIM_UART_FIFO 128
+
+static double txBytesPerUs(Device* d) { return d->serialBaud / 10 / 1e6; }
+
+static double txRoom(Device* d) { return SIM_UART_FIFO + d->serialTxBuffer; }
+
+static void drainTx(Device* d) {
+  uint64_t now = sim::nowUs();
+  d->serialTxQueued -= (now - d->serialTxAtUs) * txBytesPerUs(d);
+  if (d->serialTxQueued < 0) d->serialTxQueued = 0;
+  d->serialTxAtUs = now;
+}
+
+static void queueTx(Device* d, size_t size) {
+  drainTx(d);
+  double overBefore = d->serialTxQueued - txRoom(d);
+  d->serialTxQueued += size;
+  double overAfter = d->serialTxQueued - txRoom(d);
+  if (overAfter > 0) d->serialTxBlockedUs += (uint64_t)((overAfter - (overBefore > 0 ? overBefore : 0)) / txBytesPerUs(d));
+}
+
+int HardwareSerial::availableForWrite() {
+  Device* d = dev();
+  drainTx(d);
+  double room = txRoom(d) - d->serialTxQueued;
+  return room > 0 ? (int)room : 0;
+}
+
+size_t HardwareSerial::setTxBufferSize(size_t size) {
+  dev()->serialTxBuffer = (uint32_t)size;
+  return size;
+}
+
+static size_t writeText(Device* d, uint8_t c) {
+  d->serialBytes++;
+  if (c == '\r') return 1;
+  if (c != '\n') {
+    d->serialLine += (char)c;
+    return 1;
+  }
+  if (d->echoSerial) {
+    uint64_t t = sim::nowUs();
+    ::printf("[%7llu.%03llu] %-6s| %s\n", (unsigned long long)(t / 1000000),
+             (unsigned long long)(t / 1000 % 1000), d->name.c_str(), d->serialLine.c_str());
+  }
+  if (d->onSerialLine) d->onSerialLine(*d, d->serialLine);
+  d->serialLine.clear();
+  return 1;
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  Device* d = dev();
+  queueTx(d, 1);
+  if (d->serialCapture) fputc(c, d->serialCapture);
+  return writeText(d, c);
+}
+
+// One write() call holding binary data (a telemetry block) goes to the
+// capture only, so it cannot break up the text lines around it
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+  Device* d = dev();
+  queueTx(d, size);
+  if (d->serialCapture) fwrite(buffer, 1, size, d->serialCapture);
+  for (size_t i = 0; i < size; i++) {
+    if (buffer[i] < 0x20 && buffer[i] != '\t' && buffer[i] != '\r' && buffer[i] != '\n') {
+      d->serialBytes += size;
+      d->serialBinaryBytes += size;
+      return size;
+    }
+  }
+  for (size_t i = 0; i < size; i++) writeText(d, buffer[i]);
+  return size;
+}
+
+int HardwareSerial::available() { return (int)dev()->serialIn.size(); }
+
+int HardwareSerial::peek() {
+  Device* d = dev();
+  return d->serialIn.empty() ? -1 : (uint8_t)d->serialIn[0];
+}
+
+int HardwareSerial::read() {
+  Device* d = dev();
+  if (d->serialIn.empty()) return -1;
+  uint8_t c = (uint8_t)d->serialIn[0];
+  d->serialIn.erase(0, 1);
+  return c;
+}
+
+// ---------------- ESP ----------------
+#define SIM_HEAP_SIZE 327680
+
+// From the device's operator new accounting (SimRuntime.h). The heap does not
+// fragment here, so the largest block is all of it.
+uint32_t EspClass::getFreeHeap() { return (uint32_t)(SIM_HEAP_SIZE - dev()->heapUsed); }
+uint32_t EspClass::getMinFreeHeap() { return (uint32_t)(SIM_HEAP_SIZE - dev()->heapPeak); }
+uint32_t EspClass::getHeapSize() { return SIM_HEAP_SIZE; }
+uint32_t EspClass::getMaxAllocHeap() { return getFreeHeap(); }
+uint32_t EspClass::getCycleCount() { return (uint32_t)(sim::nowUs() * getCpuFreqMHz()); }
+
+void EspClass::restart() {
+  ::printf("sim: %s called ESP.restart(), device stopped\n", dev()->name.c_str());
+  sim::sleepDevice(dev());
+}
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause() { return (esp_sleep_wakeup_cause_t)dev()->wakeupCause; }
+esp_err_t esp_sleep_enable_ext0_wakeup(gpio_num_t gpio, int level) {
+  dev()->ext0Pin = gpio;
+  dev()->ext0Level = level ? 1 : 0;
+  return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t timeUs) {
+  dev()->timerWakeupUs = timeUs;
+  return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_gpio_wakeup() {
+  dev()->gpioWakeup = true;
+  return ESP_OK;
+}
+
+esp_err_t esp_sleep_disable_wakeup_source(esp_sleep_wakeup_cause_t source) {
+  if (source == ESP_SLEEP_WAKEUP_TIMER || source == ESP_SLEEP_WAKEUP_ALL) dev()->timerWakeupUs = 0;
+  if (source == ESP_SLEEP_WAKEUP_GPIO || source == ESP_SLEEP_WAKEUP_ALL) dev()->gpioWakeup = false;
+  return ESP_OK;
+}
+
+esp_err_t esp_light_sleep_start() {
+  bool gpio = sim::lightSleep(dev());
+  dev()->wakeupCause = gpio ? ESP_SLEEP_WAKEUP_GPIO : ESP_SLEEP_WAKEUP_TIMER;
+  return ESP_OK;
+}
+
+bool setCpuFrequencyMhz(uint32_t mhz) {
+  if (mhz != 80 && mhz != 160 && mhz != 240) return false;
+  dev()->cpuMhz = (uint16_t)mhz;
+  return true;
+}
+
+uint32_t getCpuFrequencyMhz() { return dev()->cpuMhz; }
+uint32_t EspClass::getCpuFreqMHz() { return getCpuFrequencyMhz(); }
+
+// The radio goes down with the rest; the EXT0 wakeup reboots the device
+// (SimRuntime.h)
+void esp_deep_sleep_start() {
+  sim::detachBle(dev());
+  sim::sleepDevice(dev());
+  abort();  // Only reached from outside a task
+}
+
+// ---------------- Preferences ----------------
+bool Preferences::begin(const char* name, bool readOnly) {
+  space = name;
+  this->readOnly = readOnly;
+  open = true;
+  return true;
+}
+
+bool Preferences::clear() {
+  if (!open || readOnly) return false;
+  std::map<std::string, std::string>& nvs = dev()->nvs;
+  std::string prefix = space + "/";
+  for (auto it = nvs.begin(); it != nvs.end();) {
+    if (it->first.compare(0, prefix.size(), prefix) == 0) it = nvs.erase(it);
+    else ++it;
+  }
+  return true;
+}
+
+bool Preferences::remove(const char* key) {
+  return open && !readOnly && dev()->nvs.erase(keyOf(key)) > 0;
+}
+
+bool Preferences::isKey(const char* key) { return open && dev()->nvs.count(keyOf(key)) > 0; }
+
+bool Preferences::put(const char* key, const std::string& value) {
+  if (!open || readOnly) return false;
+  sim::UntrackedHeap untracked;  // NVS lives in flash
+  dev()->nvs[keyOf(key)] = value;
+  return true;
+}
+
+bool Preferences::get(const char* key, std::string& value) {
+  if (!open) return false;
+  auto it = dev()->nvs.find(keyOf(key));
+  if (it == dev()->nvs.end()) return false;
+  value = it->second;
+  return true;
+}
+
+size_t Preferences::putString(const char* key, const char* value) {
+  return put(key, value) ? strlen(value) : 0;
+}
+
+String Preferences::getString(const char* key, const String& defaultValue) {
+  std::string v;
+  return get(key, v) ? String(v) : defaultValue;
+}
+
+size_t Preferences::putUChar(const char* key, uint8_t value) {
+  return put(key, std::string(1, (char)value)) ? 1 : 0;
+}
+
+uint8_t Preferences::getUChar(const char* key, uint8_t defaultValue) {
+  std::string v;
+  return get(key, v) && v.size() == 1 ? (uint8_t)v[0] : defaultValue;
+}
+
+size_t Preferences::putUInt(const char* key, uint32_t value) {
+  return put(key, std::string((const char*)&value, sizeof(value))) ? sizeof(value) : 0;
+}
+
+uint32_t Preferences::getUInt(const char* key, uint32_t defaultValue) {
+  std::string v;
+  if (!get(key, v) || v.size() != sizeof(uint32_t)) return defaultValue;
+  uint32_t value;
+  memcpy(&value, v.data(), sizeof(value));
+  return value;
+}
+
+// ---------------- FreeRTOS ----------------
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stackDepth,
+                                   void* param, UBaseType_t priority, TaskHandle_t* handle,
+                                   BaseType_t core) {
+  sim::Task* task = sim::spawn(dev(), name, [fn, param] { fn(param); }, stackDepth);
+  if (handle != nullptr) *handle = task;
+  return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char* name, uint32_t stackDepth, void* param,
+                       UBaseType_t priority, TaskHandle_t* handle) {
+  return xTaskCreatePinnedToCore(fn, name, stackDepth, param, priority, handle, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+  if (task == nullptr || task == sim::currentTask()) sim::exitTask();
+  ::printf("sim: vTaskDelete() of another task is not supported\n");
+}
+
+void vTaskDelay(TickType_t ticks) { sim::sleepFor((uint64_t)ticks * 1000); }
+TickType_t xTaskGetTickCount() { return (TickType_t)(sim::nowUs() / 1000); }
+TaskHandle_t xTaskGetCurrentTaskHandle() { return sim::currentTask(); }
+const char* pcTaskGetName(TaskHandle_t task) {
+  return sim::taskName(task != nullptr ? (sim::Task*)task : sim::currentTask());
+}
+BaseType_t xPortGetCoreID() { return 0; }
+
+// Host frames are far bigger than Xtensa ones, so the host's stack use (see
+// sim::taskStackUsed()) says little about the firmware's budget: report the
+// whole stack as free.
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+  return sim::taskStackDepth(task != nullptr ? (sim::Task*)task : sim::currentTask());
+}
+
+// Notification counts per task; waiters are woken by xTaskNotifyGive
+static std::map<sim::Task*, uint32_t> notifyCounts;
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+  sim::UntrackedHeap untracked;  // The count lives in the task's TCB
+  notifyCounts[(sim::Task*)task]++;
+  sim::wake((sim::Task*)task);
+  return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t wait) {
+  sim::Task* self = sim::currentTask();
+  uint64_t deadline = wait == portMAX_DELAY ? UINT64_MAX : sim::nowUs() + (uint64_t)wait * 1000;
+  uint32_t* slot;
+  {
+    sim::UntrackedHeap untracked;
+    slot = &notifyCounts[self];
+  }
+  uint32_t& count = *slot;
+  while (count == 0 && sim::inTask() && sim::nowUs() < deadline) sim::sleepUntil(deadline);
+  uint32_t taken = count;
+  if (count > 0) count = clearOnExit ? 0 : count - 1;
+  return taken;
+}
+
+struct SimQueue {
+  size_t itemSize;
+  size_t length;
+  std::deque<std::vector<uint8_t>> items;
+  std::vector<sim::Task*> waiters;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+  SimQueue* q = new SimQueue();
+  q->itemSize = itemSize;
+  q->length = length;
+  return q;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t wait) {
+  SimQueue* q = (SimQueue*)queue;
+  if (q->items.size() >= q->length) return errQUEUE_FULL;  // Senders never block here
+  const uint8_t* bytes = (const uint8_t*)item;
+  q->items.push_back(std::vector<uint8_t>(bytes, bytes + q->itemSize));
+  for (sim::Task* t : q->waiters) sim::wake(t);
+  return pdTRUE;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void* item, BaseType_t* woken) {
+  BaseType_t ok = xQueueSend(queue, item, 0);
+  if (woken != nullptr && ok == pdTRUE) *woken = pdTRUE;
+  return ok;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t wait) {
+  SimQueue* q = (SimQueue*)queue;
+  uint64_t deadline = wait == portMAX_DELAY ? UINT64_MAX : sim::nowUs() + (uint64_t)wait * 1000;
+
+  while (q->items.empty()) {
+    if (!sim::inTask() || sim::nowUs() >= deadline) return pdFALSE;
+    sim::Task* self = sim::currentTask();
+    q->waiters.push_back(self);
+    sim::sleepUntil(deadline);
+    for (size_t i = 0; i < q->waiters.size(); i++) {
+      if (q->waiters[i] == self) {
+        q->waiters.erase(q->waiters.begin() + i);
+        break;
+      }
+    }
+  }
+
+  memcpy(item, q->items.front().data(), q->itemSize);
+  q->items.pop_front();
+  return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+  return (UBaseType_t)((SimQueue*)queue)->items.size();
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() { return new int(0); }
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait) { return pdTRUE; }
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) { return pdTRUE; }
+
+// ---------------- Wire ----------------
+void TwoWire::beginTransmission(uint8_t address) {
+  txAddress = address;
+  txLength = 0;
+}
+
+size_t TwoWire::write(uint8_t value) {
+  if (txLength >= I2C_BUFFER_LENGTH) return 0;
+  txBuffer[txLength++] = value;
+  return 1;
+}
+
+size_t TwoWire::write(const uint8_t* data, size_t length) {
+  size_t n = 0;
+  while (n < length && write(data[n])) n++;
+  return n;
+}
+
+uint8_t TwoWire::endTransmission(bool sendStop) {
+  sim::sleepFor((uint64_t)(txLength + 1) * 9 * 1000000 / clockHz);  // 8 data bits + ACK
+  auto it = devices.find(txAddress);
+  if (it == devices.end()) return 2;
+  it->second(txBuffer, txLength);
+  return 0;
+}
+
+// ---------------- LiquidCrystal_I2C ----------------
+// Each LCD byte goes out as two 4-bit nibbles, each written to the PCF8574
+// three times (data, EN high, EN low): 6 transactions of address + data.
+#define LCD_I2C_BYTES_PER_WRITE 12
+#define LCD_CLEAR_US 2000
+
+LiquidCrystal_I2C::LiquidCrystal_I2C(uint8_t address, uint8_t cols, uint8_t rows)
+    : address(address), cols(cols), rows(rows) {
+  memset(text, ' ', sizeof(text));
+  for (int r = 0; r < 2; r++) text[r][cols < 40 ? cols : 40] = '\0';
+}
+
+// Bus time is charged to the calling task, like the blocking Wire driver.
+void LiquidCrystal_I2C::command(int transactions) {
+  uint64_t bytes = (uint64_t)transactions * LCD_I2C_BYTES_PER_WRITE;
+  busBytes += bytes;
+  sim::sleepFor(bytes * 9 * 1000000 / Wire.getClock());  // 8 data bits + ACK
+}
+
+// The library's begin() waits for the HD44780 to power up and for each of
+// its three 8-bit mode resets, then sends the setup commands
+#define LCD_POWER_UP_US (50000 + 1000000 + 3 * 4500 + 150)
+
+void LiquidCrystal_I2C::init() {
+  sim::sleepFor(LCD_POWER_UP_US);
+  command(6);  // Function set / display control / entry mode sequence
+  clear();
+  Wire.devices[address] = [this](const uint8_t* data, size_t length) {
+    busBytes += length + 1;
+    for (size_t i = 0; i < length; i++) onPins(data[i]);
+  };
+}
+
+// PCF8574: P0 RS, P2 EN, P3 backlight, P4-P7 data
+void LiquidCrystal_I2C::onPins(uint8_t pins) {
+  backlightOn = (pins & 0x08) != 0;
+  if ((lastPins & 0x04) && !(pins & 0x04)) {
+    uint8_t nibble = pins >> 4;
+    if (lowNibbleNext) execute((uint8_t)(highNibble << 4 | nibble), (pins & 0x01) != 0);
+    else highNibble = nibble;
+    lowNibbleNext = !lowNibbleNext;
+  }
+  lastPins = pins;
+}
+
+void LiquidCrystal_I2C::execute(uint8_t value, bool data) {
+  if (data) {
+    if (row < 2 && col < cols && col < 40) text[row][col] = (char)value;
+    col++;
+  } else if (value == 0x01) {
+    memset(text, ' ', sizeof(text));
+    for (int r = 0; r < 2; r++) text[r][cols < 40 ? cols : 40] = '\0';
+    col = row = 0;
+    sim::sleepFor(LCD_CLEAR_US);
+  } else if (value & 0x80) {
+    uint8_t ddram = value & 0x7f;
+    row = ddram >= 0x40 ? 1 : 0;
+    col = ddram - (row ? 0x40 : 0);
+  }
+}
+
+void LiquidCrystal_I2C::clear() {
+  memset(text, ' ', sizeof(text));
+  for (int r = 0; r < 2; r++) text[r][cols < 40 ? cols : 40] = '\0';
+  col = row = 0;
+  command(1);
+  sim::sleepFor(LCD_CLEAR_US);
+}
+
+void LiquidCrystal_I2C::setCursor(uint8_t c, uint8_t r) {
+  col = c;
+  row = r < rows ? r : rows - 1;
+  command(1);
+}
+
+size_t LiquidCrystal_I2C::write(uint8_t c) {
+  if (row < 2 && col < cols && col < 40) text[row][col] = (char)c;
+  col++;
+  command(1);
+  return 1;
+}
@@ -0,0 +1,119 @@
+// Continuous ADC (driver/adc.h) for the simulator.
+//
+// Conversions are produced at sample_freq_hz of virtual time and handed out
+// in DMA frames of conv_num_each_intr bytes. Every conversion in a frame
+// reads the pin's analog value at the time the frame is read (plus glitches,
+// see Config::adcGlitch); when the reader falls more than max_store_buf_size
+// behind, the oldest conversions are lost as on the real driver.
+
+#include <driver/adc.h>
+
+#include <cstring>
+#include <map>
+
+#include "SimRuntime.h"
+
+using sim::Device;
+
+namespace {
+
+struct AdcState {
+  adc_digi_init_config_t init = {};
+  adc_digi_configuration_t config = {};
+  adc_digi_pattern_config_t pattern[8] = {};
+  bool running = false;
+  uint64_t periodUs = 0;
+  uint64_t nextConversionUs = 0;  // Conversions before this time have been read or lost
+  uint32_t patternIndex = 0;
+};
+
+std::map<Device*, AdcState> adcs;
+
+AdcState* adcOf(Device* d) {
+  auto it = adcs.find(d);
+  return it != adcs.end() ? &it->second : nullptr;
+}
+
+}  // namespace
+
+esp_err_t adc_digi_initialize(const adc_digi_init_config_t* init_config) {
+  AdcState& a = adcs[sim::current()];
+  a = AdcState();
+  a.init = *init_config;
+  return ESP_OK;
+}
+
+esp_err_t adc_digi_controller_configure(const adc_digi_configuration_t* config) {
+  AdcState* a = adcOf(sim::current());
+  if (a == nullptr || config->pattern_num == 0 || config->pattern_num > 8) return ESP_ERR_INVALID_STATE;
+  if (config->sample_freq_hz < SOC_ADC_SAMPLE_FREQ_THRES_LOW ||
+      config->sample_freq_hz > SOC_ADC_SAMPLE_FREQ_THRES_HIGH) {
+    return ESP_FAIL;
+  }
+  a->config = *config;
+  for (uint32_t i = 0; i < config->pattern_num; i++) a->pattern[i] = config->adc_pattern[i];
+  a->config.adc_pattern = a->pattern;
+  a->periodUs = 1000000 / config->sample_freq_hz;
+  return ESP_OK;
+}
+
+esp_err_t adc_digi_start() {
+  AdcState* a = adcOf(sim::current());
+  if (a == nullptr || a->periodUs == 0) return ESP_ERR_INVALID_STATE;
+  a->running = true;
+  a->nextConversionUs = sim::nowUs();
+  return ESP_OK;
+}
+
+esp_err_t adc_digi_stop() {
+  AdcState* a = adcOf(sim::current());
+  if (a == nullptr) return ESP_ERR_INVALID_STATE;
+  a->running = false;
+  return ESP_OK;
+}
+
+esp_err_t adc_digi_deinitialize() {
+  adcs.erase(sim::current());
+  return ESP_OK;
+}
+
+esp_err_t adc_digi_read_bytes(uint8_t* buf, uint32_t length_max, uint32_t* out_length, uint32_t timeout_ms) {
+  Device* d = sim::current();
+  AdcState* a = adcOf(d);
+  *out_length = 0;
+  if (a == nullptr || !a->running) return ESP_ERR_INVALID_STATE;
+
+  uint32_t frame = a->init.conv_num_each_intr / SOC_ADC_DIGI_RESULT_BYTES;
+  uint32_t maxStored = a->init.max_store_buf_size / SOC_ADC_DIGI_RESULT_BYTES;
+  if (frame == 0) frame = 1;
+
+  uint64_t frameReadyUs = a->nextConversionUs + frame * a->periodUs;
+  if (sim::nowUs() < frameReadyUs) {
+    uint64_t deadline = sim::nowUs() + (uint64_t)timeout_ms * 1000;
+    if (timeout_ms == ADC_MAX_DELAY || deadline > frameReadyUs) deadline = frameReadyUs;
+    sim::sleepUntil(deadline);
+    if (sim::nowUs() < frameReadyUs) return ESP_ERR_TIMEOUT;
+  }
+
+  uint64_t available = (sim::nowUs() - a->nextConversionUs) / a->periodUs;
+  if (maxStored > 0 && available > maxStored) {
+    a->nextConversionUs += (available - maxStored) * a->periodUs;
+    available = maxStored;
+  }
+  uint32_t count = length_max / SOC_ADC_DIGI_RESULT_BYTES;
+  if (count > available) count = (uint32_t)available;
+
+  for (uint32_t i = 0; i < count; i++) {
+    const adc_digi_pattern_config_t& p = a->pattern[a->patternIndex];
+    a->patternIndex = (a->patternIndex + 1) % a->config.pattern_num;
+    adc_digi_output_data_t out;
+    out.val = 0;
+    out.type2.channel = p.channel;
+    out.type2.unit = p.unit;
+    out.type2.data = sim::readAnalog(d, p.channel) & 0xFFF;
+    memcpy(buf + i * SOC_ADC_DIGI_RESULT_BYTES, &out, sizeof(out));
+  }
+  a->nextConversionUs += (uint64_t)count * a->periodUs;
+  *out_length = count * SOC_ADC_DIGI_RESULT_BYTES;
+  return ESP_OK;
+}
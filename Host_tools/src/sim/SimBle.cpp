@@ -0,0 +1,594 @@
+#include "SimBle.h"
+
+#include <algorithm>
+
+namespace sim {
+
+static BleConfig config_;
+static BleStats stats_;
+static std::vector<BleNode*> nodes;
+static std::vector<BleLink*> links;  // Live links; dropped ones are never freed, pending events may still point at them
+static uint32_t nextLinkId = 1;
+
+std::function<void(Device& from, Device& to, const BLEUUID& characteristic, const uint8_t* data,
+                   size_t length)> onNotifyDelivered;
+
+BleConfig& bleConfig() { return config_; }
+BleStats& bleStats() { return stats_; }
+
+static BleNode* self() {
+  Device* dev = current();
+  if (dev == nullptr || dev->ble == nullptr) {
+    fprintf(stderr, "sim: BLE used before BLEDevice::init()\n");
+    abort();
+  }
+  return dev->ble;
+}
+
+static BleNode* findNode(const BLEAddress& address) {
+  for (BleNode* n : nodes) {
+    if (n->address == address) return n;
+  }
+  return nullptr;
+}
+
+static bool inRange(const BleLink* link) {
+  return link->central->inRange && link->peripheral->inRange;
+}
+
+static uint64_t linkLatencyUs() {
+  return (uint64_t)((config_.latencyMs + config_.jitterMs * uniform()) * 1000.0);
+}
+
+// Own generator for the connection event model, so a run with one link and
+// no scan draws exactly the numbers it drew before there was one
+static std::mt19937_64& radioRng() {
+  static std::mt19937_64 generator(config_.radioSeed);
+  return generator;
+}
+
+static double radioUniform() { return (double)(radioRng()() >> 11) * (1.0 / 9007199254740992.0); }
+
+static uint16_t pickInterval(uint16_t minInterval, uint16_t maxInterval) {
+  if (maxInterval <= minInterval) return minInterval;
+  return minInterval + (uint16_t)(radioRng()() % (maxInterval - minInterval + 1));
+}
+
+static double scanDuty(const BLEScan& scan) {
+  if (scan.intervalMs == 0) return 1.0;
+  return std::min(1.0, (double)scan.windowMs / scan.intervalMs);
+}
+
+// The controller puts scan windows in the gap between connection events when
+// every link has the same interval, the scan repeats at a multiple of it and
+// the window fits
+static bool scanFitsBetweenEvents(const BleNode* central) {
+  const BLEScan& scan = central->scan;
+  uint64_t intervalUs = 0;
+  uint32_t linkCount = 0;
+  for (const BleLink* l : links) {
+    if (!l->up || l->central != central) continue;
+    if (intervalUs != 0 && intervalUs != (uint64_t)l->interval * 1250) return false;
+    intervalUs = (uint64_t)l->interval * 1250;
+    linkCount++;
+  }
+  if (intervalUs == 0 || ((uint64_t)scan.intervalMs * 1000) % intervalUs != 0) return false;
+  return (uint64_t)scan.windowMs * 1000 + (uint64_t)(linkCount * config_.eventMs * 1000) <= intervalUs;
+}
+
+// Extra delay of the next packet on `link`: the events it loses to the
+// central's other links and to its scan, one interval each
+static uint64_t contentionDelayUs(const BleLink* link) {
+  double p = 0;
+  for (const BleLink* other : links) {
+    if (other == link || !other->up || other->central != link->central) continue;
+    if (other->interval == link->interval) continue;
+    p += 2 * config_.eventMs / (other->interval * 1.25);
+  }
+  const BleNode* central = link->central;
+  if (central->scan.scanning && !scanFitsBetweenEvents(central)) p += scanDuty(central->scan);
+  if (p <= 0) return 0;
+  p = std::min(p, 0.9);
+
+  uint32_t lost = 0;
+  while (lost < 8 && radioUniform() < p) lost++;
+  return (uint64_t)(lost * link->interval * 1250);
+}
+
+static BLECharacteristic* serverCharacteristic(BLEServer* server, const BLEUUID& service,
+                                               const BLEUUID& uuid) {
+  BLEService* s = server->getServiceByUUID(service);
+  return s != nullptr ? s->getCharacteristic(uuid) : nullptr;
+}
+
+static void dropLink(BleLink* link) {
+  if (!link->up) return;
+  link->up = false;
+  link->client->link = nullptr;
+  link->server->link = nullptr;
+  stats_.disconnects++;
+  link->central->dropped = true;
+  link->central->droppedAtUs = nowUs();
+
+  at(nowUs(), link->central->dev, [link] {
+    if (link->client->callbacks != nullptr) link->client->callbacks->onDisconnect(link->client);
+  });
+  at(nowUs(), link->peripheral->dev, [link] {
+    if (link->server->callbacks != nullptr) link->server->callbacks->onDisconnect(link->server);
+  });
+}
+
+uint64_t advIntervalUs(const BleNode* node) {
+  uint16_t interval = node->advertising.maxInterval;
+  return interval > 0 ? (uint64_t)interval * 625 : (uint64_t)config_.advIntervalMs * 1000;
+}
+
+// A scanner sees an advertiser after a random discovery delay, once per scan;
+// a slowly advertising peer takes up to an advertising interval longer
+// scanFindMs is at Arduino's default duty (30 ms every 50 ms); a lower duty
+// takes proportionally longer
+static void scheduleDiscovery(BleNode* scanner, BleNode* advertiser) {
+  uint32_t generation = scanner->scan.generation;
+  uint64_t delayUs = (uint64_t)(config_.scanFindMs * (0.5 + uniform()) * 1000.0);
+  if (advIntervalUs(advertiser) > (uint64_t)config_.scanFindMs * 1000) {
+    delayUs = (uint64_t)(advIntervalUs(advertiser) * (0.5 + uniform()));
+  }
+  double duty = scanDuty(scanner->scan);
+  if (duty > 0 && duty < 0.6) delayUs = (uint64_t)(delayUs * 0.6 / duty);
+  after(delayUs, scanner->dev, [scanner, advertiser, generation] {
+    BLEScan& scan = scanner->scan;
+    if (!scan.scanning || scan.generation != generation) return;
+    if (!advertiser->advertisingOn || !scanner->inRange || !advertiser->inRange) return;
+    if (scan.callbacks == nullptr) return;
+
+    BLEAdvertisedDevice device;
+    device.address = advertiser->address;
+    device.name = advertiser->name;
+    device.services = advertiser->advServices;
+    scan.callbacks->onResult(device);
+  });
+}
+
+void setInRange(Device* dev, bool reachable) {
+  BleNode* node = dev->ble;
+  if (node == nullptr || node->inRange == reachable) return;
+  node->inRange = reachable;
+  if (reachable) return;
+
+  for (BleLink* link : links) {
+    if (!link->up || (link->central != node && link->peripheral != node)) continue;
+    after((uint64_t)link->supervisionMs * 1000, nullptr, [link] {
+      if (link->up && !inRange(link)) dropLink(link);
+    });
+  }
+}
+
+void dropLinks(Device* dev) {
+  for (BleLink* link : links) {
+    if (link->up && (link->central->dev == dev || link->peripheral->dev == dev)) dropLink(link);
+  }
+}
+
+void detachBle(Device* dev) {
+  BleNode* node = dev->ble;
+  if (node == nullptr) return;
+  setInRange(dev, false);
+  node->scan.stop();
+  node->advertisingOn = false;
+  nodes.erase(std::find(nodes.begin(), nodes.end(), node));  // Kept alive: links and events still point at it
+  dev->ble = nullptr;
+}
+
+bool isLinked(Device* dev) {
+  for (BleLink* link : links) {
+    if (link->up && (link->central->dev == dev || link->peripheral->dev == dev)) return true;
+  }
+  return false;
+}
+
+}  // namespace sim
+
+using sim::BleLink;
+using sim::BleNode;
+
+// ---------------- BLEDevice ----------------
+void BLEDevice::init(std::string deviceName) {
+  sim::Device* dev = sim::current();
+  if (dev->ble != nullptr) return;
+  sim::sleepFor((uint64_t)sim::bleConfig().initMs * 1000);
+
+  BleNode* node = new BleNode();
+  char address[18];
+  snprintf(address, sizeof(address), "24:0a:c4:00:00:%02x", dev->index + 1);
+  node->dev = dev;
+  node->name = deviceName;
+  node->address = BLEAddress(address);
+  node->scan.node = node;
+  node->advertising.node = node;
+  dev->ble = node;
+  sim::nodes.push_back(node);
+}
+
+void BLEDevice::deinit(bool releaseMemory) {}
+bool BLEDevice::getInitialized() { return sim::current()->ble != nullptr; }
+BLEScan* BLEDevice::getScan() { return &sim::self()->scan; }
+BLEAdvertising* BLEDevice::getAdvertising() { return &sim::self()->advertising; }
+void BLEDevice::startAdvertising() { getAdvertising()->start(); }
+BLEAddress BLEDevice::getAddress() { return sim::self()->address; }
+
+esp_err_t BLEDevice::setMTU(uint16_t mtu) {
+  sim::self()->mtu = mtu;
+  return ESP_OK;
+}
+
+uint16_t BLEDevice::getMTU() { return sim::self()->mtu; }
+
+BLEClient* BLEDevice::createClient() {
+  BLEClient* client = new BLEClient();
+  client->node = sim::self();
+  return client;
+}
+
+BLEServer* BLEDevice::createServer() {
+  BLEServer* server = new BLEServer();
+  server->node = sim::self();
+  server->node->server = server;
+  return server;
+}
+
+// ---------------- Advertising / scanning ----------------
+bool BLEAdvertisedDevice::isAdvertisingService(const BLEUUID& uuid) const {
+  for (const BLEUUID& s : services) {
+    if (s == uuid) return true;
+  }
+  return false;
+}
+
+void BLEAdvertising::addServiceUUID(BLEUUID uuid) { node->advServices.push_back(uuid); }
+
+void BLEAdvertising::start() {
+  if (node->advertisingOn) return;
+  node->advertisingOn = true;
+  for (BleNode* n : sim::nodes) {
+    if (n != node && n->scan.scanning) sim::scheduleDiscovery(n, node);
+  }
+}
+
+void BLEAdvertising::stop() { node->advertisingOn = false; }
+
+void BLEScan::setAdvertisedDeviceCallbacks(BLEAdvertisedDeviceCallbacks* callbacks,
+                                          bool wantDuplicates, bool shouldParse) {
+  this->callbacks = callbacks;
+}
+
+bool BLEScan::start(uint32_t duration, void (*scanCompleteCB)(BLEScanResults), bool isContinue) {
+  stop();
+  scanning = true;
+  completeCallback = scanCompleteCB;
+  sim::bleStats().scans++;
+
+  for (BleNode* n : sim::nodes) {
+    if (n != node && n->advertisingOn) sim::scheduleDiscovery(node, n);
+  }
+
+  uint32_t scanGeneration = generation;
+  sim::after((uint64_t)duration * 1000000, node->dev, [this, scanGeneration] {
+    if (!scanning || generation != scanGeneration) return;
+    scanning = false;
+    if (completeCallback != nullptr) completeCallback(BLEScanResults());
+  });
+  return true;
+}
+
+BLEScanResults BLEScan::start(uint32_t duration, bool isContinue) {
+  start(duration, nullptr, isContinue);
+  sim::sleepFor((uint64_t)duration * 1000000);
+  stop();
+  return BLEScanResults();
+}
+
+void BLEScan::stop() {
+  scanning = false;
+  generation++;
+}
+
+esp_err_t esp_ble_gap_set_prefer_conn_params(esp_bd_addr_t bd_addr, uint16_t min_conn_int, uint16_t max_conn_int,
+                                             uint16_t slave_latency, uint16_t supervision_tout) {
+  char address[18];
+  snprintf(address, sizeof(address), "%02x:%02x:%02x:%02x:%02x:%02x", bd_addr[0], bd_addr[1], bd_addr[2],
+           bd_addr[3], bd_addr[4], bd_addr[5]);
+  sim::PreferredConnParams& params = sim::current()->ble->preferred[address];
+  params.minInterval = min_conn_int;
+  params.maxInterval = max_conn_int;
+  params.supervisionMs = (uint32_t)supervision_tout * 10;
+  return ESP_OK;
+}
+
+// ---------------- GATT client ----------------
+BLEClient::~BLEClient() {
+  disconnect();
+  clearServices();
+}
+
+void BLEClient::clearServices() {
+  for (auto& service : services) {
+    for (auto& characteristic : service.second->characteristics) delete characteristic.second;
+    delete service.second;
+  }
+  services.clear();
+}
+
+bool BLEClient::connect(BLEAdvertisedDevice* device) { return connect(device->getAddress()); }
+
+bool BLEClient::connect(BLEAddress address, esp_ble_addr_type_t type) {
+  if (link != nullptr) return true;
+
+  BleNode* peer = sim::findNode(address);
+  auto reachable = [this, peer] {
+    return peer != nullptr && peer->advertisingOn && peer->server != nullptr &&
+           peer->server->link == nullptr && node->inRange && peer->inRange;
+  };
+
+  const sim::BleConfig& cfg = sim::bleConfig();
+  uint64_t deadlineUs = sim::nowUs() + (uint64_t)cfg.connectTimeoutMs * 1000;
+  while (!reachable() && sim::nowUs() < deadlineUs) {
+    uint64_t stepUs = peer != nullptr ? sim::advIntervalUs(peer) : (uint64_t)cfg.advIntervalMs * 1000;
+    sim::sleepFor(std::min(stepUs, deadlineUs - sim::nowUs()));
+  }
+  if (reachable()) sim::sleepFor((uint64_t)cfg.connectMs * 1000);
+  if (!reachable()) {
+    sim::bleStats().connectFailures++;
+    return false;
+  }
+
+  BleLink* l;
+  {
+    sim::UntrackedHeap untracked;  // The link is the radio's, not the firmware's heap
+    l = new BleLink();
+    l->id = sim::nextLinkId++;
+    l->central = node;
+    l->peripheral = peer;
+    l->client = this;
+    l->server = peer->server;
+    l->mtu = node->mtu < peer->mtu ? node->mtu : peer->mtu;  // Exchanged on connect
+    auto preferred = node->preferred.find(address.toString());
+    if (preferred != node->preferred.end()) {
+      l->supervisionMs = preferred->second.supervisionMs;
+      l->interval = sim::pickInterval(preferred->second.minInterval, preferred->second.maxInterval);
+    } else {
+      l->supervisionMs = cfg.supervisionMs;
+    }
+    sim::links.erase(std::remove_if(sim::links.begin(), sim::links.end(), [](BleLink* old) { return !old->up; }),
+                     sim::links.end());
+    sim::links.push_back(l);
+  }
+
+  link = l;
+  mtu = l->mtu;
+  peerAddress = address;
+  peer->server->link = l;
+  peer->server->connId++;
+  peer->advertisingOn = false;  // Connectable advertising stops on connection
+  sim::bleStats().connects++;
+  if (node->dropped) {
+    sim::UntrackedHeap untracked;
+    node->dropped = false;
+    sim::bleStats().reconnectUs.push_back((uint32_t)(sim::nowUs() - node->droppedAtUs));
+  }
+
+  sim::at(sim::nowUs(), peer->dev, [l] {
+    if (!l->up || l->server->callbacks == nullptr) return;
+    esp_ble_gatts_cb_param_t param = {};
+    param.connect.conn_id = l->server->connId;
+    memcpy(param.connect.remote_bda, *l->central->address.getNative(), ESP_BD_ADDR_LEN);
+    l->server->callbacks->onConnect(l->server);
+    l->server->callbacks->onConnect(l->server, &param);
+  });
+  if (callbacks != nullptr) callbacks->onConnect(this);
+  return true;
+}
+
+void BLEClient::disconnect() {
+  if (link != nullptr) sim::dropLink(link);
+}
+
+bool BLEClient::setMTU(uint16_t requested) {
+  if (link == nullptr) return false;
+  uint16_t peerMtu = link->peripheral->mtu;
+  link->mtu = requested < peerMtu ? requested : peerMtu;
+  mtu = link->mtu;
+  return true;
+}
+
+BLERemoteService* BLEClient::getService(BLEUUID uuid) {
+  if (link == nullptr) return nullptr;
+  auto it = services.find(uuid.toString());
+  if (it != services.end()) return it->second;
+  if (link->server->getServiceByUUID(uuid) == nullptr) return nullptr;
+
+  BLERemoteService* service = new BLERemoteService();
+  service->uuid = uuid;
+  service->client = this;
+  services[uuid.toString()] = service;
+  return service;
+}
+
+std::map<std::string, BLERemoteService*>* BLEClient::getServices() {
+  clearServices();
+  if (link != nullptr) {
+    for (BLEService* s : link->server->services) getService(s->getUUID());
+  }
+  return &services;
+}
+
+BLERemoteCharacteristic* BLERemoteService::getCharacteristic(BLEUUID charUuid) {
+  auto it = characteristics.find(charUuid.toString());
+  if (it != characteristics.end()) return it->second;
+  if (client->link == nullptr) return nullptr;
+
+  BLECharacteristic* remote = sim::serverCharacteristic(client->link->server, uuid, charUuid);
+  if (remote == nullptr) return nullptr;
+
+  BLERemoteCharacteristic* characteristic = new BLERemoteCharacteristic();
+  characteristic->uuid = charUuid;
+  characteristic->properties = remote->properties;
+  characteristic->client = client;
+  characteristic->service = uuid;
+  characteristics[charUuid.toString()] = characteristic;
+  return characteristic;
+}
+
+void BLERemoteCharacteristic::registerForNotify(notify_callback callback, bool notifications,
+                                               bool descriptorRequiresRegistration) {
+  onNotify = callback;
+  BleLink* link = client->link;
+  if (link == nullptr) return;
+  BLECharacteristic* remote = sim::serverCharacteristic(link->server, service, uuid);
+  if (remote == nullptr) return;
+  sim::UntrackedHeap untracked;  // Part of the link
+  if (callback) {
+    link->subscriptions[remote] = this;
+  } else {
+    link->subscriptions.erase(remote);
+  }
+}
+
+void BLERemoteCharacteristic::writeValue(uint8_t* data, size_t length, bool response) {
+  BleLink* link = client->link;
+  if (link == nullptr) return;
+  BLECharacteristic* remote = sim::serverCharacteristic(link->server, service, uuid);
+  if (remote == nullptr) return;
+
+  std::string value((const char*)data, length);
+  // A peripheral with latency only listens every (latency + 1)th connection
+  // event. Own generator, so latency settings do not change the rest of a seeded run.
+  static std::mt19937_64 skipRng(1);
+  uint64_t skipped = link->peripheralLatency > 0 ? skipRng() % (link->peripheralLatency + 1) : 0;
+  uint64_t latencyUs = sim::linkLatencyUs() + (uint64_t)(skipped * sim::bleConfig().latencyMs * 1000.0) +
+                       sim::contentionDelayUs(link);
+  sim::after(latencyUs, link->peripheral->dev, [link, remote, value] {
+    if (!link->up) return;
+    remote->value = value;
+    if (remote->callbacks != nullptr) remote->callbacks->onWrite(remote);
+  });
+  if (response) sim::sleepFor(2 * latencyUs);
+}
+
+void BLERemoteCharacteristic::writeValue(std::string value, bool response) {
+  writeValue((uint8_t*)value.data(), value.size(), response);
+}
+
+std::string BLERemoteCharacteristic::readValue() {
+  BleLink* link = client->link;
+  if (link == nullptr) return std::string();
+  sim::sleepFor(2 * sim::linkLatencyUs());
+  if (!link->up) return std::string();
+  BLECharacteristic* remote = sim::serverCharacteristic(link->server, service, uuid);
+  return remote != nullptr ? remote->value : std::string();
+}
+
+// ---------------- GATT server ----------------
+BLEService* BLEServer::createService(const char* uuid) { return createService(BLEUUID(uuid)); }
+
+BLEService* BLEServer::createService(BLEUUID uuid) {
+  BLEService* service = new BLEService();
+  service->uuid = uuid;
+  service->server = this;
+  services.push_back(service);
+  return service;
+}
+
+BLEService* BLEServer::getServiceByUUID(BLEUUID uuid) {
+  for (BLEService* s : services) {
+    if (s->uuid == uuid) return s;
+  }
+  return nullptr;
+}
+
+BLEAdvertising* BLEServer::getAdvertising() { return &node->advertising; }
+void BLEServer::startAdvertising() { node->advertising.start(); }
+
+void BLEServer::updateConnParams(uint8_t* remoteBda, uint16_t minInterval, uint16_t maxInterval,
+                                 uint16_t latency, uint16_t timeout) {
+  if (link == nullptr) return;
+  link->peripheralLatency = latency;
+  // The central keeps its interval if it is in the requested range
+  if (link->interval < minInterval || link->interval > maxInterval) {
+    link->interval = sim::pickInterval(minInterval, maxInterval);
+  }
+}
+
+void BLEServer::disconnect(uint16_t id) {
+  if (link != nullptr) sim::dropLink(link);
+}
+
+uint16_t BLEServer::getPeerMTU(uint16_t id) { return link != nullptr ? link->mtu : 23; }
+
+bool BLE2902::getNotifications() {
+  BLEServer* server = characteristic != nullptr ? characteristic->server : nullptr;
+  if (server == nullptr || server->link == nullptr) return false;
+  return server->link->subscriptions.count(characteristic) > 0;
+}
+
+BLECharacteristic* BLEService::createCharacteristic(const char* uuid, uint32_t properties) {
+  return createCharacteristic(BLEUUID(uuid), properties);
+}
+
+BLECharacteristic* BLEService::createCharacteristic(BLEUUID uuid, uint32_t properties) {
+  BLECharacteristic* characteristic = new BLECharacteristic();
+  characteristic->uuid = uuid;
+  characteristic->properties = properties;
+  characteristic->server = server;
+  characteristics.push_back(characteristic);
+  return characteristic;
+}
+
+BLECharacteristic* BLEService::getCharacteristic(BLEUUID uuid) {
+  for (BLECharacteristic* c : characteristics) {
+    if (c->uuid == uuid) return c;
+  }
+  return nullptr;
+}
+
+void BLECharacteristic::setValue(uint8_t* data, size_t length) {
+  value.assign((const char*)data, length);
+}
+void BLECharacteristic::setValue(std::string v) { value = v; }
+void BLECharacteristic::setValue(uint16_t& data16) { setValue((uint8_t*)&data16, 2); }
+void BLECharacteristic::setValue(uint32_t& data32) { setValue((uint8_t*)&data32, 4); }
+void BLECharacteristic::setValue(int& data32) { setValue((uint8_t*)&data32, 4); }
+
+void BLECharacteristic::notify(bool isNotification) {
+  BleLink* link = server != nullptr ? server->link : nullptr;
+  if (link == nullptr) return;
+  auto it = link->subscriptions.find(this);
+  if (it == link->subscriptions.end()) return;  // Peer has not enabled notifications
+
+  sim::BleStats& stats = sim::bleStats();
+  stats.notifySent++;
+  if (!sim::inRange(link) || sim::uniform() < sim::bleConfig().loss) {
+    stats.notifyDropped++;
+    return;
+  }
+
+  // Payload is cut to ATT_MTU - 3, like the real stack
+  std::string payload = value.substr(0, link->mtu - 3);
+  uint64_t deliverAt = sim::nowUs() + sim::linkLatencyUs() + sim::contentionDelayUs(link);
+  if (deliverAt < link->lastDeliveryUs) deliverAt = link->lastDeliveryUs;
+  link->lastDeliveryUs = deliverAt;
+
+  BLERemoteCharacteristic* remote = it->second;
+  sim::at(deliverAt, link->central->dev, [link, remote, payload] {
+    sim::BleStats& stats = sim::bleStats();
+    if (!link->up) {
+      stats.notifyDropped++;
+      return;
+    }
+    std::vector<uint8_t> data(payload.begin(), payload.end());
+    stats.notifyDelivered++;
+    if (sim::onNotifyDelivered) {
+      sim::onNotifyDelivered(*link->peripheral->dev, *link->central->dev, remote->uuid, data.data(), data.size());
+    }
+    if (remote->onNotify) remote->onNotify(remote, data.data(), data.size(), true);
+  });
+}
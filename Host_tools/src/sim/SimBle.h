@@ -0,0 +1,115 @@
+#pragma once
+
+// Fake BLE transport joining the simulated devices' BLEDevice stubs.
+//
+// One node per device that called BLEDevice::init(). Advertising nodes are
+// found by scanners after a short discovery delay, a client connect takes a
+// few connection events (to a peer that is not advertising yet it waits, like
+// Bluedroid's initiator, up to connectTimeoutMs), and each notification
+// reaches the peer after a random latency (in order, like the link layer).
+// Links drop on request, or after the supervision timeout once a device goes
+// out of range.
+//
+// A central serves one connection event at a time. When it holds links with
+// different intervals their events drift through each other, and a colliding
+// event is skipped; a running scan takes the radio for its window the same
+// way. Every skipped event delays a notification or write by one interval of
+// its link. Links with the same interval are kept apart, like the controller
+// does, and so is a scan whose windows fit between their events.
+
+#include <BLEDevice.h>
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "SimRuntime.h"
+
+namespace sim {
+
+struct BleConfig {
+  double latencyMs = 7.5;          // Minimum notify latency (one connection interval)
+  double jitterMs = 7.5;           // Extra uniform random latency on top
+  double loss = 0.0;               // Probability a notification never arrives
+  uint32_t connectMs = 60;         // Connect + service discovery
+  uint32_t connectTimeoutMs = 30000; // Bluedroid's direct connect timeout (CONFIG_BT_BLE_ESTAB_LINK_CONN_TOUT)
+  uint32_t advIntervalMs = 100;    // Advertising interval of a peer that did not set one
+  uint32_t scanFindMs = 150;       // Mean time for a scan to see an advertiser
+  uint32_t supervisionMs = 4000;   // Out of range -> disconnect
+  uint32_t initMs = 250;           // BLEDevice::init(): controller and Bluedroid bring-up (rough)
+  double eventMs = 1.25;           // Radio time of one connection event
+  uint64_t radioSeed = 1;          // Connection intervals and lost events (--seed)
+};
+
+struct BleStats {
+  uint64_t notifySent = 0;
+  uint64_t notifyDelivered = 0;
+  uint64_t notifyDropped = 0;      // Lost (loss rate / out of range / link dropped in flight)
+  uint64_t connects = 0;
+  uint64_t connectFailures = 0;
+  uint64_t disconnects = 0;
+  uint64_t scans = 0;
+  std::vector<uint32_t> reconnectUs;  // Link drop -> the same central connected again
+};
+
+struct PreferredConnParams {
+  uint16_t minInterval;            // 1.25 ms units
+  uint16_t maxInterval;
+  uint32_t supervisionMs;
+};
+
+struct BleNode {
+  Device* dev = nullptr;
+  std::string name;
+  BLEAddress address;
+  bool inRange = true;
+  BLEScan scan;
+  BLEAdvertising advertising;
+  bool advertisingOn = false;
+  std::vector<BLEUUID> advServices;
+  BLEServer* server = nullptr;
+  uint16_t mtu = 23;
+  std::map<std::string, PreferredConnParams> preferred;  // esp_ble_gap_set_prefer_conn_params() per peer
+  bool dropped = false;            // A link of this central dropped and it has not reconnected yet
+  uint64_t droppedAtUs = 0;
+};
+
+struct BleLink {
+  uint32_t id = 0;
+  bool up = true;
+  BleNode* central = nullptr;
+  BleNode* peripheral = nullptr;
+  BLEClient* client = nullptr;
+  BLEServer* server = nullptr;
+  uint16_t mtu = 23;
+  uint32_t supervisionMs = 0;
+  uint16_t interval = 6;           // Connection interval, 1.25 ms units
+  uint16_t peripheralLatency = 0;  // Connection events the peripheral may sleep through
+  uint64_t lastDeliveryUs = 0;     // Keeps notifications in order
+  std::map<BLECharacteristic*, BLERemoteCharacteristic*> subscriptions;
+};
+
+BleConfig& bleConfig();
+BleStats& bleStats();
+
+// Called on the receiving device for every delivered notification
+extern std::function<void(Device& from, Device& to, const BLEUUID& characteristic, const uint8_t* data,
+                          size_t length)> onNotifyDelivered;
+
+// Radio range of a device; out of range links drop after the supervision timeout
+void setInRange(Device* dev, bool inRange);
+
+// Drop every link of `dev` now (interference, peer reset, ...)
+void dropLinks(Device* dev);
+
+bool isLinked(Device* dev);
+
+// The device lost power (deep sleep): its radio goes silent, so its links drop
+// after the supervision timeout, and the next BLEDevice::init() starts afresh
+void detachBle(Device* dev);
+
+// Advertising interval of a node, in microseconds
+uint64_t advIntervalUs(const BleNode* node);
+
+}  // namespace sim
@@ -0,0 +1,48 @@
+#pragma once
+
+// The firmware images linked into the simulator. Each main.cpp is compiled
+// inside its own namespace (bike_firmware.cpp, helmet_firmware.cpp) so both
+// can live in one program; these descriptors expose what the harness needs.
+// The bike is built twice: bike_wake_firmware.cpp is the image it reboots
+// into when the starter wakes it from deep sleep, with fresh globals. So is
+// the helmet: helmet2_firmware.cpp is the pillion's (--helmets 2).
+
+#include <stddef.h>
+
+class LiquidCrystal_I2C;
+class HelmetPowerModel;
+
+namespace sim {
+
+struct BikeFirmware {
+  void (*setup)();
+  void (*loop)();
+  int standPin;
+  int ridingPin;
+  int ignitionPin;
+  int buzzerPin;
+  int starterPin;
+  LiquidCrystal_I2C* lcd;
+  void* rtcData;     // RTC_DATA_ATTR state, copied into the wake image
+  size_t rtcSize;
+};
+
+struct HelmetFirmware {
+  void (*setup)();
+  void (*loop)();
+  int fsrPin;
+  int touchPin;
+  int buckledPin;
+  int buttonPin;
+  const bool* deviceConnected;
+  const bool* isAdvertising;
+  const HelmetPowerModel* power;
+  int batteryMah;
+};
+
+extern const BikeFirmware bikeFirmware;
+extern const BikeFirmware bikeWakeFirmware;
+extern const HelmetFirmware helmetFirmware;
+extern const HelmetFirmware helmet2Firmware;
+
+}  // namespace sim
@@ -0,0 +1,76 @@
+// Flash partitions (esp_partition.h) for the simulator.
+//
+// Each device gets its own image of the "journal" partition, created erased
+// (all 0xFF) on first use. Like the real flash it survives restarts and deep
+// sleep; writes AND into it, so a missing erase shows up as corrupt data.
+// Erases and writes take the typical time of an ESP32 module's SPI flash,
+// with the device stalled meanwhile (sim::stall()).
+
+#include <esp_partition.h>
+
+#include <cstring>
+#include <map>
+#include <vector>
+
+#include "SimRuntime.h"
+
+using sim::Device;
+
+#define SIM_SECTOR_ERASE_US 45000  // 4 KB sector erase, typical (datasheets: up to 300-400 ms)
+#define SIM_PAGE_PROGRAM_US 700    // One 256-byte page program, typical
+#define SIM_PAGE_BYTES 256
+
+namespace {
+
+const esp_partition_t journalPartition = {
+  ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)0x40, 0x290000, 0x40000, "journal", false,
+};
+
+std::map<Device*, std::vector<uint8_t>> images;
+
+std::vector<uint8_t>& imageOf(const esp_partition_t* partition) {
+  sim::UntrackedHeap untracked;  // The flash, not the firmware's heap
+  std::vector<uint8_t>& image = images[sim::current()];
+  if (image.empty()) image.assign(partition->size, 0xFF);
+  return image;
+}
+
+bool inside(const esp_partition_t* partition, size_t offset, size_t size) {
+  return partition == &journalPartition && offset <= partition->size && size <= partition->size - offset;
+}
+
+}  // namespace
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char* label) {
+  if (type != journalPartition.type) return nullptr;
+  if (subtype != ESP_PARTITION_SUBTYPE_ANY && subtype != journalPartition.subtype) return nullptr;
+  if (label != nullptr && strcmp(label, journalPartition.label) != 0) return nullptr;
+  return &journalPartition;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* partition, size_t src_offset, void* dst, size_t size) {
+  if (!inside(partition, src_offset, size)) return ESP_ERR_INVALID_SIZE;
+  memcpy(dst, imageOf(partition).data() + src_offset, size);
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t* partition, size_t dst_offset, const void* src, size_t size) {
+  if (!inside(partition, dst_offset, size)) return ESP_ERR_INVALID_SIZE;
+  uint8_t* p = imageOf(partition).data() + dst_offset;
+  const uint8_t* s = (const uint8_t*)src;
+  for (size_t i = 0; i < size; i++) p[i] &= s[i];
+  if (size > 0) {
+    size_t pages = (dst_offset + size - 1) / SIM_PAGE_BYTES - dst_offset / SIM_PAGE_BYTES + 1;
+    sim::stall(pages * SIM_PAGE_PROGRAM_US);
+  }
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition, size_t offset, size_t size) {
+  if (offset % SPI_FLASH_SEC_SIZE != 0 || size % SPI_FLASH_SEC_SIZE != 0) return ESP_ERR_INVALID_ARG;
+  if (!inside(partition, offset, size)) return ESP_ERR_INVALID_SIZE;
+  memset(imageOf(partition).data() + offset, 0xFF, size);
+  sim::stall(size / SPI_FLASH_SEC_SIZE * SIM_SECTOR_ERASE_US);
+  return ESP_OK;
+}
@@ -0,0 +1,431 @@
+#include "SimRuntime.h"
+
+#include <sim_esp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+
+#include <new>
+#include <queue>
+
+namespace sim {
+
+const size_t HOST_STACK_BYTES = 256 * 1024;
+const char STACK_PAINT = (char)0xa5;
+
+// ---------------- Scheduler state ----------------
+struct Task {
+  Device* dev = nullptr;
+  std::string name;
+  std::function<void()> body;
+  uint32_t stackDepth = 0;
+  ucontext_t context;
+  std::vector<char> stack;
+  bool dead = false;
+  uint64_t wakeAt = 0;
+  uint64_t readySeq = 0;  // FIFO order among tasks due at the same time
+};
+
+struct Event {
+  uint64_t timeUs;
+  uint64_t seq;
+  Device* dev;
+  uint32_t boot;  // dev->boots when scheduled
+  std::function<void()> fn;
+};
+
+struct EventLater {
+  bool operator()(const Event* a, const Event* b) const {
+    return a->timeUs != b->timeUs ? a->timeUs > b->timeUs : a->seq > b->seq;
+  }
+};
+
+static ucontext_t mainContext;
+static Task* runningTask = nullptr;
+static Device* currentDevice = nullptr;
+
+static uint64_t now = 0;
+static uint64_t endTime = 0;
+static uint64_t eventSeq = 0;
+static uint64_t readySeq = 0;
+static std::priority_queue<Event*, std::vector<Event*>, EventLater> events;
+static std::vector<Task*> tasks;
+static std::vector<Device*> devices;
+
+static Config cfg;
+static std::mt19937_64 generator(1);
+static RunStats stats;
+
+uint64_t nowUs() { return now; }
+Device* current() { return currentDevice; }
+bool inTask() { return runningTask != nullptr; }
+Task* currentTask() { return runningTask; }
+const char* taskName(Task* task) { return task != nullptr ? task->name.c_str() : "event"; }
+uint32_t taskStackDepth(Task* task) { return task != nullptr ? task->stackDepth : 0; }
+
+// The stack grows down from the end of the buffer; the painted bytes left at
+// the bottom were never touched
+uint32_t taskStackUsed(Task* task) {
+  if (task == nullptr) return 0;
+  size_t untouched = 0;
+  while (untouched < task->stack.size() && task->stack[untouched] == STACK_PAINT) untouched++;
+  return (uint32_t)(task->stack.size() - untouched);
+}
+
+Config& config() { return cfg; }
+std::mt19937_64& rng() { return generator; }
+double uniform() { return (generator() >> 11) * (1.0 / 9007199254740992.0); }
+const RunStats& runStats() { return stats; }
+
+// ---------------- Context switching ----------------
+// Called by the running task: hand control back to the event loop until the
+// loop switches to this task again.
+static void yieldToMain(Task* self) {
+  runningTask = nullptr;
+  swapcontext(&self->context, &mainContext);
+}
+
+// Called by the event loop: run `task` until it blocks again.
+static void switchTo(Task* task) {
+  runningTask = task;
+  currentDevice = task->dev;
+  swapcontext(&mainContext, &task->context);
+  stats.taskSwitches++;
+}
+
+static void taskEntry() {
+  runningTask->body();
+  exitTask();
+}
+
+// A task of a light-sleeping or stalled device, other than the one that put
+// it there
+static bool frozen(const Task* t) {
+  return (t->dev->lightSleeper != nullptr && t->dev->lightSleeper != t) ||
+         (t->dev->staller != nullptr && t->dev->staller != t);
+}
+
+// Earliest time anything other than `self` needs the CPU
+static uint64_t nextDueExcept(Task* self) {
+  uint64_t due = endTime;
+  if (!events.empty() && events.top()->timeUs < due) due = events.top()->timeUs;
+  for (Task* t : tasks) {
+    if (t != self && !t->dead && !frozen(t) && t->wakeAt < due) due = t->wakeAt;
+  }
+  return due;
+}
+
+// ---------------- Tasks ----------------
+Task* spawn(Device* dev, const std::string& name, std::function<void()> body,
+            uint32_t stackDepth) {
+  UntrackedHeap untracked;
+  Task* task = new Task();
+  task->dev = dev;
+  task->name = name;
+  task->body = body;
+  task->stackDepth = stackDepth;
+  task->wakeAt = now;
+  task->readySeq = readySeq++;
+
+  // Host code (printf, std::string, ...) needs far more stack than the
+  // firmware's FreeRTOS budget, so every task gets the same generous stack.
+  // FreeRTOS takes the task's own stack from the heap: charge that instead.
+  task->stack.assign(HOST_STACK_BYTES, STACK_PAINT);
+  dev->heapUsed += stackDepth;
+  if (dev->heapUsed > dev->heapPeak) dev->heapPeak = dev->heapUsed;
+  getcontext(&task->context);
+  task->context.uc_stack.ss_sp = task->stack.data();
+  task->context.uc_stack.ss_size = task->stack.size();
+  task->context.uc_link = nullptr;
+  makecontext(&task->context, taskEntry, 0);
+
+  tasks.push_back(task);
+  dev->tasks.push_back(task);
+  return task;
+}
+
+void sleepUntil(uint64_t timeUs) {
+  Task* self = runningTask;
+  if (self == nullptr) return;  // Events and ISRs cannot block
+  if (timeUs < now) timeUs = now;
+
+  // Fast path: nobody else is due before us, keep running and skip ahead.
+  // Equal times go through the event loop so events run before tasks.
+  if (timeUs < nextDueExcept(self)) {
+    now = timeUs;
+    return;
+  }
+  self->wakeAt = timeUs;
+  self->readySeq = readySeq++;
+  yieldToMain(self);
+}
+
+void sleepFor(uint64_t durationUs) { sleepUntil(now + durationUs); }
+
+void wake(Task* task) {
+  if (task != nullptr && !task->dead && task->wakeAt > now) {
+    task->wakeAt = now;
+    task->readySeq = readySeq++;
+  }
+}
+
+void exitTask() {
+  Task* self = runningTask;
+  if (self == nullptr) {
+    fprintf(stderr, "sim: exitTask() outside of a task\n");
+    abort();
+  }
+  self->dead = true;
+  for (;;) yieldToMain(self);  // Never switched to again
+}
+
+// ---------------- Heap ----------------
+// Each block carries a header naming the device it was charged to, so frees
+// from another context (an event deleting what a task allocated) balance.
+struct BlockHeader {
+  Device* owner;
+  size_t size;
+};
+const size_t HEADER_BYTES = 16;  // Keeps the block itself 16-byte aligned
+static_assert(sizeof(BlockHeader) <= HEADER_BYTES, "block header too big");
+
+static int untrackedDepth = 0;
+
+UntrackedHeap::UntrackedHeap() { untrackedDepth++; }
+UntrackedHeap::~UntrackedHeap() { untrackedDepth--; }
+
+static void* allocate(size_t size) {
+  char* raw = (char*)malloc(size + HEADER_BYTES);
+  if (raw == nullptr) throw std::bad_alloc();
+  BlockHeader* header = (BlockHeader*)raw;
+  header->owner = untrackedDepth == 0 ? currentDevice : nullptr;
+  header->size = size;
+  if (header->owner != nullptr) {
+    header->owner->heapUsed += size;
+    if (header->owner->heapUsed > header->owner->heapPeak) header->owner->heapPeak = header->owner->heapUsed;
+  }
+  return raw + HEADER_BYTES;
+}
+
+static void release(void* block) {
+  if (block == nullptr) return;
+  char* raw = (char*)block - HEADER_BYTES;
+  BlockHeader* header = (BlockHeader*)raw;
+  if (header->owner != nullptr) header->owner->heapUsed -= header->size;
+  free(raw);
+}
+
+// ---------------- Events ----------------
+void at(uint64_t timeUs, Device* dev, std::function<void()> fn) {
+  Event* ev = new Event();
+  ev->timeUs = timeUs < now ? now : timeUs;
+  ev->seq = eventSeq++;
+  ev->dev = dev;
+  ev->boot = dev != nullptr ? dev->boots : 0;
+  ev->fn = fn;
+  events.push(ev);
+}
+
+// ---------------- Devices ----------------
+Device* createDevice(const std::string& name, void (*setupFn)(), void (*loopFn)()) {
+  Device* dev = new Device();
+  dev->name = name;
+  dev->index = (int)devices.size();
+  dev->setupFn = setupFn;
+  dev->loopFn = loopFn;
+  devices.push_back(dev);
+  return dev;
+}
+
+void boot(Device* dev) {
+  spawn(dev, "loopTask", [dev] {
+    dev->setupFn();
+    for (;;) {
+      dev->loopFn();
+      sleepFor(cfg.loopCostUs);
+    }
+  }, 8192);
+}
+
+// Back to the state of a chip coming out of reset; the previous boot's heap
+// blocks are forgotten (a freed one may leave heapUsed a little off)
+static void wakeFromDeepSleep(Device* dev) {
+  UntrackedHeap untracked;
+  dev->asleep = false;
+  dev->boots++;
+  dev->wokeAtUs = now;
+  dev->wakeupCause = ESP_SLEEP_WAKEUP_EXT0;
+  dev->ext0Pin = -1;
+  for (int pin = 0; pin < NUM_PINS; pin++) {
+    dev->isr[pin] = nullptr;
+    dev->isrMasked[pin] = false;
+    dev->wakeLevel[pin] = -1;
+    if (!dev->driven[pin]) dev->level[pin] = 0;
+    dev->mode[pin] = 0;
+  }
+  dev->tasks.clear();
+  dev->heapUsed = dev->heapPeak = 0;
+  dev->cpuMhz = 160;
+  dev->gpioWakeup = false;
+  dev->timerWakeupUs = 0;
+  dev->serialLine.clear();
+
+  if (!dev->onDeepSleepWake || !dev->onDeepSleepWake(*dev)) {
+    printf("sim: %s woke from deep sleep but has no fresh firmware image, device stays off\n",
+           dev->name.c_str());
+    dev->asleep = true;
+    return;
+  }
+  boot(dev);
+}
+
+void setInput(Device* dev, int pin, int level) {
+  if (pin < 0 || pin >= NUM_PINS) return;
+  uint8_t old = dev->level[pin];
+  dev->driven[pin] = true;
+  dev->level[pin] = level ? 1 : 0;
+  if (old == dev->level[pin]) return;
+  if (dev->asleep) {
+    if (pin == dev->ext0Pin && dev->level[pin] == dev->ext0Level) wakeFromDeepSleep(dev);
+    return;
+  }
+  if (dev->lightSleeper != nullptr) {
+    if (dev->gpioWakeup && dev->wakeLevel[pin] == dev->level[pin]) {
+      dev->gpioWoke = true;
+      wake(dev->lightSleeper);
+    }
+    return;  // The edge itself is not seen
+  }
+  if (dev->isr[pin] == nullptr || dev->isrMasked[pin]) return;
+
+  int mode = dev->isrMode[pin];
+  bool rising = dev->level[pin] == 1;
+  if (mode == 0x03 || (mode == 0x01 && rising) || (mode == 0x02 && !rising)) {
+    // ISRs run immediately, outside any task
+    Device* saved = currentDevice;
+    Task* savedTask = runningTask;
+    currentDevice = dev;
+    runningTask = nullptr;
+    dev->isr[pin](dev->isrArg[pin]);
+    runningTask = savedTask;
+    currentDevice = saved;
+  }
+}
+
+void setAnalog(Device* dev, int pin, uint16_t value) {
+  if (pin >= 0 && pin < NUM_PINS) dev->analog[pin] = value;
+}
+
+uint16_t readAnalog(Device* dev, int pin) {
+  if (pin < 0 || pin >= NUM_PINS) return 0;
+  // Own generator, so glitches do not change the rest of a seeded run
+  static std::mt19937_64 glitchRng(1);
+  if (config().adcGlitch > 0 && (glitchRng() >> 11) * (1.0 / 9007199254740992.0) < config().adcGlitch) {
+    return 0;
+  }
+  return dev->analog[pin];
+}
+
+void sleepDevice(Device* dev) {
+  dev->asleep = true;
+  dev->sleptAtUs = now;
+  for (Task* t : dev->tasks) t->dead = true;
+  if (runningTask != nullptr && runningTask->dev == dev) exitTask();
+}
+
+bool lightSleep(Device* dev) {
+  Task* self = runningTask;
+  if (self == nullptr || self->dev != dev) return false;
+  // A wake level that is already there wakes the chip right away
+  dev->gpioWoke = false;
+  for (int pin = 0; pin < NUM_PINS; pin++) {
+    if (dev->gpioWakeup && dev->wakeLevel[pin] >= 0 && dev->wakeLevel[pin] == dev->level[pin]) {
+      dev->gpioWoke = true;
+      return true;
+    }
+  }
+
+  uint64_t start = now;
+  dev->lightSleeper = self;
+  sleepUntil(dev->timerWakeupUs > 0 ? now + dev->timerWakeupUs : UINT64_MAX);
+  dev->lightSleeper = nullptr;
+  dev->lightSleepUs += now - start;
+  dev->lightSleeps++;
+  return dev->gpioWoke;
+}
+
+void stall(uint64_t durationUs) {
+  Task* self = runningTask;
+  if (self == nullptr || durationUs == 0) return;
+  Device* dev = self->dev;
+  uint64_t until = now + durationUs;
+  dev->staller = self;
+  dev->stalledUntilUs = until;
+  while (now < until) sleepUntil(until);  // wake() cannot end it early
+  dev->staller = nullptr;
+  dev->stalls++;
+  if (durationUs > dev->stallMaxUs) dev->stallMaxUs = durationUs;
+}
+
+// ---------------- Run ----------------
+void run(uint64_t endUs) {
+  endTime = endUs;
+
+  for (;;) {
+    Task* next = nullptr;
+    for (Task* t : tasks) {
+      if (t->dead || frozen(t)) continue;
+      if (next == nullptr || t->wakeAt < next->wakeAt ||
+          (t->wakeAt == next->wakeAt && t->readySeq < next->readySeq)) {
+        next = t;
+      }
+    }
+
+    bool eventFirst = !events.empty() &&
+                      (next == nullptr || events.top()->timeUs <= next->wakeAt);
+    uint64_t due = eventFirst ? events.top()->timeUs : (next != nullptr ? next->wakeAt : endUs);
+    if (due >= endUs) break;
+    if (due > now) now = due;  // A task frozen past its wake time runs late, time does not go back
+
+    if (eventFirst) {
+      Event* ev = events.top();
+      events.pop();
+      if (ev->dev != nullptr && ev->dev->stalledUntilUs > now) {
+        ev->timeUs = ev->dev->stalledUntilUs;  // After the device's flash operation
+        ev->seq = eventSeq++;
+        events.push(ev);
+        continue;
+      }
+      if (ev->dev == nullptr || (!ev->dev->asleep && ev->boot == ev->dev->boots)) {
+        currentDevice = ev->dev;
+        ev->fn();
+        currentDevice = nullptr;
+      }
+      delete ev;
+      stats.events++;
+    } else {
+      switchTo(next);
+      currentDevice = nullptr;
+    }
+  }
+  now = endUs;
+}
+
+}  // namespace sim
+
+// ---------------- Global operator new ----------------
+void* operator new(size_t size) { return sim::allocate(size); }
+void* operator new[](size_t size) { return sim::allocate(size); }
+void operator delete(void* block) noexcept { sim::release(block); }
+void operator delete[](void* block) noexcept { sim::release(block); }
+void operator delete(void* block, size_t) noexcept { sim::release(block); }
+void operator delete[](void* block, size_t) noexcept { sim::release(block); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  try { return sim::allocate(size); } catch (...) { return nullptr; }
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  try { return sim::allocate(size); } catch (...) { return nullptr; }
+}
+void operator delete(void* block, const std::nothrow_t&) noexcept { sim::release(block); }
+void operator delete[](void* block, const std::nothrow_t&) noexcept { sim::release(block); }
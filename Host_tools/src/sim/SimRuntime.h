@@ -0,0 +1,203 @@
+#pragma once
+
+// Discrete-event runtime behind the simulator's Arduino/FreeRTOS/BLE stubs.
+//
+// Virtual time only moves when every simulated task is blocked (delay,
+// vTaskDelay, xQueueReceive, a BLE connect, ...), so firmware code runs
+// "infinitely fast" and hours of operation replay in seconds. Simulated tasks
+// are coroutines (ucontext) on a single host thread: exactly one of them, or
+// the event loop, runs at any moment, so runs are deterministic for a given
+// seed.
+//
+// Events run on the event loop in the context of one device, the way
+// BLE callbacks run on Bluedroid's task or ISRs run outside any task.
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <functional>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace sim {
+
+struct Task;
+struct BleNode;
+
+const int NUM_PINS = 64;
+
+struct Device {
+  std::string name;
+  int index = 0;
+
+  // Firmware entry points (Arduino setup()/loop())
+  void (*setupFn)() = nullptr;
+  void (*loopFn)() = nullptr;
+
+  // GPIO
+  uint8_t level[NUM_PINS] = {};
+  uint8_t mode[NUM_PINS] = {};
+  bool driven[NUM_PINS] = {};      // Level forced from outside (scenario)
+  uint16_t analog[NUM_PINS] = {};
+  void (*isr[NUM_PINS])(void*) = {};
+  void* isrArg[NUM_PINS] = {};
+  int isrMode[NUM_PINS] = {};
+  bool isrMasked[NUM_PINS] = {};   // gpio_intr_disable()
+  int8_t wakeLevel[NUM_PINS];      // gpio_wakeup_enable() level, -1 = none
+  std::function<void(Device&, int pin, int level)> onPinWrite;
+
+  // Serial
+  bool echoSerial = false;
+  std::string serialLine;
+  std::string serialIn;
+  uint64_t serialBytes = 0;
+  uint64_t serialBinaryBytes = 0;  // Writes holding control bytes (telemetry blocks), kept off the echo
+  FILE* serialCapture = nullptr;   // Raw copy of everything written, if set
+  std::function<void(Device&, const std::string& line)> onSerialLine;
+
+  BleNode* ble = nullptr;
+  std::map<std::string, std::string> nvs;  // Preferences ("namespace/key"), kept across restarts
+  std::vector<Task*> tasks;
+  int64_t heapUsed = 0;            // Bytes allocated with operator new in this device's context
+  int64_t heapPeak = 0;
+  bool asleep = false;
+  uint64_t sleptAtUs = 0;
+
+  // Deep sleep wakeup (esp_sleep_enable_ext0_wakeup()). Waking reboots the
+  // device: onDeepSleepWake gets it back with fresh pins, tasks and heap and
+  // must point setupFn/loopFn at a firmware image whose globals are fresh
+  // too, returning false when there is none (the device then stays off).
+  int ext0Pin = -1;
+  uint8_t ext0Level = 0;
+  uint32_t boots = 0;              // Restarts so far; events of an earlier boot are dropped
+  uint64_t wokeAtUs = 0;
+  std::function<bool(Device&)> onDeepSleepWake;
+
+  // Light sleep (esp_light_sleep_start())
+  uint16_t cpuMhz = 160;
+  bool gpioWakeup = false;         // esp_sleep_enable_gpio_wakeup()
+  uint64_t timerWakeupUs = 0;      // esp_sleep_enable_timer_wakeup(), 0 = off
+  Task* lightSleeper = nullptr;    // Task inside esp_light_sleep_start(); the others are frozen
+  bool gpioWoke = false;           // The last light sleep ended on a wake level
+  int wakeupCause = 0;             // esp_sleep_get_wakeup_cause() (set by the stubs)
+  uint64_t lightSleepUs = 0;
+  uint64_t lightSleeps = 0;
+
+  // Flash operations with the cache off (stall())
+  Task* staller = nullptr;         // Task holding the device; the others are frozen
+  uint64_t stalledUntilUs = 0;     // Its events wait until then
+  uint64_t stalls = 0;
+  uint64_t stallMaxUs = 0;
+
+  // UART transmit side: bytes drain at serialBaud / 10 per second
+  uint32_t serialBaud = 115200;
+  uint32_t serialTxBuffer = 0;     // setTxBufferSize(); the UART's FIFO comes on top
+  double serialTxQueued = 0;       // Bytes still to go out at serialTxAtUs
+  uint64_t serialTxAtUs = 0;
+  uint64_t serialTxBlockedUs = 0;  // Time writers would have waited for room
+
+  Device() {
+    for (int i = 0; i < NUM_PINS; i++) wakeLevel[i] = -1;
+  }
+};
+
+// ---------------- Time ----------------
+uint64_t nowUs();
+
+// Device whose code is running (task or event). Never null while firmware runs.
+Device* current();
+
+// True when called from a simulated task (blocking calls are allowed).
+bool inTask();
+
+// ---------------- Devices ----------------
+Device* createDevice(const std::string& name, void (*setupFn)(), void (*loopFn)());
+
+// Start the Arduino loopTask: setup() once, then loop() forever. Each loop()
+// pass costs `loopCostUs` of virtual time so busy-polling firmware advances.
+void boot(Device* dev);
+
+// Drive an input pin from outside; runs attached interrupt handlers.
+void setInput(Device* dev, int pin, int level);
+void setAnalog(Device* dev, int pin, uint16_t value);
+
+// One ADC conversion of a pin (analogRead, continuous ADC), glitches included.
+uint16_t readAnalog(Device* dev, int pin);
+
+// Deep sleep: stops every task of the device. An EXT0 wake level on an
+// input (setInput) then reboots it through onDeepSleepWake.
+void sleepDevice(Device* dev);
+
+// Light sleep of the running task's device until a GPIO wake level
+// (setInput) or the timer wakeup. The device's other tasks are frozen and
+// its pin interrupts do not run meanwhile. Returns true for a GPIO wakeup.
+bool lightSleep(Device* dev);
+
+// A flash erase or write from the running task: the cache is off on both
+// cores for `durationUs`, so none of the device's other tasks run and its
+// events (BLE callbacks, timers) wait until the end. No-op outside a task.
+void stall(uint64_t durationUs);
+
+// ---------------- Tasks ----------------
+Task* spawn(Device* dev, const std::string& name, std::function<void()> body,
+            uint32_t stackDepth = 4096);
+Task* currentTask();
+const char* taskName(Task* task);
+uint32_t taskStackDepth(Task* task);
+
+// Block the running task until `timeUs` (or until woken). Returns immediately
+// from event context.
+void sleepUntil(uint64_t timeUs);
+void sleepFor(uint64_t durationUs);
+
+// Make a blocked task runnable at the current time.
+void wake(Task* task);
+
+// End the running task (vTaskDelete(NULL)); never returns.
+void exitTask() __attribute__((noreturn));
+
+// Deepest stack use of a task so far, in bytes (its stack is painted at spawn)
+uint32_t taskStackUsed(Task* task);
+
+// ---------------- Heap ----------------
+// operator new is replaced in the simulator: every block is charged to the
+// device whose task or event allocated it, and credited back to that device
+// when freed (ESP.getFreeHeap() and friends report from this). Host objects
+// are bigger than their ESP32 counterparts, so only trends mean anything.
+//
+// The harness's own bookkeeping (statistics, reports) runs in device context
+// too; wrap it in an UntrackedHeap so it is not charged to the device.
+struct UntrackedHeap {
+  UntrackedHeap();
+  ~UntrackedHeap();
+};
+
+// ---------------- Events ----------------
+void at(uint64_t timeUs, Device* dev, std::function<void()> fn);
+inline void after(uint64_t delayUs, Device* dev, std::function<void()> fn) {
+  at(nowUs() + delayUs, dev, fn);
+}
+
+// ---------------- Run ----------------
+struct Config {
+  uint64_t loopCostUs = 1000;
+  double adcGlitch = 0;  // Chance that one ADC conversion reads 0 (loose FSR contact)
+};
+
+Config& config();
+std::mt19937_64& rng();  // Seed before run() for reproducible runs
+double uniform();  // [0, 1)
+
+// Run until virtual time reaches `endUs`.
+void run(uint64_t endUs);
+
+// Host wall-clock statistics of the last run()
+struct RunStats {
+  uint64_t taskSwitches = 0;
+  uint64_t events = 0;
+};
+const RunStats& runStats();
+
+}  // namespace sim
@@ -0,0 +1,48 @@
+// Biketest firmware again, for the reboot after a deep sleep (SimFirmware.h).
+//
+// Every header main.cpp uses is included here first, outside the namespace,
+// so the includes inside main.cpp are no-ops and only its own definitions end
+// up in bike_wake_fw.
+
+#include <Arduino.h>
+#include <BLEDevice.h>
+#include <esp_gap_ble_api.h>
+#include <Preferences.h>
+#include <Wire.h>
+#include <LiquidCrystal_I2C.h>
+#include "driver/rtc_io.h"
+#include <HelmetProtocol.h>
+#include <FsrStream.h>
+#include <FsrCalibration.h>
+#include <TaskScheduler.h>
+#include <SnapshotMailbox.h>
+#include <SafetyStateMachine.h>
+#include <LatencyTrace.h>
+#include <LcdFrame.h>
+#include <HelmetPolicy.h>
+#include <ConnectionPlan.h>
+#include <TelemetryLog.h>
+#include <BikeStatus.h>
+#include <ConsoleRing.h>
+#include <BoardTraits.h>
+#include <SectionProfiler.h>
+#include <EventJournal.h>
+#include <esp_partition.h>
+
+#include "SimFirmware.h"
+
+namespace bike_wake_fw {
+#include "../../../Biketest/src/main.cpp"
+}
+
+namespace sim {
+
+const BikeFirmware bikeWakeFirmware = {
+  bike_wake_fw::setup, bike_wake_fw::loop,
+  bike_wake_fw::Board::STAND_PIN, bike_wake_fw::Board::RIDING_PIN, bike_wake_fw::Board::IGNITION_PIN,
+  bike_wake_fw::Board::BUZZER_PIN, bike_wake_fw::Board::STARTER_WAKEUP_PIN,
+  &bike_wake_fw::lcd,
+  &bike_wake_fw::resume, sizeof(bike_wake_fw::resume),
+};
+
+}  // namespace sim
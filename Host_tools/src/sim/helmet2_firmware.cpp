@@ -0,0 +1,34 @@
+// "helmet test c3" firmware again, for the pillion's helmet (SimFirmware.h).
+
+#include <Arduino.h>
+#include <BLEDevice.h>
+#include <BLEUtils.h>
+#include <BLEServer.h>
+#include <BLE2902.h>
+#include <HelmetProtocol.h>
+#include <FsrStream.h>
+#include <BoardTraits.h>
+#include <HelmetNotifyPolicy.h>
+#include <TelemetryLog.h>
+#include <FsrFilter.h>
+#include <EdgeDebouncer.h>
+#include <HelmetPowerModel.h>
+#include <LatencyTrace.h>
+#include <driver/adc.h>
+
+#include "SimFirmware.h"
+
+namespace helmet2_fw {
+#include "../../../helmet test c3/src/main.cpp"
+}
+
+namespace sim {
+
+const HelmetFirmware helmet2Firmware = {
+  helmet2_fw::setup, helmet2_fw::loop,
+  helmet2_fw::Board::FSR_PIN, helmet2_fw::Board::TOUCH_PIN, helmet2_fw::Board::BUCKLE_PIN, helmet2_fw::Board::BUTTON_PIN,
+  &helmet2_fw::deviceConnected, &helmet2_fw::isAdvertising,
+  &helmet2_fw::power, BATTERY_MAH,
+};
+
+}  // namespace sim
@@ -0,0 +1,34 @@
+// "helmet test c3" firmware, built for the simulator (see bike_firmware.cpp).
+
+#include <Arduino.h>
+#include <BLEDevice.h>
+#include <BLEUtils.h>
+#include <BLEServer.h>
+#include <BLE2902.h>
+#include <HelmetProtocol.h>
+#include <FsrStream.h>
+#include <BoardTraits.h>
+#include <HelmetNotifyPolicy.h>
+#include <TelemetryLog.h>
+#include <FsrFilter.h>
+#include <EdgeDebouncer.h>
+#include <HelmetPowerModel.h>
+#include <LatencyTrace.h>
+#include <driver/adc.h>
+
+#include "SimFirmware.h"
+
+namespace helmet_fw {
+#include "../../../helmet test c3/src/main.cpp"
+}
+
+namespace sim {
+
+const HelmetFirmware helmetFirmware = {
+  helmet_fw::setup, helmet_fw::loop,
+  helmet_fw::Board::FSR_PIN, helmet_fw::Board::TOUCH_PIN, helmet_fw::Board::BUCKLE_PIN, helmet_fw::Board::BUTTON_PIN,
+  &helmet_fw::deviceConnected, &helmet_fw::isAdvertising,
+  &helmet_fw::power, BATTERY_MAH,
+};
+
+}  // namespace sim
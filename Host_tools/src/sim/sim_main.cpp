@@ -0,0 +1,729 @@
+// Host simulator for the helmet <-> bike system.
+//
+//   sim [--hours H] [--seed S] [--scenario FILE] [--verbose] [--loop-us US]
+//       [--latency-ms MS] [--jitter-ms MS] [--loss P]
+//       [--disconnects-per-hour N] [--out-of-range-per-hour N] [--no-auto-pair]
+//       [--fsr-glitch P] [--serial-dir DIR] [--soak CYCLES] [--soak-tolerance BYTES]
+//       [--helmets N]
+//
+// Runs the Biketest and "helmet test c3" firmware against the stubs in
+// ../stubs, joined by the fake BLE link in SimBle.cpp, in virtual time.
+// Without --scenario a random day of rides is generated: park, put the helmet
+// on and buckle it, stand up, ride with stops (sometimes unbuckling on the
+// way), arrive, take the helmet off, and again. The rider re-pairs the helmet
+// (button press) whenever it is neither connected nor advertising.
+//
+// --helmets 2 adds a pillion with a second helmet ("pillion" in scenarios).
+// In generated rides the pillion comes along every time, putting the helmet
+// on and buckling it just after the rider and taking it off on arrival. It is
+// paired once the rider's helmet is linked, so it lands in the second slot.
+//
+// --serial-dir writes each device's raw serial output to DIR/<name>.log, e.g.
+// to feed the helmet's binary telemetry to the env:telemetry decoder (the
+// helmet logs it only when built with -DTELEMETRY=1, as its telemetry env does).
+//
+// --soak replaces the rides with CYCLES connect/disconnect cycles (every 50th
+// one a 35 s trip out of range, so direct connects time out too) and checks
+// that both devices' heap stays flat: the heap in use while linked, over the
+// second half of the cycles, may not exceed the first half's by more than
+// --soak-tolerance bytes (default 512). Exits with status 1 otherwise.
+//
+// Scenario files hold one command per line, `<time ms> <target> <command>`:
+//   1000  helmet pair               press the pairing button
+//   1500  helmet state secure       removed | worn | secure (`pillion` for the second helmet)
+//   2000  bike stand up             up | down
+//   2500  bike riding on            on | off
+//   3000  bike starter off          on | off (on wakes the bike from deep sleep)
+//   3500  helmet range out          in | out (link drops after supervision timeout)
+//   4000  link drop                 drop the BLE link now
+//   4500  bike pin 26 0             raw pin level / `analog <pin> <value>`
+//   5000  bike serial J600          a line on the serial console (one word)
+
+#include <HelmetPowerModel.h>
+#include <HelmetProtocol.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "SimBle.h"
+#include "SimFirmware.h"
+#include "SimRuntime.h"
+#include <LiquidCrystal_I2C.h>
+
+namespace {
+
+using namespace sim;
+
+const uint64_t MS = 1000;
+const uint64_t SEC = 1000000;
+const uint64_t INPUT_RESPONSE_WINDOW_US = 1 * SEC; // Ignition edges this soon after an input change count as responses
+const uint16_t FSR_WORN = 420;                      // analogRead() with the helmet on
+
+Device* bike;
+Device* helmet;
+Device* pillion;  // nullptr unless --helmets 2
+const BikeFirmware* bikeImage = &bikeFirmware;  // bikeWakeFirmware after a deep sleep wakeup
+
+// ---------------- Statistics ----------------
+struct Samples {
+  std::vector<uint32_t> values;
+
+  void add(uint64_t v) { values.push_back((uint32_t)v); }
+
+  uint32_t percentile(double p) {
+    if (values.empty()) return 0;
+    std::sort(values.begin(), values.end());
+    size_t i = (size_t)(p * (values.size() - 1) + 0.5);
+    return values[i];
+  }
+
+  void print(const char* name) {
+    if (values.empty()) {
+      std::printf("  %-28s no samples\n", name);
+      return;
+    }
+    std::printf("  %-28s n=%-7zu p50 %7.2f ms  p99 %7.2f ms  max %7.2f ms\n", name, values.size(),
+                percentile(0.5) / 1000.0, percentile(0.99) / 1000.0, percentile(1.0) / 1000.0);
+  }
+};
+
+struct Report {
+  uint64_t ignitionEdges = 0;
+  uint64_t ignitionOnUs = 0;
+  uint64_t unsafeIgnitionUs = 0;   // Ignition on while the helmet was not secure (warnings, BLE lag)
+  uint64_t buzzerStarts = 0;
+  uint64_t buzzerOnUs = 0;
+  uint64_t pairPresses = 0;
+  uint64_t injectedDrops = 0;
+  uint64_t outOfRange = 0;
+  uint64_t rides = 0;
+  uint64_t helmetEdgesOffline = 0;  // Helmet changes while no link was up
+  uint64_t warn15 = 0, warn60 = 0, warn15Expired = 0, grace = 0, graceExpired = 0;
+  Samples inputToIgnition;          // Last input change -> IGNITION_PIN edge
+  uint64_t bikeSleptUs = 0;         // Bike went into deep sleep (0 = never)
+  uint64_t bikeWokeUs = 0;          // Starter woke it again
+  uint64_t wakeToFrameUs = 0;       // Wakeup -> first helmet frame received by the bike
+  uint64_t wakeToIgnitionUs = 0;    // Wakeup -> IGNITION_PIN on
+};
+
+Report report;
+
+// ---------------- Soak ----------------
+const uint64_t SOAK_CHECK_US = 50 * MS;
+const uint64_t SOAK_OUT_OF_RANGE_US = 35 * SEC;  // Longer than a direct connect waits
+const uint64_t SOAK_OUT_OF_RANGE_EVERY = 50;
+const double SOAK_WARMUP = 0.1;                  // Fraction of cycles left out of the check
+
+struct Soak {
+  uint64_t cycles = 0;
+  uint64_t target = 0;
+  uint64_t linkedSinceUs = 0;
+  uint64_t holdUs = 0;
+  std::vector<int64_t> bikeHeap;   // Heap in use while linked, one sample per cycle
+  std::vector<int64_t> helmetHeap;
+};
+
+Soak soak;
+
+// Ground truth of what the rider is doing
+struct Rider {
+  bool standUp = false;
+  bool riding = false;
+} rider;
+
+// A helmet, what its wearer is doing with it, and how fast the bike hears of it
+struct Wearer {
+  Device* dev = nullptr;
+  const HelmetFirmware* fw = nullptr;
+  HelmetState state = HELMET_REMOVED;
+  bool edgePending = false;
+  uint64_t edgeUs = 0;
+  uint64_t edgeLinkDrops = 0;       // Disconnect count when the edge happened
+  Samples toBike;                   // Helmet sensor change -> matching frame received by the bike
+};
+
+Wearer riderHelmet;
+Wearer pillionHelmet;
+
+bool ignitionOn = false;
+bool buzzerOn = false;
+uint64_t accountedUs = 0;
+uint64_t lastInputUs = 0;
+
+// Integrate on-times up to now; called before anything they depend on changes.
+// A pillion helmet counts while it is worn.
+void account() {
+  uint64_t dt = nowUs() - accountedUs;
+  accountedUs = nowUs();
+  if (ignitionOn) {
+    report.ignitionOnUs += dt;
+    if (riderHelmet.state != HELMET_SECURE || pillionHelmet.state == HELMET_WORN_NOT_BUCKLED) {
+      report.unsafeIgnitionUs += dt;
+    }
+  }
+  if (buzzerOn) report.buzzerOnUs += dt;
+}
+
+void onBikePin(Device& dev, int pin, int level) {
+  UntrackedHeap untracked;
+  if (pin == bikeFirmware.ignitionPin) {
+    account();
+    ignitionOn = level == HIGH;
+    if (ignitionOn && report.bikeWokeUs != 0 && report.wakeToIgnitionUs == 0) {
+      report.wakeToIgnitionUs = nowUs() - report.bikeWokeUs;
+    }
+    report.ignitionEdges++;
+    if (nowUs() - lastInputUs <= INPUT_RESPONSE_WINDOW_US) {
+      report.inputToIgnition.add(nowUs() - lastInputUs);
+    }
+  } else if (pin == bikeFirmware.buzzerPin) {
+    account();
+    buzzerOn = level == HIGH;
+    if (buzzerOn) report.buzzerStarts++;
+  }
+}
+
+// Starter on while the bike sleeps: reboot it into the second image (there is
+// only one, so a second deep sleep is final)
+bool onBikeWake(Device& dev) {
+  if (bikeImage != &bikeFirmware) return false;
+  std::memcpy(bikeWakeFirmware.rtcData, bikeFirmware.rtcData, bikeFirmware.rtcSize);
+  bikeImage = &bikeWakeFirmware;
+  dev.setupFn = bikeImage->setup;
+  dev.loopFn = bikeImage->loop;
+  report.bikeSleptUs = dev.sleptAtUs;
+  report.bikeWokeUs = nowUs();
+  return true;
+}
+
+void onBikeLine(Device& dev, const std::string& line) {
+  if (line.find("Starting 15s warning") != std::string::npos) report.warn15++;
+  if (line.find("Starting 60s warning") != std::string::npos) report.warn60++;
+  if (line.find("15s WARNING EXPIRED") != std::string::npos) report.warn15Expired++;
+  if (line.find("Starting 60s grace period") != std::string::npos) report.grace++;
+  if (line.find("GRACE PERIOD EXPIRED") != std::string::npos) report.graceExpired++;
+}
+
+void onDelivered(Device& from, Device& to, const BLEUUID& characteristic, const uint8_t* data, size_t length) {
+  UntrackedHeap untracked;
+  if (&to != bike || !(characteristic == BLEUUID(CHAR_UUID_TX))) return;  // Status frames only
+  if (&from == helmet && report.bikeWokeUs != 0 && report.wakeToFrameUs == 0) {
+    report.wakeToFrameUs = nowUs() - report.bikeWokeUs;
+  }
+  Wearer& w = &from == pillion ? pillionHelmet : riderHelmet;
+  if (!w.edgePending) return;
+  if (bleStats().disconnects != w.edgeLinkDrops) {
+    w.edgePending = false;  // Link dropped in between: that's reconnect time, not latency
+    return;
+  }
+  HelmetStatus status;
+  decodeHelmetStatus(data, length, status);
+  if (status.state == w.state) {
+    w.toBike.add(nowUs() - w.edgeUs);
+    w.edgePending = false;
+  }
+}
+
+// ---------------- Rider actions ----------------
+void inputChanged() { lastInputUs = nowUs(); }
+
+void setStand(bool up) {
+  if (up == rider.standUp) return;
+  rider.standUp = up;
+  setInput(bike, bikeFirmware.standPin, up ? LOW : HIGH);  // LOW = stand up
+  inputChanged();
+}
+
+void setRiding(bool on) {
+  if (on == rider.riding) return;
+  rider.riding = on;
+  setInput(bike, bikeFirmware.ridingPin, on ? LOW : HIGH); // LOW = riding
+  inputChanged();
+}
+
+void setStarter(bool on) { setInput(bike, bikeFirmware.starterPin, on ? HIGH : LOW); }
+
+void setHelmet(Wearer& w, HelmetState state) {
+  if (w.dev == nullptr || state == w.state) return;
+  account();
+  w.state = state;
+  bool worn = state != HELMET_REMOVED;
+  setInput(w.dev, w.fw->touchPin, worn ? HIGH : LOW);
+  setAnalog(w.dev, w.fw->fsrPin, worn ? FSR_WORN : 0);
+  setInput(w.dev, w.fw->buckledPin, state == HELMET_SECURE ? LOW : HIGH);
+  inputChanged();
+
+  if (isLinked(w.dev)) {
+    w.edgePending = true;
+    w.edgeUs = nowUs();
+    w.edgeLinkDrops = bleStats().disconnects;
+  } else {
+    w.edgePending = false;
+    report.helmetEdgesOffline++;
+  }
+}
+
+void setHelmet(HelmetState state) { setHelmet(riderHelmet, state); }
+
+void pressButton(Wearer& w) {
+  report.pairPresses++;
+  setInput(w.dev, w.fw->buttonPin, LOW);
+  after(100 * MS, nullptr, [&w] { setInput(w.dev, w.fw->buttonPin, HIGH); });
+}
+
+// ---------------- Generated rides ----------------
+uint64_t randomUs(double minSec, double maxSec) {
+  return (uint64_t)((minSec + (maxSec - minSec) * uniform()) * SEC);
+}
+
+uint64_t exponentialUs(double perHour) {
+  return (uint64_t)(-std::log(1.0 - uniform()) / perHour * 3600.0 * SEC);
+}
+
+void scheduleRide(uint64_t t) {
+  at(t, nullptr, [] {
+    setStand(false);
+    setRiding(false);
+    setHelmet(HELMET_REMOVED);
+  });
+  t += randomUs(20, 60);
+  at(t, nullptr, [] { setHelmet(HELMET_WORN_NOT_BUCKLED); });
+  if (pillion != nullptr) at(t + randomUs(0, 1), nullptr, [] { setHelmet(pillionHelmet, HELMET_WORN_NOT_BUCKLED); });
+  t += randomUs(1, 5);
+  at(t, nullptr, [] { setHelmet(HELMET_SECURE); });
+  if (pillion != nullptr) at(t + randomUs(0, 1), nullptr, [] { setHelmet(pillionHelmet, HELMET_SECURE); });
+  t += randomUs(2, 8);
+  at(t, nullptr, [] { setStand(true); });
+  t += randomUs(1, 3);
+  at(t, nullptr, [] {
+    setRiding(true);
+    report.rides++;
+  });
+
+  // Riding, with stops and the odd unbuckled stretch
+  uint64_t end = t + randomUs(120, 1200);
+  bool unbuckle = uniform() < 0.15;
+  for (t += randomUs(30, 300); t < end; t += randomUs(30, 300)) {
+    at(t, nullptr, [] { setRiding(false); });
+    t += randomUs(5, 60);
+    at(t, nullptr, [] { setRiding(true); });
+    if (unbuckle) {
+      unbuckle = false;
+      t += randomUs(5, 30);
+      at(t, nullptr, [] { setHelmet(HELMET_WORN_NOT_BUCKLED); });
+      t += randomUs(5, 30);
+      at(t, nullptr, [] { setHelmet(HELMET_SECURE); });
+    }
+  }
+
+  t = end;
+  at(t, nullptr, [] { setRiding(false); });
+  t += randomUs(2, 5);
+  at(t, nullptr, [] { setStand(false); });
+  if (pillion != nullptr) at(t + randomUs(1, 5), nullptr, [] { setHelmet(pillionHelmet, HELMET_REMOVED); });
+  t += randomUs(2, 10);
+  at(t, nullptr, [] { setHelmet(HELMET_WORN_NOT_BUCKLED); });
+  t += randomUs(1, 3);
+  at(t, nullptr, [t] { scheduleRide(t); });
+}
+
+// The pillion waits for the rider's helmet to be linked before pairing
+void scheduleAutoPair(Wearer* w, uint64_t t) {
+  at(t, nullptr, [w, t] {
+    bool turn = w == &riderHelmet || isLinked(helmet);
+    if (turn && !*w->fw->deviceConnected && !*w->fw->isAdvertising) pressButton(*w);
+    scheduleAutoPair(w, t + SEC);
+  });
+}
+
+void scheduleDrops(double perHour, uint64_t endUs) {
+  for (uint64_t t = exponentialUs(perHour); t < endUs; t += exponentialUs(perHour)) {
+    at(t, nullptr, [] {
+      report.injectedDrops++;
+      dropLinks(helmet);
+    });
+  }
+}
+
+void scheduleOutOfRange(double perHour, uint64_t endUs) {
+  for (uint64_t t = exponentialUs(perHour); t < endUs; t += exponentialUs(perHour)) {
+    uint64_t back = t + randomUs(5, 90);
+    at(t, nullptr, [] {
+      report.outOfRange++;
+      setInRange(helmet, false);
+    });
+    at(back, nullptr, [] { setInRange(helmet, true); });
+    t = back;
+  }
+}
+
+// Hold each link for a random moment, sample the heap, then drop it
+void scheduleSoak(uint64_t t) {
+  at(t, nullptr, [t] {
+    if (soak.cycles >= soak.target) return;
+    if (!isLinked(helmet)) {
+      soak.linkedSinceUs = 0;
+    } else if (soak.linkedSinceUs == 0) {
+      soak.linkedSinceUs = nowUs();
+      soak.holdUs = randomUs(0.1, 0.6);
+    } else if (nowUs() - soak.linkedSinceUs >= soak.holdUs) {
+      soak.bikeHeap.push_back(bike->heapUsed);
+      soak.helmetHeap.push_back(helmet->heapUsed);
+      soak.linkedSinceUs = 0;
+      if (++soak.cycles % SOAK_OUT_OF_RANGE_EVERY == 0) {
+        report.outOfRange++;
+        setInRange(helmet, false);
+        after(SOAK_OUT_OF_RANGE_US, nullptr, [] { setInRange(helmet, true); });
+      } else {
+        report.injectedDrops++;
+        dropLinks(helmet);
+      }
+    }
+    scheduleSoak(t + SOAK_CHECK_US);
+  });
+}
+
+// Highest heap use in samples [from, to)
+int64_t heapMax(const std::vector<int64_t>& samples, size_t from, size_t to) {
+  int64_t max = 0;
+  for (size_t i = from; i < to; i++) max = std::max(max, samples[i]);
+  return max;
+}
+
+// Returns false if a device's heap grew by more than `tolerance` bytes
+bool checkSoak(int64_t tolerance) {
+  std::printf("\n==== Soak: %llu cycles ====\n", (unsigned long long)soak.cycles);
+  if (soak.cycles < 10) {
+    std::printf("FAIL: only %llu of %llu cycles completed\n", (unsigned long long)soak.cycles,
+                (unsigned long long)soak.target);
+    return false;
+  }
+  size_t first = (size_t)(soak.cycles * SOAK_WARMUP);
+  size_t middle = first + (soak.cycles - first) / 2;
+  bool ok = true;
+  for (Device* d : {bike, helmet}) {
+    const std::vector<int64_t>& samples = d == bike ? soak.bikeHeap : soak.helmetHeap;
+    int64_t before = heapMax(samples, first, middle);
+    int64_t after = heapMax(samples, middle, samples.size());
+    int64_t growth = after - before;
+    bool flat = growth <= tolerance;
+    std::printf("%-6s heap in use: first cycle %lld, first half max %lld, second half max %lld, "
+                "growth %lld bytes (%.3f B/cycle), peak %lld  %s\n",
+                d->name.c_str(), (long long)samples[0], (long long)before, (long long)after,
+                (long long)growth, (double)(samples.back() - samples[first]) / (samples.size() - first),
+                (long long)d->heapPeak, flat ? "flat" : "GROWING");
+    ok = ok && flat;
+  }
+  for (Device* d : {bike, helmet}) {
+    std::printf("%-6s stack used (host):", d->name.c_str());
+    for (Task* t : d->tasks) std::printf(" %s %u/%u", taskName(t), taskStackUsed(t), taskStackDepth(t));
+    std::printf("\n");
+  }
+  std::printf("%s\n", ok ? "PASS" : "FAIL: heap grows with connect/disconnect cycles");
+  return ok;
+}
+
+// ---------------- Scenario files ----------------
+bool parseHelmetState(const std::string& s, HelmetState& out) {
+  if (s == "removed") out = HELMET_REMOVED;
+  else if (s == "worn") out = HELMET_WORN_NOT_BUCKLED;
+  else if (s == "secure") out = HELMET_SECURE;
+  else return false;
+  return true;
+}
+
+bool parseOnOff(const std::string& s, const char* on, const char* off, bool& out) {
+  if (s == on) out = true;
+  else if (s == off) out = false;
+  else return false;
+  return true;
+}
+
+// Returns the time of the last command, or -1 on a parse error
+int64_t loadScenario(const char* path) {
+  std::ifstream in(path);
+  if (!in) {
+    std::fprintf(stderr, "cannot open scenario %s\n", path);
+    return -1;
+  }
+
+  int64_t lastMs = 0;
+  std::string line;
+  for (int lineNo = 1; std::getline(in, line); lineNo++) {
+    size_t hash = line.find('#');
+    if (hash != std::string::npos) line.erase(hash);
+    std::istringstream words(line);
+    int64_t ms;
+    std::string target, cmd, a, b;
+    if (!(words >> ms)) continue;  // Blank line
+    words >> target >> cmd >> a >> b;
+    uint64_t t = (uint64_t)ms * MS;
+    lastMs = std::max(lastMs, ms);
+
+    bool ok = true;
+    bool flag = false;
+    HelmetState state;
+    Device* dev = target == "bike" ? bike : (target == "helmet" ? helmet : (target == "pillion" ? pillion : nullptr));
+    Wearer* wearer = dev == helmet ? &riderHelmet : &pillionHelmet;
+    if (target == "link" && cmd == "drop") {
+      at(t, nullptr, [] { dropLinks(helmet); });
+    } else if (dev == nullptr) {
+      ok = false;
+    } else if (cmd == "pin" && !a.empty() && !b.empty()) {
+      int pin = std::atoi(a.c_str()), level = std::atoi(b.c_str());
+      at(t, nullptr, [dev, pin, level] { setInput(dev, pin, level); inputChanged(); });
+    } else if (cmd == "analog" && !a.empty() && !b.empty()) {
+      int pin = std::atoi(a.c_str()), value = std::atoi(b.c_str());
+      at(t, nullptr, [dev, pin, value] { setAnalog(dev, pin, (uint16_t)value); });
+    } else if (cmd == "range" && parseOnOff(a, "in", "out", flag)) {
+      at(t, nullptr, [dev, flag] { setInRange(dev, flag); });
+    } else if (dev == bike && cmd == "stand" && parseOnOff(a, "up", "down", flag)) {
+      at(t, nullptr, [flag] { setStand(flag); });
+    } else if (dev == bike && cmd == "riding" && parseOnOff(a, "on", "off", flag)) {
+      at(t, nullptr, [flag] { setRiding(flag); });
+    } else if (dev == bike && cmd == "starter" && parseOnOff(a, "on", "off", flag)) {
+      at(t, nullptr, [flag] { setStarter(flag); });
+    } else if (cmd == "serial" && !a.empty()) {
+      at(t, nullptr, [dev, a] { dev->serialIn += a + "\n"; });
+    } else if (dev != bike && cmd == "state" && parseHelmetState(a, state)) {
+      at(t, nullptr, [wearer, state] { setHelmet(*wearer, state); });
+    } else if (dev != bike && cmd == "pair") {
+      at(t, nullptr, [wearer] { pressButton(*wearer); });
+    } else {
+      ok = false;
+    }
+
+    if (!ok) {
+      std::fprintf(stderr, "%s:%d: cannot parse \"%s\"\n", path, lineNo, line.c_str());
+      return -1;
+    }
+  }
+  return lastMs;
+}
+
+// ---------------- Report ----------------
+void printReport(uint64_t endUs, double wallSec) {
+  account();
+  const BleStats& ble = bleStats();
+  double hours = endUs / 3600.0 / SEC;
+
+  std::printf("\n==== Simulation report ====\n");
+  std::printf("Simulated %.2f h in %.2f s wall clock (%.0fx), %llu task switches, %llu events\n",
+              hours, wallSec, wallSec > 0 ? endUs / 1e6 / wallSec : 0.0,
+              (unsigned long long)runStats().taskSwitches, (unsigned long long)runStats().events);
+  if (report.bikeWokeUs != 0) {
+    std::printf("Bike deep sleep at %.1f s, starter wakeup at %.1f s: first helmet frame after %.0f ms, "
+                "ignition on after %.0f ms (0 = never)\n",
+                report.bikeSleptUs / 1e6, report.bikeWokeUs / 1e6, report.wakeToFrameUs / 1e3,
+                report.wakeToIgnitionUs / 1e3);
+  }
+  if (bike->asleep) std::printf("Bike entered deep sleep at %.1f s\n", bike->sleptAtUs / 1e6);
+
+  std::printf("Rides: %llu\n", (unsigned long long)report.rides);
+  std::printf("Ignition: %llu edges, on %.1f min, on with helmet not secure %.1f s\n",
+              (unsigned long long)report.ignitionEdges, report.ignitionOnUs / 60e6,
+              report.unsafeIgnitionUs / 1e6);
+  std::printf("Buzzer: %llu starts, on %.1f s\n", (unsigned long long)report.buzzerStarts,
+              report.buzzerOnUs / 1e6);
+  std::printf("Warnings: 15s %llu (expired %llu), 60s %llu, BLE grace %llu (expired %llu)\n",
+              (unsigned long long)report.warn15, (unsigned long long)report.warn15Expired,
+              (unsigned long long)report.warn60, (unsigned long long)report.grace,
+              (unsigned long long)report.graceExpired);
+  std::printf("BLE: %llu connects, %llu failed, %llu disconnects (%llu injected, %llu out of range), "
+              "%llu scans, %llu pairing presses\n",
+              (unsigned long long)ble.connects, (unsigned long long)ble.connectFailures,
+              (unsigned long long)ble.disconnects, (unsigned long long)report.injectedDrops,
+              (unsigned long long)report.outOfRange, (unsigned long long)ble.scans,
+              (unsigned long long)report.pairPresses);
+  std::printf("Notifies: %llu sent, %llu delivered, %llu dropped; %llu helmet changes while offline\n",
+              (unsigned long long)ble.notifySent, (unsigned long long)ble.notifyDelivered,
+              (unsigned long long)ble.notifyDropped, (unsigned long long)report.helmetEdgesOffline);
+  std::printf("Latency:\n");
+  riderHelmet.toBike.print("helmet change -> bike rx");
+  if (pillion != nullptr) pillionHelmet.toBike.print("pillion change -> bike rx");
+  report.inputToIgnition.print("input change -> ignition");
+  Samples reconnect;
+  for (uint32_t us : ble.reconnectUs) reconnect.add(us);
+  reconnect.print("link drop -> reconnected");
+
+  LiquidCrystal_I2C* lcd = bikeImage->lcd;
+  uint64_t lcdBytes = bikeFirmware.lcd->i2cBytes() + (bikeImage != &bikeFirmware ? lcd->i2cBytes() : 0);
+  std::printf("Bike LCD: |%s|\n          |%s|\n", lcd->rowText(0), lcd->rowText(1));
+  std::printf("Bike LCD I2C traffic: %llu bytes (%.0f B/s)\n", (unsigned long long)lcdBytes,
+              lcdBytes / (endUs / 1e6));
+  const HelmetPowerModel& power = *helmetFirmware.power;
+  std::printf("Helmet power (firmware estimate): %.2f mA average, %.0f h on %d mAh\n",
+              power.averageMa(endUs), power.batteryHours((float)helmetFirmware.batteryMah, endUs),
+              helmetFirmware.batteryMah);
+  for (uint8_t i = 0; i < NUM_POWER_STATES; i++) {
+    HelmetPowerState state = (HelmetPowerState)i;
+    std::printf("  %-12s %5.1f%% of the time, %.2f mAh\n", powerStateName(state),
+                100.0 * power.timeUs(state, endUs) / endUs, power.chargeMah(state, endUs));
+  }
+  std::printf("Helmet light sleep: %llu sleeps, %.1f%% of the time, CPU at %u MHz\n",
+              (unsigned long long)helmet->lightSleeps, 100.0 * helmet->lightSleepUs / endUs, helmet->cpuMhz);
+  for (Device* d : {bike, helmet, pillion}) {
+    if (d == nullptr) continue;
+    std::printf("%s serial: %llu bytes (%.0f B/s), %llu binary, writers blocked %.1f ms\n", d->name.c_str(),
+                (unsigned long long)d->serialBytes, d->serialBytes / (endUs / 1e6),
+                (unsigned long long)d->serialBinaryBytes, d->serialTxBlockedUs / 1e3);
+  }
+  if (bike->stalls > 0) {
+    std::printf("bike flash stalls: %llu, longest %.1f ms\n", (unsigned long long)bike->stalls, bike->stallMaxUs / 1e3);
+  }
+}
+
+void usage(const char* argv0) {
+  std::fprintf(stderr,
+               "usage: %s [--hours H] [--seed S] [--scenario FILE] [--verbose] [--loop-us US]\n"
+               "          [--latency-ms MS] [--jitter-ms MS] [--loss P]\n"
+               "          [--disconnects-per-hour N] [--out-of-range-per-hour N] [--no-auto-pair]\n"
+               "          [--fsr-glitch P] [--serial-dir DIR] [--soak CYCLES] [--soak-tolerance BYTES]\n"
+               "          [--helmets N]\n",
+               argv0);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  double hours = -1;
+  unsigned seed = 1;
+  const char* scenario = nullptr;
+  bool verbose = false;
+  bool autoPair = true;
+  double disconnectsPerHour = 0;
+  double outOfRangePerHour = 0;
+  const char* serialDir = nullptr;
+  int64_t soakTolerance = 512;
+  int helmets = 1;
+  BleConfig& ble = bleConfig();
+
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!std::strcmp(argv[i], "--hours") && hasValue) {
+      hours = std::atof(argv[++i]);
+    } else if (!std::strcmp(argv[i], "--seed") && hasValue) {
+      seed = (unsigned)std::strtoul(argv[++i], nullptr, 10);
+    } else if (!std::strcmp(argv[i], "--scenario") && hasValue) {
+      scenario = argv[++i];
+    } else if (!std::strcmp(argv[i], "--verbose")) {
+      verbose = true;
+    } else if (!std::strcmp(argv[i], "--no-auto-pair")) {
+      autoPair = false;
+    } else if (!std::strcmp(argv[i], "--loop-us") && hasValue) {
+      config().loopCostUs = std::strtoull(argv[++i], nullptr, 10);
+    } else if (!std::strcmp(argv[i], "--latency-ms") && hasValue) {
+      ble.latencyMs = std::atof(argv[++i]);
+    } else if (!std::strcmp(argv[i], "--jitter-ms") && hasValue) {
+      ble.jitterMs = std::atof(argv[++i]);
+    } else if (!std::strcmp(argv[i], "--loss") && hasValue) {
+      ble.loss = std::atof(argv[++i]);
+    } else if (!std::strcmp(argv[i], "--disconnects-per-hour") && hasValue) {
+      disconnectsPerHour = std::atof(argv[++i]);
+    } else if (!std::strcmp(argv[i], "--out-of-range-per-hour") && hasValue) {
+      outOfRangePerHour = std::atof(argv[++i]);
+    } else if (!std::strcmp(argv[i], "--fsr-glitch") && hasValue) {
+      config().adcGlitch = std::atof(argv[++i]);
+    } else if (!std::strcmp(argv[i], "--serial-dir") && hasValue) {
+      serialDir = argv[++i];
+    } else if (!std::strcmp(argv[i], "--soak") && hasValue) {
+      soak.target = std::strtoull(argv[++i], nullptr, 10);
+    } else if (!std::strcmp(argv[i], "--soak-tolerance") && hasValue) {
+      soakTolerance = std::strtoll(argv[++i], nullptr, 10);
+    } else if (!std::strcmp(argv[i], "--helmets") && hasValue) {
+      helmets = std::atoi(argv[++i]);
+      if (helmets < 1 || helmets > 2) {
+        usage(argv[0]);
+        return 2;
+      }
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  rng().seed(seed);
+  ble.radioSeed = seed;
+
+  bike = createDevice("bike", bikeFirmware.setup, bikeFirmware.loop);
+  helmet = createDevice("helmet", helmetFirmware.setup, helmetFirmware.loop);
+  riderHelmet.dev = helmet;
+  riderHelmet.fw = &helmetFirmware;
+  if (helmets > 1) {
+    pillion = createDevice("pillion", helmet2Firmware.setup, helmet2Firmware.loop);
+    pillionHelmet.dev = pillion;
+    pillionHelmet.fw = &helmet2Firmware;
+  }
+  bike->echoSerial = verbose;
+  helmet->echoSerial = verbose;
+  if (pillion != nullptr) pillion->echoSerial = verbose;
+  if (serialDir != nullptr) {
+    for (Device* d : {bike, helmet, pillion}) {
+      if (d == nullptr) continue;
+      std::string path = std::string(serialDir) + "/" + d->name + ".log";
+      d->serialCapture = std::fopen(path.c_str(), "wb");
+      if (d->serialCapture == nullptr) {
+        std::fprintf(stderr, "cannot write %s\n", path.c_str());
+        return 2;
+      }
+    }
+  }
+  bike->onPinWrite = onBikePin;
+  bike->onSerialLine = onBikeLine;
+  bike->onDeepSleepWake = onBikeWake;
+  onNotifyDelivered = onDelivered;
+
+  // Power-on levels: starter on, stand down, stationary, helmet off
+  setInput(bike, bikeFirmware.starterPin, HIGH);
+  setInput(bike, bikeFirmware.standPin, HIGH);
+  setInput(bike, bikeFirmware.ridingPin, HIGH);
+  for (Wearer* w : {&riderHelmet, &pillionHelmet}) {
+    if (w->dev == nullptr) continue;
+    setInput(w->dev, w->fw->buttonPin, HIGH);
+    setInput(w->dev, w->fw->buckledPin, HIGH);
+  }
+
+  uint64_t endUs;
+  if (soak.target > 0) {
+    // Runs until the cycles are done; the time limit only stops a stuck run
+    endUs = hours > 0 ? (uint64_t)(hours * 3600.0 * SEC)
+                      : soak.target * (SOAK_OUT_OF_RANGE_US / SOAK_OUT_OF_RANGE_EVERY + 10 * SEC);
+    scheduleSoak(2 * SEC);
+  } else if (scenario != nullptr) {
+    int64_t lastMs = loadScenario(scenario);
+    if (lastMs < 0) return 2;
+    endUs = hours > 0 ? (uint64_t)(hours * 3600.0 * SEC) : (uint64_t)lastMs * MS + 5 * SEC;
+  } else {
+    endUs = (uint64_t)((hours > 0 ? hours : 1.0) * 3600.0 * SEC);
+    scheduleRide(0);
+  }
+  if (autoPair) scheduleAutoPair(&riderHelmet, 2 * SEC);
+  if (autoPair && pillion != nullptr) scheduleAutoPair(&pillionHelmet, 2 * SEC);
+  if (disconnectsPerHour > 0) scheduleDrops(disconnectsPerHour, endUs);
+  if (outOfRangePerHour > 0) scheduleOutOfRange(outOfRangePerHour, endUs);
+
+  boot(bike);
+  boot(helmet);
+  if (pillion != nullptr) boot(pillion);
+
+  auto wallStart = std::chrono::steady_clock::now();
+  if (soak.target > 0) {
+    while (soak.cycles < soak.target && nowUs() < endUs) run(std::min(nowUs() + 60 * SEC, endUs));
+    endUs = nowUs();
+  } else {
+    run(endUs);
+  }
+  double wallSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+
+  printReport(endUs, wallSec);
+  bool ok = soak.target == 0 || checkSoak(soakTolerance);
+  std::fflush(nullptr);  // Also the serial captures
+  std::_Exit(ok ? 0 : 1);  // Skip destructors: simulated tasks are still suspended mid-function
+}
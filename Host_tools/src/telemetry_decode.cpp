@@ -0,0 +1,225 @@
+// Decoder for the helmet's binary telemetry (lib/Telemetry/TelemetryLog.h).
+//
+//   telemetry_decode [--csv] [--every-ms MS] [--section NAME] [FILE]
+//
+// Reads a raw serial capture (or a dump of /telemetry.bin) from FILE or
+// stdin. Valid blocks are decoded; everything else is treated as the plain
+// text the firmware prints in between and passed through line by line.
+//
+// The default output matches the old text log, so it can go straight into
+// analyze_helmet.py:
+//   ##NAME                                     (with --section)
+//   helmetTouched: 1, fsrValue: 812, buckled: 1
+// --every-ms keeps one sample per MS (500 reproduces the old capture rate).
+// --csv writes every record instead: time_us,type,touched,buckled,fsr,state,sequence
+// (raw input edges appear as type edgeN with the pin level in the state column).
+//
+// Block, CRC and drop statistics go to stderr.
+
+#include <HelmetProtocol.h>
+#include <TelemetryLog.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Options {
+  bool csv = false;
+  uint64_t everyUs = 0;
+  const char* section = nullptr;
+};
+
+struct Stats {
+  uint64_t blocks = 0;
+  uint64_t crcErrors = 0;
+  uint64_t missingBlocks = 0;  // Sequence gaps, i.e. blocks lost on the way
+  uint64_t records = 0;
+  uint64_t samples = 0;
+  uint64_t dropped = 0;        // Reported by the device (ring full)
+  uint64_t textLines = 0;
+  uint64_t firstUs = 0;
+  uint64_t lastUs = 0;
+};
+
+class Decoder {
+public:
+  explicit Decoder(const Options& options) : options(options) {}
+
+  void decode(const std::vector<uint8_t>& data) {
+    if (options.csv) {
+      std::printf("time_us,type,touched,buckled,fsr,state,sequence\n");
+    } else if (options.section != nullptr) {
+      std::printf("##%s\n", options.section);
+    }
+
+    size_t i = 0;
+    while (i < data.size()) {
+      size_t length = blockAt(data, i);
+      if (length > 0) {
+        i += length;
+      } else {
+        text(data[i++]);
+      }
+    }
+    if (!line.empty()) text('\n');
+  }
+
+  const Stats& stats() const { return stats_; }
+
+private:
+  // Size of the valid block at data[i], or 0 when there is none
+  size_t blockAt(const std::vector<uint8_t>& data, size_t i) {
+    const uint8_t* p = &data[i];
+    TelemetryBlockHeader header;
+    size_t length;
+    switch (telemetryBlockAt(p, data.size() - i, header, length)) {
+      case TELEMETRY_BLOCK:
+        break;
+      case TELEMETRY_BAD_CRC:
+        stats_.crcErrors++;
+        return 0;
+      default:
+        return 0;
+    }
+
+    if (stats_.blocks > 0) {
+      stats_.missingBlocks += (uint16_t)(header.sequence - lastSequence - 1);
+    }
+    lastSequence = header.sequence;
+    stats_.blocks++;
+    stats_.dropped += header.dropped;
+
+    for (uint8_t r = 0; r < header.count; r++) {
+      TelemetryRecord record;
+      std::memcpy(&record, p + sizeof(header) + r * sizeof(TelemetryRecord), sizeof(record));
+      emit(record);
+    }
+    return length;
+  }
+
+  void emit(const TelemetryRecord& record) {
+    // Unwrap the 32-bit micros() stamps (they wrap every ~71 minutes). The
+    // bike logs streamed helmet samples at their sample time, a little behind
+    // its own records: those go back to their time, timeUs stays the newest.
+    uint64_t t = timeUs;
+    if (stats_.records == 0) {
+      timeUs = t = record.timeUs;
+      stats_.firstUs = timeUs;
+    } else {
+      int32_t delta = (int32_t)(record.timeUs - (uint32_t)timeUs);
+      t = timeUs + delta;
+      if (delta > 0) timeUs = t;
+    }
+    stats_.lastUs = timeUs;
+    stats_.records++;
+
+    bool touched = (record.a & HELMET_FLAG_TOUCHED) != 0;
+    bool buckled = (record.a & HELMET_FLAG_BUCKLED) != 0;
+
+    if (options.csv) {
+      switch (record.type) {
+        case TELEMETRY_SAMPLE:
+          std::printf("%llu,sample,%d,%d,%u,,\n", (unsigned long long)t, touched, buckled, record.b);
+          break;
+        case TELEMETRY_STATE:
+          std::printf("%llu,state,,,,%u,%u\n", (unsigned long long)t, record.a, record.b);
+          break;
+        case TELEMETRY_EDGE:
+          std::printf("%llu,edge%u,,,,%u,\n", (unsigned long long)t, record.a, record.b);
+          break;
+        case TELEMETRY_LINK:
+          std::printf("%llu,%s,,,,,\n", (unsigned long long)t, record.a ? "connect" : "disconnect");
+          break;
+        default:
+          std::printf("%llu,type%u,,,,%u,%u\n", (unsigned long long)t, record.type, record.a, record.b);
+          break;
+      }
+    }
+
+    if (record.type != TELEMETRY_SAMPLE) return;
+    stats_.samples++;
+    if (options.csv) return;
+    if (options.everyUs > 0 && haveOutput && t - lastOutputUs < options.everyUs) return;
+    haveOutput = true;
+    lastOutputUs = t;
+    std::printf("helmetTouched: %d, fsrValue: %u, buckled: %d\n", touched, record.b, buckled);
+  }
+
+  void text(uint8_t c) {
+    if (c == '\r') return;
+    if (c != '\n') {
+      line += (char)c;
+      return;
+    }
+    stats_.textLines++;
+    if (!options.csv) std::printf("%s\n", line.c_str());
+    line.clear();
+  }
+
+  Options options;
+  Stats stats_;
+  std::string line;
+  uint16_t lastSequence = 0;
+  uint64_t timeUs = 0;
+  uint64_t lastOutputUs = 0;
+  bool haveOutput = false;
+};
+
+bool readAll(FILE* f, std::vector<uint8_t>& data) {
+  uint8_t buf[65536];
+  size_t n;
+  while ((n = std::fread(buf, 1, sizeof(buf), f)) > 0) data.insert(data.end(), buf, buf + n);
+  return !std::ferror(f);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  const char* path = nullptr;
+
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!std::strcmp(argv[i], "--csv")) {
+      options.csv = true;
+    } else if (!std::strcmp(argv[i], "--every-ms") && hasValue) {
+      options.everyUs = std::strtoull(argv[++i], nullptr, 10) * 1000;
+    } else if (!std::strcmp(argv[i], "--section") && hasValue) {
+      options.section = argv[++i];
+    } else if (argv[i][0] != '-' && path == nullptr) {
+      path = argv[i];
+    } else {
+      std::fprintf(stderr, "usage: %s [--csv] [--every-ms MS] [--section NAME] [FILE]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  FILE* f = path != nullptr ? std::fopen(path, "rb") : stdin;
+  if (f == nullptr) {
+    std::fprintf(stderr, "cannot open %s\n", path);
+    return 1;
+  }
+  std::vector<uint8_t> data;
+  if (!readAll(f, data)) {
+    std::fprintf(stderr, "read error\n");
+    return 1;
+  }
+
+  Decoder decoder(options);
+  decoder.decode(data);
+
+  const Stats& s = decoder.stats();
+  double spanSec = (s.lastUs - s.firstUs) / 1e6;
+  std::fprintf(stderr,
+               "blocks: %llu (%llu CRC errors, %llu missing), records: %llu, samples: %llu "
+               "(%.0f/s over %.1f s), dropped on device: %llu, text lines: %llu\n",
+               (unsigned long long)s.blocks, (unsigned long long)s.crcErrors,
+               (unsigned long long)s.missingBlocks, (unsigned long long)s.records,
+               (unsigned long long)s.samples, spanSec > 0 ? s.samples / spanSec : 0.0, spanSec,
+               (unsigned long long)s.dropped, (unsigned long long)s.textLines);
+  return 0;
+}
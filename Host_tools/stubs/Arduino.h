@@ -0,0 +1,156 @@
+#pragma once
+
+// Host stand-in for the Arduino-ESP32 core, used by the simulator (env:sim).
+//
+// Only what the firmware in this repository uses is provided. Everything is
+// backed by the simulator runtime (src/sim/SimRuntime.h): time is virtual,
+// pins belong to the device whose code is currently running, and blocking
+// calls (delay, vTaskDelay, xQueueReceive, ...) yield to the other simulated
+// tasks.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string>
+
+#include "sim_freertos.h"
+#include "sim_esp.h"
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT          0x01
+#define OUTPUT         0x03
+#define PULLUP         0x04
+#define INPUT_PULLUP   0x05
+#define PULLDOWN       0x08
+#define INPUT_PULLDOWN 0x09
+
+#define RISING  0x01
+#define FALLING 0x02
+#define CHANGE  0x03
+
+#define DEC 10
+#define HEX 16
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+uint16_t analogRead(uint8_t pin);
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+
+template <typename T> T constrain(T x, T lo, T hi) { return x < lo ? lo : (x > hi ? hi : x); }
+
+// ---------------- String ----------------
+class String {
+public:
+  String(const char* s = "") : str(s ? s : "") {}
+  String(const std::string& s) : str(s) {}
+  String(char c) : str(1, c) {}
+  String(int v) : str(std::to_string(v)) {}
+  String(unsigned int v) : str(std::to_string(v)) {}
+  String(long v) : str(std::to_string(v)) {}
+  String(unsigned long v) : str(std::to_string(v)) {}
+
+  String& operator+=(char c) { str += c; return *this; }
+  String& operator+=(const char* s) { str += s; return *this; }
+  String& operator+=(const String& s) { str += s.str; return *this; }
+  String operator+(const String& s) const { return String(str + s.str); }
+  bool operator==(const char* s) const { return str == s; }
+  bool operator==(const String& s) const { return str == s.str; }
+  bool operator!=(const char* s) const { return str != s; }
+  char operator[](size_t i) const { return str[i]; }
+
+  const char* c_str() const { return str.c_str(); }
+  unsigned int length() const { return (unsigned int)str.size(); }
+  bool startsWith(const String& s) const { return str.compare(0, s.str.size(), s.str) == 0; }
+  int toInt() const { return atoi(str.c_str()); }
+  void trim();
+
+private:
+  std::string str;
+};
+
+// ---------------- Print / Serial ----------------
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size);
+  size_t write(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+
+  size_t print(const char* s) { return write(s); }
+  size_t print(const String& s) { return write(s.c_str()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int v, int base = DEC) { return print((long)v, base); }
+  size_t print(unsigned int v, int base = DEC) { return print((unsigned long)v, base); }
+  size_t print(long v, int base = DEC);
+  size_t print(unsigned long v, int base = DEC);
+  size_t print(double v, int digits = 2);
+
+  size_t println() { return write("\r\n"); }
+  template <typename T> size_t println(T v) { size_t n = print(v); return n + println(); }
+  template <typename T> size_t println(T v, int fmt) { size_t n = print(v, fmt); return n + println(); }
+
+  size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class HardwareSerial : public Print {
+public:
+  void begin(unsigned long baud, uint32_t config = 0, int8_t rxPin = -1, int8_t txPin = -1);
+  void end() {}
+  int available();
+  int read();
+  int peek();
+  int availableForWrite();
+  size_t setTxBufferSize(size_t size);
+  void flush() {}
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+  operator bool() const { return true; }
+};
+
+extern HardwareSerial Serial;
+
+// ---------------- Interrupts ----------------
+#define IRAM_ATTR
+#define digitalPinToInterrupt(p) (p)
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode);
+void attachInterruptArg(uint8_t pin, void (*isr)(void*), void* arg, int mode);
+void detachInterrupt(uint8_t pin);
+
+// ---------------- ESP class ----------------
+class EspClass {
+public:
+  uint32_t getFreeHeap();
+  uint32_t getMinFreeHeap();
+  uint32_t getHeapSize();
+  uint32_t getMaxAllocHeap();
+  uint32_t getCycleCount();
+  uint32_t getCpuFreqMHz();
+  void restart();
+};
+
+extern EspClass ESP;
+
+// ---------------- CPU clock ----------------
+// Recorded per device (default 160 MHz); code does not run any slower for it.
+bool setCpuFrequencyMhz(uint32_t mhz);
+uint32_t getCpuFrequencyMhz();
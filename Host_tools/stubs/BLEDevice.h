@@ -0,0 +1,335 @@
+#pragma once
+
+// Arduino-ESP32 (Bluedroid) BLE API stand-in for the simulator.
+//
+// Both roles are provided: the helmet firmware uses BLEServer/BLEAdvertising/
+// BLECharacteristic, the bike firmware uses BLEScan/BLEClient/
+// BLERemoteCharacteristic. The two sides are joined by the simulator's fake
+// link (src/sim/SimBle.cpp), which adds latency, loss and disconnects.
+// Callbacks run in the simulator's "BLE stack" context, like Bluedroid's task.
+
+#include <Arduino.h>
+#include <esp_gap_ble_api.h>
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace sim { struct BleNode; struct BleLink; }
+
+class BLEUUID {
+public:
+  BLEUUID() {}
+  BLEUUID(const char* uuid) : value(uuid) {}
+  BLEUUID(const std::string& uuid) : value(uuid) {}
+  bool equals(const BLEUUID& other) const { return value == other.value; }
+  bool operator==(const BLEUUID& other) const { return value == other.value; }
+  std::string toString() const { return value; }
+
+private:
+  std::string value;
+};
+
+class BLEAddress {
+public:
+  BLEAddress() {}
+  BLEAddress(const std::string& address) : value(address) {
+    unsigned b[6] = {};
+    sscanf(address.c_str(), "%x:%x:%x:%x:%x:%x", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]);
+    for (int i = 0; i < 6; i++) native[i] = (uint8_t)b[i];
+  }
+  BLEAddress(esp_bd_addr_t address) {
+    char text[18];
+    snprintf(text, sizeof(text), ESP_BD_ADDR_STR, ESP_BD_ADDR_HEX(address));
+    value = text;
+    memcpy(native, address, sizeof(native));
+  }
+  bool equals(const BLEAddress& other) const { return value == other.value; }
+  bool operator==(const BLEAddress& other) const { return value == other.value; }
+  std::string toString() const { return value; }
+  esp_bd_addr_t* getNative() { return &native; }
+
+private:
+  std::string value;
+  esp_bd_addr_t native = {};
+};
+
+typedef uint8_t esp_ble_addr_type_t;
+#define BLE_ADDR_TYPE_PUBLIC 0
+
+// ---------------- Scanning (client side) ----------------
+class BLEAdvertisedDevice {
+public:
+  bool haveServiceUUID() const { return !services.empty(); }
+  bool isAdvertisingService(const BLEUUID& uuid) const;
+  BLEAddress getAddress() const { return address; }
+  esp_ble_addr_type_t getAddressType() const { return BLE_ADDR_TYPE_PUBLIC; }
+  std::string getName() const { return name; }
+  bool haveName() const { return !name.empty(); }
+  int getRSSI() const { return rssi; }
+  std::string toString() const { return "Name: " + name + ", Address: " + address.toString(); }
+
+  // --- Simulator ---
+  BLEAddress address;
+  std::string name;
+  std::vector<BLEUUID> services;
+  int rssi = -60;
+};
+
+class BLEScanResults {
+public:
+  int getCount() { return count; }
+  int count = 0;
+};
+
+class BLEAdvertisedDeviceCallbacks {
+public:
+  virtual ~BLEAdvertisedDeviceCallbacks() {}
+  virtual void onResult(BLEAdvertisedDevice advertisedDevice) = 0;
+};
+
+class BLEScan {
+public:
+  void setAdvertisedDeviceCallbacks(BLEAdvertisedDeviceCallbacks* callbacks,
+                                    bool wantDuplicates = false, bool shouldParse = true);
+  void setActiveScan(bool active) {}
+  void setInterval(uint16_t intervalMs) { this->intervalMs = intervalMs; }
+  void setWindow(uint16_t windowMs) { this->windowMs = windowMs; }
+  BLEScanResults start(uint32_t duration, bool isContinue = false);
+  bool start(uint32_t duration, void (*scanCompleteCB)(BLEScanResults), bool isContinue = false);
+  void stop();
+  void clearResults() {}
+  bool isScanning() const { return scanning; }
+
+  // --- Simulator ---
+  sim::BleNode* node = nullptr;
+  BLEAdvertisedDeviceCallbacks* callbacks = nullptr;
+  void (*completeCallback)(BLEScanResults) = nullptr;
+  bool scanning = false;
+  uint32_t generation = 0;   // Invalidates pending scan events on stop()/restart
+  uint16_t intervalMs = 50;  // Arduino's defaults (0x50 / 0x30 in 0.625 ms units)
+  uint16_t windowMs = 30;
+};
+
+// ---------------- GATT client ----------------
+class BLERemoteCharacteristic;
+class BLEClient;
+
+typedef std::function<void(BLERemoteCharacteristic* characteristic, uint8_t* data,
+                           size_t length, bool isNotify)> notify_callback;
+
+class BLERemoteCharacteristic {
+public:
+  // `properties` holds the server's BLECharacteristic::PROPERTY_* bits
+  bool canNotify() const { return (properties & (1 << 2)) != 0; }
+  bool canWrite() const { return (properties & ((1 << 1) | (1 << 5))) != 0; }
+  void registerForNotify(notify_callback callback, bool notifications = true,
+                         bool descriptorRequiresRegistration = true);
+  void writeValue(uint8_t* data, size_t length, bool response = false);
+  void writeValue(std::string value, bool response = false);
+  std::string readValue();
+  BLEUUID getUUID() const { return uuid; }
+
+  // --- Simulator ---
+  BLEUUID uuid;
+  BLEUUID service;
+  uint32_t properties = 0;
+  BLEClient* client = nullptr;
+  notify_callback onNotify;
+};
+
+class BLERemoteService {
+public:
+  BLERemoteCharacteristic* getCharacteristic(BLEUUID uuid);
+
+  // --- Simulator ---
+  BLEUUID uuid;
+  BLEClient* client = nullptr;
+  std::map<std::string, BLERemoteCharacteristic*> characteristics;
+};
+
+class BLEClientCallbacks {
+public:
+  virtual ~BLEClientCallbacks() {}
+  virtual void onConnect(BLEClient* client) = 0;
+  virtual void onDisconnect(BLEClient* client) = 0;
+};
+
+class BLEClient {
+public:
+  ~BLEClient();
+  void setClientCallbacks(BLEClientCallbacks* callbacks) { this->callbacks = callbacks; }
+  bool connect(BLEAdvertisedDevice* device);
+  bool connect(BLEAddress address, esp_ble_addr_type_t type = BLE_ADDR_TYPE_PUBLIC);
+  void disconnect();
+  bool isConnected() const { return link != nullptr; }
+  BLERemoteService* getService(BLEUUID uuid);
+  std::map<std::string, BLERemoteService*>* getServices();
+  BLEAddress getPeerAddress() const { return peerAddress; }
+  bool setMTU(uint16_t mtu);
+  uint16_t getMTU() const { return mtu; }
+  int getRssi() { return -60; }
+
+  // --- Simulator ---
+  sim::BleNode* node = nullptr;
+  sim::BleLink* link = nullptr;
+  BLEClientCallbacks* callbacks = nullptr;
+  BLEAddress peerAddress;
+  uint16_t mtu = 23;
+  // Like Arduino-ESP32, kept from one connection to the next until
+  // getServices() rediscovers them or the client is deleted
+  std::map<std::string, BLERemoteService*> services;
+  void clearServices();
+};
+
+// ---------------- GATT server ----------------
+class BLECharacteristic;
+class BLEServer;
+
+class BLECharacteristicCallbacks {
+public:
+  virtual ~BLECharacteristicCallbacks() {}
+  virtual void onRead(BLECharacteristic* characteristic) {}
+  virtual void onWrite(BLECharacteristic* characteristic) {}
+};
+
+class BLEDescriptor {
+public:
+  BLEDescriptor(const char* uuid) {}
+
+  // --- Simulator ---
+  BLECharacteristic* characteristic = nullptr;
+};
+
+// The client characteristic configuration: enabled while the peer has
+// registered for notifications (the link's subscriptions)
+class BLE2902 : public BLEDescriptor {
+public:
+  BLE2902() : BLEDescriptor("2902") {}
+  bool getNotifications();
+};
+
+class BLECharacteristic {
+public:
+  static const uint32_t PROPERTY_READ = 1 << 0;
+  static const uint32_t PROPERTY_WRITE = 1 << 1;
+  static const uint32_t PROPERTY_NOTIFY = 1 << 2;
+  static const uint32_t PROPERTY_BROADCAST = 1 << 3;
+  static const uint32_t PROPERTY_INDICATE = 1 << 4;
+  static const uint32_t PROPERTY_WRITE_NR = 1 << 5;
+
+  void setValue(uint8_t* data, size_t length);
+  void setValue(std::string value);
+  void setValue(uint16_t& data16);
+  void setValue(uint32_t& data32);
+  void setValue(int& data32);
+  std::string getValue() const { return value; }
+  uint8_t* getData() { return (uint8_t*)value.data(); }
+  size_t getLength() const { return value.size(); }
+  void notify(bool isNotification = true);
+  void indicate() { notify(false); }
+  void setCallbacks(BLECharacteristicCallbacks* callbacks) { this->callbacks = callbacks; }
+  void addDescriptor(BLEDescriptor* descriptor) { descriptor->characteristic = this; }
+  BLEUUID getUUID() const { return uuid; }
+
+  // --- Simulator ---
+  BLEUUID uuid;
+  uint32_t properties = 0;
+  std::string value;
+  BLECharacteristicCallbacks* callbacks = nullptr;
+  BLEServer* server = nullptr;
+};
+
+class BLEService {
+public:
+  BLECharacteristic* createCharacteristic(const char* uuid, uint32_t properties);
+  BLECharacteristic* createCharacteristic(BLEUUID uuid, uint32_t properties);
+  BLECharacteristic* getCharacteristic(BLEUUID uuid);
+  void start() {}
+  BLEUUID getUUID() const { return uuid; }
+
+  // --- Simulator ---
+  BLEUUID uuid;
+  BLEServer* server = nullptr;
+  std::vector<BLECharacteristic*> characteristics;
+};
+
+// esp_gatts_api.h subset: what the connect event carries
+typedef union {
+  struct gatts_connect_evt_param {
+    uint16_t conn_id;
+    uint8_t link_role;
+    esp_bd_addr_t remote_bda;
+  } connect;
+} esp_ble_gatts_cb_param_t;
+
+// Both onConnect overloads are called, as in the real library
+class BLEServerCallbacks {
+public:
+  virtual ~BLEServerCallbacks() {}
+  virtual void onConnect(BLEServer* server) {}
+  virtual void onConnect(BLEServer* server, esp_ble_gatts_cb_param_t* param) {}
+  virtual void onDisconnect(BLEServer* server) {}
+};
+
+class BLEAdvertising;
+
+class BLEServer {
+public:
+  BLEService* createService(const char* uuid);
+  BLEService* createService(BLEUUID uuid);
+  BLEService* getServiceByUUID(BLEUUID uuid);
+  void setCallbacks(BLEServerCallbacks* callbacks) { this->callbacks = callbacks; }
+  BLEAdvertising* getAdvertising();
+  void startAdvertising();
+  uint16_t getConnId() const { return connId; }
+  uint32_t getConnectedCount() const { return link != nullptr ? 1 : 0; }
+  void disconnect(uint16_t connId);
+  uint16_t getPeerMTU(uint16_t connId);
+  // Only the peripheral latency is modelled (it delays writes from the central)
+  void updateConnParams(uint8_t* remoteBda, uint16_t minInterval, uint16_t maxInterval,
+                        uint16_t latency, uint16_t timeout);
+
+  // --- Simulator ---
+  sim::BleNode* node = nullptr;
+  sim::BleLink* link = nullptr;
+  BLEServerCallbacks* callbacks = nullptr;
+  uint16_t connId = 0;
+  std::vector<BLEService*> services;
+};
+
+class BLEAdvertising {
+public:
+  void addServiceUUID(const char* uuid) { addServiceUUID(BLEUUID(uuid)); }
+  void addServiceUUID(BLEUUID uuid);
+  void setScanResponse(bool response) {}
+  void setMinPreferred(uint16_t value) {}
+  void setMaxPreferred(uint16_t value) {}
+  // 0.625 ms units; the maximum is what the simulator uses
+  void setMinInterval(uint16_t interval) { minInterval = interval; }
+  void setMaxInterval(uint16_t interval) { maxInterval = interval; }
+  void start();
+  void stop();
+
+  // --- Simulator ---
+  sim::BleNode* node = nullptr;
+  uint16_t minInterval = 0;
+  uint16_t maxInterval = 0;       // 0 = not set: BleConfig::advIntervalMs
+};
+
+// ---------------- Device ----------------
+class BLEDevice {
+public:
+  static void init(std::string deviceName);
+  static void deinit(bool releaseMemory = false);
+  static bool getInitialized();
+  static BLEScan* getScan();
+  static BLEClient* createClient();
+  static BLEServer* createServer();
+  static BLEAdvertising* getAdvertising();
+  static void startAdvertising();
+  static BLEAddress getAddress();
+  static esp_err_t setMTU(uint16_t mtu);
+  static uint16_t getMTU();
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+// LiquidCrystal_I2C stand-in. Keeps the display contents in memory so the
+// simulator can show and inspect them, and counts the I2C bytes the real
+// PCF8574 backpack would have put on the bus. After init() the backpack is
+// also on the Wire stub: raw PCF8574 pin writes are decoded like the HD44780
+// would (4-bit mode, latched on EN falling edges).
+
+#include <Arduino.h>
+
+class LiquidCrystal_I2C : public Print {
+public:
+  LiquidCrystal_I2C(uint8_t address, uint8_t cols, uint8_t rows);
+
+  void init();
+  void begin(uint8_t cols, uint8_t rows) {}
+  void clear();
+  void home() { setCursor(0, 0); }
+  void setCursor(uint8_t col, uint8_t row);
+  void backlight() { backlightOn = true; }
+  void noBacklight() { backlightOn = false; }
+  size_t write(uint8_t c) override;
+  using Print::write;
+
+  // --- Simulator inspection ---
+  const char* rowText(uint8_t row) const { return text[row < 2 ? row : 1]; }
+  uint64_t i2cBytes() const { return busBytes; }
+  bool isBacklightOn() const { return backlightOn; }
+
+private:
+  void command(int transactions);
+  void onPins(uint8_t pins);
+  void execute(uint8_t value, bool data);
+
+  uint8_t address;
+  uint8_t cols;
+  uint8_t rows;
+  uint8_t col = 0;
+  uint8_t row = 0;
+  bool backlightOn = false;
+  char text[2][41];
+  uint64_t busBytes = 0;
+  uint8_t lastPins = 0;
+  bool lowNibbleNext = false;
+  uint8_t highNibble = 0;
+};
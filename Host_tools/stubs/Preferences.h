@@ -0,0 +1,35 @@
+#pragma once
+
+// Preferences (NVS key/value store) for the simulator. Values live in the
+// device (sim::Device::nvs), so they survive the firmware's deep sleep and
+// restarts like real flash.
+
+#include <Arduino.h>
+
+#include <string>
+
+class Preferences {
+public:
+  bool begin(const char* name, bool readOnly = false);
+  void end() { open = false; }
+  bool clear();
+  bool remove(const char* key);
+  bool isKey(const char* key);
+
+  size_t putString(const char* key, const char* value);
+  size_t putString(const char* key, const String& value) { return putString(key, value.c_str()); }
+  String getString(const char* key, const String& defaultValue = String());
+  size_t putUChar(const char* key, uint8_t value);
+  uint8_t getUChar(const char* key, uint8_t defaultValue = 0);
+  size_t putUInt(const char* key, uint32_t value);
+  uint32_t getUInt(const char* key, uint32_t defaultValue = 0);
+
+private:
+  std::string keyOf(const char* key) const { return space + "/" + key; }
+  bool put(const char* key, const std::string& value);
+  bool get(const char* key, std::string& value);
+
+  std::string space;
+  bool open = false;
+  bool readOnly = false;
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+// I2C bus stand-in. Devices on the bus (the LCD backpack) attach a handler
+// for their address and get each transmission's bytes; the bus time is
+// charged to the calling task, like the blocking ESP32 driver.
+
+#include <Arduino.h>
+
+#include <functional>
+#include <map>
+
+#define I2C_BUFFER_LENGTH 128
+
+class TwoWire {
+public:
+  bool begin(int sda = -1, int scl = -1, uint32_t frequency = 0) {
+    if (frequency != 0) clockHz = frequency;
+    return true;
+  }
+  bool setClock(uint32_t frequency) { clockHz = frequency; return true; }
+  uint32_t getClock() const { return clockHz; }
+
+  void beginTransmission(uint8_t address);
+  size_t write(uint8_t value);
+  size_t write(const uint8_t* data, size_t length);
+  uint8_t endTransmission(bool sendStop = true);  // 0 = ok, 2 = no ACK on the address
+
+  // --- Simulator ---
+  uint32_t clockHz = 100000;
+  std::map<uint8_t, std::function<void(const uint8_t* data, size_t length)>> devices;
+  uint8_t txAddress = 0;
+  uint8_t txBuffer[I2C_BUFFER_LENGTH];
+  size_t txLength = 0;
+};
+
+extern TwoWire Wire;
@@ -0,0 +1,18 @@
+#pragma once
+
+// Bluedroid GAP subset for the simulator.
+
+#include "sim_esp.h"
+
+#define ESP_BD_ADDR_LEN 6
+typedef uint8_t esp_bd_addr_t[ESP_BD_ADDR_LEN];
+
+// printf helpers (esp_bt_defs.h)
+#define ESP_BD_ADDR_STR "%02x:%02x:%02x:%02x:%02x:%02x"
+#define ESP_BD_ADDR_HEX(addr) addr[0], addr[1], addr[2], addr[3], addr[4], addr[5]
+
+// Connection parameters for the next connection to bd_addr (intervals in
+// 1.25 ms units, supervision timeout in 10 ms units). The simulator applies
+// the interval and the supervision timeout to that link.
+esp_err_t esp_ble_gap_set_prefer_conn_params(esp_bd_addr_t bd_addr, uint16_t min_conn_int, uint16_t max_conn_int,
+                                             uint16_t slave_latency, uint16_t supervision_tout);
@@ -0,0 +1,44 @@
+#pragma once
+
+// ESP-IDF partition API subset for the simulator. The table is the bike's
+// (Biketest/partitions.csv) as far as the firmware looks into it: only the
+// "journal" data partition exists, with a RAM image per device that is kept
+// across restarts and deep sleep like the real flash (see SimPartition.cpp).
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sim_esp.h"
+
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_SIZE 0x104
+#define SPI_FLASH_SEC_SIZE 4096
+
+typedef enum {
+  ESP_PARTITION_TYPE_APP = 0x00,
+  ESP_PARTITION_TYPE_DATA = 0x01,
+} esp_partition_type_t;
+
+typedef enum {
+  ESP_PARTITION_SUBTYPE_DATA_NVS = 0x02,
+  ESP_PARTITION_SUBTYPE_DATA_COREDUMP = 0x03,
+  ESP_PARTITION_SUBTYPE_DATA_SPIFFS = 0x82,
+  ESP_PARTITION_SUBTYPE_ANY = 0xff,
+} esp_partition_subtype_t;
+
+typedef struct {
+  esp_partition_type_t type;
+  esp_partition_subtype_t subtype;
+  uint32_t address;
+  uint32_t size;
+  char label[17];
+  bool encrypted;
+} esp_partition_t;
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char* label);
+esp_err_t esp_partition_read(const esp_partition_t* partition, size_t src_offset, void* dst, size_t size);
+// NOR flash: a write can only clear bits; erase first
+esp_err_t esp_partition_write(const esp_partition_t* partition, size_t dst_offset, const void* src, size_t size);
+// offset and size must be multiples of SPI_FLASH_SEC_SIZE
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition, size_t offset, size_t size);
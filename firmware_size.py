@@ -0,0 +1,153 @@
+# Flash/RAM use of every firmware target, so a change's footprint shows up:
+#   python firmware_size.py --against HEAD~1      (this tree vs. the previous commit)
+#   python firmware_size.py --save sizes.csv      (record a baseline)
+#   python firmware_size.py --baseline sizes.csv  (exit code 1 if a target grew)
+
+import argparse
+import csv
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+from pathlib import Path
+
+# ---------------------------
+# CONFIGURATION
+# ---------------------------
+# Every firmware project; each environment in its platformio.ini is one target
+projects = [
+    "Biketest",
+    "Bike Unit_evaluation",
+    "helmet test",
+    "helmet test c3",
+    "Helmet_Unit_evaluation"
+]
+
+# PlatformIO's summary after a build:
+#   RAM:   [=         ]  11.2% (used 36788 bytes from 327680 bytes)
+#   Flash: [========  ]  78.5% (used 1029061 bytes from 1310720 bytes)
+size_line = re.compile(r"^(RAM|Flash):.*\(used (\d+) bytes from (\d+) bytes\)")
+
+fields = ["target", "flash", "flash_max", "ram", "ram_max"]
+
+# ---------------------------
+# HELPER FUNCTIONS
+# ---------------------------
+def environments(project_dir):
+    """Environment names of one platformio.ini."""
+    names = []
+    with open(project_dir / "platformio.ini", "r", encoding="utf-8") as f:
+        for line in f:
+            m = re.match(r"^\[env:([^\]]+)\]", line.strip())
+            if m:
+                names.append(m.group(1))
+    return names
+
+
+def build_size(project_dir, env):
+    """Build one environment and return its RAM/Flash use, None if the build failed."""
+    run = subprocess.run(["pio", "run", "-d", str(project_dir), "-e", env],
+                         stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                         universal_newlines=True, errors="ignore")
+    size = {}
+    for line in run.stdout.splitlines():
+        m = size_line.match(line.strip())
+        if m:
+            key = m.group(1).lower()
+            size[key] = int(m.group(2))
+            size[key + "_max"] = int(m.group(3))
+    if run.returncode != 0 or "flash" not in size:
+        sys.stderr.write(run.stdout[-2000:])
+        print(f"❌ {project_dir.name}/{env}: build failed")
+        return None
+    return size
+
+
+def measure(root):
+    """Sizes of every target under one checkout, keyed 'project/env'."""
+    sizes = {}
+    for project in projects:
+        project_dir = Path(root) / project
+        for env in environments(project_dir):
+            size = build_size(project_dir, env)
+            if size:
+                sizes[f"{project}/{env}"] = size
+    return sizes
+
+
+def measure_ref(ref):
+    """Sizes of every target at a git ref, built in a throwaway worktree."""
+    tmp = tempfile.mkdtemp(prefix="firmware_size_")
+    tree = os.path.join(tmp, "tree")
+    subprocess.run(["git", "worktree", "add", "--detach", tree, ref], check=True,
+                   stdout=subprocess.DEVNULL)
+    try:
+        return measure(tree)
+    finally:
+        subprocess.run(["git", "worktree", "remove", "--force", tree], stdout=subprocess.DEVNULL)
+        shutil.rmtree(tmp, ignore_errors=True)
+
+
+def read_csv(filename):
+    with open(filename, "r", encoding="utf-8", newline="") as f:
+        return {row["target"]: {k: int(row[k]) for k in fields[1:]} for row in csv.DictReader(f)}
+
+
+def write_csv(filename, sizes):
+    with open(filename, "w", encoding="utf-8", newline="") as f:
+        writer = csv.DictWriter(f, fieldnames=fields)
+        writer.writeheader()
+        for target in sorted(sizes):
+            writer.writerow(dict(target=target, **sizes[target]))
+
+
+def delta(now, then):
+    return f"{now - then:+d}" if then is not None else ""
+
+# ---------------------------
+# MAIN
+# ---------------------------
+def main():
+    parser = argparse.ArgumentParser(
+        description="Flash/RAM use of every firmware target, from `pio run` (needs PlatformIO on PATH).")
+    parser.add_argument("--baseline", help="CSV from an earlier --save: show the change, fail on growth")
+    parser.add_argument("--against", metavar="REF", help="Build git REF as the baseline instead (e.g. HEAD~1)")
+    parser.add_argument("--tolerance", type=int, default=256,
+                        help="Bytes of flash or RAM a target may grow before it fails (default 256)")
+    parser.add_argument("--save", help="Write this run's sizes to a CSV (the next baseline)")
+    args = parser.parse_args()
+
+    os.chdir(Path(__file__).resolve().parent)
+    baseline = {}
+    if args.against:
+        print(f"🔍 Building {args.against} for the baseline...")
+        baseline = measure_ref(args.against)
+    elif args.baseline:
+        baseline = read_csv(args.baseline)
+
+    sizes = measure(".")
+    if args.save:
+        write_csv(args.save, sizes)
+
+    print(f"\n{'target':<44}{'flash':>10}{'Δ':>8}{'ram':>10}{'Δ':>8}")
+    grown = []
+    for target in sorted(sizes):
+        s = sizes[target]
+        b = baseline.get(target)
+        print(f"{target:<44}{s['flash']:>10}{delta(s['flash'], b and b['flash']):>8}"
+              f"{s['ram']:>10}{delta(s['ram'], b and b['ram']):>8}")
+        if b and (s["flash"] - b["flash"] > args.tolerance or s["ram"] - b["ram"] > args.tolerance):
+            grown.append(target)
+
+    failed = sum(1 for p in projects for _ in environments(Path(p))) - len(sizes)
+    if grown:
+        print(f"\n⚠️ Grown by more than {args.tolerance} bytes: {', '.join(grown)}")
+    if failed:
+        print(f"\n❌ {failed} target(s) did not build")
+    return 1 if grown or failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
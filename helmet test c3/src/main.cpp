@@ -2,32 +2,225 @@
 #include <BLEDevice.h>
 #include <BLEUtils.h>
 #include <BLEServer.h>
+#include <BLE2902.h>
+#include <HelmetProtocol.h>
+#include <FsrStream.h>
+#include <HelmetNotifyPolicy.h>
+#include <LatencyTrace.h>
+#include <TelemetryLog.h>
+#include <FsrFilter.h>
+#include <EdgeDebouncer.h>
+#include <HelmetPowerModel.h>
+#include <BoardTraits.h>
+#include <driver/adc.h>
 
-#define SERVICE_UUID "4fafc201-1fb5-459e-8fcc-c5c9c331914b"
-#define CHAR_UUID_TX "beb5483e-36e1-4688-b7f5-ea07361b26a8"
-#define CHAR_UUID_RX "6e400002-b5a3-f393-e0a9-e50e24dcca9e"
+// Pins and sensors come from the board traits (lib/BoardTraits/BoardTraits.h);
+// the environment picks the board with -DBOARD
+#ifndef BOARD
+#define BOARD HelmetC3Board
+#endif
+typedef BOARD Board;
 
-#define FSR_PIN 0 
-#define TOUCH_PIN 5        // TTP223 touch sensor → HIGH = touched (helmet worn)
-#define BUCKLE_PIN 6       // Buckle switch input (active LOW when buckled)
-#define BUTTON_PIN 7       // push button to enable/disable pairing 
+// 1 = sample fast and notify on state change (+ heartbeat), 0 = legacy fixed 500 ms notify
+#define NOTIFY_ON_CHANGE 1
+#define LOG_INTERVAL_MS 500 // Sensor printout rate (kept at the capture rate used by analyze_helmet.py)
+#define LATENCY_REPORT_MS 10000
+// 1 = advertise again as soon as the bike's link drops (so the bike's direct
+// reconnect gets through), 0 = only after a button press
+#define READVERTISE_ON_DROP 1
+
+// 1 = low-power mode: light sleep whenever there is no bike to serve or wait
+// for (touch, buckle and the button wake it), FSR and ADC off unless a bike
+// is connected or may connect, advertising that slows down and times out,
+// peripheral latency on the link and a lower CPU clock. 0 = always awake.
+#define LOW_POWER 1
+#define CPU_MHZ 80                 // Lowest clock the radio runs at (Arduino default: 160)
+#define ADV_FAST_INTERVAL 48       // 30 ms (0.625 ms units) for ADV_FAST_MS after advertising starts
+#define ADV_SLOW_INTERVAL 1636     // 1022.5 ms after that
+#define ADV_DEFAULT_INTERVAL 64    // BLEAdvertising's own maximum (40 ms), used when LOW_POWER is 0
+#define ADV_FAST_MS 30000
+#define ADV_TIMEOUT_MS 600000      // No bike for 10 min: stop advertising until touch or buckle changes
+// Asked of the bike once connected: its own 7.5-15 ms interval, but the
+// helmet may sleep through CONN_PERIPHERAL_LATENCY events in a row when it
+// has nothing to send. A notify still goes out at the next event, so
+// detection latency does not change; only the bike's writes can wait longer.
+#define CONN_INTERVAL_MIN 6
+#define CONN_INTERVAL_MAX 12
+#define CONN_PERIPHERAL_LATENCY 4
+#define CONN_SUPERVISION_TIMEOUT 200
+#define BATTERY_MAH 500            // Helmet cell, for the runtime estimate
+
+// Touch, buckle and button are read by GPIO interrupts; loop() sleeps until
+// an edge or the next timed job (sample, heartbeat, debounce deadline)
+#define SWITCH_SETTLE_US 2000       // Buckle and touch: quiet time before a new level counts
+#define BUTTON_SETTLE_US 20000
+#define INPUT_QUEUE_LENGTH 32
+#define LOOP_IDLE_MAX_MS 1000
+
+// 1 = continuous (DMA) ADC filtered by FsrFilter in fsrTask, 0 = analogRead() against FSR_ANALOG_THRESHOLD
+// (both thresholds come from lib/FsrFilter/FsrCalibration.h). Only on boards with the continuous ADC.
+#define FSR_CONTINUOUS (1 && Board::HAS_FSR_DMA)
+#define FSR_SAMPLE_HZ 2000
+#define FSR_FRAME_BYTES 64               // 16 conversions per DMA frame = 8 ms at FSR_SAMPLE_HZ
+
+// 1 = stream the FSR waveform with touch and buckle to a bike that subscribes
+// to CHAR_UUID_FSR_STREAM, many samples per notification, as many as the
+// negotiated MTU takes (lib/HelmetProtocol/FsrStream.h). Needs the continuous ADC.
+// Opt-in per build (env:esp32-c3-devkitc-02-stream): about 10 notifications/s
+// on top of the status frames, charged to the power model as notifyChargeUc().
+#ifndef FSR_STREAM
+#define FSR_STREAM 0
+#endif
+static_assert(!FSR_STREAM || FSR_CONTINUOUS, "FSR_STREAM needs a board with the continuous ADC");
+#define FSR_STREAM_DECIMATE 8            // Conversions per stream sample (their mean): 250 Hz
+#define FSR_STREAM_PERIOD_US (1000000 / FSR_SAMPLE_HZ * FSR_STREAM_DECIMATE)
+#define FSR_STREAM_BATCH_MS 100          // A batch goes out at the latest this long after its first sample
+
+// 1 = log every sample as a binary record (decode with Host_tools env:telemetry),
+// 0 = text printout every LOG_INTERVAL_MS. Opt-in per build (env:esp32-c3-devkitc-02-telemetry):
+// sampling at TELEMETRY_SAMPLE_US wakes loop() every 1 ms while connected, so the
+// helmet never reaches light sleep, and the text lines the capture tools read are gone.
+#ifndef TELEMETRY
+#define TELEMETRY 0
+#endif
+#define TELEMETRY_SAMPLE_US 1000     // Sampling period while TELEMETRY is on
+#define TELEMETRY_DRAIN_MS 20
+#define TELEMETRY_SINK_SERIAL 0
+#define TELEMETRY_SINK_FLASH 1       // Append to TELEMETRY_FILE; send 'D' to dump it, 'E' to erase it
+#define TELEMETRY_SINK TELEMETRY_SINK_SERIAL
+#define TELEMETRY_FILE "/telemetry.bin"
+#define TELEMETRY_FILE_MAX_BYTES (1024UL * 1024UL)
+
+#if TELEMETRY_SINK == TELEMETRY_SINK_FLASH
+#include <LittleFS.h>
+#endif
 
 BLECharacteristic *txCharacteristic;
 BLECharacteristic *rxCharacteristic;
+BLECharacteristic *streamCharacteristic;
+BLE2902 *streamConfig;  // The bike's subscription to the stream
 BLEServer *pServer;
 BLEAdvertising *pAdvertising;
 
 bool deviceConnected = false;
 bool isAdvertising = false;
-bool lastButtonState = HIGH;
-unsigned long lastDebounceTime = 0;
-const unsigned long debounceDelay = 300;  // debounce delay in ms
+bool userDisconnect = false;  // The button dropped the link: stay quiet
+
+// --- Inputs (edges from the GPIO ISRs, fsrTask and the BLE callbacks) ---
+enum HelmetInput : uint8_t {
+  INPUT_TOUCH,
+  INPUT_BUCKLE,
+  INPUT_BUTTON,
+  NUM_SWITCH_INPUTS,
+  INPUT_FSR = NUM_SWITCH_INPUTS,  // Debounced by FsrFilter already
+  INPUT_LINK                      // Connect/disconnect, only wakes loop()
+};
+const uint8_t inputPins[NUM_SWITCH_INPUTS] = {Board::TOUCH_PIN, Board::BUCKLE_PIN, Board::BUTTON_PIN};
+// Touch lost, buckle open and button press go through on their first edge,
+// the way back is debounced
+EdgeDebouncer inputs[NUM_SWITCH_INPUTS] = {
+  EdgeDebouncer(SWITCH_SETTLE_US, !Board::TOUCH_ACTIVE), EdgeDebouncer(SWITCH_SETTLE_US, !Board::BUCKLE_ACTIVE),
+  EdgeDebouncer(BUTTON_SETTLE_US, LOW)
+};
+QueueHandle_t inputEdges;
+volatile uint32_t inputOverflows = 0;
+uint32_t seenOverflows = 0;
+bool inputChanged = false;
+uint32_t inputChangeUs = 0;  // First edge of the latest accepted change
 
 // --- Timing variables ---
 unsigned long bootTime = 0;
 unsigned long connectTime = 0;
 bool connectTimeRecorded = false;
 
+// --- Status frame ---
+uint16_t frameSequence = 0;
+HelmetNotifyPolicy notifyPolicy(NOTIFY_ON_CHANGE,
+                                NOTIFY_ON_CHANGE ? HELMET_HEARTBEAT_INTERVAL_MS : HELMET_LEGACY_NOTIFY_MS);
+bool wasConnected = false;
+uint32_t lastSampleUs = 0;
+int lastFsrValue = 0;
+unsigned long lastLogTime = 0;
+
+// --- Telemetry (filled by loop(), drained by telemetryTask) ---
+TelemetryLog<1024> telemetry;
+#if TELEMETRY_SINK == TELEMETRY_SINK_FLASH
+File telemetryFile;
+#endif
+
+// --- FSR (written by fsrTask) ---
+FsrFilter fsrFilter;
+volatile uint16_t fsrLevel = 0;
+volatile bool fsrWorn = false;
+
+// --- FSR stream (fsrTask only, except sensorFlags) ---
+FsrStreamEncoder fsrStream(FSR_STREAM_PERIOD_US);
+uint32_t streamSum = 0;
+uint8_t streamTaken = 0;
+uint16_t streamMtu = 23;
+volatile uint32_t streamNotifies = 0;   // Read by updatePower() for the power model
+volatile uint32_t streamBytes = 0;
+volatile uint8_t sensorFlags = 0;  // HELMET_FLAG_* of the debounced touch and buckle, set by loop()
+
+// Sensor sample -> notify() returned (the bike traces the rest of the path)
+LatencyHistogram notifyLatency;
+unsigned long lastLatencyReport = 0;
+
+// --- Power ---
+HelmetPowerModel power;
+TaskHandle_t fsrTaskHandle = NULL;
+volatile bool fsrPowered = true;
+unsigned long advertisingSince = 0;
+bool advertisingFast = false;
+bool advertiseOnWear = false;  // Advertising timed out: a touch or buckle change starts it again
+uint32_t lightSleeps = 0;
+
+void postInputEdge(uint8_t input, uint8_t level) {
+  InputEdge edge = {input, level, (uint32_t)micros()};
+  xQueueSend(inputEdges, &edge, 0);
+}
+
+void IRAM_ATTR onInputEdge(void* arg) {
+  uint8_t input = (uint8_t)(uintptr_t)arg;
+  InputEdge edge = {input, (uint8_t)digitalRead(inputPins[input]), (uint32_t)micros()};
+  BaseType_t woken = pdFALSE;
+  if (xQueueSendFromISR(inputEdges, &edge, &woken) != pdTRUE) inputOverflows++;
+  portYIELD_FROM_ISR(woken);
+}
+
+// ---------------- Advertising ----------------
+void setAdvertisingInterval(uint16_t interval) {
+  pAdvertising->setMinInterval(interval);
+  pAdvertising->setMaxInterval(interval);
+}
+
+// Fast at first, so the bike's direct connect gets through at once; slow
+// once nobody came; off after ADV_TIMEOUT_MS (see updateAdvertising())
+void startAdvertising() {
+  if (LOW_POWER) setAdvertisingInterval(ADV_FAST_INTERVAL);
+  pAdvertising->start();
+  isAdvertising = true;
+  advertisingFast = true;
+  advertisingSince = millis();
+  advertiseOnWear = false;
+}
+
+void updateAdvertising() {
+  if (!LOW_POWER || !isAdvertising || deviceConnected) return;
+  unsigned long elapsed = millis() - advertisingSince;
+  if (elapsed >= ADV_TIMEOUT_MS) {
+    pAdvertising->stop();
+    isAdvertising = false;
+    advertiseOnWear = true;
+    Serial.println("💤 No bike came → Stop advertising until the helmet is picked up");
+  } else if (advertisingFast && elapsed >= ADV_FAST_MS) {
+    pAdvertising->stop();  // The interval only changes on a new start
+    setAdvertisingInterval(ADV_SLOW_INTERVAL);
+    pAdvertising->start();
+    advertisingFast = false;
+  }
+}
+
 class ServerCallbacks: public BLEServerCallbacks {
   void onConnect(BLEServer* pServer) override {
     deviceConnected = true;
@@ -36,14 +229,239 @@ class ServerCallbacks: public BLEServerCallbacks {
     Serial.println("✅ Bike connected.");
     Serial.printf("⏱ BLE connection time: %.2f seconds\n", connectTime / 1000.0);
     isAdvertising = false;
+    postInputEdge(INPUT_LINK, 1);
+  }
+
+  void onConnect(BLEServer* pServer, esp_ble_gatts_cb_param_t* param) override {
+    if (LOW_POWER) {
+      pServer->updateConnParams(param->connect.remote_bda, CONN_INTERVAL_MIN, CONN_INTERVAL_MAX,
+                                CONN_PERIPHERAL_LATENCY, CONN_SUPERVISION_TIMEOUT);
+    }
   }
 
   void onDisconnect(BLEServer* pServer) override {
     deviceConnected = false;
     Serial.println("❌ Bike disconnected.");
+    if (READVERTISE_ON_DROP && !userDisconnect) {
+      startAdvertising();
+      Serial.println("🔵 Advertising again for the bike");
+    }
+    userDisconnect = false;
+    postInputEdge(INPUT_LINK, 0);
   }
 };
 
+// ---------------- FSR stream ----------------
+// fsrTask hands in every conversion; FSR_STREAM_DECIMATE of them make one
+// sample. A batch goes out when the next sample no longer fits (see
+// FsrStreamEncoder::add()) or FSR_STREAM_BATCH_MS after its first sample.
+void sendStreamBatch(uint8_t* batch, size_t length) {
+  streamCharacteristic->setValue(batch, length);
+  streamCharacteristic->notify();
+  streamBytes += length;
+  streamNotifies++;
+}
+
+void streamConversion(uint16_t raw, uint32_t timeUs) {
+  static uint8_t batch[FSR_STREAM_MAX_BYTES];
+  streamSum += raw;
+  if (++streamTaken < FSR_STREAM_DECIMATE) return;
+  uint16_t fsr = streamSum / FSR_STREAM_DECIMATE;
+  streamSum = 0;
+  streamTaken = 0;
+  size_t n = fsrStream.add(fsr, sensorFlags, timeUs, batch);
+  if (n > 0) sendStreamBatch(batch, n);
+}
+
+void flushStreamIfDue(uint32_t nowUs) {
+  static uint8_t batch[FSR_STREAM_MAX_BYTES];
+  if (fsrStream.empty() || nowUs - fsrStream.firstSampleUs() < FSR_STREAM_BATCH_MS * 1000UL) return;
+  size_t n = fsrStream.flush(batch);
+  sendStreamBatch(batch, n);
+}
+
+// Only while a bike listens. The batch size follows the MTU the bike negotiated.
+bool updateStream() {
+  bool streaming = FSR_STREAM && deviceConnected && streamConfig->getNotifications();
+  if (streaming) {
+    streamMtu = pServer->getPeerMTU(pServer->getConnId());
+    fsrStream.setMaxBytes(streamMtu - 3);
+  } else {
+    fsrStream.reset();
+    streamSum = 0;
+    streamTaken = 0;
+  }
+  return streaming;
+}
+
+// ---------------- FSR acquisition ----------------
+// The ADC fills DMA frames on its own; this task wakes once per frame, runs
+// the filter over it and publishes the level and the debounced worn signal.
+// While the FSR is powered down it waits for setFsrPower(true), and the
+// filter starts over from "not worn".
+void fsrTask(void* param) {
+  static uint8_t frame[FSR_FRAME_BYTES];
+  unsigned long lastReport = millis();
+  for (;;) {
+    if (!fsrPowered) {
+      fsrFilter.reset();
+      fsrLevel = 0;
+      fsrWorn = false;  // Only read while connected, and the FSR is on then
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      continue;
+    }
+    uint32_t length = 0;
+    if (adc_digi_read_bytes(frame, sizeof(frame), &length, 100) != ESP_OK) {
+      vTaskDelay(pdMS_TO_TICKS(10));
+      continue;
+    }
+    // The last conversion of the frame is the newest
+    uint32_t frameUs = micros();
+    uint32_t conversions = length / SOC_ADC_DIGI_RESULT_BYTES;
+    bool streaming = updateStream();
+    for (uint32_t k = 0; k < conversions; k++) {
+      const adc_digi_output_data_t* p = (const adc_digi_output_data_t*)&frame[k * SOC_ADC_DIGI_RESULT_BYTES];
+      if (p->type2.channel != Board::FSR_ADC_CHANNEL) continue;
+      fsrFilter.update(p->type2.data);
+      if (streaming) streamConversion(p->type2.data, frameUs - (conversions - 1 - k) * (1000000 / FSR_SAMPLE_HZ));
+    }
+    if (streaming) flushStreamIfDue(frameUs);
+    fsrLevel = fsrFilter.value();
+    if (fsrFilter.worn() != fsrWorn) {
+      fsrWorn = fsrFilter.worn();
+      postInputEdge(INPUT_FSR, fsrWorn);
+    }
+
+    if (millis() - lastReport >= LATENCY_REPORT_MS) {
+      lastReport = millis();
+      const FsrStats& s = fsrFilter.stats();
+      if (deviceConnected) {
+        Serial.printf("FSR n:%lu mean:%u min:%u max:%u noise:%u glitches:%lu changes:%lu\n",
+                      (unsigned long)s.samples, s.meanRaw(), s.minRaw, s.maxRaw, s.noise(),
+                      (unsigned long)s.glitches, (unsigned long)s.transitions);
+      }
+      if (streaming) Serial.printf("FSR stream: %u batches, MTU %u\n", fsrStream.batches(), streamMtu);
+      fsrFilter.resetStats();
+    }
+  }
+}
+
+void beginFsrAdc() {
+  adc_digi_init_config_t init = {};
+  init.max_store_buf_size = 4 * FSR_FRAME_BYTES;
+  init.conv_num_each_intr = FSR_FRAME_BYTES;
+  init.adc1_chan_mask = Board::HAS_FSR_DMA ? 1 << Board::FSR_ADC_CHANNEL : 0;
+  init.adc2_chan_mask = 0;
+
+  static adc_digi_pattern_config_t pattern = {};
+  pattern.atten = ADC_ATTEN_DB_11;  // Same 0..4095 range analogRead() gave
+  pattern.channel = Board::FSR_ADC_CHANNEL;
+  pattern.unit = 0;                 // ADC1
+  pattern.bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+
+  adc_digi_configuration_t config = {};
+  config.conv_limit_en = false;
+  config.conv_limit_num = 250;
+  config.pattern_num = 1;
+  config.adc_pattern = &pattern;
+  config.sample_freq_hz = FSR_SAMPLE_HZ;
+  config.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+  config.format = ADC_DIGI_OUTPUT_FORMAT_TYPE2;
+
+  if (adc_digi_initialize(&init) != ESP_OK || adc_digi_controller_configure(&config) != ESP_OK ||
+      adc_digi_start() != ESP_OK) {
+    Serial.println("❌ Continuous ADC setup failed.");
+    return;
+  }
+  // notify() from the stream needs the extra stack
+  xTaskCreate(fsrTask, "fsr", FSR_STREAM ? 4096 : 3072, NULL, 2, &fsrTaskHandle);
+}
+
+// ---------------- Power ----------------
+// Only needed while a bike is connected or may connect
+void setFsrPower(bool on) {
+  if (on == fsrPowered) return;
+  fsrPowered = on;
+  if (Board::FSR_POWER_PIN >= 0) digitalWrite(Board::FSR_POWER_PIN, on ? HIGH : LOW);
+  if (!FSR_CONTINUOUS || fsrTaskHandle == NULL) return;
+  if (on) {
+    adc_digi_start();
+    xTaskNotifyGive(fsrTaskHandle);
+  } else {
+    adc_digi_stop();
+  }
+}
+
+HelmetPowerState powerState() {
+  return deviceConnected ? POWER_LINKED : isAdvertising ? POWER_ADVERTISING : POWER_AWAKE;
+}
+
+// Time between radio events in a state (see helmetCurrentMa())
+float radioEventMs(HelmetPowerState state) {
+  if (state == POWER_LINKED) return CONN_INTERVAL_MAX * 1.25f * (1 + (LOW_POWER ? CONN_PERIPHERAL_LATENCY : 0));
+  if (state != POWER_ADVERTISING) return 0;
+  if (!LOW_POWER) return ADV_DEFAULT_INTERVAL * 0.625f;
+  return (advertisingFast ? ADV_FAST_INTERVAL : ADV_SLOW_INTERVAL) * 0.625f;
+}
+
+void updatePower() {
+  static uint32_t chargedNotifies = 0, chargedBytes = 0;
+  if (LOW_POWER) setFsrPower(deviceConnected || isAdvertising);
+  uint32_t notifies = streamNotifies, bytes = streamBytes;
+  power.addCharge(notifyChargeUc(notifies - chargedNotifies, bytes - chargedBytes));
+  chargedNotifies = notifies;
+  chargedBytes = bytes;
+  HelmetPowerState state = powerState();
+  power.enter(state, helmetCurrentMa(state, getCpuFrequencyMhz(), radioEventMs(state), fsrPowered),
+              esp_timer_get_time());
+}
+
+// ---------------- Telemetry drain ----------------
+void writeTelemetry(const uint8_t* block, size_t length) {
+#if TELEMETRY_SINK == TELEMETRY_SINK_FLASH
+  if (telemetryFile && telemetryFile.size() + length <= TELEMETRY_FILE_MAX_BYTES) {
+    telemetryFile.write(block, length);
+  }
+#else
+  Serial.write(block, length);
+#endif
+}
+
+#if TELEMETRY_SINK == TELEMETRY_SINK_FLASH
+void handleTelemetryCommand(int command) {
+  if (command != 'D' && command != 'E') return;
+  telemetryFile.close();
+  if (command == 'D') {
+    File f = LittleFS.open(TELEMETRY_FILE, "r");
+    uint8_t buf[256];
+    size_t n;
+    while (f && (n = f.read(buf, sizeof(buf))) > 0) Serial.write(buf, n);
+    f.close();
+  } else {
+    LittleFS.remove(TELEMETRY_FILE);
+    Serial.println("🗑 Telemetry file erased.");
+  }
+  telemetryFile = LittleFS.open(TELEMETRY_FILE, "a");
+}
+#endif
+
+// Runs at the loop task's priority: blocks go out between samples, and a
+// slow sink only fills the ring (drops are counted in the next block).
+void telemetryTask(void* param) {
+  static uint8_t block[TELEMETRY_BLOCK_BYTES(TELEMETRY_MAX_BLOCK_RECORDS)];
+  for (;;) {
+    size_t n;
+    while ((n = telemetry.drain(block, sizeof(block))) > 0) {
+      writeTelemetry(block, n);
+    }
+#if TELEMETRY_SINK == TELEMETRY_SINK_FLASH
+    telemetryFile.flush();
+    if (Serial.available()) handleTelemetryCommand(Serial.read());
+#endif
+    vTaskDelay(pdMS_TO_TICKS(TELEMETRY_DRAIN_MS));
+  }
+}
+
 void setup() {
   Serial.begin(115200);
   delay(1000);
@@ -51,11 +469,24 @@ void setup() {
 
   bootTime = millis();  // Record system start time
 
-  pinMode(TOUCH_PIN, INPUT);
-  pinMode(BUCKLE_PIN, INPUT_PULLUP);
-  pinMode(BUTTON_PIN, INPUT_PULLUP);
+  pinMode(Board::TOUCH_PIN, INPUT);
+  pinMode(Board::BUCKLE_PIN, INPUT_PULLUP);
+  pinMode(Board::BUTTON_PIN, INPUT_PULLUP);
+  if (Board::FSR_POWER_PIN >= 0) {
+    pinMode(Board::FSR_POWER_PIN, OUTPUT);
+    digitalWrite(Board::FSR_POWER_PIN, HIGH);
+  }
+  if (LOW_POWER) setCpuFrequencyMhz(CPU_MHZ);
+
+  inputEdges = xQueueCreate(INPUT_QUEUE_LENGTH, sizeof(InputEdge));
+  for (uint8_t i = 0; i < NUM_SWITCH_INPUTS; i++) {
+    inputs[i].reset(digitalRead(inputPins[i]), micros());
+    attachInterruptArg(inputPins[i], onInputEdge, (void*)(uintptr_t)i, CHANGE);
+  }
+  if (FSR_CONTINUOUS) beginFsrAdc();
 
   BLEDevice::init("HelmetUnit");
+  if (FSR_STREAM) BLEDevice::setMTU(FSR_STREAM_MTU);  // The bike asks for it; only the stream needs it
   pServer = BLEDevice::createServer();
   pServer->setCallbacks(new ServerCallbacks());
 
@@ -67,73 +498,262 @@ void setup() {
   rxCharacteristic = pService->createCharacteristic(
     CHAR_UUID_RX, BLECharacteristic::PROPERTY_WRITE
   );
+  if (FSR_STREAM) {
+    streamCharacteristic = pService->createCharacteristic(
+      CHAR_UUID_FSR_STREAM, BLECharacteristic::PROPERTY_NOTIFY
+    );
+    streamConfig = new BLE2902();
+    streamCharacteristic->addDescriptor(streamConfig);
+  }
 
   pService->start();
 
   pAdvertising = BLEDevice::getAdvertising();
   pAdvertising->addServiceUUID(SERVICE_UUID);
 
+#if TELEMETRY
+#if TELEMETRY_SINK == TELEMETRY_SINK_FLASH
+  if (LittleFS.begin(true)) {
+    telemetryFile = LittleFS.open(TELEMETRY_FILE, "a");
+  } else {
+    Serial.println("❌ LittleFS mount failed, telemetry disabled.");
+  }
+#endif
+  xTaskCreate(telemetryTask, "telemetry", 3072, NULL, 1, NULL);
+#endif
+
+  updatePower();
   Serial.println("Helmet ready. Press button to start/stop pairing.");
 }
 
-void loop() {
-  bool currentButtonState = digitalRead(BUTTON_PIN);
-
-  // Detect button press (active LOW) with debounce
-  if (currentButtonState == LOW && lastButtonState == HIGH && 
-      (millis() - lastDebounceTime) > debounceDelay) {
-
-    lastDebounceTime = millis();
-
-    if (!isAdvertising && !deviceConnected) {
-      Serial.println("🔵 Button pressed → Start advertising (pairing enabled)");
-      pAdvertising->start();
-      isAdvertising = true;
-      connectTimeRecorded = false;  // reset timer for new connection
-      bootTime = millis();          // reset base time for timing measurement
-      delay(500);
-
-    } else if (isAdvertising) {
-      Serial.println("🟡 Button pressed → Stop advertising");
-      pAdvertising->stop();
-      isAdvertising = false;
-      delay(500);
-
-    } else if (deviceConnected) {
-      Serial.println("🔴 Button pressed → Disconnect BLE device");
-      pServer->disconnect(pServer->getConnId());
-      deviceConnected = false;
-      isAdvertising = false;
-      delay(500);
+// ---------------- Input handling ----------------
+void handleButtonPress() {
+  if (!isAdvertising && !deviceConnected) {
+    Serial.println("🔵 Button pressed → Start advertising (pairing enabled)");
+    startAdvertising();
+    connectTimeRecorded = false;  // reset timer for new connection
+    bootTime = millis();          // reset base time for timing measurement
+
+  } else if (isAdvertising) {
+    Serial.println("🟡 Button pressed → Stop advertising");
+    pAdvertising->stop();
+    isAdvertising = false;
+    advertiseOnWear = false;  // Stays quiet until the next press
+
+  } else if (deviceConnected) {
+    Serial.println("🔴 Button pressed → Disconnect BLE device");
+    userDisconnect = true;
+    pServer->disconnect(pServer->getConnId());
+    deviceConnected = false;
+    isAdvertising = false;
+  }
+}
+
+void onInputChange(uint8_t input) {
+  if (input == INPUT_BUTTON) {
+    if (inputs[INPUT_BUTTON].level() == LOW) handleButtonPress();  // Active LOW
+    return;
+  }
+  inputChanged = true;
+  inputChangeUs = inputs[input].changedAtUs();
+  if (advertiseOnWear && !deviceConnected && !isAdvertising) {
+    Serial.println("🔵 Helmet picked up → Advertising for the bike again");
+    startAdvertising();
+  }
+}
+
+void handleEdge(const InputEdge& edge) {
+  if (TELEMETRY) telemetry.log(TELEMETRY_EDGE, edge.input, edge.level, edge.timeUs);
+  if (edge.input == INPUT_FSR) {
+    inputChanged = true;
+    inputChangeUs = edge.timeUs;
+  }
+  if (edge.input >= NUM_SWITCH_INPUTS) return;
+
+  EdgeDebouncer& d = inputs[edge.input];
+  if (d.poll(edge.timeUs)) onInputChange(edge.input);  // The previous burst settled before this edge
+  d.edge(edge.level, edge.timeUs);
+}
+
+// Time until the earliest debounce deadline, or limitUs if none is sooner
+uint32_t debounceWaitUs(uint32_t limitUs) {
+  uint32_t now = micros();
+  for (uint8_t i = 0; i < NUM_SWITCH_INPUTS; i++) {
+    if (!inputs[i].pending()) continue;
+    int32_t left = (int32_t)(inputs[i].deadlineUs() - now);
+    if (left <= 0) return 0;
+    if ((uint32_t)left < limitUs) limitUs = left;
+  }
+  return limitUs;
+}
+
+// Periodic work: telemetry samples, the polled FSR, notify heartbeats.
+// Everything else arrives as an edge.
+TickType_t loopWaitTicks() {
+  uint32_t waitUs = LOOP_IDLE_MAX_MS * 1000;
+  uint32_t now = micros();
+  if (deviceConnected) {
+    uint32_t samplePeriodUs = TELEMETRY ? TELEMETRY_SAMPLE_US
+        : FSR_CONTINUOUS ? 0 : (NOTIFY_ON_CHANGE ? HELMET_SAMPLE_INTERVAL_MS : HELMET_LEGACY_NOTIFY_MS) * 1000;
+    if (samplePeriodUs > 0) {
+      uint32_t elapsed = now - lastSampleUs;
+      uint32_t dueUs = elapsed >= samplePeriodUs ? 0 : samplePeriodUs - elapsed;
+      if (dueUs < waitUs) waitUs = dueUs;
     }
+    uint32_t heartbeatUs = notifyPolicy.msUntilHeartbeat(millis()) * 1000;
+    if (heartbeatUs < waitUs) waitUs = heartbeatUs;
+  }
+  waitUs = debounceWaitUs(waitUs);
+  return pdMS_TO_TICKS((waitUs + 999) / 1000);
+}
+
+// ---------------- Light sleep ----------------
+// Nothing to serve: sleep until touch, buckle or the button moves, or until
+// a debounce deadline (UINT32_MAX = none). gpio_wakeup_enable() turns a
+// pin's interrupt into a level one, so the edge interrupts are off meanwhile
+// and the pins are read again afterwards.
+void lightSleep(uint32_t sleepUs) {
+  for (uint8_t i = 0; i < NUM_SWITCH_INPUTS; i++) {
+    gpio_num_t pin = (gpio_num_t)inputPins[i];
+    gpio_intr_disable(pin);
+    gpio_wakeup_enable(pin, digitalRead(pin) == HIGH ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL);
   }
+  esp_sleep_enable_gpio_wakeup();
+  if (sleepUs == UINT32_MAX) {
+    esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_TIMER);
+  } else {
+    esp_sleep_enable_timer_wakeup(sleepUs);
+  }
+  Serial.flush();  // The UART stops in light sleep
+  power.enter(POWER_LIGHT_SLEEP, helmetCurrentMa(POWER_LIGHT_SLEEP, 0, 0, false), esp_timer_get_time());
+  esp_light_sleep_start();
+  lightSleeps++;
+  updatePower();
+
+  uint32_t wakeUs = micros();
+  for (uint8_t i = 0; i < NUM_SWITCH_INPUTS; i++) {
+    gpio_num_t pin = (gpio_num_t)inputPins[i];
+    gpio_wakeup_disable(pin);
+    gpio_set_intr_type(pin, GPIO_INTR_ANYEDGE);
+    gpio_intr_enable(pin);
+  }
+  // The edge that woke us was never queued: take what changed as an edge now
+  for (uint8_t i = 0; i < NUM_SWITCH_INPUTS; i++) {
+    uint8_t level = digitalRead(inputPins[i]);
+    if (level == inputs[i].level() && !inputs[i].pending()) continue;
+    InputEdge edge = {i, level, wakeUs};
+    handleEdge(edge);
+  }
+}
+
+void printPower() {
+  uint64_t now = esp_timer_get_time();
+  Serial.println("---- Power (estimate) ----");
+  for (uint8_t i = 0; i < NUM_POWER_STATES; i++) {
+    HelmetPowerState s = (HelmetPowerState)i;
+    Serial.printf("%-12s %9.1f s %8.3f mAh\n", powerStateName(s), power.timeUs(s, now) / 1e6,
+                  power.chargeMah(s, now));
+  }
+  Serial.printf("average %.2f mA → %.0f h on %d mAh, %lu light sleeps\n", power.averageMa(now),
+                power.batteryHours(BATTERY_MAH, now), BATTERY_MAH, (unsigned long)lightSleeps);
+}
 
-  lastButtonState = currentButtonState;
+void loop() {
+  // Sleep until an input edge or the next timed job, then take everything
+  // queued. With no radio work the chip itself sleeps.
+  InputEdge edge;
+  TickType_t wait = loopWaitTicks();
+  if (LOW_POWER && wait > 0 && !deviceConnected && !isAdvertising && uxQueueMessagesWaiting(inputEdges) == 0) {
+    lightSleep(debounceWaitUs(UINT32_MAX));
+    wait = 0;
+  }
+  if (xQueueReceive(inputEdges, &edge, wait) == pdTRUE) {
+    do {
+      handleEdge(edge);
+    } while (xQueueReceive(inputEdges, &edge, 0) == pdTRUE);
+  }
+  if (inputOverflows != seenOverflows) {
+    // Edges were lost: resynchronise from the pins
+    seenOverflows = inputOverflows;
+    for (uint8_t i = 0; i < NUM_SWITCH_INPUTS; i++) {
+      InputEdge now = {i, (uint8_t)digitalRead(inputPins[i]), (uint32_t)micros()};
+      handleEdge(now);
+    }
+  }
+  uint32_t nowUs = micros();
+  for (uint8_t i = 0; i < NUM_SWITCH_INPUTS; i++) {
+    if (inputs[i].poll(nowUs)) onInputChange(i);
+  }
 
   // Helmet logic (only active when connected)
+  if (deviceConnected != wasConnected) {
+    if (deviceConnected) notifyPolicy.reset(); // Send the current state to a newly connected bike right away
+    if (TELEMETRY) telemetry.log(TELEMETRY_LINK, deviceConnected, 0, micros());
+  }
+  wasConnected = deviceConnected;
+  updateAdvertising();
+  updatePower();
+
   if (deviceConnected) {
-    bool helmetTouched = (digitalRead(TOUCH_PIN) == HIGH);
-    int fsrValue = analogRead(FSR_PIN);
-    bool buckled = (digitalRead(BUCKLE_PIN) == LOW);
+    uint32_t samplePeriodUs = TELEMETRY ? TELEMETRY_SAMPLE_US
+        : (NOTIFY_ON_CHANGE ? HELMET_SAMPLE_INTERVAL_MS : HELMET_LEGACY_NOTIFY_MS) * 1000;
+    bool sampleDue = micros() - lastSampleUs >= samplePeriodUs;
+    if (sampleDue) lastSampleUs = micros();
 
-    Serial.printf("helmetTouched: %d, fsrValue: %d, buckled: %d\n",
-                  helmetTouched, fsrValue, buckled);
+    // A change is stamped with its first edge, so notify latency includes the debounce
+    uint32_t sampleTime = inputChanged ? inputChangeUs : micros();
+    inputChanged = false;
+    bool helmetTouched = inputs[INPUT_TOUCH].level() == Board::TOUCH_ACTIVE;
+    bool buckled = inputs[INPUT_BUCKLE].level() == Board::BUCKLE_ACTIVE;
+    sensorFlags = (helmetTouched ? HELMET_FLAG_TOUCHED : 0) | (buckled ? HELMET_FLAG_BUCKLED : 0);
+    int fsrValue = FSR_CONTINUOUS ? fsrLevel : (sampleDue ? analogRead(Board::FSR_PIN) : lastFsrValue);
+    lastFsrValue = fsrValue;
+    bool worn = FSR_CONTINUOUS ? fsrWorn : fsrValue > FSR_ANALOG_THRESHOLD;
 
-    if (helmetTouched && fsrValue > 50 && buckled) {
-      txCharacteristic->setValue("true");
-      txCharacteristic->notify();
-      Serial.println("✅ Helmet touch + FSR + buckle → Sent TRUE to Bike.");
-    } 
-    else if(helmetTouched && fsrValue > 50 && !buckled){
-      txCharacteristic->setValue("warn_notbuckeld");
-      txCharacteristic->notify();
-      Serial.println("⚠️ Warning: Missing condition → Sent WARN to Bike.");
+#if TELEMETRY
+    if (sampleDue) {
+      telemetry.log(TELEMETRY_SAMPLE, (helmetTouched ? HELMET_FLAG_TOUCHED : 0) | (buckled ? HELMET_FLAG_BUCKLED : 0),
+                    (uint16_t)fsrValue, sampleTime);
     }
-    else {
-      txCharacteristic->setValue("warn");
+#else
+    if (millis() - lastLogTime >= LOG_INTERVAL_MS) {
+      lastLogTime = millis();
+      Serial.printf("helmetTouched: %d, fsrValue: %d, buckled: %d\n",
+                    helmetTouched, fsrValue, buckled);
+    }
+#endif
+
+    HelmetState state = helmetStateFromSensors(helmetTouched, worn, buckled);
+
+    HelmetNotifyReason reason = notifyPolicy.update(state, millis());
+    if (reason != NOTIFY_NONE) {
+      HelmetStatusFrame frame;
+      encodeHelmetStatus(frame, state, helmetTouched, buckled, (uint16_t)fsrValue,
+                         frameSequence++, sampleTime);
+      txCharacteristic->setValue((uint8_t*)&frame, sizeof(frame));
       txCharacteristic->notify();
-      Serial.println("⚠️ Warning: Missing condition → Sent WARN to Bike.");
+      notifyLatency.record(micros() - sampleTime);
+      if (TELEMETRY) telemetry.log(TELEMETRY_STATE, state, frameSequence - 1, sampleTime);
+
+      if (reason != NOTIFY_HEARTBEAT) {
+        if (state == HELMET_SECURE) {
+          Serial.println("✅ Helmet touch + FSR + buckle → Sent TRUE to Bike.");
+        } 
+        else {
+          Serial.println("⚠️ Warning: Missing condition → Sent WARN to Bike.");
+        }
+      }
     }
-    delay(500);
+  }
+
+  if (deviceConnected && millis() - lastLatencyReport >= LATENCY_REPORT_MS) {
+    lastLatencyReport = millis();
+    Serial.println("---- Latency (us) ----");
+    printLatency(Serial, "notify", notifyLatency);
+    Serial.printf("inputs: buckle %lu edges %lu glitches, touch %lu edges %lu glitches, %lu lost\n",
+                  (unsigned long)inputs[INPUT_BUCKLE].edges(), (unsigned long)inputs[INPUT_BUCKLE].glitches(),
+                  (unsigned long)inputs[INPUT_TOUCH].edges(), (unsigned long)inputs[INPUT_TOUCH].glitches(),
+                  (unsigned long)seenOverflows);
+    printPower();
   }
 }
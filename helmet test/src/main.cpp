@@ -2,15 +2,20 @@
 #include <BLEDevice.h>
 #include <BLEUtils.h>
 #include <BLEServer.h>
+#include <HelmetProtocol.h>
+#include <HelmetNotifyPolicy.h>
+#include <FsrCalibration.h>
+#include <BoardTraits.h>
 
-#define SERVICE_UUID "4fafc201-1fb5-459e-8fcc-c5c9c331914b"
-#define CHAR_UUID_TX "beb5483e-36e1-4688-b7f5-ea07361b26a8"
-#define CHAR_UUID_RX "6e400002-b5a3-f393-e0a9-e50e24dcca9e"
+// Pins and sensors come from the board traits (lib/BoardTraits/BoardTraits.h)
+#ifndef BOARD
+#define BOARD HelmetDevkitBoard
+#endif
+typedef BOARD Board;
 
-#define FSR_PIN 34
-#define TOUCH_PIN 4        // TTP223 touch sensor → HIGH = touched (helmet worn)
-#define BUCKLE_PIN 2       // Buckle switch input (active LOW when buckled)
-#define BUTTON_PIN 15   // push button to enable/disable pairing
+// 1 = sample fast and notify on state change (+ heartbeat), 0 = legacy fixed 500 ms notify
+#define NOTIFY_ON_CHANGE 1
+#define LOG_INTERVAL_MS 500 // Sensor printout rate (kept at the capture rate used by analyze_helmet.py)
 
 BLECharacteristic *txCharacteristic;
 BLECharacteristic *rxCharacteristic;
@@ -21,6 +26,12 @@ bool deviceConnected = false;
 bool isAdvertising = false;   // <--- custom flag
 bool lastButtonState = HIGH;
 
+HelmetNotifyPolicy notifyPolicy(NOTIFY_ON_CHANGE,
+                                NOTIFY_ON_CHANGE ? HELMET_HEARTBEAT_INTERVAL_MS : HELMET_LEGACY_NOTIFY_MS);
+bool wasConnected = false;
+unsigned long lastSampleTime = 0;
+unsigned long lastLogTime = 0;
+
 class ServerCallbacks: public BLEServerCallbacks {
   void onConnect(BLEServer* pServer) {
     deviceConnected = true;
@@ -38,9 +49,9 @@ class ServerCallbacks: public BLEServerCallbacks {
 
 void setup() {
   Serial.begin(115200);
-  pinMode(TOUCH_PIN, INPUT);
-  pinMode(BUCKLE_PIN, INPUT_PULLUP);   
-  pinMode(BUTTON_PIN, INPUT_PULLUP);
+  pinMode(Board::TOUCH_PIN, INPUT);
+  pinMode(Board::BUCKLE_PIN, INPUT_PULLUP);   
+  pinMode(Board::BUTTON_PIN, INPUT_PULLUP);
 
   BLEDevice::init("HelmetUnit");
   pServer = BLEDevice::createServer();
@@ -69,26 +80,33 @@ void setup() {
 
 void loop() {
   // Start advertising only if button pressed & not already advertising
-  if (digitalRead(BUTTON_PIN) == LOW && !isAdvertising) {
+  if (digitalRead(Board::BUTTON_PIN) == LOW && !isAdvertising) {
     Serial.println("Button pressed → start advertising for pairing");
     pAdvertising->start();
     isAdvertising = true;
   }
 
-  
-  if (deviceConnected) {
-    // int fsrValue = analogRead(FSR_PIN);
-    // int touchValue = digitalRead(TOUCH_PIN);
-
-    // if (fsrValue > 500 && touchValue == HIGH) {
-    //   txCharacteristic->setValue("true");
-    //   txCharacteristic->notify();
-    //   Serial.println("Human detected, sent TRUE to Bike.");
-    // }
-    bool helmetWorn = digitalRead(TOUCH_PIN) == HIGH;  // TTP223
-    bool buckled = digitalRead(BUCKLE_PIN) == LOW;     // active LOW when buckled
-    Serial.printf("helmetWorn: %d, buckled: %d\n", helmetWorn, buckled);
-    if (helmetWorn && buckled) {
+  if (deviceConnected && !wasConnected) {
+    notifyPolicy.reset(); // Send the current state to a newly connected bike right away
+  }
+  wasConnected = deviceConnected;
+
+  unsigned long sampleInterval = NOTIFY_ON_CHANGE ? HELMET_SAMPLE_INTERVAL_MS : HELMET_LEGACY_NOTIFY_MS;
+  if (deviceConnected && millis() - lastSampleTime >= sampleInterval) {
+    lastSampleTime = millis();
+    // The FSR only counts on boards that read it
+    bool helmetWorn = digitalRead(Board::TOUCH_PIN) == Board::TOUCH_ACTIVE &&  // TTP223
+                      (!Board::HAS_FSR || analogRead(Board::FSR_PIN) > FSR_ANALOG_THRESHOLD);
+    bool buckled = digitalRead(Board::BUCKLE_PIN) == Board::BUCKLE_ACTIVE;
+    bool secure = helmetWorn && buckled;
+
+    if (millis() - lastLogTime >= LOG_INTERVAL_MS) {
+      lastLogTime = millis();
+      Serial.printf("helmetWorn: %d, buckled: %d\n", helmetWorn, buckled);
+    }
+    if (notifyPolicy.update(secure, millis()) == NOTIFY_NONE) return;
+
+    if (secure) {
       txCharacteristic->setValue("true");
       txCharacteristic->notify();
       Serial.println("✅ Helmet worn & buckled → Sent TRUE to Bike.");
@@ -97,6 +115,5 @@ void loop() {
       txCharacteristic->notify();
       Serial.println("⚠️ Warning: Helmet not worn OR not buckled → Sent WARN to Bike.");
     }
-    delay(500);
   }
 }
@@ -0,0 +1,108 @@
+#pragma once
+
+// Pin maps and feature sets of the boards the firmwares run on.
+//
+// Each PlatformIO environment names its board with -DBOARD=<type>, and the
+// firmware does `typedef BOARD Board;` and reads everything from Board::. The
+// members are compile-time constants, so a feature a board lacks is an
+// `if (Board::HAS_...)` the compiler drops, code and strings included, and a
+// firmware holds no pin numbers of its own. A board starts from the base of
+// its unit, where every pin is -1 and every feature off, and only states what
+// it has; an unused trait costs nothing.
+//
+// Switch levels are the ones the sensor reports when active (HIGH = 1,
+// LOW = 0), so `digitalRead(Board::TOUCH_PIN) == Board::TOUCH_ACTIVE`.
+
+#include <stdint.h>
+
+// ---------------- Bike unit ----------------
+
+struct BikeBoardBase {
+  static constexpr int8_t STAND_PIN = -1;            // Side stand switch
+  static constexpr uint8_t STAND_UP_LEVEL = 0;
+  static constexpr int8_t RIDING_PIN = -1;           // Motion / seat sensor
+  static constexpr uint8_t RIDING_LEVEL = 0;
+  static constexpr int8_t IGNITION_PIN = -1;         // Ignition relay, HIGH = on
+  static constexpr int8_t BUZZER_PIN = -1;           // HIGH = on
+  static constexpr int8_t BLE_RED_PIN = -1;          // Link LEDs
+  static constexpr int8_t BLE_GREEN_PIN = -1;
+  static constexpr int8_t STARTER_WAKEUP_PIN = -1;   // RTC GPIO that wakes the bike from deep sleep
+  static constexpr uint8_t STARTER_ON_LEVEL = 1;
+  static constexpr int8_t I2C_SDA_PIN = -1;
+  static constexpr int8_t I2C_SCL_PIN = -1;
+  static constexpr uint8_t LCD_I2C_ADDRESS = 0;      // 0 = no LCD
+
+  static constexpr bool HAS_LCD = false;
+  static constexpr bool HAS_STATUS_LEDS = false;
+  static constexpr bool HAS_STARTER_WAKE = false;
+};
+
+// ESP32 DevKit V1 on the bike harness (Biketest)
+struct BikeDevkitBoard : BikeBoardBase {
+  static constexpr int8_t STAND_PIN = 26;            // LOW = stand up, INPUT_PULLUP
+  static constexpr uint8_t STAND_UP_LEVEL = 0;
+  static constexpr int8_t RIDING_PIN = 34;           // LOW = riding, INPUT_PULLUP
+  static constexpr uint8_t RIDING_LEVEL = 0;
+  static constexpr int8_t IGNITION_PIN = 25;
+  static constexpr int8_t BUZZER_PIN = 27;
+  static constexpr int8_t BLE_RED_PIN = 2;
+  static constexpr int8_t BLE_GREEN_PIN = 4;
+  static constexpr int8_t STARTER_WAKEUP_PIN = 32;
+  static constexpr uint8_t STARTER_ON_LEVEL = 1;     // Starter switch HIGH when on
+  static constexpr int8_t I2C_SDA_PIN = 21;
+  static constexpr int8_t I2C_SCL_PIN = 22;
+  static constexpr uint8_t LCD_I2C_ADDRESS = 0x27;
+
+  static constexpr bool HAS_LCD = true;
+  static constexpr bool HAS_STATUS_LEDS = true;
+  static constexpr bool HAS_STARTER_WAKE = true;
+};
+
+// The same DevKit on the evaluation bench (Bike Unit_evaluation): stand
+// switch and LCD only, the LCD module at 0x3F
+struct BikeEvalBoard : BikeBoardBase {
+  static constexpr int8_t STAND_PIN = 26;            // HIGH = stand up, plain INPUT
+  static constexpr uint8_t STAND_UP_LEVEL = 1;
+  static constexpr int8_t I2C_SDA_PIN = 21;
+  static constexpr int8_t I2C_SCL_PIN = 22;
+  static constexpr uint8_t LCD_I2C_ADDRESS = 0x3F;
+
+  static constexpr bool HAS_LCD = true;
+};
+
+// ---------------- Helmet unit ----------------
+
+struct HelmetBoardBase {
+  static constexpr int8_t FSR_PIN = -1;              // Force sensor divider (ADC)
+  static constexpr int8_t FSR_ADC_CHANNEL = -1;      // ADC1 channel of FSR_PIN, for the continuous driver
+  static constexpr int8_t FSR_POWER_PIN = -1;        // GPIO feeding the divider, switched with the ADC (-1 = on 3V3)
+  static constexpr int8_t TOUCH_PIN = -1;            // TTP223 touch sensor
+  static constexpr uint8_t TOUCH_ACTIVE = 1;         // HIGH = touched (helmet worn)
+  static constexpr int8_t BUCKLE_PIN = -1;           // Buckle switch, INPUT_PULLUP
+  static constexpr uint8_t BUCKLE_ACTIVE = 0;        // LOW = buckled
+  static constexpr int8_t BUTTON_PIN = -1;           // Pairing button, INPUT_PULLUP, LOW = pressed
+
+  static constexpr bool HAS_FSR = false;
+  static constexpr bool HAS_FSR_DMA = false;         // Continuous (DMA) ADC on FSR_ADC_CHANNEL
+};
+
+// ESP32 DevKit V1 helmet prototype (helmet test). The FSR is wired to 34 but
+// the prototype decides on touch and buckle alone.
+struct HelmetDevkitBoard : HelmetBoardBase {
+  static constexpr int8_t FSR_PIN = 34;
+  static constexpr int8_t TOUCH_PIN = 4;
+  static constexpr int8_t BUCKLE_PIN = 2;
+  static constexpr int8_t BUTTON_PIN = 15;
+};
+
+// ESP32-C3 helmet (helmet test c3, Helmet_Unit_evaluation)
+struct HelmetC3Board : HelmetBoardBase {
+  static constexpr int8_t FSR_PIN = 0;
+  static constexpr int8_t FSR_ADC_CHANNEL = 0;       // ADC1_CHANNEL_0 = GPIO0
+  static constexpr int8_t TOUCH_PIN = 5;
+  static constexpr int8_t BUCKLE_PIN = 6;
+  static constexpr int8_t BUTTON_PIN = 7;
+
+  static constexpr bool HAS_FSR = true;
+  static constexpr bool HAS_FSR_DMA = true;
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+// Debouncing for interrupt-driven switch inputs (buckle, touch, button).
+//
+// The GPIO ISR timestamps every raw edge and queues it (InputEdge); the task
+// that drains the queue feeds the edges to one EdgeDebouncer per input
+// (poll(edge.timeUs) first, then edge()) and calls poll() again when they
+// have been quiet for a while. A new level is accepted once the raw input
+// has stayed there for settleUs after its last edge, and the accepted change
+// is stamped with the FIRST edge of the burst, i.e. when the contact
+// actually moved, not when the bouncing stopped.
+// A burst that ends back at the old level is a glitch and changes nothing.
+//
+// Optionally one level is "fast": a change towards it is accepted on its
+// first edge, and only the way back is debounced. The helmet uses this for
+// buckle open and touch lost, so losing a safety condition is reported
+// without delay while regaining one still has to settle.
+//
+// Nothing here needs a periodic tick: between edges the caller can block
+// until deadlineUs().
+
+#include <stdint.h>
+
+#define EDGE_NO_FAST_LEVEL -1
+
+struct InputEdge {
+  uint8_t input;   // Index of the input (firmware defined)
+  uint8_t level;   // Pin level right after the edge
+  uint32_t timeUs; // micros() in the ISR
+};
+
+class EdgeDebouncer {
+public:
+  explicit EdgeDebouncer(uint32_t settleUs, int8_t fastLevel = EDGE_NO_FAST_LEVEL)
+      : settleUs(settleUs), fastLevel(fastLevel) {
+    reset(false, 0);
+  }
+
+  void reset(bool level, uint32_t nowUs) {
+    stable = level;
+    raw = level;
+    burst = false;
+    firstEdgeUs = nowUs;
+    lastEdgeUs = nowUs;
+    changedUs = nowUs;
+    edgeCount = 0;
+    glitchCount = 0;
+    changeCount = 0;
+  }
+
+  // A raw edge; level is the pin level read right after it
+  void edge(bool level, uint32_t timeUs) {
+    edgeCount++;
+    if (!burst) {
+      if (level == stable) return;  // Missed the edge away (queue overflow); nothing to do
+      burst = true;
+      firstEdgeUs = timeUs;
+    }
+    raw = level;
+    lastEdgeUs = timeUs;
+  }
+
+  // Returns true when level() changed; changedAtUs() then holds the stamp
+  bool poll(uint32_t nowUs) {
+    if (!burst) return false;
+    bool fast = raw != stable && (int8_t)raw == fastLevel;
+    if (!fast && (int32_t)(nowUs - lastEdgeUs) < (int32_t)settleUs) return false;
+    burst = false;
+    if (raw == stable) {
+      glitchCount++;
+      return false;
+    }
+    stable = raw;
+    changedUs = firstEdgeUs;
+    changeCount++;
+    return true;
+  }
+
+  bool pending() const { return burst; }
+  // Only meaningful while pending()
+  uint32_t deadlineUs() const {
+    return raw != stable && (int8_t)raw == fastLevel ? lastEdgeUs : lastEdgeUs + settleUs;
+  }
+
+  bool level() const { return stable; }
+  uint32_t changedAtUs() const { return changedUs; }
+
+  uint32_t edges() const { return edgeCount; }
+  uint32_t glitches() const { return glitchCount; }
+  uint32_t changes() const { return changeCount; }
+
+private:
+  uint32_t settleUs;
+  int8_t fastLevel;
+  bool stable;
+  bool raw;
+  bool burst;  // Edges seen since the last accepted level
+  uint32_t firstEdgeUs;
+  uint32_t lastEdgeUs;
+  uint32_t changedUs;
+  uint32_t edgeCount;
+  uint32_t glitchCount;
+  uint32_t changeCount;
+};
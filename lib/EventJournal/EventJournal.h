@@ -0,0 +1,502 @@
+#pragma once
+
+// Append-only event journal in a flash partition, kept across power cycles.
+//
+// Records are 16 bytes, each with its own CRC, written in order into 4 KB
+// sectors that are used round robin: every sector is erased once per lap of
+// the partition, so the wear is spread evenly, and once the journal is full
+// the oldest sector makes room. Slot 0 of a sector is its header: the
+// sector's sequence number (the highest is the head) and the time of its
+// first record. The headers of all sectors are kept in RAM as the time index,
+// so the start of a time range is a binary search over them plus one over the
+// 255 records of a sector (8 reads of 16 bytes), whatever the journal holds.
+//
+// append() is for the control path: it stamps the record, seals it with its
+// CRC and queues it. It never touches the flash and never blocks; when the
+// queue is full the record is dropped and counted. flush() runs in a
+// low-priority task and writes the queue out. It also erases the sector after
+// the head ahead of time, so opening a sector never waits for an erase. An
+// erase stalls flash-cached code on both cores for tens of ms, once every
+// JOURNAL_SECTOR_RECORDS records.
+//
+// Time is the journal's own clock, in ms: where the newest record left off at
+// mount, plus the uptime since. It does not run while the unit is off or in
+// deep sleep. Every record carries the number of the boot that wrote it, so a
+// reader sees where the clock was stopped.
+//
+// A record torn by a power loss fails its CRC and is skipped on read; a torn
+// sector header makes mount() treat the sector as free.
+//
+// Dump format (little endian), for getting records off the unit:
+//   JournalBlockHeader  'E' 'J' version count
+//   JournalRecord       x count
+//   uint16_t crc        CRC-16/CCITT-FALSE over header and records
+// Like telemetry blocks, these can be mixed with plain text on one serial
+// port (Host_tools env:journal decodes them).
+//
+// The flash is a template parameter:
+//   bool read(uint32_t offset, void* data, size_t size);
+//   bool write(uint32_t offset, const void* data, size_t size);  // NOR: bits only go 1 -> 0
+//   bool erase(uint32_t offset, size_t size);                     // Whole sectors
+//   uint32_t size();
+// (esp_partition_* on the bike, a RAM image in the host simulator).
+//
+// Exactly one task may call append(); flush(), find() and read() belong to
+// one other task (or the same one). mount() runs before either.
+//
+// No Arduino includes: journal_decode.cpp (env:journal) reads dump blocks
+// with these definitions.
+
+#include <atomic>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <TelemetryLog.h>  // telemetryCrc16(), TelemetryScan
+
+#define JOURNAL_VERSION 1
+#define JOURNAL_MAGIC0 'E'
+#define JOURNAL_MAGIC1 'J'
+#define JOURNAL_SECTOR_BYTES 4096
+#define JOURNAL_ERASED 0xFF          // Type byte of a free slot
+#define JOURNAL_MAX_BLOCK_RECORDS 32
+
+struct __attribute__((packed)) JournalRecord {
+  uint8_t type;     // User defined, but not JOURNAL_ERASED
+  uint8_t a;        // User defined
+  uint16_t b;       // User defined
+  uint32_t timeS;   // Journal clock
+  uint16_t timeMs;  // 0..999
+  uint16_t boot;    // Boot that wrote it, counted by mount()
+  uint16_t c;       // User defined
+  uint16_t crc;     // telemetryCrc16() over the bytes before it
+};
+
+struct __attribute__((packed)) JournalSectorHeader {
+  uint8_t magic[2];
+  uint8_t version;
+  uint8_t reserved;
+  uint32_t sequence;  // Sectors opened before this one
+  uint32_t firstS;    // Time of its first record
+  uint16_t boot;
+  uint16_t crc;
+};
+
+struct __attribute__((packed)) JournalBlockHeader {
+  uint8_t magic[2];
+  uint8_t version;
+  uint8_t count;
+};
+
+static_assert(sizeof(JournalRecord) == 16, "JournalRecord must stay 16 bytes");
+static_assert(sizeof(JournalSectorHeader) == sizeof(JournalRecord), "The sector header takes one record slot");
+
+#define JOURNAL_SECTOR_RECORDS (JOURNAL_SECTOR_BYTES / sizeof(JournalRecord) - 1)
+#define JOURNAL_BLOCK_BYTES(count) \
+  (sizeof(JournalBlockHeader) + (count) * sizeof(JournalRecord) + 2)
+
+inline void sealJournalRecord(JournalRecord& r) {
+  r.crc = telemetryCrc16((const uint8_t*)&r, sizeof(r) - 2);
+}
+
+inline bool journalRecordValid(const JournalRecord& r) {
+  return r.type != JOURNAL_ERASED && telemetryCrc16((const uint8_t*)&r, sizeof(r) - 2) == r.crc;
+}
+
+inline bool journalErased(const void* data, size_t size) {
+  const uint8_t* p = (const uint8_t*)data;
+  for (size_t i = 0; i < size; i++) {
+    if (p[i] != 0xFF) return false;
+  }
+  return true;
+}
+
+// Writes one dump block of `count` records (at most JOURNAL_MAX_BLOCK_RECORDS)
+// into out and returns its size.
+inline size_t encodeJournalBlock(const JournalRecord* records, uint8_t count, uint8_t* out) {
+  JournalBlockHeader header;
+  header.magic[0] = JOURNAL_MAGIC0;
+  header.magic[1] = JOURNAL_MAGIC1;
+  header.version = JOURNAL_VERSION;
+  header.count = count;
+  memcpy(out, &header, sizeof(header));
+  memcpy(out + sizeof(header), records, count * sizeof(JournalRecord));
+  size_t crcAt = JOURNAL_BLOCK_BYTES(count) - 2;
+  uint16_t crc = telemetryCrc16(out, crcAt);
+  out[crcAt] = (uint8_t)crc;
+  out[crcAt + 1] = (uint8_t)(crc >> 8);
+  return JOURNAL_BLOCK_BYTES(count);
+}
+
+// Decoder side, as telemetryBlockAt()
+inline TelemetryScan journalBlockAt(const uint8_t* p, size_t available, JournalBlockHeader& header,
+                                    size_t& length) {
+  if (available < 3) return available > 0 && p[0] == JOURNAL_MAGIC0 ? TELEMETRY_PARTIAL : TELEMETRY_NO_BLOCK;
+  if (p[0] != JOURNAL_MAGIC0 || p[1] != JOURNAL_MAGIC1 || p[2] != JOURNAL_VERSION) return TELEMETRY_NO_BLOCK;
+  if (available < sizeof(header)) return TELEMETRY_PARTIAL;
+  memcpy(&header, p, sizeof(header));
+  if (header.count > JOURNAL_MAX_BLOCK_RECORDS) return TELEMETRY_NO_BLOCK;
+  length = JOURNAL_BLOCK_BYTES(header.count);
+  if (available < length) return TELEMETRY_PARTIAL;
+
+  size_t crcAt = length - 2;
+  uint16_t crc = (uint16_t)(p[crcAt] | (p[crcAt + 1] << 8));
+  return telemetryCrc16(p, crcAt) == crc ? TELEMETRY_BLOCK : TELEMETRY_BAD_CRC;
+}
+
+// Where a reader is: record slot `slot` of the sector opened as `sequence`.
+// Stays valid while the journal grows; if that sector is erased meanwhile,
+// read() goes on with the oldest one left.
+struct JournalCursor {
+  uint32_t sequence;
+  uint16_t slot;
+  bool done;
+};
+
+struct JournalStats {
+  uint32_t appended;     // Queued by append()
+  uint32_t dropped;      // Queue full
+  uint32_t written;      // Into the flash
+  uint32_t writeErrors;  // Flash write or erase failed; the record is lost
+  uint32_t erases;
+  uint32_t badRecords;   // Failed their CRC on read (torn writes)
+};
+
+template <class Flash, size_t MaxSectors, size_t QueueCapacity>
+class EventJournal {
+  static_assert((QueueCapacity & (QueueCapacity - 1)) == 0, "QueueCapacity must be a power of two");
+  static_assert(MaxSectors >= 2, "The journal needs at least two sectors");
+
+public:
+  explicit EventJournal(Flash& flash) : flash(flash), head(0), tail(0), droppedCount(0) {
+    memset(&counts, 0, sizeof(counts));
+  }
+
+  // Reads the sector headers and finds where the next record goes, the clock
+  // and the boot number. The partition may hold anything the first time:
+  // sectors without a valid header are erased before they are used.
+  // False = the flash is too small or unreadable; append() then only drops.
+  bool mount(uint64_t uptimeMs) {
+    sectors = (uint16_t)(flash.size() / JOURNAL_SECTOR_BYTES);
+    if (sectors > MaxSectors) sectors = MaxSectors;
+    mounted = false;
+    if (sectors < 2) return false;
+
+    headSector = -1;
+    for (uint16_t s = 0; s < sectors; s++) {
+      JournalSectorHeader h;
+      index[s].valid = false;
+      if (!flash.read(sectorOffset(s), &h, sizeof(h))) return false;
+      if (!headerValid(h)) continue;
+      index[s].valid = true;
+      index[s].sequence = h.sequence;
+      index[s].firstS = h.firstS;
+      if (headSector < 0 || (int32_t)(h.sequence - index[headSector].sequence) > 0) headSector = s;
+    }
+
+    uint64_t lastMs = 0;
+    uint16_t lastBoot = 0;
+    if (headSector < 0) {
+      // Empty: the first record opens sector 0
+      headSector = sectors - 1;
+      nextSlot = JOURNAL_SECTOR_RECORDS + 1;
+      nextSequence = 0;
+    } else {
+      JournalSectorHeader h;
+      flash.read(sectorOffset(headSector), &h, sizeof(h));
+      nextSequence = h.sequence + 1;
+      lastMs = (uint64_t)h.firstS * 1000;
+      lastBoot = h.boot;
+      nextSlot = firstFreeSlot(headSector);
+      // The newest record that reads back sets the clock and the boot number
+      for (uint16_t slot = nextSlot; slot-- > 1;) {
+        JournalRecord r;
+        if (flash.read(slotOffset(headSector, slot), &r, sizeof(r)) && journalRecordValid(r)) {
+          lastMs = (uint64_t)r.timeS * 1000 + r.timeMs;
+          lastBoot = r.boot;
+          break;
+        }
+      }
+    }
+    bootNumber = (uint16_t)(lastBoot + 1);
+    clockOffsetMs = (int64_t)(lastMs + 1) - (int64_t)uptimeMs;
+    nextErased = sectorErased(nextSector());
+    mounted = true;
+    return true;
+  }
+
+  // Producer side: O(1), no flash access. Returns false (and counts the
+  // record as dropped) when the queue is full or the journal is not mounted.
+  bool append(uint8_t type, uint8_t a, uint16_t b, uint16_t c, uint64_t uptimeMs) {
+    uint32_t h = head.load(std::memory_order_relaxed);
+    if (!mounted || h - tail.load(std::memory_order_acquire) >= QueueCapacity) {
+      droppedCount.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    uint64_t t = (uint64_t)(clockOffsetMs + (int64_t)uptimeMs);
+    JournalRecord& r = queue[h & (QueueCapacity - 1)];
+    r.type = type;
+    r.a = a;
+    r.b = b;
+    r.timeS = (uint32_t)(t / 1000);
+    r.timeMs = (uint16_t)(t % 1000);
+    r.boot = bootNumber;
+    r.c = c;
+    sealJournalRecord(r);
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side: writes what append() queued, then makes sure the sector
+  // after the head is erased (at most one erase per call). Returns the
+  // records written.
+  size_t flush() {
+    if (!mounted) return 0;
+    size_t n = 0;
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    uint32_t h = head.load(std::memory_order_acquire);
+    for (; t != h; t++) {
+      if (writeRecord(queue[t & (QueueCapacity - 1)])) n++;
+      else counts.writeErrors++;
+      tail.store(t + 1, std::memory_order_release);
+    }
+    counts.written += n;
+    if (!nextErased && eraseSector(nextSector())) nextErased = true;
+    return n;
+  }
+
+  bool pending() const { return head.load(std::memory_order_acquire) != tail.load(std::memory_order_acquire); }
+
+  // First record at or after fromS (journal clock), through the time index.
+  JournalCursor find(uint32_t fromS) {
+    JournalCursor cursor = {0, 1, true};
+    uint16_t order[MaxSectors];
+    uint16_t used = orderedSectors(order);
+    if (!mounted || used == 0) return cursor;
+
+    // Last sector that starts before fromS (the one before may end in the
+    // same second); the oldest if none does
+    uint16_t lo = 0, hi = used;
+    while (hi - lo > 1) {
+      uint16_t mid = (uint16_t)((lo + hi) / 2);
+      if (index[order[mid]].firstS < fromS) lo = mid;
+      else hi = mid;
+    }
+    uint16_t s = order[lo];
+
+    // First record in it at or after fromS (past the end = the next sector's
+    // first). A torn record counts as late, so no record in range is skipped;
+    // the early ones it hides are stepped over after the search.
+    uint16_t first = 1, last = usedSlots(s);
+    while (first <= last) {
+      uint16_t mid = (uint16_t)((first + last) / 2);
+      JournalRecord r;
+      if (!flash.read(slotOffset(s, mid), &r, sizeof(r))) break;
+      if (!journalRecordValid(r) || r.timeS >= fromS) last = (uint16_t)(mid - 1);
+      else first = (uint16_t)(mid + 1);
+    }
+    for (uint16_t end = usedSlots(s); first <= end; first++) {
+      JournalRecord r;
+      if (!flash.read(slotOffset(s, first), &r, sizeof(r))) break;
+      if (journalRecordValid(r) && r.timeS >= fromS) break;
+    }
+    cursor.sequence = index[s].sequence;
+    cursor.slot = first;
+    cursor.done = false;
+    return cursor;
+  }
+
+  // Copies up to max records from the cursor on into out and moves the
+  // cursor past them. Records after toS end the read, as does the end of
+  // the journal (cursor.done). Records that fail their CRC are skipped.
+  size_t read(JournalCursor& cursor, JournalRecord* out, size_t max, uint32_t toS) {
+    size_t n = 0;
+    while (n < max && !cursor.done) {
+      int s = sectorWithSequence(cursor.sequence);
+      if (s < 0) {
+        // Erased since: on with the oldest sector after it
+        s = sectorAfter(cursor.sequence);
+        if (s < 0) {
+          cursor.done = true;
+          break;
+        }
+        cursor.sequence = index[s].sequence;
+        cursor.slot = 1;
+      }
+      uint16_t end = (uint16_t)(usedSlots((uint16_t)s) + 1);
+      if (cursor.slot >= end) {
+        if (s == headSector) break;  // Not done: more may come
+        cursor.sequence++;
+        cursor.slot = 1;
+        continue;
+      }
+
+      size_t want = end - cursor.slot;
+      if (want > max - n) want = max - n;
+      if (!flash.read(slotOffset((uint16_t)s, cursor.slot), &out[n], want * sizeof(JournalRecord))) break;
+      cursor.slot = (uint16_t)(cursor.slot + want);
+      // Keep the good ones, moved down over the skipped ones
+      size_t from = n;
+      for (size_t i = 0; i < want; i++) {
+        JournalRecord r = out[from + i];
+        if (!journalRecordValid(r)) {
+          if (!journalErased(&r, sizeof(r))) counts.badRecords++;
+          continue;
+        }
+        if (r.timeS > toS) {
+          cursor.done = true;
+          break;
+        }
+        out[n++] = r;
+      }
+    }
+    return n;
+  }
+
+  // Journal clock now, for ranges relative to it
+  uint32_t nowS(uint64_t uptimeMs) const { return (uint32_t)((uint64_t)(clockOffsetMs + (int64_t)uptimeMs) / 1000); }
+
+  // Time of the oldest sector's first record (0 when empty)
+  uint32_t oldestS() {
+    uint16_t order[MaxSectors];
+    return orderedSectors(order) > 0 ? index[order[0]].firstS : 0;
+  }
+
+  uint16_t sectorCount() const { return sectors; }
+  uint16_t usedSectors() {
+    uint16_t order[MaxSectors];
+    return orderedSectors(order);
+  }
+  uint16_t boot() const { return bootNumber; }
+  bool ready() const { return mounted; }
+
+  JournalStats stats() const {
+    JournalStats s = counts;
+    s.appended = head.load(std::memory_order_acquire);
+    s.dropped = droppedCount.load(std::memory_order_relaxed);
+    return s;
+  }
+
+private:
+  struct SectorIndex {
+    bool valid;
+    uint32_t sequence;
+    uint32_t firstS;
+  };
+
+  static uint32_t sectorOffset(uint16_t s) { return (uint32_t)s * JOURNAL_SECTOR_BYTES; }
+  static uint32_t slotOffset(uint16_t s, uint16_t slot) {
+    return sectorOffset(s) + (uint32_t)slot * sizeof(JournalRecord);
+  }
+
+  static bool headerValid(const JournalSectorHeader& h) {
+    return h.magic[0] == JOURNAL_MAGIC0 && h.magic[1] == JOURNAL_MAGIC1 && h.version == JOURNAL_VERSION &&
+           telemetryCrc16((const uint8_t*)&h, sizeof(h) - 2) == h.crc;
+  }
+
+  uint16_t nextSector() const { return (uint16_t)((headSector + 1) % sectors); }
+
+  // Slots are written in order, so the used ones come first: binary search
+  // for the first one still erased (JOURNAL_SECTOR_RECORDS + 1 = full).
+  uint16_t firstFreeSlot(uint16_t s) {
+    uint16_t lo = 1, hi = JOURNAL_SECTOR_RECORDS + 1;
+    while (lo < hi) {
+      uint16_t mid = (uint16_t)((lo + hi) / 2);
+      JournalRecord r;
+      if (flash.read(slotOffset(s, mid), &r, sizeof(r)) && journalErased(&r, sizeof(r))) hi = mid;
+      else lo = (uint16_t)(mid + 1);
+    }
+    return lo;
+  }
+
+  // Record slots that may hold data, 1..n
+  uint16_t usedSlots(uint16_t s) const {
+    return (int)s == headSector ? (uint16_t)(nextSlot - 1) : (uint16_t)JOURNAL_SECTOR_RECORDS;
+  }
+
+  bool sectorErased(uint16_t s) {
+    uint8_t chunk[256];
+    for (uint32_t at = 0; at < JOURNAL_SECTOR_BYTES; at += sizeof(chunk)) {
+      if (!flash.read(sectorOffset(s) + at, chunk, sizeof(chunk)) || !journalErased(chunk, sizeof(chunk))) return false;
+    }
+    return true;
+  }
+
+  bool eraseSector(uint16_t s) {
+    index[s].valid = false;
+    counts.erases++;
+    return flash.erase(sectorOffset(s), JOURNAL_SECTOR_BYTES);
+  }
+
+  bool writeRecord(const JournalRecord& r) {
+    if (nextSlot > JOURNAL_SECTOR_RECORDS && !openSector(r)) return false;
+    uint32_t offset = slotOffset((uint16_t)headSector, nextSlot);
+    nextSlot++;  // A failed write uses up its slot too
+    return flash.write(offset, &r, sizeof(r));
+  }
+
+  bool openSector(const JournalRecord& first) {
+    uint16_t s = nextSector();
+    if (!nextErased && !eraseSector(s)) return false;
+    JournalSectorHeader h;
+    h.magic[0] = JOURNAL_MAGIC0;
+    h.magic[1] = JOURNAL_MAGIC1;
+    h.version = JOURNAL_VERSION;
+    h.reserved = 0xFF;
+    h.sequence = nextSequence;
+    h.firstS = first.timeS;
+    h.boot = first.boot;
+    h.crc = telemetryCrc16((const uint8_t*)&h, sizeof(h) - 2);
+    nextErased = false;
+    if (!flash.write(sectorOffset(s), &h, sizeof(h))) return false;
+    index[s].valid = true;
+    index[s].sequence = nextSequence++;
+    index[s].firstS = first.timeS;
+    headSector = s;
+    nextSlot = 1;
+    return true;
+  }
+
+  // Sectors with data, oldest first: they follow the head round the partition
+  uint16_t orderedSectors(uint16_t* order) const {
+    uint16_t used = 0;
+    for (uint16_t i = 1; i <= sectors; i++) {
+      uint16_t s = (uint16_t)((headSector + i) % sectors);
+      if (index[s].valid) order[used++] = s;
+    }
+    return used;
+  }
+
+  int sectorWithSequence(uint32_t sequence) const {
+    for (uint16_t s = 0; s < sectors; s++) {
+      if (index[s].valid && index[s].sequence == sequence) return s;
+    }
+    return -1;
+  }
+
+  int sectorAfter(uint32_t sequence) const {
+    int best = -1;
+    for (uint16_t s = 0; s < sectors; s++) {
+      if (!index[s].valid || (int32_t)(index[s].sequence - sequence) <= 0) continue;
+      if (best < 0 || (int32_t)(index[s].sequence - index[best].sequence) < 0) best = s;
+    }
+    return best;
+  }
+
+  Flash& flash;
+  SectorIndex index[MaxSectors];
+  uint16_t sectors = 0;
+  int headSector = -1;
+  uint16_t nextSlot = JOURNAL_SECTOR_RECORDS + 1;  // In the head sector
+  uint32_t nextSequence = 0;
+  bool nextErased = false;  // The sector after the head is ready to open
+  bool mounted = false;
+  uint16_t bootNumber = 0;
+  int64_t clockOffsetMs = 0;  // Journal clock - uptime
+
+  JournalRecord queue[QueueCapacity];
+  std::atomic<uint32_t> head;  // Written by the producer only
+  std::atomic<uint32_t> tail;  // Written by the consumer only
+  std::atomic<uint32_t> droppedCount;
+  JournalStats counts;         // Consumer side
+};
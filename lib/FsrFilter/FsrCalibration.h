@@ -0,0 +1,18 @@
+#pragma once
+
+// Generated by Host_tools/src/fsr_calibrate.cpp from 3 capture(s), 839 rows:
+//   helmet_data_1.csv
+//   helmet_data_2.csv
+//   helmet_data_3.csv
+// Rerun it (env:calibrate) when captures are added instead of editing this file.
+//
+// A worn helmet may take 1000 ms to be detected before it counts as false rejects;
+// a removed one decided worn is a false accept from its first row (filter delay included).
+// FsrFilter: false accept 2.362 %, false reject 0.000 %, margin 15 counts
+// (best at the 500 ms capture rate with a 1-tap average and 1-sample debounce;
+// the firmware keeps its own window for 2 kHz).
+// analogRead() > FSR_ANALOG_THRESHOLD: false accept 0.000 %, false reject 0.171 %, margin 7 counts
+
+#define FSR_WORN_ON 58
+#define FSR_WORN_OFF 43
+#define FSR_ANALOG_THRESHOLD 50
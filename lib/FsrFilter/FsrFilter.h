@@ -0,0 +1,145 @@
+#pragma once
+
+// FSR conditioning for the helmet "worn" decision.
+//
+// The raw ADC stream (several kHz from the continuous ADC) goes through
+//   1. a 5-tap median, which removes single- and double-sample dropouts such
+//      as the fsrValue 0 in the middle of a worn capture (helmet_data_2),
+//   2. a 2^AverageShift-tap moving average kept as a running sum (16 taps,
+//      Q4 fixed point in the firmware's FsrFilter),
+//   3. a hysteresis detector (on above FSR_WORN_ON, off below FSR_WORN_OFF)
+//      that only changes state after FSR_DEBOUNCE_SAMPLES consecutive samples
+//      on the other side of the threshold.
+// update() is integer-only and O(1) apart from sorting five values.
+//
+// Thresholds are in raw 12-bit ADC counts and come from FsrCalibration.h,
+// which Host_tools/src/fsr_calibrate.cpp generates from the labeled captures.
+
+#include <stdint.h>
+
+#include "FsrCalibration.h"
+
+#define FSR_MEDIAN_TAPS 5
+#define FSR_AVERAGE_SHIFT 4         // 16-tap average
+#define FSR_DEBOUNCE_SAMPLES 20     // 10 ms at 2 kHz
+
+struct FsrStats {
+  uint32_t samples;
+  uint16_t minRaw;
+  uint16_t maxRaw;
+  uint64_t sumRaw;
+  uint64_t sumDeviation;  // |raw - filtered|, for the noise figure
+  uint32_t glitches;      // Raw samples on the wrong side of the thresholds, absorbed by the filter
+  uint32_t transitions;   // Debounced worn changes
+
+  uint16_t meanRaw() const { return samples ? (uint16_t)(sumRaw / samples) : 0; }
+  uint16_t noise() const { return samples ? (uint16_t)(sumDeviation / samples) : 0; }
+};
+
+template <uint8_t AverageShift>
+class BasicFsrFilter {
+public:
+  explicit BasicFsrFilter(uint16_t onThreshold = FSR_WORN_ON, uint16_t offThreshold = FSR_WORN_OFF,
+                     uint16_t debounceSamples = FSR_DEBOUNCE_SAMPLES)
+      : onThreshold(onThreshold), offThreshold(offThreshold), debounceSamples(debounceSamples) {
+    reset();
+  }
+
+  void reset() {
+    primed = false;
+    isWorn = false;
+    pendingCount = 0;
+    resetStats();
+  }
+
+  void resetStats() {
+    stats_.samples = 0;
+    stats_.minRaw = 0xFFFF;
+    stats_.maxRaw = 0;
+    stats_.sumRaw = 0;
+    stats_.sumDeviation = 0;
+    stats_.glitches = 0;
+    stats_.transitions = 0;
+  }
+
+  // Feed one raw sample. Returns true when worn() changed.
+  bool update(uint16_t raw) {
+    if (!primed) prime(raw);
+
+    medianRing[medianIndex] = raw;
+    medianIndex = (medianIndex + 1) % FSR_MEDIAN_TAPS;
+    uint16_t median = medianOf(medianRing);
+
+    averageSum += median - averageRing[averageIndex];
+    averageRing[averageIndex] = median;
+    averageIndex = (averageIndex + 1) & (AVERAGE_TAPS - 1);
+    uint16_t filtered = value();
+
+    stats_.samples++;
+    stats_.sumRaw += raw;
+    if (raw < stats_.minRaw) stats_.minRaw = raw;
+    if (raw > stats_.maxRaw) stats_.maxRaw = raw;
+    stats_.sumDeviation += raw > filtered ? raw - filtered : filtered - raw;
+    if (isWorn ? raw < offThreshold : raw >= onThreshold) stats_.glitches++;
+
+    bool crossed = isWorn ? filtered < offThreshold : filtered >= onThreshold;
+    if (!crossed) {
+      pendingCount = 0;
+      return false;
+    }
+    if (++pendingCount < debounceSamples) return false;
+
+    // A real change: the samples counted as glitches on the way were not
+    if (stats_.glitches >= pendingCount) stats_.glitches -= pendingCount;
+    pendingCount = 0;
+    isWorn = !isWorn;
+    stats_.transitions++;
+    return true;
+  }
+
+  bool worn() const { return isWorn; }
+  uint16_t value() const { return (uint16_t)(averageSum >> AverageShift); }
+  // value() with 4 fractional bits
+  uint32_t valueQ4() const { return AverageShift >= 4 ? averageSum >> (AverageShift - 4) : averageSum << (4 - AverageShift); }
+  const FsrStats& stats() const { return stats_; }
+
+private:
+  static const uint8_t AVERAGE_TAPS = 1 << AverageShift;
+
+  void prime(uint16_t raw) {
+    for (uint8_t i = 0; i < FSR_MEDIAN_TAPS; i++) medianRing[i] = raw;
+    for (uint8_t i = 0; i < AVERAGE_TAPS; i++) averageRing[i] = raw;
+    averageSum = (uint32_t)raw << AverageShift;
+    medianIndex = 0;
+    averageIndex = 0;
+    isWorn = raw >= onThreshold;
+    primed = true;
+  }
+
+  static uint16_t medianOf(const uint16_t* ring) {
+    uint16_t v[FSR_MEDIAN_TAPS];
+    for (uint8_t i = 0; i < FSR_MEDIAN_TAPS; i++) {
+      uint16_t x = ring[i];
+      uint8_t j = i;
+      for (; j > 0 && v[j - 1] > x; j--) v[j] = v[j - 1];
+      v[j] = x;
+    }
+    return v[FSR_MEDIAN_TAPS / 2];
+  }
+
+  uint16_t onThreshold;
+  uint16_t offThreshold;
+  uint16_t debounceSamples;
+
+  uint16_t medianRing[FSR_MEDIAN_TAPS];
+  uint16_t averageRing[AVERAGE_TAPS];
+  uint32_t averageSum;
+  uint8_t medianIndex;
+  uint8_t averageIndex;
+  uint16_t pendingCount;
+  bool isWorn;
+  bool primed;
+  FsrStats stats_;
+};
+
+typedef BasicFsrFilter<FSR_AVERAGE_SHIFT> FsrFilter;
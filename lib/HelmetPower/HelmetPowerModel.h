@@ -0,0 +1,136 @@
+#pragma once
+
+// Energy model for the helmet unit.
+//
+// The firmware tells the model which power state it is in and what that
+// state draws (helmetCurrentMa() from the CPU clock, the radio event rate
+// and whether the FSR is powered); the model charges the time in each state
+// at that current and reports the average and the runtime it gives on a
+// battery. Nothing is measured on the board: the result is only as good as
+// the figures below.
+//
+// No Arduino includes: sim_main.cpp reads the helmet firmware's model for
+// its power report.
+
+#include <stdint.h>
+
+// ---------------- Currents ----------------
+// ESP32-C3 typical figures at 3.3 V from the datasheet ("Current
+// Consumption Characteristics"), plus rough charges per radio event.
+// Replace them with figures measured on the helmet board when there are some.
+#define POWER_MA_LIGHT_SLEEP 0.13f   // Light sleep, RTC timer and GPIO wakeup armed
+#define POWER_MA_CPU_80MHZ 12.0f     // Awake (modem sleep), CPU idle at 80 MHz
+#define POWER_MA_CPU_160MHZ 16.0f    // Same at 160 MHz, the Arduino default
+#define POWER_UC_CONN_EVENT 40.0f    // One connection event, empty packet each way (uC = mA x ms)
+#define POWER_UC_ADV_EVENT 120.0f    // One connectable advertising event on the three channels
+#define POWER_MA_FSR 0.8f            // FSR divider plus the SAR ADC converting continuously
+#define POWER_UC_TX_BYTE 0.8f        // One payload byte on air: 8 us at 1 Mbit/s, ~100 mA transmitting
+
+enum HelmetPowerState : uint8_t {
+  POWER_LINKED,       // Connected to the bike
+  POWER_ADVERTISING,  // Waiting for the bike
+  POWER_AWAKE,        // No radio, CPU running (input handling, LOW_POWER off)
+  POWER_LIGHT_SLEEP,
+  NUM_POWER_STATES
+};
+
+inline const char* powerStateName(HelmetPowerState state) {
+  switch (state) {
+    case POWER_LINKED: return "linked";
+    case POWER_ADVERTISING: return "advertising";
+    case POWER_AWAKE: return "awake";
+    case POWER_LIGHT_SLEEP: return "light sleep";
+    default: return "?";
+  }
+}
+
+// Average current of a state. radioEventMs is the time between radio events
+// (connection interval x (1 + peripheral latency), or the advertising
+// interval), 0 for no radio.
+inline float helmetCurrentMa(HelmetPowerState state, uint16_t cpuMhz, float radioEventMs, bool fsrPowered) {
+  if (state == POWER_LIGHT_SLEEP) return POWER_MA_LIGHT_SLEEP;
+  float mA = cpuMhz > 80 ? POWER_MA_CPU_160MHZ : POWER_MA_CPU_80MHZ;
+  if (radioEventMs > 0) {
+    mA += (state == POWER_ADVERTISING ? POWER_UC_ADV_EVENT : POWER_UC_CONN_EVENT) / radioEventMs;
+  }
+  if (fsrPowered) mA += POWER_MA_FSR;
+  return mA;
+}
+
+// Charge of notifications beyond the linked state's current: each takes a
+// connection event peripheral latency would have skipped, plus its bytes on
+// air. Status frames ride in the events already counted; the FSR stream's
+// batches do not.
+inline float notifyChargeUc(uint32_t notifies, uint32_t bytes) {
+  return notifies * POWER_UC_CONN_EVENT + bytes * POWER_UC_TX_BYTE;
+}
+
+// ---------------- Model ----------------
+class HelmetPowerModel {
+public:
+  HelmetPowerModel() : state(POWER_AWAKE), currentMa(0), sinceUs(0), startUs(0), started(false) {
+    for (uint8_t i = 0; i < NUM_POWER_STATES; i++) {
+      stateUs[i] = 0;
+      stateUc[i] = 0;
+    }
+  }
+
+  // From now on the device is in `s` drawing `mA`; the time since the last
+  // call is charged to the previous state. Cheap enough to call every pass.
+  void enter(HelmetPowerState s, float mA, uint64_t nowUs) {
+    if (!started) {
+      started = true;
+      startUs = nowUs;
+    } else {
+      charge(nowUs);
+    }
+    state = s;
+    currentMa = mA;
+    sinceUs = nowUs;
+  }
+
+  HelmetPowerState current() const { return state; }
+
+  // A one-off charge on top of the running state's current (see notifyChargeUc())
+  void addCharge(float uC) {
+    if (started) stateUc[state] += uC;
+  }
+
+  // Totals up to nowUs, the running state included
+  uint64_t timeUs(HelmetPowerState s, uint64_t nowUs) const {
+    return stateUs[s] + (started && s == state ? nowUs - sinceUs : 0);
+  }
+
+  float chargeMah(HelmetPowerState s, uint64_t nowUs) const {
+    double uC = stateUc[s] + (started && s == state ? currentMa * (double)(nowUs - sinceUs) / 1000.0 : 0);
+    return (float)(uC / 3600000.0);
+  }
+
+  float averageMa(uint64_t nowUs) const {
+    if (!started || nowUs <= startUs) return currentMa;
+    double mAh = 0;
+    for (uint8_t i = 0; i < NUM_POWER_STATES; i++) mAh += chargeMah((HelmetPowerState)i, nowUs);
+    return (float)(mAh * 3600.0e6 / (double)(nowUs - startUs));
+  }
+
+  // Runtime on a full battery at the average so far
+  float batteryHours(float capacityMah, uint64_t nowUs) const {
+    float mA = averageMa(nowUs);
+    return mA > 0 ? capacityMah / mA : 0;
+  }
+
+private:
+  void charge(uint64_t nowUs) {
+    uint64_t elapsed = nowUs - sinceUs;
+    stateUs[state] += elapsed;
+    stateUc[state] += currentMa * (double)elapsed / 1000.0;
+  }
+
+  HelmetPowerState state;
+  float currentMa;
+  uint64_t sinceUs;
+  uint64_t startUs;
+  bool started;
+  uint64_t stateUs[NUM_POWER_STATES];
+  double stateUc[NUM_POWER_STATES];  // Charge in uC (mA x ms)
+};
@@ -0,0 +1,257 @@
+#pragma once
+
+// Raw FSR waveform stream, Helmet -> Bike, on its own characteristic.
+//
+// The status frames on CHAR_UUID_TX carry the helmet's verdict; this stream
+// carries the samples behind it: the FSR reading with the touch and buckle
+// flags, at a fixed rate, many samples per notification. Each notification is
+// one batch:
+//
+//   FsrStreamHeader   version count sequence firstUs periodUs (10 bytes)
+//   samples           count x 1 or 2 bytes
+//
+// A sample is either a delta or an absolute value:
+//   0ddddddd                    FSR - previous FSR, zigzag coded (-64..63), flags unchanged
+//   10ffvvvv vvvvvvvv           absolute: flags (HELMET_FLAG_*) and the 12-bit FSR reading
+// The first sample of a batch is always absolute, so a lost batch costs only
+// its own samples. Sample i was taken at firstUs + i * periodUs (helmet
+// micros()); the encoder starts a new batch when a sample does not follow on
+// in time, so the timestamps stay exact across ADC overruns.
+//
+// The encoder fills a batch up to the payload a notification can carry
+// (negotiated MTU - 3), so a larger MTU means fewer, longer notifications:
+// less header and radio overhead per sample. With the default 23-byte MTU it
+// still works, up to 9 samples at a time.
+//
+// FsrStreamReceiver decodes batches into a ring that the bike drains from
+// another task: one producer (the BLE stack's notify callback), one consumer.
+
+#include <atomic>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "HelmetProtocol.h"
+
+#define CHAR_UUID_FSR_STREAM "6e400003-b5a3-f393-e0a9-e50e24dcca9e" // Helmet -> Bike raw FSR samples (optional)
+
+#define FSR_STREAM_VERSION 1
+#define FSR_STREAM_MTU 247           // Asked for by both ends; the link uses the smaller of the two
+#define FSR_STREAM_MAX_BYTES (FSR_STREAM_MTU - 3)
+#define FSR_STREAM_MAX_COUNT 255
+
+#define FSR_SAMPLE_ABSOLUTE 0x80     // First byte of a 2-byte absolute sample
+#define FSR_SAMPLE_VALUE_MAX 4095
+
+struct __attribute__((packed)) FsrStreamHeader {
+  uint8_t version;    // FSR_STREAM_VERSION
+  uint8_t count;      // Samples in this batch
+  uint16_t sequence;  // Batch number; a gap means batches were lost
+  uint32_t firstUs;   // Helmet micros() of the first sample
+  uint16_t periodUs;  // Between two samples
+};
+
+static_assert(sizeof(FsrStreamHeader) == 10, "FsrStreamHeader must stay 10 bytes");
+
+struct FsrStreamSample {
+  uint32_t timeUs;    // Clock of the sender
+  uint16_t fsr;
+  uint8_t flags;      // HELMET_FLAG_*
+};
+
+// ---------------- Helmet side ----------------
+
+class FsrStreamEncoder {
+public:
+  explicit FsrStreamEncoder(uint16_t periodUs) : periodUs(periodUs) { reset(); }
+
+  // Drop the batch in progress, e.g. when the bike disconnects
+  void reset() {
+    count = 0;
+    length = sizeof(FsrStreamHeader);
+  }
+
+  // Payload one notification can carry: negotiated MTU - 3
+  void setMaxBytes(size_t bytes) {
+    if (bytes > sizeof(buffer)) bytes = sizeof(buffer);
+    if (bytes < sizeof(FsrStreamHeader) + 2) bytes = sizeof(FsrStreamHeader) + 2;
+    maxBytes = bytes;
+  }
+
+  // Adds one sample. When it does not fit into the batch in progress, or
+  // does not follow on in time, that batch is finished first: it is written
+  // to `out` (FSR_STREAM_MAX_BYTES) and its length returned. 0 = nothing to send yet.
+  size_t add(uint16_t fsr, uint8_t flags, uint32_t timeUs, uint8_t* out) {
+    if (fsr > FSR_SAMPLE_VALUE_MAX) fsr = FSR_SAMPLE_VALUE_MAX;
+    flags &= HELMET_FLAG_TOUCHED | HELMET_FLAG_BUCKLED;
+    size_t sent = 0;
+    if (count > 0) {
+      int32_t late = (int32_t)(timeUs - (firstUs + (uint32_t)count * periodUs));
+      bool inTime = late >= -(int32_t)(periodUs / 2) && late <= (int32_t)(periodUs / 2);
+      if (!inTime || length + 2 > maxBytes || count == FSR_STREAM_MAX_COUNT) sent = flush(out);
+    }
+
+    if (count == 0) {
+      firstUs = timeUs;
+      putAbsolute(fsr, flags);
+    } else {
+      int32_t delta = (int32_t)fsr - lastFsr;
+      if (flags == lastFlags && delta >= -64 && delta <= 63) {
+        buffer[length++] = (uint8_t)(((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31));  // Zigzag
+      } else {
+        putAbsolute(fsr, flags);
+      }
+    }
+    count++;
+    lastFsr = fsr;
+    lastFlags = flags;
+    return sent;
+  }
+
+  // Finish the batch in progress, so a batch that fills slowly still reaches
+  // the bike in time (see firstSampleUs()). 0 = empty.
+  size_t flush(uint8_t* out) {
+    if (count == 0) return 0;
+    FsrStreamHeader header;
+    header.version = FSR_STREAM_VERSION;
+    header.count = (uint8_t)count;
+    header.sequence = sequence++;
+    header.firstUs = firstUs;
+    header.periodUs = periodUs;
+    memcpy(buffer, &header, sizeof(header));
+    size_t n = length;
+    memcpy(out, buffer, n);
+    reset();
+    return n;
+  }
+
+  bool empty() const { return count == 0; }
+  uint32_t firstSampleUs() const { return firstUs; }
+  uint16_t batches() const { return sequence; }
+
+private:
+  void putAbsolute(uint16_t fsr, uint8_t flags) {
+    buffer[length++] = (uint8_t)(FSR_SAMPLE_ABSOLUTE | (flags << 4) | (fsr >> 8));
+    buffer[length++] = (uint8_t)fsr;
+  }
+
+  uint8_t buffer[FSR_STREAM_MAX_BYTES];
+  size_t maxBytes = 20;  // Default MTU until setMaxBytes()
+  size_t length;
+  uint32_t count;
+  uint32_t firstUs = 0;
+  uint16_t periodUs;
+  uint16_t sequence = 0;
+  uint16_t lastFsr = 0;
+  uint8_t lastFlags = 0;
+};
+
+// ---------------- Bike side ----------------
+
+// Calls sink(const FsrStreamSample&) for every sample of one notification.
+// Returns false, before calling sink at all, when the batch is malformed.
+template <class Sink>
+bool decodeFsrStream(const uint8_t* data, size_t length, FsrStreamHeader& header, Sink sink) {
+  if (length < sizeof(header) + 2 || data[0] != FSR_STREAM_VERSION) return false;
+  memcpy(&header, data, sizeof(header));
+  if (header.count == 0) return false;
+
+  // Check the sample count against the length before handing anything out
+  size_t at = sizeof(header);
+  for (uint8_t i = 0; i < header.count; i++) {
+    if (at >= length) return false;
+    if (data[at] & FSR_SAMPLE_ABSOLUTE) {
+      if (at + 2 > length || (data[at] & 0x40)) return false;
+      at += 2;
+    } else {
+      if (i == 0) return false;
+      at++;
+    }
+  }
+  if (at != length) return false;
+
+  FsrStreamSample s = {header.firstUs, 0, 0};
+  at = sizeof(header);
+  for (uint8_t i = 0; i < header.count; i++) {
+    uint8_t b = data[at++];
+    if (b & FSR_SAMPLE_ABSOLUTE) {
+      s.flags = (b >> 4) & 0x03;
+      s.fsr = (uint16_t)(((b & 0x0F) << 8) | data[at++]);
+    } else {
+      int32_t delta = (int32_t)(b >> 1) ^ -(int32_t)(b & 1);  // Zigzag
+      s.fsr = (uint16_t)(s.fsr + delta);
+    }
+    s.timeUs = header.firstUs + (uint32_t)i * header.periodUs;
+    sink(s);
+  }
+  return true;
+}
+
+struct FsrStreamStats {
+  uint32_t batches;   // Decoded
+  uint32_t samples;   // Put into the ring
+  uint32_t lost;      // Batches missing from the sequence
+  uint32_t bad;       // Malformed notifications
+  uint32_t overflows; // Samples dropped because the ring was full
+};
+
+// Batches in, samples out. receive() runs in the BLE stack's notify callback
+// (producer), pop() in the task that uses the samples (consumer). stats()
+// is written by the producer only; a reader on another core may see it one
+// batch behind.
+template <size_t Capacity>
+class FsrStreamReceiver {
+  static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+  FsrStreamReceiver() : head(0), tail(0) {
+    memset(&counts, 0, sizeof(counts));
+  }
+
+  // A new connection: the helmet's batch sequence starts over. Producer side,
+  // before notifications are registered again.
+  void restart() { haveSequence = false; }
+
+  bool receive(const uint8_t* data, size_t length) {
+    FsrStreamHeader header;
+    bool ok = decodeFsrStream(data, length, header, [this](const FsrStreamSample& s) { push(s); });
+    if (!ok) {
+      counts.bad++;
+      return false;
+    }
+    if (haveSequence) counts.lost += (uint16_t)(header.sequence - nextSequence);
+    nextSequence = header.sequence + 1;
+    haveSequence = true;
+    counts.batches++;
+    return true;
+  }
+
+  bool pop(FsrStreamSample& out) {
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire)) return false;
+    out = ring[t & (Capacity - 1)];
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  const FsrStreamStats& stats() const { return counts; }
+
+private:
+  void push(const FsrStreamSample& s) {
+    uint32_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) >= Capacity) {
+      counts.overflows++;
+      return;
+    }
+    ring[h & (Capacity - 1)] = s;
+    head.store(h + 1, std::memory_order_release);
+    counts.samples++;
+  }
+
+  FsrStreamSample ring[Capacity];
+  std::atomic<uint32_t> head;
+  std::atomic<uint32_t> tail;
+  FsrStreamStats counts;
+  bool haveSequence = false;
+  uint16_t nextSequence = 0;
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+// Decides when the helmet should notify the bike.
+//
+// In change-detection mode a notification goes out as soon as the sampled
+// state differs from the last one sent, and otherwise only once per
+// heartbeat period so the bike still sees a live link. With change
+// detection off it reproduces the old behaviour: one notification per
+// period regardless of state.
+
+#include <stdint.h>
+
+#define HELMET_SAMPLE_INTERVAL_MS 5       // Sensor sampling period in change-detection mode
+#define HELMET_HEARTBEAT_INTERVAL_MS 2000 // Max silence between notifications when nothing changes
+#define HELMET_LEGACY_NOTIFY_MS 500       // Fixed notify period of the original firmware
+
+enum HelmetNotifyReason : uint8_t {
+  NOTIFY_NONE = 0,
+  NOTIFY_CHANGE,     // State differs from the last one sent
+  NOTIFY_HEARTBEAT,  // Periodic keep-alive
+  NOTIFY_FIRST       // First frame after (re)connection
+};
+
+class HelmetNotifyPolicy {
+public:
+  HelmetNotifyPolicy(bool onChange, uint32_t heartbeatMs)
+    : changeDetection(onChange), periodMs(heartbeatMs) {}
+
+  // Force the next update() to send, e.g. when a new bike connects.
+  void reset() { hasSent = false; }
+
+  // Feed the latest sampled state; returns why a notification is due (if at all).
+  // The caller is expected to send when the result is not NOTIFY_NONE.
+  HelmetNotifyReason update(uint8_t state, uint32_t nowMs) {
+    HelmetNotifyReason reason = NOTIFY_NONE;
+    if (!hasSent) {
+      reason = NOTIFY_FIRST;
+    } else if (changeDetection && state != lastState) {
+      reason = NOTIFY_CHANGE;
+    } else if (nowMs - lastSentMs >= periodMs) {
+      reason = NOTIFY_HEARTBEAT;
+    }
+
+    if (reason != NOTIFY_NONE) {
+      hasSent = true;
+      lastState = state;
+      lastSentMs = nowMs;
+      sentCount++;
+    }
+    return reason;
+  }
+
+  // Time left until update() sends a heartbeat (0 when one is due or nothing was sent yet),
+  // so an event-driven caller knows how long it may sleep
+  uint32_t msUntilHeartbeat(uint32_t nowMs) const {
+    if (!hasSent) return 0;
+    uint32_t elapsed = nowMs - lastSentMs;
+    return elapsed >= periodMs ? 0 : periodMs - elapsed;
+  }
+
+  uint32_t framesSent() const { return sentCount; }
+
+private:
+  bool changeDetection;
+  uint32_t periodMs;
+  bool hasSent = false;
+  uint8_t lastState = 0;
+  uint32_t lastSentMs = 0;
+  uint32_t sentCount = 0;
+};
@@ -0,0 +1,123 @@
+#pragma once
+
+// Shared Helmet <-> Bike BLE protocol.
+//
+// Both units compile against this header (see `lib_extra_dirs = ../lib` in
+// each platformio.ini), so the UUIDs and the status frame layout can never
+// drift apart between the helmet and the bike firmware.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// --- BLE SERVICE DEFINITIONS ---
+#define SERVICE_UUID "4fafc201-1fb5-459e-8fcc-c5c9c331914b"
+#define CHAR_UUID_TX "beb5483e-36e1-4688-b7f5-ea07361b26a8" // Helmet -> Bike notifications (Helmet Status)
+#define CHAR_UUID_RX "6e400002-b5a3-f393-e0a9-e50e24dcca9e" // Bike -> Helmet writes
+
+#define HELMET_FRAME_VERSION 1
+
+// Helmet state as decided by the helmet unit.
+enum HelmetState : uint8_t {
+  HELMET_REMOVED = 0,           // Not worn (legacy "warn")
+  HELMET_WORN_NOT_BUCKLED = 1,  // Worn but buckle open (legacy "warn_notbuckeld")
+  HELMET_SECURE = 2,            // Worn & buckled (legacy "true")
+  HELMET_UNKNOWN = 0xFF         // Undecodable payload
+};
+
+// Bits of HelmetStatusFrame::flags
+#define HELMET_FLAG_TOUCHED 0x01
+#define HELMET_FLAG_BUCKLED 0x02
+
+// Fixed-size binary status frame sent on CHAR_UUID_TX (12 bytes, little endian).
+struct __attribute__((packed)) HelmetStatusFrame {
+  uint8_t  version;      // HELMET_FRAME_VERSION
+  uint8_t  state;        // HelmetState
+  uint8_t  flags;        // HELMET_FLAG_*
+  uint8_t  reserved;     // Always 0 for version 1
+  uint16_t fsrValue;     // Raw FSR ADC reading
+  uint16_t sequence;     // Incremented on every frame sent by the helmet
+  uint32_t timestampUs;  // Helmet micros() when the sensors were sampled
+};
+
+static_assert(sizeof(HelmetStatusFrame) == 12, "HelmetStatusFrame must stay 12 bytes");
+
+// Decoded view of a notification, whatever format it arrived in.
+struct HelmetStatus {
+  HelmetState state;
+  bool touched;
+  bool buckled;
+  uint16_t fsrValue;
+  uint16_t sequence;
+  uint32_t timestampUs;
+  bool legacy;           // true when decoded from an ASCII "true"/"warn" payload
+};
+
+// Decide the helmet state from the raw sensor readings.
+inline HelmetState helmetStateFromSensors(bool touched, bool fsrPressed, bool buckled) {
+  if (touched && fsrPressed) {
+    return buckled ? HELMET_SECURE : HELMET_WORN_NOT_BUCKLED;
+  }
+  return HELMET_REMOVED;
+}
+
+inline void encodeHelmetStatus(HelmetStatusFrame& frame, HelmetState state,
+                               bool touched, bool buckled, uint16_t fsrValue,
+                               uint16_t sequence, uint32_t timestampUs) {
+  frame.version = HELMET_FRAME_VERSION;
+  frame.state = state;
+  frame.flags = (touched ? HELMET_FLAG_TOUCHED : 0) | (buckled ? HELMET_FLAG_BUCKLED : 0);
+  frame.reserved = 0;
+  frame.fsrValue = fsrValue;
+  frame.sequence = sequence;
+  frame.timestampUs = timestampUs;
+}
+
+// Legacy ASCII payloads sent by helmets running the old string firmware.
+inline bool decodeLegacyHelmetStatus(const uint8_t* data, size_t length, HelmetStatus& out) {
+  HelmetState state;
+  if (length == 4 && memcmp(data, "true", 4) == 0) {
+    state = HELMET_SECURE;
+  } else if (length == 4 && memcmp(data, "warn", 4) == 0) {
+    state = HELMET_REMOVED;
+  } else if (length == 15 && memcmp(data, "warn_notbuckeld", 15) == 0) {
+    state = HELMET_WORN_NOT_BUCKLED;
+  } else {
+    return false;
+  }
+
+  out.state = state;
+  out.touched = (state != HELMET_REMOVED);
+  out.buckled = (state == HELMET_SECURE);
+  out.fsrValue = 0;
+  out.sequence = 0;
+  out.timestampUs = 0;
+  out.legacy = true;
+  return true;
+}
+
+// Decode a CHAR_UUID_TX notification. Binary frames are a single fixed-size
+// copy; anything else falls back to the legacy string decoder. Returns false
+// (with out.state = HELMET_UNKNOWN) when the payload is not recognised.
+inline bool decodeHelmetStatus(const uint8_t* data, size_t length, HelmetStatus& out) {
+  if (length == sizeof(HelmetStatusFrame) && data[0] == HELMET_FRAME_VERSION) {
+    HelmetStatusFrame frame;
+    memcpy(&frame, data, sizeof(frame));
+    if (frame.state <= HELMET_SECURE) {
+      out.state = (HelmetState)frame.state;
+      out.touched = (frame.flags & HELMET_FLAG_TOUCHED) != 0;
+      out.buckled = (frame.flags & HELMET_FLAG_BUCKLED) != 0;
+      out.fsrValue = frame.fsrValue;
+      out.sequence = frame.sequence;
+      out.timestampUs = frame.timestampUs;
+      out.legacy = false;
+      return true;
+    }
+  }
+
+  if (decodeLegacyHelmetStatus(data, length, out)) return true;
+
+  out.state = HELMET_UNKNOWN;
+  out.legacy = false;
+  return false;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+// Connection event plan for a central holding several helmet links.
+//
+// The radio serves one connection event at a time. Links that share one
+// interval get their events placed back to back by the controller and never
+// meet; links whose intervals differ drift through each other, and whenever
+// two events land on the same moment one of them is skipped, which delays
+// that helmet's frame by a whole interval. A running scan takes the radio
+// the same way for its window. So every helmet link gets the same interval,
+// the preferred one unless the links' events do not fit in it, and a second
+// helmet costs the first one nothing. A scan for another helmet gets windows
+// that fit in the gap the events leave, repeating at a multiple of the
+// connection interval so they stay in that gap.
+
+#include <stdint.h>
+
+#define CONN_EVENT_US 1250       // One connection event with a frame each way, guard time included
+#define CONN_INTERVAL_UNIT_US 1250
+
+// Shortest interval (1.25 ms units) at or above `preferred` that holds one
+// event of each of `links` links
+inline uint16_t plannedConnInterval(uint8_t links, uint16_t preferred) {
+  uint32_t needUs = (uint32_t)links * CONN_EVENT_US;
+  uint16_t units = (uint16_t)((needUs + CONN_INTERVAL_UNIT_US - 1) / CONN_INTERVAL_UNIT_US);
+  return units > preferred ? units : preferred;
+}
+
+// Longest scan window (ms) next to the events of `links` links at `interval`
+inline uint16_t plannedScanWindowMs(uint8_t links, uint16_t interval) {
+  uint32_t intervalUs = (uint32_t)interval * CONN_INTERVAL_UNIT_US;
+  uint32_t eventsUs = (uint32_t)links * CONN_EVENT_US;
+  return intervalUs > eventsUs ? (uint16_t)((intervalUs - eventsUs) / 1000) : 0;
+}
+
+// Scan interval (ms) of about `every` connection intervals. Rounded up to a
+// multiple of 4 intervals, the first one that is a whole number of ms.
+inline uint16_t plannedScanIntervalMs(uint16_t interval, uint8_t every) {
+  uint32_t intervals = ((uint32_t)every + 3) / 4 * 4;
+  return (uint16_t)(intervals * interval * CONN_INTERVAL_UNIT_US / 1000);
+}
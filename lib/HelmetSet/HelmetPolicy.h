@@ -0,0 +1,66 @@
+#pragma once
+
+// Which helmets the bike's ignition depends on, when it links to several
+// (rider and pillion).
+//
+// Slot 0 is the rider's helmet and always counts. Any other helmet counts
+// from the moment it is linked and worn, so a pillion can put a helmet on
+// at any time, and keeps counting until it is released: its link is lost
+// or it is taken off while the bike is parked (stand down, not moving; the
+// ignition is off then anyway). A pillion helmet lying in the top box never
+// counts, and one lost on the way is treated like the rider's.
+//
+// The verdict feeds SafetyStateMachine as if it were one helmet: connected
+// when every counted helmet is linked, secure / worn when every counted
+// helmet is.
+
+#include <stdint.h>
+#include <HelmetProtocol.h>
+
+#define RIDER_SLOT 0
+
+struct HelmetSlotState {
+  bool linked;
+  HelmetState state;  // HELMET_UNKNOWN until the first frame of this link
+};
+
+struct HelmetVerdict {
+  bool connected;  // Every counted helmet is linked
+  bool secure;     // ... and worn & buckled
+  bool worn;       // ... and worn
+  uint8_t counted;
+};
+
+template <uint8_t N>
+class HelmetPolicy {
+public:
+  HelmetPolicy() { reset(); }
+
+  void reset() {
+    for (uint8_t i = 0; i < N; i++) enlisted[i] = i == RIDER_SLOT;
+  }
+
+  HelmetVerdict evaluate(const HelmetSlotState* slots, bool parked) {
+    HelmetVerdict v = {true, true, true, 0};
+    for (uint8_t i = 0; i < N; i++) {
+      const HelmetSlotState& s = slots[i];
+      bool worn = s.linked && (s.state == HELMET_SECURE || s.state == HELMET_WORN_NOT_BUCKLED);
+      if (i != RIDER_SLOT) {
+        if (worn) enlisted[i] = true;
+        else if (parked && (!s.linked || s.state == HELMET_REMOVED)) enlisted[i] = false;
+      }
+      if (!enlisted[i]) continue;
+
+      v.counted++;
+      v.connected = v.connected && s.linked;
+      v.secure = v.secure && s.linked && s.state == HELMET_SECURE;
+      v.worn = v.worn && worn;
+    }
+    return v;
+  }
+
+  bool counts(uint8_t slot) const { return slot < N && enlisted[slot]; }
+
+private:
+  bool enlisted[N];
+};
@@ -0,0 +1,146 @@
+#pragma once
+
+// Latency measurement helpers shared by the helmet and bike units.
+//
+// LatencyHistogram keeps log-linear buckets (8 per power of two, so any
+// percentile is within 12.5% of the true value) over the full 32-bit
+// microsecond range in under 1 KB, with O(1) record().
+//
+// ClockAligner maps helmet micros() stamps (HelmetStatusFrame.timestampUs)
+// onto the bike's clock. The offset is the minimum of (bike rx time - helmet
+// stamp) over recent frames, i.e. the frame that crossed the link fastest, so
+// aligned delays are measured from that fastest delivery: the true one-way
+// delay is the aligned value plus that frame's own (unknown, ~one BLE radio
+// event) delay. The minimum is taken over two alternating windows so crystal
+// drift between the boards (tens of ppm, tens of ms per hour) is followed.
+//
+// printLatency() writes to any object with a printf(); the bike passes its
+// ConsoleBuffer, which the display task sends on.
+
+#include <stdint.h>
+#include <stddef.h>
+
+class LatencyHistogram {
+public:
+  static const uint8_t SUB_BITS = 3;
+  static const uint8_t SUB_BUCKETS = 1 << SUB_BITS;
+  static const uint16_t BUCKETS = (32 - SUB_BITS + 1) * SUB_BUCKETS;
+
+  LatencyHistogram() { reset(); }
+
+  void reset() {
+    for (uint16_t i = 0; i < BUCKETS; i++) buckets[i] = 0;
+    samples = 0;
+    maxValue = 0;
+    totalUs = 0;
+  }
+
+  void record(uint32_t us) {
+    buckets[bucketOf(us)]++;
+    samples++;
+    totalUs += us;
+    if (us > maxValue) maxValue = us;
+  }
+
+  uint32_t count() const { return samples; }
+  uint32_t maxUs() const { return maxValue; }
+  uint32_t meanUs() const { return samples ? (uint32_t)(totalUs / samples) : 0; }
+
+  // Upper edge of the bucket holding the given percentile (0..1000 permille)
+  uint32_t percentileUs(uint16_t permille) const {
+    if (samples == 0) return 0;
+    uint32_t target = (uint32_t)(((uint64_t)samples * permille + 999) / 1000);
+    if (target == 0) target = 1;
+    uint32_t seen = 0;
+    for (uint16_t b = 0; b < BUCKETS; b++) {
+      seen += buckets[b];
+      if (seen >= target) {
+        uint32_t upper = upperEdge(b);
+        return upper < maxValue ? upper : maxValue;
+      }
+    }
+    return maxValue;
+  }
+
+private:
+  static uint16_t bucketOf(uint32_t v) {
+    if (v < SUB_BUCKETS) return (uint16_t)v;
+    uint8_t msb = 31 - __builtin_clz(v);
+    uint8_t shift = msb - SUB_BITS;
+    return (uint16_t)((shift + 1) * SUB_BUCKETS + ((v >> shift) & (SUB_BUCKETS - 1)));
+  }
+
+  static uint32_t upperEdge(uint16_t b) {
+    if (b < SUB_BUCKETS) return b;
+    uint8_t shift = b / SUB_BUCKETS - 1;
+    uint32_t lower = (uint32_t)(SUB_BUCKETS + b % SUB_BUCKETS) << shift;
+    return lower + ((1u << shift) - 1);
+  }
+
+  uint32_t buckets[BUCKETS];
+  uint32_t samples;
+  uint32_t maxValue;
+  uint64_t totalUs;
+};
+
+class ClockAligner {
+public:
+  explicit ClockAligner(uint32_t windowUs = 30000000) : windowUs(windowUs) { reset(); }
+
+  // Forget the offset, e.g. when the helmet reconnects (it may have rebooted)
+  void reset() {
+    currentValid = false;
+    previousValid = false;
+  }
+
+  // One remote stamp and the local time it was received
+  void update(uint32_t localUs, uint32_t remoteUs) {
+    int32_t offset = (int32_t)(localUs - remoteUs);
+    if (!currentValid) {
+      currentMin = offset;
+      currentValid = true;
+      windowStartUs = localUs;
+    } else if (offset - currentMin < 0) {
+      currentMin = offset;
+    }
+
+    if (localUs - windowStartUs >= windowUs) {
+      previousMin = currentMin;
+      previousValid = true;
+      currentMin = offset;
+      windowStartUs = localUs;
+    }
+  }
+
+  bool valid() const { return currentValid; }
+
+  int32_t offsetUs() const {
+    if (previousValid && previousMin - currentMin < 0) return previousMin;
+    return currentMin;
+  }
+
+  uint32_t toLocal(uint32_t remoteUs) const { return remoteUs + (uint32_t)offsetUs(); }
+
+  // Delay from a remote stamp to a local time, clamped at 0
+  uint32_t delayUs(uint32_t remoteUs, uint32_t localUs) const {
+    int32_t d = (int32_t)(localUs - toLocal(remoteUs));
+    return d > 0 ? (uint32_t)d : 0;
+  }
+
+private:
+  uint32_t windowUs;
+  uint32_t windowStartUs;
+  int32_t currentMin;
+  int32_t previousMin;
+  bool currentValid;
+  bool previousValid;
+};
+
+// One line per histogram, in the style of the scheduler statistics printout
+template <typename Out>
+void printLatency(Out& out, const char* name, const LatencyHistogram& h) {
+  if (h.count() == 0) return;
+  out.printf("%-10s n:%6lu p50:%8lu p99:%8lu max:%8lu\n", name, (unsigned long)h.count(),
+             (unsigned long)h.percentileUs(500), (unsigned long)h.percentileUs(990),
+             (unsigned long)h.maxUs());
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+// Shadow framebuffer for the bike's character LCD.
+//
+// The control task draws into an LcdCanvas with the calls it always used on
+// LiquidCrystal_I2C (clear, setCursor, print), which only touches RAM. The
+// display task hands the newest canvas to LcdShadow::update(). That compares
+// it with what is on the glass and sends only the changed cells to an LcdSink,
+// one setCursor per run. Runs split by a single unchanged cell are merged,
+// because rewriting that cell costs the same as another setCursor.
+//
+// Pcf8574LcdEncoder turns HD44780 commands and characters into the pin
+// states of the usual PCF8574 I2C backpack (P0 RS, P1 RW, P2 EN,
+// P3 backlight, P4-P7 data), the same sequence LiquidCrystal_I2C sends. A
+// sink can then put a whole run into one I2C transmission.
+// LiquidCrystal_I2C makes a separate transmission for every nibble strobe.
+//
+// No Arduino includes: Host_tools env:bench times the diff on the host, and a
+// canvas is plain data that fits through a SnapshotMailbox.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// ---------------- Canvas ----------------
+template <uint8_t Cols, uint8_t Rows>
+struct LcdCanvas {
+  char cells[Rows][Cols];
+  uint8_t col;
+  uint8_t row;
+  bool backlight;
+
+  void clear() {
+    memset(cells, ' ', sizeof(cells));
+    col = row = 0;
+  }
+
+  void setCursor(uint8_t c, uint8_t r) {
+    col = c;
+    row = r < Rows ? r : Rows - 1;
+  }
+
+  // Text past the last column is dropped (it lands in invisible DDRAM on the glass)
+  void write(char c) {
+    if (col < Cols) cells[row][col] = c;
+    if (col < 0xff) col++;
+  }
+
+  void print(const char* text) {
+    while (*text) write(*text++);
+  }
+
+  void print(long value) {
+    char text[12];
+    snprintf(text, sizeof(text), "%ld", value);
+    print(text);
+  }
+};
+
+// ---------------- Sink ----------------
+class LcdSink {
+public:
+  virtual ~LcdSink() {}
+  virtual void setCursor(uint8_t col, uint8_t row) = 0;
+  virtual void write(const char* text, uint8_t length) = 0;
+  virtual void setBacklight(bool on) = 0;
+  virtual void flush() {}  // End of an update: send whatever is batched
+};
+
+// ---------------- Shadow ----------------
+template <uint8_t Cols, uint8_t Rows>
+class LcdShadow {
+public:
+  LcdShadow() : valid(false), cellsSent(0) {}
+
+  // The glass no longer matches the shadow (after init, or a write that did
+  // not go through update()): the next update redraws everything
+  void invalidate() { valid = false; }
+
+  // Sends the differences between `want` and the glass; returns the number of
+  // cells written
+  uint16_t update(const LcdCanvas<Cols, Rows>& want, LcdSink& sink) {
+    uint16_t sent = 0;
+    if (!valid || want.backlight != shown.backlight) sink.setBacklight(want.backlight);
+
+    for (uint8_t r = 0; r < Rows; r++) {
+      uint8_t c = 0;
+      while (c < Cols) {
+        if (same(want, r, c)) {
+          c++;
+          continue;
+        }
+        uint8_t end = c + 1;
+        while (end < Cols) {
+          if (!same(want, r, end)) {
+            end++;
+          } else if (end + 1 < Cols && !same(want, r, end + 1)) {
+            end += 2;  // Bridge a single unchanged cell
+          } else {
+            break;
+          }
+        }
+        sink.setCursor(c, r);
+        sink.write(&want.cells[r][c], end - c);
+        sent += end - c;
+        c = end;
+      }
+    }
+
+    shown = want;
+    valid = true;
+    sink.flush();
+    cellsSent += sent;
+    return sent;
+  }
+
+  uint32_t totalCellsSent() const { return cellsSent; }
+
+private:
+  bool same(const LcdCanvas<Cols, Rows>& want, uint8_t r, uint8_t c) const {
+    return valid && want.cells[r][c] == shown.cells[r][c];
+  }
+
+  LcdCanvas<Cols, Rows> shown;
+  bool valid;
+  uint32_t cellsSent;
+};
+
+// ---------------- PCF8574 backpack ----------------
+#define PCF8574_LCD_RS 0x01
+#define PCF8574_LCD_EN 0x04
+#define PCF8574_LCD_BACKLIGHT 0x08
+#define PCF8574_LCD_BYTES_PER_WRITE 6  // Two nibbles, each: data, EN high, EN low
+#define HD44780_SET_DDRAM 0x80
+
+class Pcf8574LcdEncoder {
+public:
+  // Pin states for one HD44780 write (a command when `data` is false);
+  // fills PCF8574_LCD_BYTES_PER_WRITE bytes of `out`. The HD44780 needs
+  // 37 us per write, less than three byte times even on a 400 kHz bus.
+  static uint8_t encode(uint8_t value, bool data, bool backlight, uint8_t* out) {
+    uint8_t flags = (data ? PCF8574_LCD_RS : 0) | (backlight ? PCF8574_LCD_BACKLIGHT : 0);
+    uint8_t n = 0;
+    uint8_t nibbles[2] = {(uint8_t)(value & 0xf0), (uint8_t)((value << 4) & 0xf0)};
+    for (uint8_t i = 0; i < 2; i++) {
+      out[n++] = nibbles[i] | flags;
+      out[n++] = nibbles[i] | flags | PCF8574_LCD_EN;  // Latched on the falling edge
+      out[n++] = nibbles[i] | flags;
+    }
+    return n;
+  }
+
+  static uint8_t setCursorCommand(uint8_t col, uint8_t row) {
+    static const uint8_t ROW_OFFSETS[4] = {0x00, 0x40, 0x14, 0x54};
+    return HD44780_SET_DDRAM | (ROW_OFFSETS[row & 3] + col);
+  }
+};
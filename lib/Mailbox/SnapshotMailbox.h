@@ -0,0 +1,66 @@
+#pragma once
+
+// Lock-free single-producer / single-consumer snapshot mailbox.
+//
+// A triple buffer: the producer always owns one slot, the consumer owns
+// another and the third is exchanged atomically between them. publish()
+// and read() never block or spin, the consumer always gets the newest
+// complete snapshot, and a snapshot can never be observed half-written.
+// Intermediate snapshots are dropped if the producer publishes faster than
+// the consumer reads, so T should carry state, not events (use counters
+// for anything that must not be missed).
+//
+// Exactly one task may call publish() and exactly one task may call read().
+
+#include <atomic>
+#include <stdint.h>
+
+template <typename T>
+class SnapshotMailbox {
+public:
+  SnapshotMailbox() : middle(0), back(1), front(2) {}
+
+  // Seed all slots, e.g. with the power-on state. Not thread-safe; call
+  // before the producer and consumer tasks start.
+  void reset(const T& value) {
+    slots[0] = value;
+    slots[1] = value;
+    slots[2] = value;
+    middle.store(0, std::memory_order_relaxed);
+    back = 1;
+    front = 2;
+    publishCount = 0;
+  }
+
+  void publish(const T& value) {
+    slots[back] = value;
+    uint8_t previous = middle.exchange(back | FRESH, std::memory_order_acq_rel);
+    back = previous & INDEX;
+    publishCount++;
+  }
+
+  // Copies the newest snapshot into `out`. Returns true when it is newer
+  // than the one returned by the previous read().
+  bool read(T& out) {
+    bool fresh = (middle.load(std::memory_order_relaxed) & FRESH) != 0;
+    if (fresh) {
+      uint8_t previous = middle.exchange(front, std::memory_order_acq_rel);
+      front = previous & INDEX;
+    }
+    out = slots[front];
+    return fresh;
+  }
+
+  // Producer side only.
+  uint32_t published() const { return publishCount; }
+
+private:
+  static const uint8_t INDEX = 0x03;
+  static const uint8_t FRESH = 0x04;
+
+  T slots[3];
+  std::atomic<uint8_t> middle; // Index of the exchange slot | FRESH
+  uint8_t back;                // Producer-owned slot
+  uint8_t front;               // Consumer-owned slot
+  uint32_t publishCount = 0;
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+// CPU cycle counts per code section, for profiling on the device.
+//
+// A ProfileScope reads the cycle counter when it is created and again when it
+// goes out of scope, and adds the difference to its section of a
+// SectionProfiler: calls, min, max and total cycles. The counter is read
+// through a Cycles type with a static now() (ESP.getCycleCount() on the
+// ESP32, a single CCOUNT read), so nothing here depends on Arduino. With
+// Enabled = false the scope is an empty object that the compiler removes
+// along with both counter reads. The profiler table is zero-initialized data
+// with no constructor, so the linker drops it when nothing references it.
+//
+// The cycle counter is per core and wraps after 2^32 cycles (17.9 s at
+// 240 MHz). A section must stay on one core (the firmware's tasks are
+// pinned) and finish well within that. Preemption and interrupts inside a
+// section count towards it, and sections nest, so an outer section includes
+// its inner ones. Each section has a single writer. A dump from another task
+// may catch a section in the middle of an update and be off by one call.
+//
+// print() is a template over its output: the 'P' console command prints to
+// Serial, the periodic stats go to the ConsoleBuffer.
+
+#include <stdint.h>
+#include <string.h>
+
+struct ProfileSection {
+  uint32_t calls;
+  uint32_t minCycles;
+  uint32_t maxCycles;
+  uint64_t totalCycles;
+};
+
+template <uint8_t N>
+class SectionProfiler {
+public:
+  void record(uint8_t id, uint32_t cycles) {
+    ProfileSection& s = sections[id];
+    if (s.calls == 0 || cycles < s.minCycles) s.minCycles = cycles;
+    if (cycles > s.maxCycles) s.maxCycles = cycles;
+    s.totalCycles += cycles;
+    s.calls++;
+  }
+
+  void reset() { memset(sections, 0, sizeof(sections)); }
+
+  const ProfileSection& section(uint8_t id) const { return sections[id]; }
+
+  // One line per section that ran: cycles, the mean in us, and the share of
+  // the `elapsedUs` since the last reset spent in it (of one core)
+  template <class Out>
+  void print(Out& out, const char* const* names, uint32_t cpuMhz, uint32_t elapsedUs) const {
+    uint64_t elapsedCycles = (uint64_t)elapsedUs * cpuMhz;
+    for (uint8_t i = 0; i < N; i++) {
+      const ProfileSection& s = sections[i];
+      if (s.calls == 0) continue;
+      uint32_t mean = (uint32_t)(s.totalCycles / s.calls);
+      uint32_t permille = elapsedCycles ? (uint32_t)(s.totalCycles * 1000 / elapsedCycles) : 0;
+      out.printf("%-10s n:%7lu min:%8lu avg:%8lu max:%9lu cyc  avg %6lu us  %3lu.%lu%%\n", names[i],
+                 (unsigned long)s.calls, (unsigned long)s.minCycles, (unsigned long)mean,
+                 (unsigned long)s.maxCycles, (unsigned long)(cpuMhz ? mean / cpuMhz : 0),
+                 (unsigned long)(permille / 10), (unsigned long)(permille % 10));
+    }
+  }
+
+private:
+  ProfileSection sections[N];
+};
+
+template <class Profiler, class Cycles, bool Enabled>
+class ProfileScope {
+public:
+  ProfileScope(Profiler& profiler, uint8_t id) : profiler(profiler), id(id), start(Cycles::now()) {}
+  ~ProfileScope() { profiler.record(id, Cycles::now() - start); }
+
+private:
+  Profiler& profiler;
+  uint8_t id;
+  uint32_t start;
+};
+
+template <class Profiler, class Cycles>
+class ProfileScope<Profiler, Cycles, false> {
+public:
+  ProfileScope(Profiler&, uint8_t) {}
+};
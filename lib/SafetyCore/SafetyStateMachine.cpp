@@ -0,0 +1,155 @@
+#include "SafetyStateMachine.h"
+
+// Rule for every (S, R, H, W) combination, indexed by S<<3 | R<<2 | H<<1 | W.
+static const SafetyRule RULE_TABLE[16] = {
+  // S=0 R=0
+  SAFETY_RULE_OFF,         // H=0 W=0
+  SAFETY_RULE_WARN_60S,    // H=0 W=1
+  SAFETY_RULE_OFF,         // H=1 W=0
+  SAFETY_RULE_WARN_60S,    // H=1 W=1
+  // S=0 R=1
+  SAFETY_RULE_WARN_15S,
+  SAFETY_RULE_WARN_15S,
+  SAFETY_RULE_WARN_15S,
+  SAFETY_RULE_WARN_15S,
+  // S=1 R=0
+  SAFETY_RULE_OFF,
+  SAFETY_RULE_OFF,
+  SAFETY_RULE_IGNITION_ON,
+  SAFETY_RULE_IGNITION_ON,
+  // S=1 R=1
+  SAFETY_RULE_WARN_15S,
+  SAFETY_RULE_WARN_15S,
+  SAFETY_RULE_IGNITION_ON,
+  SAFETY_RULE_IGNITION_ON,
+};
+
+SafetyStateMachine::SafetyStateMachine(SafetyClock& clock, SafetyOutputs& outputs)
+  : clock(clock), outputs(outputs) {}
+
+SafetyRule SafetyStateMachine::ruleFor(bool standUp, bool riding, bool helmetSecure, bool helmetWorn) {
+  return RULE_TABLE[(standUp << 3) | (riding << 2) | (helmetSecure << 1) | helmetWorn];
+}
+
+void SafetyStateMachine::reset() {
+  ignition = false;
+  buzzer = false;
+  outputs.setIgnition(false);
+  outputs.setBuzzer(false);
+  wasConnected = false;
+  warningRule = SAFETY_RULE_OFF;
+  graceRunning = false;
+}
+
+void SafetyStateMachine::driveIgnition(bool on) {
+  if (on == ignition) return;
+  ignition = on;
+  outputs.setIgnition(on);
+}
+
+void SafetyStateMachine::driveBuzzer(bool on) {
+  if (on == buzzer) return;
+  buzzer = on;
+  outputs.setBuzzer(on);
+}
+
+SafetyEvent SafetyStateMachine::step(const SafetyInputs& in) {
+  uint32_t now = clock.nowMs();
+  SafetyEvent event = SAFETY_EV_NONE;
+
+  // --- BLE link edges ---
+  if (!in.bleConnected) {
+    if (wasConnected) {
+      wasConnected = false;
+      if (ignition) {
+        // Keep the ignition as it is for the grace period
+        graceRunning = true;
+        graceStartMs = now;
+        event = SAFETY_EV_GRACE_START;
+      } else {
+        driveBuzzer(false);
+        event = SAFETY_EV_DISCONNECT_SHUTDOWN;
+      }
+    }
+
+    if (graceRunning && now - graceStartMs >= SAFETY_GRACE_PERIOD_MS) {
+      graceRunning = false;
+      driveIgnition(false);
+      driveBuzzer(false);
+      event = SAFETY_EV_GRACE_EXPIRED;
+    }
+    return event;
+  }
+
+  if (!wasConnected) {
+    wasConnected = true;
+    graceRunning = false; // Clear grace timer immediately on re-connection
+  }
+
+  // --- Truth table ---
+  SafetyRule rule = ruleFor(in.standUp, in.riding, in.helmetSecure, in.helmetWorn);
+
+  switch (rule) {
+    case SAFETY_RULE_IGNITION_ON:
+      if (!ignition) {
+        driveIgnition(true);
+        event = SAFETY_EV_IGNITION_ENABLED;
+      }
+      // Clear all warnings and buzzer when ignition is ON
+      warningRule = SAFETY_RULE_OFF;
+      driveBuzzer(false);
+      break;
+
+    case SAFETY_RULE_WARN_60S:
+      // A warning of the other kind does not carry over: the cut must be immediate
+      if (warningRule != SAFETY_RULE_WARN_60S) {
+        warningRule = SAFETY_RULE_WARN_60S;
+        warningStartMs = now;
+        driveIgnition(false);
+        event = SAFETY_EV_WARN60_START;
+      }
+      driveBuzzer(true);
+      if (now - warningStartMs >= SAFETY_WARNING_60S_MS) {
+        // Buzzer stops after 60 seconds (ignition is already off)
+        driveBuzzer(false);
+        warningRule = SAFETY_RULE_OFF;
+        event = SAFETY_EV_WARN60_EXPIRED;
+      }
+      break;
+
+    case SAFETY_RULE_WARN_15S:
+      if (warningRule != SAFETY_RULE_WARN_15S) {
+        warningRule = SAFETY_RULE_WARN_15S;
+        warningStartMs = now;
+        // The buzzer is left as it is: on when a 60 s warning turned into this one
+        event = SAFETY_EV_WARN15_START;
+      }
+      if (now - warningStartMs >= SAFETY_WARNING_15S_MS) {
+        driveIgnition(false);
+        warningRule = SAFETY_RULE_OFF;
+        event = SAFETY_EV_WARN15_EXPIRED;
+      }
+      break;
+
+    case SAFETY_RULE_OFF:
+    default:
+      driveIgnition(false);
+      driveBuzzer(false);
+      warningRule = SAFETY_RULE_OFF;
+      break;
+  }
+  return event;
+}
+
+uint32_t SafetyStateMachine::warningRemainingMs() const {
+  if (warningRule == SAFETY_RULE_OFF) return 0;
+  uint32_t duration = (warningRule == SAFETY_RULE_WARN_60S) ? SAFETY_WARNING_60S_MS : SAFETY_WARNING_15S_MS;
+  uint32_t elapsed = clock.nowMs() - warningStartMs;
+  return elapsed >= duration ? 0 : duration - elapsed;
+}
+
+uint32_t SafetyStateMachine::graceRemainingMs() const {
+  if (!graceRunning) return 0;
+  uint32_t elapsed = clock.nowMs() - graceStartMs;
+  return elapsed >= SAFETY_GRACE_PERIOD_MS ? 0 : SAFETY_GRACE_PERIOD_MS - elapsed;
+}
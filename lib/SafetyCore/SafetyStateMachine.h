@@ -0,0 +1,104 @@
+#pragma once
+
+// Bike unit safety logic (truth table, warning timers, BLE grace period)
+// as a pure state machine.
+//
+// Time and outputs are injected, so the same code drives the ignition relay
+// on the ESP32 and runs on a Linux host (see Host_tools, env:safety).
+//
+// Truth table (S = stand up, R = riding, H = helmet secure, W = helmet worn):
+//   S=1 H=1                    -> ignition ON
+//   S=0 R=0 W=1                -> 60 s warning: ignition cut at once, buzzer for 60 s
+//   S=0 R=1, or S=1 R=1 H=0    -> 15 s warning: ignition cut when it expires
+//   anything else              -> ignition OFF
+// While BLE is down the table is not evaluated: if the ignition was on at
+// the moment of disconnect it stays on for a 60 s grace period, otherwise
+// everything is switched off immediately.
+
+#include <stdint.h>
+
+#define SAFETY_WARNING_15S_MS 15000
+#define SAFETY_WARNING_60S_MS 60000
+#define SAFETY_GRACE_PERIOD_MS 60000
+
+class SafetyClock {
+public:
+  virtual ~SafetyClock() {}
+  virtual uint32_t nowMs() = 0;
+};
+
+class SafetyOutputs {
+public:
+  virtual ~SafetyOutputs() {}
+  virtual void setIgnition(bool on) = 0;
+  virtual void setBuzzer(bool on) = 0;
+};
+
+struct SafetyInputs {
+  bool standUp;       // S
+  bool riding;        // R
+  bool helmetSecure;  // H: worn & buckled
+  bool helmetWorn;    // W
+  bool bleConnected;
+};
+
+enum SafetyRule : uint8_t {
+  SAFETY_RULE_OFF = 0,
+  SAFETY_RULE_IGNITION_ON,
+  SAFETY_RULE_WARN_60S,
+  SAFETY_RULE_WARN_15S
+};
+
+// What happened during a step, for logging and display.
+enum SafetyEvent : uint8_t {
+  SAFETY_EV_NONE = 0,
+  SAFETY_EV_IGNITION_ENABLED,
+  SAFETY_EV_WARN60_START,       // Ignition cut, buzzer on
+  SAFETY_EV_WARN60_EXPIRED,     // Buzzer off
+  SAFETY_EV_WARN15_START,
+  SAFETY_EV_WARN15_EXPIRED,     // Ignition cut
+  SAFETY_EV_GRACE_START,        // BLE lost with ignition on
+  SAFETY_EV_GRACE_EXPIRED,      // Ignition cut
+  SAFETY_EV_DISCONNECT_SHUTDOWN // BLE lost with ignition off
+};
+
+class SafetyStateMachine {
+public:
+  SafetyStateMachine(SafetyClock& clock, SafetyOutputs& outputs);
+
+  // Drive both outputs off and forget all timers.
+  void reset();
+
+  // Evaluate one set of inputs. Outputs are only written when they change.
+  SafetyEvent step(const SafetyInputs& in);
+
+  static SafetyRule ruleFor(bool standUp, bool riding, bool helmetSecure, bool helmetWorn);
+
+  bool ignitionEnabled() const { return ignition; }
+  bool buzzerOn() const { return buzzer; }
+  bool connected() const { return wasConnected; }
+
+  bool warningActive() const { return warningRule != SAFETY_RULE_OFF; }
+  SafetyRule activeWarning() const { return warningRule; }
+  uint32_t warningRemainingMs() const;
+
+  bool graceActive() const { return graceRunning; }
+  uint32_t graceRemainingMs() const;
+
+private:
+  void driveIgnition(bool on);
+  void driveBuzzer(bool on);
+
+  SafetyClock& clock;
+  SafetyOutputs& outputs;
+
+  bool ignition = false;
+  bool buzzer = false;
+  bool wasConnected = false;
+
+  SafetyRule warningRule = SAFETY_RULE_OFF; // Warning currently running, if any
+  uint32_t warningStartMs = 0;
+
+  bool graceRunning = false;
+  uint32_t graceStartMs = 0;
+};
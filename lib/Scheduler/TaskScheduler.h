@@ -0,0 +1,134 @@
+#pragma once
+
+// Small cooperative scheduler for Arduino-style main loops.
+//
+// Tasks are plain function pointers that must return quickly (no delay()).
+// Periodic tasks are re-armed relative to their previous deadline so they do
+// not drift; one-shot tasks run once and stay idle until schedule() is called
+// again. Every task records how late it started compared to its deadline and
+// how long it ran, so worst-case response times can be read off at runtime.
+//
+// All times are in microseconds and compared wrap-safe, so the scheduler can
+// be driven straight from micros() (intervals must stay below ~35 minutes).
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef void (*SchedulerTaskFn)();
+
+struct SchedulerTask {
+  const char* name;
+  SchedulerTaskFn fn;
+  uint32_t periodUs;     // 0 = one-shot
+  uint32_t dueUs;        // Next deadline
+  bool armed;
+  uint32_t runs;
+  uint32_t maxLatencyUs; // Worst start delay after the deadline
+  uint32_t maxRunUs;     // Worst execution time
+  uint64_t totalRunUs;
+};
+
+template <size_t MaxTasks>
+class TaskScheduler {
+public:
+  // Returns a task id, or -1 when the table is full.
+  int addPeriodic(const char* name, SchedulerTaskFn fn, uint32_t periodUs, uint32_t nowUs) {
+    int id = add(name, fn, periodUs);
+    if (id >= 0) schedule(id, 0, nowUs);
+    return id;
+  }
+
+  // One-shot tasks are created idle; arm them with schedule().
+  int addOneShot(const char* name, SchedulerTaskFn fn) {
+    return add(name, fn, 0);
+  }
+
+  void schedule(int id, uint32_t delayUs, uint32_t nowUs) {
+    if (id < 0 || (size_t)id >= count) return;
+    tasks[id].dueUs = nowUs + delayUs;
+    tasks[id].armed = true;
+  }
+
+  void cancel(int id) {
+    if (id < 0 || (size_t)id >= count) return;
+    tasks[id].armed = false;
+  }
+
+  bool isArmed(int id) const {
+    return id >= 0 && (size_t)id < count && tasks[id].armed;
+  }
+
+  // Run every task whose deadline has passed (each at most once per call).
+  // `clock` is read again around each task so run times and latencies are
+  // measured accurately. Returns the time until the next deadline, which the
+  // caller may use to idle.
+  uint32_t run(uint32_t (*clock)()) {
+    for (size_t i = 0; i < count; i++) {
+      SchedulerTask& t = tasks[i];
+      if (!t.armed) continue;
+
+      uint32_t start = clock();
+      int32_t late = (int32_t)(start - t.dueUs);
+      if (late < 0) continue;
+
+      if (t.periodUs > 0) {
+        t.dueUs += t.periodUs;
+        // Fell behind by more than a period: resync instead of bursting
+        if ((int32_t)(start - t.dueUs) >= 0) t.dueUs = start + t.periodUs;
+      } else {
+        t.armed = false;
+      }
+
+      t.fn();
+
+      uint32_t ran = clock() - start;
+      t.runs++;
+      t.totalRunUs += ran;
+      if ((uint32_t)late > t.maxLatencyUs) t.maxLatencyUs = (uint32_t)late;
+      if (ran > t.maxRunUs) t.maxRunUs = ran;
+    }
+    return untilNextDeadline(clock());
+  }
+
+  uint32_t untilNextDeadline(uint32_t nowUs) const {
+    uint32_t next = UINT32_MAX;
+    for (size_t i = 0; i < count; i++) {
+      if (!tasks[i].armed) continue;
+      int32_t remaining = (int32_t)(tasks[i].dueUs - nowUs);
+      if (remaining <= 0) return 0;
+      if ((uint32_t)remaining < next) next = (uint32_t)remaining;
+    }
+    return next;
+  }
+
+  void resetStats() {
+    for (size_t i = 0; i < count; i++) {
+      tasks[i].runs = 0;
+      tasks[i].maxLatencyUs = 0;
+      tasks[i].maxRunUs = 0;
+      tasks[i].totalRunUs = 0;
+    }
+  }
+
+  size_t size() const { return count; }
+  const SchedulerTask& task(size_t i) const { return tasks[i]; }
+
+private:
+  int add(const char* name, SchedulerTaskFn fn, uint32_t periodUs) {
+    if (count >= MaxTasks) return -1;
+    SchedulerTask& t = tasks[count];
+    t.name = name;
+    t.fn = fn;
+    t.periodUs = periodUs;
+    t.dueUs = 0;
+    t.armed = false;
+    t.runs = 0;
+    t.maxLatencyUs = 0;
+    t.maxRunUs = 0;
+    t.totalRunUs = 0;
+    return (int)count++;
+  }
+
+  SchedulerTask tasks[MaxTasks];
+  size_t count = 0;
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+// The bike unit's safety loop as telemetry records (TelemetryLog.h), so the
+// same blocks, decoder and CRC carry it off the bike as the helmet's samples.
+//
+//   TELEMETRY_BIKE_STATUS  every TELEMETRY_STATUS_US (10 Hz):
+//                          a = BIKE_FLAG_* bits, b = bikeWarningField()
+//   TELEMETRY_BIKE_EVENT   every SafetyEvent the state machine reports:
+//                          a = SafetyEvent, b = BIKE_FLAG_* bits after the step
+//
+// A record carries no vehicle: whoever collects the blocks knows which bike
+// they came from (the serial port, or the header the fleet gateway's UDP
+// datagrams put in front of them; see Host_tools env:gateway).
+//
+// No Arduino includes: fleet_gateway.cpp and journal_decode.cpp decode
+// records with these same structs.
+
+#include <stdint.h>
+#include <SafetyStateMachine.h>
+#include <TelemetryLog.h>
+
+#define BIKE_FLAG_STAND_UP 0x01
+#define BIKE_FLAG_RIDING 0x02
+#define BIKE_FLAG_HELMET_SECURE 0x04
+#define BIKE_FLAG_HELMET_WORN 0x08
+#define BIKE_FLAG_BLE_CONNECTED 0x10
+#define BIKE_FLAG_IGNITION 0x20
+#define BIKE_FLAG_BUZZER 0x40
+#define BIKE_FLAG_GRACE 0x80
+
+// SafetyEvent values, SAFETY_EV_NONE included
+#define BIKE_EVENT_TYPES (SAFETY_EV_DISCONNECT_SHUTDOWN + 1)
+
+// Event journal records (EventJournal.h) of the bike unit. The type byte is
+// a SafetyEvent or one of the BIKE_JOURNAL_* values above them:
+//   SafetyEvent               a = BIKE_FLAG_* bits after the step, b = bikeWarningField()
+//   BIKE_JOURNAL_BOOT         a = esp_sleep_wakeup_cause_t, b = 1 fast resume
+//   BIKE_JOURNAL_DEEP_SLEEP   a = BIKE_FLAG_* bits, b = 0
+//   BIKE_JOURNAL_HELMET_LINK  a = helmet slot, b = 1 connected / 0 lost
+// c is 0 for now.
+#define BIKE_JOURNAL_BOOT 16
+#define BIKE_JOURNAL_DEEP_SLEEP 17
+#define BIKE_JOURNAL_HELMET_LINK 18
+
+inline const char* bikeJournalTypeName(uint8_t type) {
+  switch (type) {
+    case SAFETY_EV_IGNITION_ENABLED: return "ignition";
+    case SAFETY_EV_WARN60_START: return "warn60";
+    case SAFETY_EV_WARN60_EXPIRED: return "warn60_expired";
+    case SAFETY_EV_WARN15_START: return "warn15";
+    case SAFETY_EV_WARN15_EXPIRED: return "warn15_expired";
+    case SAFETY_EV_GRACE_START: return "grace";
+    case SAFETY_EV_GRACE_EXPIRED: return "ble_shutdown";
+    case SAFETY_EV_DISCONNECT_SHUTDOWN: return "disconnect_shutdown";
+    case BIKE_JOURNAL_BOOT: return "boot";
+    case BIKE_JOURNAL_DEEP_SLEEP: return "deep_sleep";
+    case BIKE_JOURNAL_HELMET_LINK: return "helmet_link";
+    default: return "unknown";
+  }
+}
+
+inline uint8_t bikeStatusFlags(const SafetyInputs& in, const SafetyStateMachine& safety) {
+  return (in.standUp ? BIKE_FLAG_STAND_UP : 0) | (in.riding ? BIKE_FLAG_RIDING : 0) |
+         (in.helmetSecure ? BIKE_FLAG_HELMET_SECURE : 0) | (in.helmetWorn ? BIKE_FLAG_HELMET_WORN : 0) |
+         (in.bleConnected ? BIKE_FLAG_BLE_CONNECTED : 0) | (safety.ignitionEnabled() ? BIKE_FLAG_IGNITION : 0) |
+         (safety.buzzerOn() ? BIKE_FLAG_BUZZER : 0) | (safety.graceActive() ? BIKE_FLAG_GRACE : 0);
+}
+
+// Low byte: the SafetyRule of the running warning (SAFETY_RULE_OFF for none).
+// High byte: seconds left of that warning, or of the grace period (saturating).
+inline uint16_t bikeWarningField(const SafetyStateMachine& safety) {
+  uint32_t leftMs = safety.warningActive() ? safety.warningRemainingMs()
+                    : safety.graceActive() ? safety.graceRemainingMs() : 0;
+  uint32_t leftS = (leftMs + 999) / 1000;
+  return (uint16_t)(safety.activeWarning() | (leftS > 0xff ? 0xff : leftS) << 8);
+}
+
+// A rule broken on the road: riding off the stand-up position, or riding
+// without a secure helmet (the 15 s warning). The warning running out, and
+// so the ignition being cut, is counted apart (SAFETY_EV_WARN15_EXPIRED).
+inline bool bikeViolation(uint8_t event) { return event == SAFETY_EV_WARN15_START; }
@@ -0,0 +1,66 @@
+#pragma once
+
+// Console text from a task that must not wait for the serial port: writes go
+// into a RAM ring, a low-priority task sends them on. At 115200 baud the UART
+// takes ~11 bytes per ms, so a statistics dump written straight to Serial
+// holds its writer for a few hundred ms; into the ring it is a memcpy.
+//
+// A write goes in whole or not at all. When the ring is full it is dropped and
+// its bytes counted, and the reader reports the count, so a gap in the text
+// shows where it is.
+//
+// Exactly one task may call write() and exactly one task may call read().
+// Biketest's ConsoleBuffer is the Print in front of it.
+
+#include <atomic>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+template <size_t Capacity>
+class ConsoleRing {
+  static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+  ConsoleRing() : head(0), tail(0), droppedBytes(0) {}
+
+  // Producer side. Returns false (and counts the bytes as dropped) when the
+  // text does not fit.
+  bool write(const uint8_t* data, size_t size) {
+    uint32_t h = head.load(std::memory_order_relaxed);
+    if (size > Capacity - (h - tail.load(std::memory_order_acquire))) {
+      droppedBytes.fetch_add((uint32_t)size, std::memory_order_relaxed);
+      return false;
+    }
+    size_t at = h & (Capacity - 1);
+    size_t first = size < Capacity - at ? size : Capacity - at;
+    memcpy(ring + at, data, first);
+    memcpy(ring, data + first, size - first);
+    head.store(h + (uint32_t)size, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side: copies up to max bytes into out and returns how many.
+  size_t read(uint8_t* out, size_t max) {
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    size_t available = head.load(std::memory_order_acquire) - t;
+    size_t n = available < max ? available : max;
+    size_t at = t & (Capacity - 1);
+    size_t first = n < Capacity - at ? n : Capacity - at;
+    memcpy(out, ring + at, first);
+    memcpy(out + first, ring, n - first);
+    tail.store(t + (uint32_t)n, std::memory_order_release);
+    return n;
+  }
+
+  // Consumer side: bytes dropped since the last call
+  uint32_t takeDropped() { return droppedBytes.exchange(0, std::memory_order_relaxed); }
+
+  size_t pending() const { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire); }
+
+private:
+  uint8_t ring[Capacity];
+  std::atomic<uint32_t> head;  // Written by the producer only
+  std::atomic<uint32_t> tail;  // Written by the consumer only
+  std::atomic<uint32_t> droppedBytes;
+};
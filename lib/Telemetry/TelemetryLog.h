@@ -0,0 +1,161 @@
+#pragma once
+
+// Binary telemetry log: fixed 8-byte records collected in a RAM ring buffer
+// and drained in CRC-checked blocks by a low-priority task.
+//
+// log() is what the sampling loop calls: a few stores, no formatting, never
+// blocks. When the drain falls behind, records are dropped and counted, and
+// the count travels in the next block header so the decoder can report gaps.
+//
+// Stream format (little endian), one block per drain() call:
+//   TelemetryBlockHeader  'T' 'L' version count sequence dropped
+//   TelemetryRecord       x count
+//   uint16_t crc          CRC-16/CCITT-FALSE over header and records
+// Blocks can be mixed with plain text on the same serial port; the decoder
+// (Host_tools env:telemetry) resynchronises on the magic and the CRC.
+//
+// Exactly one task may call log() and exactly one task may call drain().
+
+#include <atomic>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_MAGIC0 'T'
+#define TELEMETRY_MAGIC1 'L'
+#define TELEMETRY_MAX_BLOCK_RECORDS 64
+
+enum TelemetryType : uint8_t {
+  TELEMETRY_SAMPLE = 1,  // a = HELMET_FLAG_* bits (+ helmet slot << 4 when the bike logs a streamed sample), b = FSR reading
+  TELEMETRY_STATE = 2,   // a = HelmetState sent to the bike, b = frame sequence
+  TELEMETRY_LINK = 3,    // a = 1 connected / 0 disconnected
+  TELEMETRY_MARK = 4,    // a = user defined, b = user defined
+  TELEMETRY_EDGE = 5,    // a = input index, b = raw level; time = ISR stamp
+  TELEMETRY_BIKE_STATUS = 6,  // Bike unit, see BikeStatus.h
+  TELEMETRY_BIKE_EVENT = 7
+};
+
+struct __attribute__((packed)) TelemetryRecord {
+  uint8_t type;
+  uint8_t a;
+  uint16_t b;
+  uint32_t timeUs;  // micros() of the producer
+};
+
+struct __attribute__((packed)) TelemetryBlockHeader {
+  uint8_t magic[2];
+  uint8_t version;
+  uint8_t count;
+  uint16_t sequence;
+  uint16_t dropped;  // Records lost to a full ring since the previous block (saturating)
+};
+
+static_assert(sizeof(TelemetryRecord) == 8, "TelemetryRecord must stay 8 bytes");
+static_assert(sizeof(TelemetryBlockHeader) == 8, "TelemetryBlockHeader must stay 8 bytes");
+
+#define TELEMETRY_BLOCK_BYTES(count) \
+  (sizeof(TelemetryBlockHeader) + (count) * sizeof(TelemetryRecord) + 2)
+
+inline uint16_t telemetryCrc16(const uint8_t* data, size_t length, uint16_t crc = 0xFFFF) {
+  while (length--) {
+    crc ^= (uint16_t)(*data++) << 8;
+    for (uint8_t i = 0; i < 8; i++) {
+      crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+// Decoder side: what starts at p (with `available` bytes from there on).
+// TELEMETRY_PARTIAL is a block header whose block is not complete yet; a
+// stream reader waits for more bytes, at the end of a capture it is text.
+enum TelemetryScan : uint8_t {
+  TELEMETRY_NO_BLOCK,
+  TELEMETRY_PARTIAL,
+  TELEMETRY_BAD_CRC,
+  TELEMETRY_BLOCK    // header and length are set; the records follow the header
+};
+
+inline TelemetryScan telemetryBlockAt(const uint8_t* p, size_t available, TelemetryBlockHeader& header,
+                                      size_t& length) {
+  if (available < 3) return available > 0 && p[0] == TELEMETRY_MAGIC0 ? TELEMETRY_PARTIAL : TELEMETRY_NO_BLOCK;
+  if (p[0] != TELEMETRY_MAGIC0 || p[1] != TELEMETRY_MAGIC1 || p[2] != TELEMETRY_VERSION) return TELEMETRY_NO_BLOCK;
+  if (available < sizeof(header)) return TELEMETRY_PARTIAL;
+  memcpy(&header, p, sizeof(header));
+  if (header.count > TELEMETRY_MAX_BLOCK_RECORDS) return TELEMETRY_NO_BLOCK;
+  length = TELEMETRY_BLOCK_BYTES(header.count);
+  if (available < length) return TELEMETRY_PARTIAL;
+
+  size_t crcAt = length - 2;
+  uint16_t crc = (uint16_t)(p[crcAt] | (p[crcAt + 1] << 8));
+  return telemetryCrc16(p, crcAt) == crc ? TELEMETRY_BLOCK : TELEMETRY_BAD_CRC;
+}
+
+template <size_t Capacity>
+class TelemetryLog {
+  static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+  TelemetryLog() : head(0), tail(0), droppedCount(0), sequence(0) {}
+
+  // Producer side. Returns false (and counts the record as dropped) when full.
+  bool log(uint8_t type, uint8_t a, uint16_t b, uint32_t timeUs) {
+    uint32_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) >= Capacity) {
+      droppedCount.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    TelemetryRecord& r = ring[h & (Capacity - 1)];
+    r.type = type;
+    r.a = a;
+    r.b = b;
+    r.timeUs = timeUs;
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Writes one block of at most maxBytes into out and returns
+  // its size, or 0 when there is nothing to report.
+  size_t drain(uint8_t* out, size_t maxBytes) {
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    uint32_t available = head.load(std::memory_order_acquire) - t;
+    uint32_t dropped = droppedCount.exchange(0, std::memory_order_relaxed);
+    if (available == 0 && dropped == 0) return 0;
+    if (maxBytes < TELEMETRY_BLOCK_BYTES(0)) return 0;
+
+    size_t room = (maxBytes - TELEMETRY_BLOCK_BYTES(0)) / sizeof(TelemetryRecord);
+    size_t count = available;
+    if (count > room) count = room;
+    if (count > TELEMETRY_MAX_BLOCK_RECORDS) count = TELEMETRY_MAX_BLOCK_RECORDS;
+
+    TelemetryBlockHeader header;
+    header.magic[0] = TELEMETRY_MAGIC0;
+    header.magic[1] = TELEMETRY_MAGIC1;
+    header.version = TELEMETRY_VERSION;
+    header.count = (uint8_t)count;
+    header.sequence = sequence++;
+    header.dropped = dropped > 0xFFFF ? 0xFFFF : (uint16_t)dropped;
+    memcpy(out, &header, sizeof(header));
+
+    uint8_t* p = out + sizeof(header);
+    for (size_t i = 0; i < count; i++, p += sizeof(TelemetryRecord)) {
+      memcpy(p, &ring[(t + i) & (Capacity - 1)], sizeof(TelemetryRecord));
+    }
+    tail.store(t + (uint32_t)count, std::memory_order_release);
+
+    uint16_t crc = telemetryCrc16(out, p - out);
+    p[0] = (uint8_t)crc;
+    p[1] = (uint8_t)(crc >> 8);
+    return TELEMETRY_BLOCK_BYTES(count);
+  }
+
+  size_t pending() const { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire); }
+
+private:
+  TelemetryRecord ring[Capacity];
+  std::atomic<uint32_t> head;  // Written by the producer only
+  std::atomic<uint32_t> tail;  // Written by the consumer only
+  std::atomic<uint32_t> droppedCount;
+  uint16_t sequence;
+};